@@ -1,39 +1,15 @@
 #include "pch.h"
 #include "ClassicNoise.h"
 
-ClassicNoise::ClassicNoise()
-{
-
-
-}
-
-ClassicNoise::~ClassicNoise()
+namespace
 {
+	//the tables are only ever read, so any number of threads can be making noise at once
+	const int GRAD3[12][3] = {
+		{ 1, 1, 0 }, { -1, 1, 0 }, { 1, -1, 0 }, { -1, -1, 0 },
+		{ 1, 0, 1 }, { -1, 0, 1 }, { 1, 0, -1 }, { -1, 0, -1 },
+		{ 0, 1, 1 }, { 0, -1, 1 }, { 0, 1, -1 }, { 0, -1, -1 } };
 
-}
-
-
-double ClassicNoise::noise(double x, double y, double z) {
-	// Find unit grid cell containing point
-
-	static int perm[512];
-	
-	static int **grad3 = new int* [12];
-
-	grad3[0] = new int[3] { 1, 1, 0 };
-	grad3[1] = new int[3] {-1, 1, 0};
-	grad3[2] = new int[3] { 1, -1, 0 };
-	grad3[3] = new int[3] {-1, -1, 0};
-	grad3[4] = new int[3] { 1, 0, 1 };
-	grad3[5] = new int[3] { -1, 0, 1 };
-	grad3[6] = new int[3] { 1, 0, -1 };
-	grad3[7] = new int[3] { -1, 0, -1 };
-	grad3[8] = new int[3] { 0, 1, 1 };
-	grad3[9] = new int[3] { 0, -1, 1 };
-	grad3[10] = new int[3] { 0, 1, -1 };
-	grad3[11] = new int[3] { 0, -1, -1 };
-
-	static int p[256] = { 151,160,137,91,90,15,
+	const int PERMUTATION[256] = { 151,160,137,91,90,15,
 	131,13,201,95,96,53,194,233,7,225,140,36,103,30,69,142,8,99,37,240,21,10,23,
 	190, 6,148,247,120,234,75,0,26,197,62,94,252,219,203,117,35,11,32,57,177,33,
 	88,237,149,56,87,174,20,125,136,171,168, 68,175,74,165,71,134,139,48,27,166,
@@ -47,11 +23,28 @@ double ClassicNoise::noise(double x, double y, double z) {
 	49,192,214, 31,181,199,106,157,184, 84,204,176,115,121,50,45,127, 4,150,254,
 	138,236,205,93,222,114,67,29,24,72,243,141,128,195,78,66,215,61,156,180 };
 
-	for (int i = 0; i < 512; i++)
+	//the usual doubled 512 entry table, wrapped instead of stored twice
+	inline int perm(int i)
 	{
-		perm[i] = p[i & 255];
+		return PERMUTATION[i & 255];
 	}
-	
+}
+
+
+ClassicNoise::ClassicNoise()
+{
+
+
+}
+
+ClassicNoise::~ClassicNoise()
+{
+
+}
+
+
+double ClassicNoise::noise(double x, double y, double z) {
+	// Find unit grid cell containing point
 
 	int X = fastfloor(x);
 	int Y = fastfloor(y);
@@ -65,14 +58,14 @@ double ClassicNoise::noise(double x, double y, double z) {
 	Y = Y & 255;
 	Z = Z & 255;
 	// Calculate a set of eight hashed gradient indices
-	int gi000 = perm[X + perm[Y + perm[Z]]] % 12;
-	int gi001 = perm[X + perm[Y + perm[Z + 1]]] % 12;
-	int gi010 = perm[X + perm[Y + 1 + perm[Z]]] % 12;
-	int gi011 = perm[X + perm[Y + 1 + perm[Z + 1]]] % 12;
-	int gi100 = perm[X + 1 + perm[Y + perm[Z]]] % 12;
-	int gi101 = perm[X + 1 + perm[Y + perm[Z + 1]]] % 12;
-	int gi110 = perm[X + 1 + perm[Y + 1 + perm[Z]]] % 12;
-	int gi111 = perm[X + 1 + perm[Y + 1 + perm[Z + 1]]] % 12;
+	int gi000 = perm(X + perm(Y + perm(Z))) % 12;
+	int gi001 = perm(X + perm(Y + perm(Z + 1))) % 12;
+	int gi010 = perm(X + perm(Y + 1 + perm(Z))) % 12;
+	int gi011 = perm(X + perm(Y + 1 + perm(Z + 1))) % 12;
+	int gi100 = perm(X + 1 + perm(Y + perm(Z))) % 12;
+	int gi101 = perm(X + 1 + perm(Y + perm(Z + 1))) % 12;
+	int gi110 = perm(X + 1 + perm(Y + 1 + perm(Z))) % 12;
+	int gi111 = perm(X + 1 + perm(Y + 1 + perm(Z + 1))) % 12;
 	// The gradients of each corner are now:
 	// g000 = grad3[gi000];
 	// g001 = grad3[gi001];
@@ -83,14 +76,14 @@ double ClassicNoise::noise(double x, double y, double z) {
 	// g110 = grad3[gi110];
 	// g111 = grad3[gi111];
 	// Calculate noise contributions from each of the eight corners
-	double n000 = dot(grad3[gi000], x, y, z);
-	double n100 = dot(grad3[gi100], x - 1, y, z);
-	double n010 = dot(grad3[gi010], x, y - 1, z);
-	double n110 = dot(grad3[gi110], x - 1, y - 1, z);
-	double n001 = dot(grad3[gi001], x, y, z - 1);
-	double n101 = dot(grad3[gi101], x - 1, y, z - 1);
-	double n011 = dot(grad3[gi011], x, y - 1, z - 1);
-	double n111 = dot(grad3[gi111], x - 1, y - 1, z - 1);
+	double n000 = dot(GRAD3[gi000], x, y, z);
+	double n100 = dot(GRAD3[gi100], x - 1, y, z);
+	double n010 = dot(GRAD3[gi010], x, y - 1, z);
+	double n110 = dot(GRAD3[gi110], x - 1, y - 1, z);
+	double n001 = dot(GRAD3[gi001], x, y, z - 1);
+	double n101 = dot(GRAD3[gi101], x - 1, y, z - 1);
+	double n011 = dot(GRAD3[gi011], x, y - 1, z - 1);
+	double n111 = dot(GRAD3[gi111], x - 1, y - 1, z - 1);
 	// Compute the fade curve value for each of x, y, z
 	double u = fade(x);
 	double v = fade(y);
@@ -112,7 +105,7 @@ int ClassicNoise::fastfloor(double x) {
 	return x > 0 ? (int)x : (int)x - 1;
 }
 
-double ClassicNoise::dot(int g[], double x, double y, double z) {
+double ClassicNoise::dot(const int g[], double x, double y, double z) {
 	return (g[0] * x + g[1] * y + g[2] * z);
 }
 
@@ -3,7 +3,7 @@ class ClassicNoise
 {
 
 private:
-	static double dot(int g[], double x, double y, double z);
+	static double dot(const int g[], double x, double y, double z);
 	static double mix(double a, double b, double t);
 	static int fastfloor(double x);
 	static double fade(double t);
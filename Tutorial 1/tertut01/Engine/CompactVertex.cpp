@@ -0,0 +1,230 @@
+#include "pch.h"
+#include "CompactVertex.h"
+
+using DirectX::SimpleMath::Vector3;
+
+namespace
+{
+	const float HEIGHT_STEPS = 65535.0f;
+	const float SNORM_STEPS = 32767.0f;
+
+	float SignNotZero(float value)
+	{
+		return value >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	//same as the hardware snorm conversion, -32768 and -32767 both mean -1
+	float SnormToFloat(int16_t value)
+	{
+		return std::max((float)value / SNORM_STEPS, -1.0f);
+	}
+
+	Vector3 DecodeOctahedral(float x, float y)
+	{
+		Vector3 n(x, y, 1.0f - fabsf(x) - fabsf(y));
+		if (n.z < 0.0f)
+		{
+			//lower half was folded over the diagonals
+			float fx = (1.0f - fabsf(n.y)) * SignNotZero(n.x);
+			float fy = (1.0f - fabsf(n.x)) * SignNotZero(n.y);
+			n.x = fx;
+			n.y = fy;
+		}
+		n.Normalize();
+		return n;
+	}
+}
+
+
+void CompactVertex::EncodeNormal(const Vector3& normal, int16_t out[2])
+{
+	float l1 = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	if (l1 <= 0.0f)
+	{
+		out[0] = 0;
+		out[1] = 0;
+		return;
+	}
+
+	//project onto the octahedron, then fold the lower half out into the corners
+	float x = normal.x / l1;
+	float y = normal.y / l1;
+	if (normal.z < 0.0f)
+	{
+		float fx = (1.0f - fabsf(y)) * SignNotZero(x);
+		float fy = (1.0f - fabsf(x)) * SignNotZero(y);
+		x = fx;
+		y = fy;
+	}
+
+	//rounding each axis on its own isn't always the closest, so try the four neighbours
+	float baseX = floorf(x * SNORM_STEPS);
+	float baseY = floorf(y * SNORM_STEPS);
+	float best = -2.0f;
+	for (int i = 0; i < 4; i++)
+	{
+		int16_t candidate[2];
+		candidate[0] = (int16_t)std::max(-SNORM_STEPS, std::min(SNORM_STEPS, baseX + (float)(i & 1)));
+		candidate[1] = (int16_t)std::max(-SNORM_STEPS, std::min(SNORM_STEPS, baseY + (float)(i >> 1)));
+		float dot = DecodeNormal(candidate).Dot(normal);
+		if (dot > best)
+		{
+			best = dot;
+			out[0] = candidate[0];
+			out[1] = candidate[1];
+		}
+	}
+}
+
+Vector3 CompactVertex::DecodeNormal(const int16_t in[2])
+{
+	return DecodeOctahedral(SnormToFloat(in[0]), SnormToFloat(in[1]));
+}
+
+uint16_t CompactVertex::EncodeHeight(float height, const CompactTerrainParams& params)
+{
+	if (params.heightScale <= 0.0f)
+	{
+		return 0;	//flat chunk, everything sits on the offset
+	}
+	float t = (height - params.heightOffset) / params.heightScale;
+	t = std::max(0.0f, std::min(1.0f, t));
+	return (uint16_t)(t * HEIGHT_STEPS + 0.5f);
+}
+
+float CompactVertex::DecodeHeight(uint16_t height, const CompactTerrainParams& params)
+{
+	return params.heightOffset + ((float)height / HEIGHT_STEPS) * params.heightScale;
+}
+
+void CompactVertex::ComputeHeightRange(const float* heights, size_t count, CompactTerrainParams& params)
+{
+	if (count == 0)
+	{
+		params.heightOffset = 0.0f;
+		params.heightScale = 0.0f;
+		return;
+	}
+
+	float low = heights[0];
+	float high = heights[0];
+	for (size_t i = 1; i < count; i++)
+	{
+		low = std::min(low, heights[i]);
+		high = std::max(high, heights[i]);
+	}
+	params.heightOffset = low;
+	params.heightScale = high - low;
+}
+
+CompactVertexType CompactVertex::Encode(float height, const Vector3& normal, const CompactTerrainParams& params)
+{
+	CompactVertexType vertex;
+	vertex.height = EncodeHeight(height, params);
+	vertex.spare = 0;
+	EncodeNormal(normal, vertex.normal);
+	return vertex;
+}
+
+bool CompactVertex::VerifyRoundTrip(const float* heights, const Vector3* normals, size_t count,
+	const CompactTerrainParams& params, float maxNormalDegrees, float* worstHeightError, float* worstNormalDegrees)
+{
+	//half a quantisation step, plus a little for float rounding on big offsets
+	float largest = std::max(fabsf(params.heightOffset), fabsf(params.heightOffset + params.heightScale));
+	float heightTolerance = 0.5f * params.heightScale / HEIGHT_STEPS + largest * 1e-6f;
+	float normalTolerance = cosf(maxNormalDegrees * (3.14159265f / 180.0f));
+
+	float worstHeight = 0.0f;
+	float worstDot = 1.0f;
+	for (size_t i = 0; i < count; i++)
+	{
+		CompactVertexType vertex = Encode(heights[i], normals[i], params);
+		worstHeight = std::max(worstHeight, fabsf(DecodeHeight(vertex.height, params) - heights[i]));
+
+		Vector3 normal = normals[i];
+		if (normal.Length() > 0.0f)
+		{
+			normal.Normalize();
+			worstDot = std::min(worstDot, DecodeNormal(vertex.normal).Dot(normal));
+		}
+	}
+
+	if (worstHeightError)
+	{
+		*worstHeightError = worstHeight;
+	}
+	if (worstNormalDegrees)
+	{
+		*worstNormalDegrees = acosf(std::max(-1.0f, std::min(1.0f, worstDot))) * (180.0f / 3.14159265f);
+	}
+	return worstHeight <= heightTolerance && worstDot >= normalTolerance;
+}
+
+size_t CompactVertex::TestRoundTrip()
+{
+	size_t failures = 0;
+	std::vector<float> heights;
+	std::vector<Vector3> normals;
+
+	//heights: both ends of the range exactly, a step either side of them and a spread in between,
+	//over a normal chunk, a flat one and one a long way from the origin
+	const float ranges[][2] = { { -12.5f, 40.0f }, { 3.0f, 3.0f }, { 10000.0f, 10002.0f }, { -0.001f, 0.001f } };
+	for (const auto& range : ranges)
+	{
+		heights.clear();
+		normals.clear();
+		float low = range[0];
+		float high = range[1];
+		float step = (high - low) / HEIGHT_STEPS;
+		float samples[] = { low, high, low + step, high - step, low + step * 0.5f, high - step * 0.5f };
+		heights.assign(samples, samples + 6);
+		for (int i = 0; i <= 1000; i++)
+		{
+			heights.push_back(low + (high - low) * (float)i / 1000.0f);
+		}
+		normals.assign(heights.size(), Vector3(0.0f, 1.0f, 0.0f));
+
+		CompactTerrainParams params;
+		ComputeHeightRange(heights.data(), heights.size(), params);
+		failures += VerifyRoundTrip(heights.data(), normals.data(), heights.size(), params) ? 0 : 1;
+
+		//the ends must come back exactly, or neighbouring chunks with the same edge heights would crack
+		failures += DecodeHeight(EncodeHeight(low, params), params) == low ? 0 : 1;
+		failures += EncodeHeight(high, params) == (params.heightScale > 0.0f ? 65535 : 0) ? 0 : 1;
+	}
+
+	//normals: the axes (up is on the fold between the halves), the fold diagonals, and a ring of grazing normals
+	//just above, on and just below the horizon all the way round
+	normals.clear();
+	const Vector3 axes[] = { Vector3(0.0f, 1.0f, 0.0f), Vector3(0.0f, -1.0f, 0.0f), Vector3(1.0f, 0.0f, 0.0f),
+		Vector3(-1.0f, 0.0f, 0.0f), Vector3(0.0f, 0.0f, 1.0f), Vector3(0.0f, 0.0f, -1.0f),
+		Vector3(1.0f, 1.0f, 0.0f), Vector3(-1.0f, 0.0f, -1.0f), Vector3(0.0f, 1.0f, -1.0f), Vector3(1.0f, -1.0f, -1.0f) };
+	for (const Vector3& axis : axes)
+	{
+		Vector3 normal = axis;
+		normal.Normalize();
+		normals.push_back(normal);
+	}
+	const float elevations[] = { 0.0f, 1e-4f, -1e-4f, 0.01f, 0.05f };
+	for (int i = 0; i < 360; i++)
+	{
+		float azimuth = (float)i * (3.14159265f / 180.0f);
+		for (float elevation : elevations)
+		{
+			normals.push_back(Vector3(cosf(azimuth) * cosf(elevation), sinf(elevation), sinf(azimuth) * cosf(elevation)));
+		}
+	}
+
+	heights.assign(normals.size(), 0.0f);
+	CompactTerrainParams params;
+	ComputeHeightRange(heights.data(), heights.size(), params);
+	failures += VerifyRoundTrip(heights.data(), normals.data(), normals.size(), params) ? 0 : 1;
+
+	//up has to stay exactly up, flat ground is the common case
+	int16_t encoded[2];
+	EncodeNormal(Vector3(0.0f, 1.0f, 0.0f), encoded);
+	Vector3 up = DecodeNormal(encoded);
+	failures += (up.x == 0.0f && up.y == 1.0f && up.z == 0.0f) ? 0 : 1;
+
+	return failures;
+}
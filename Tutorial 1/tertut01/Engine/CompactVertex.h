@@ -0,0 +1,48 @@
+#pragma once
+
+//Quantised 8 byte terrain vertex, a quarter of the 32 byte Terrain::VertexType.
+//On a regular grid x, z and the uvs follow from the vertex index, so all that needs storing is the height
+//(16 bit, scaled into the chunk's own min..max range) and the normal (octahedral, two 16 bit snorms).
+//The vertex shader (terrain_compact_vs.hlsl) rebuilds the rest from SV_VertexID and CompactTerrainParams.
+
+struct CompactVertexType
+{
+	uint16_t height;		//R16_UNORM, 0..1 across the chunk's height range
+	uint16_t spare;			//keeps the normal 4 byte aligned, always 0 for now
+	int16_t normal[2];		//R16G16_SNORM octahedral
+};
+
+//per chunk constants, laid out to match the cbuffer in terrain_compact_vs.hlsl
+struct CompactTerrainParams
+{
+	float heightScale;		//max - min
+	float heightOffset;		//min
+	uint32_t gridWidth;		//vertices per row, x = id % gridWidth and z = id / gridWidth
+	float uvStep;
+};
+
+class CompactVertex
+{
+public:
+	//octahedral mapping of a unit vector onto the [-1, 1] square, snapped to whichever of the
+	//four neighbouring snorm values decodes closest to the input
+	static void EncodeNormal(const DirectX::SimpleMath::Vector3& normal, int16_t out[2]);
+	static DirectX::SimpleMath::Vector3 DecodeNormal(const int16_t in[2]);
+
+	static uint16_t EncodeHeight(float height, const CompactTerrainParams& params);
+	static float DecodeHeight(uint16_t height, const CompactTerrainParams& params);
+
+	//fills in the height range for count heights
+	static void ComputeHeightRange(const float* heights, size_t count, CompactTerrainParams& params);
+
+	static CompactVertexType Encode(float height, const DirectX::SimpleMath::Vector3& normal, const CompactTerrainParams& params);
+
+	//encodes everything and decodes it straight back. returns false if any height is off by more than half a step
+	//or any normal by more than maxNormalDegrees. the worst errors seen come back through the pointers.
+	static bool VerifyRoundTrip(const float* heights, const DirectX::SimpleMath::Vector3* normals, size_t count,
+		const CompactTerrainParams& params, float maxNormalDegrees = 0.05f, float* worstHeightError = nullptr, float* worstNormalDegrees = nullptr);
+
+	//VerifyRoundTrip on the awkward cases: the ends of the height range, flat and far off chunks, and normals
+	//straight up, on the octahedron's folds and grazing the horizon. returns the number of failures.
+	static size_t TestRoundTrip();
+};
@@ -0,0 +1,337 @@
+#include "pch.h"
+#include "DensityPyramid.h"
+#include "ParallelFor.h"
+#include "Philox.h"
+#include <emmintrin.h>
+#include <cfloat>
+
+
+DensityPyramid::DensityPyramid()
+{
+	m_sizeX = m_sizeY = m_sizeZ = 0;
+	m_blockSize = 8;
+}
+
+DensityPyramid::~DensityPyramid()
+{
+}
+
+bool DensityPyramid::Build(const float* density, int sizeX, int sizeY, int sizeZ, int blockSize, int threadCount)
+{
+	Clear();
+	if (!density || sizeX < 2 || sizeY < 2 || sizeZ < 2 || blockSize < 1)
+	{
+		return false;
+	}
+
+	m_sizeX = sizeX;
+	m_sizeY = sizeY;
+	m_sizeZ = sizeZ;
+	m_blockSize = blockSize;
+
+	//blocks are counted in cells, one less than the samples along each side
+	Level level;
+	level.sizeX = (sizeX - 2) / blockSize + 1;
+	level.sizeY = (sizeY - 2) / blockSize + 1;
+	level.sizeZ = (sizeZ - 2) / blockSize + 1;
+	for (;;)
+	{
+		size_t count = (size_t)level.sizeX * level.sizeY * level.sizeZ;
+		level.minimum.assign(count, FLT_MAX);
+		level.maximum.assign(count, -FLT_MAX);
+		m_levels.push_back(level);
+		if (count == 1)
+		{
+			break;
+		}
+		level.sizeX = (level.sizeX + 1) / 2;
+		level.sizeY = (level.sizeY + 1) / 2;
+		level.sizeZ = (level.sizeZ + 1) / 2;
+	}
+
+	const Level& base = m_levels[0];
+	ParallelFor(0, base.sizeZ, [&](int blockZ)
+	{
+		for (int blockY = 0; blockY < base.sizeY; blockY++)
+		{
+			for (int blockX = 0; blockX < base.sizeX; blockX++)
+			{
+				ScanBlock(density, blockX, blockY, blockZ);
+			}
+		}
+	}, threadCount);
+
+	for (int l = 1; l < (int)m_levels.size(); l++)
+	{
+		const Level& current = m_levels[l];
+		for (int blockZ = 0; blockZ < current.sizeZ; blockZ++)
+		{
+			for (int blockY = 0; blockY < current.sizeY; blockY++)
+			{
+				for (int blockX = 0; blockX < current.sizeX; blockX++)
+				{
+					MergeBlock(l, blockX, blockY, blockZ);
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+void DensityPyramid::Update(const float* density, int x0, int y0, int z0, int x1, int y1, int z1)
+{
+	if (m_levels.empty())
+	{
+		return;
+	}
+
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	z0 = std::max(z0, 0);
+	x1 = std::min(x1, m_sizeX - 1);
+	y1 = std::min(y1, m_sizeY - 1);
+	z1 = std::min(z1, m_sizeZ - 1);
+	if (x0 > x1 || y0 > y1 || z0 > z1)
+	{
+		return;
+	}
+
+	//a sample on a block boundary belongs to the blocks on both sides of it
+	const Level& base = m_levels[0];
+	int blockX0 = std::max(0, (x0 - 1) / m_blockSize), blockX1 = std::min(base.sizeX - 1, x1 / m_blockSize);
+	int blockY0 = std::max(0, (y0 - 1) / m_blockSize), blockY1 = std::min(base.sizeY - 1, y1 / m_blockSize);
+	int blockZ0 = std::max(0, (z0 - 1) / m_blockSize), blockZ1 = std::min(base.sizeZ - 1, z1 / m_blockSize);
+
+	for (int blockZ = blockZ0; blockZ <= blockZ1; blockZ++)
+	{
+		for (int blockY = blockY0; blockY <= blockY1; blockY++)
+		{
+			for (int blockX = blockX0; blockX <= blockX1; blockX++)
+			{
+				ScanBlock(density, blockX, blockY, blockZ);
+			}
+		}
+	}
+
+	//then the same box of parents, halving on the way up
+	for (int l = 1; l < (int)m_levels.size(); l++)
+	{
+		blockX0 /= 2, blockX1 /= 2;
+		blockY0 /= 2, blockY1 /= 2;
+		blockZ0 /= 2, blockZ1 /= 2;
+		for (int blockZ = blockZ0; blockZ <= blockZ1; blockZ++)
+		{
+			for (int blockY = blockY0; blockY <= blockY1; blockY++)
+			{
+				for (int blockX = blockX0; blockX <= blockX1; blockX++)
+				{
+					MergeBlock(l, blockX, blockY, blockZ);
+				}
+			}
+		}
+	}
+}
+
+void DensityPyramid::Clear()
+{
+	m_levels.clear();
+	m_sizeX = m_sizeY = m_sizeZ = 0;
+}
+
+size_t DensityPyramid::GetActiveBlocks(float isoLevel, std::vector<uint8_t>& active) const
+{
+	size_t count = 0;
+	if (m_levels.empty())
+	{
+		active.clear();
+		return 0;
+	}
+
+	const Level& base = m_levels[0];
+	active.assign((size_t)base.sizeX * base.sizeY * base.sizeZ, 0);
+	Gather((int)m_levels.size() - 1, 0, 0, 0, isoLevel, active, count);
+	return count;
+}
+
+void DensityPyramid::GetRange(int blockX, int blockY, int blockZ, float& minimum, float& maximum) const
+{
+	const Level& base = m_levels[0];
+	size_t index = ((size_t)blockZ * base.sizeY + blockY) * base.sizeX + blockX;
+	minimum = base.minimum[index];
+	maximum = base.maximum[index];
+}
+
+void DensityPyramid::ScanBlock(const float* density, int blockX, int blockY, int blockZ)
+{
+	int x0 = blockX * m_blockSize, x1 = std::min(x0 + m_blockSize, m_sizeX - 1);
+	int y0 = blockY * m_blockSize, y1 = std::min(y0 + m_blockSize, m_sizeY - 1);
+	int z0 = blockZ * m_blockSize, z1 = std::min(z0 + m_blockSize, m_sizeZ - 1);
+
+	//rows four samples at a time, the last few (a block row is usually blockSize + 1 long) one by one
+	__m128 minimum = _mm_set1_ps(FLT_MAX);
+	__m128 maximum = _mm_set1_ps(-FLT_MAX);
+	float low = FLT_MAX, high = -FLT_MAX;
+	for (int z = z0; z <= z1; z++)
+	{
+		for (int y = y0; y <= y1; y++)
+		{
+			const float* row = density + ((size_t)z * m_sizeY + y) * m_sizeX;
+			int x = x0;
+			for (; x + 4 <= x1 + 1; x += 4)
+			{
+				__m128 values = _mm_loadu_ps(row + x);
+				minimum = _mm_min_ps(minimum, values);
+				maximum = _mm_max_ps(maximum, values);
+			}
+			for (; x <= x1; x++)
+			{
+				low = std::min(low, row[x]);
+				high = std::max(high, row[x]);
+			}
+		}
+	}
+
+	float lows[4], highs[4];
+	_mm_storeu_ps(lows, minimum);
+	_mm_storeu_ps(highs, maximum);
+	for (int i = 0; i < 4; i++)
+	{
+		low = std::min(low, lows[i]);
+		high = std::max(high, highs[i]);
+	}
+
+	Level& base = m_levels[0];
+	size_t index = ((size_t)blockZ * base.sizeY + blockY) * base.sizeX + blockX;
+	base.minimum[index] = low;
+	base.maximum[index] = high;
+}
+
+void DensityPyramid::MergeBlock(int level, int blockX, int blockY, int blockZ)
+{
+	const Level& child = m_levels[level - 1];
+	Level& current = m_levels[level];
+	float low = FLT_MAX, high = -FLT_MAX;
+
+	for (int z = blockZ * 2; z < std::min(blockZ * 2 + 2, child.sizeZ); z++)
+	{
+		for (int y = blockY * 2; y < std::min(blockY * 2 + 2, child.sizeY); y++)
+		{
+			for (int x = blockX * 2; x < std::min(blockX * 2 + 2, child.sizeX); x++)
+			{
+				size_t index = ((size_t)z * child.sizeY + y) * child.sizeX + x;
+				low = std::min(low, child.minimum[index]);
+				high = std::max(high, child.maximum[index]);
+			}
+		}
+	}
+
+	size_t index = ((size_t)blockZ * current.sizeY + blockY) * current.sizeX + blockX;
+	current.minimum[index] = low;
+	current.maximum[index] = high;
+}
+
+void DensityPyramid::Gather(int level, int blockX, int blockY, int blockZ, float isoLevel, std::vector<uint8_t>& active, size_t& count) const
+{
+	const Level& current = m_levels[level];
+	size_t index = ((size_t)blockZ * current.sizeY + blockY) * current.sizeX + blockX;
+
+	//the marching cubes test: a corner counts when it is below the iso level, so a block is all one case
+	//when none of it is below, or all of it is
+	if (current.minimum[index] >= isoLevel || current.maximum[index] < isoLevel)
+	{
+		return;
+	}
+
+	if (level == 0)
+	{
+		active[index] = 1;
+		count++;
+		return;
+	}
+
+	const Level& child = m_levels[level - 1];
+	for (int z = blockZ * 2; z < std::min(blockZ * 2 + 2, child.sizeZ); z++)
+	{
+		for (int y = blockY * 2; y < std::min(blockY * 2 + 2, child.sizeY); y++)
+		{
+			for (int x = blockX * 2; x < std::min(blockX * 2 + 2, child.sizeX); x++)
+			{
+				Gather(level - 1, x, y, z, isoLevel, active, count);
+			}
+		}
+	}
+}
+
+size_t DensityPyramid::TestUpdate(int trials, int threadCount)
+{
+	Philox random(46);
+	size_t failures = 0;
+	std::vector<float> density;
+
+	for (int trial = 0; trial < trials; trial++)
+	{
+		//sizes that do and don't fill the last block, and a few block sizes
+		const int blockSizes[] = { 2, 4, 8 };
+		int blockSize = blockSizes[trial % 3];
+		int sizeX = 2 + (int)(random.GetFloat(0, trial, 0) * 40.0f);
+		int sizeY = 2 + (int)(random.GetFloat(1, trial, 0) * 40.0f);
+		int sizeZ = 2 + (int)(random.GetFloat(2, trial, 0) * 40.0f);
+		density.resize((size_t)sizeX * sizeY * sizeZ);
+		for (size_t i = 0; i < density.size(); i++)
+		{
+			density[i] = random.GetFloat((int)i, trial, 1) * 2.0f - 1.0f;
+		}
+
+		DensityPyramid updated;
+		updated.Build(density.data(), sizeX, sizeY, sizeZ, blockSize, threadCount);
+
+		for (int edit = 0; edit < 12; edit++)
+		{
+			uint32_t stream = 2 + edit;
+			//half the boxes hug a block boundary or the grid edge, the rest are anywhere (and can stick out)
+			int x0 = (int)(random.GetFloat(0, trial, stream) * (sizeX + 4)) - 2;
+			int y0 = (int)(random.GetFloat(1, trial, stream) * (sizeY + 4)) - 2;
+			int z0 = (int)(random.GetFloat(2, trial, stream) * (sizeZ + 4)) - 2;
+			if (edit & 1)
+			{
+				x0 = x0 / blockSize * blockSize;
+				y0 = y0 / blockSize * blockSize;
+				z0 = z0 / blockSize * blockSize;
+			}
+			int x1 = x0 + (int)(random.GetFloat(3, trial, stream) * blockSize * 2.0f);
+			int y1 = y0 + (int)(random.GetFloat(4, trial, stream) * blockSize * 2.0f);
+			int z1 = z0 + (int)(random.GetFloat(5, trial, stream) * blockSize * 2.0f);
+
+			//lowering matters most, the old maximum has to go away rather than just be kept
+			float shift = (edit % 3) == 0 ? 0.75f : -0.75f;
+			for (int z = std::max(z0, 0); z <= std::min(z1, sizeZ - 1); z++)
+			{
+				for (int y = std::max(y0, 0); y <= std::min(y1, sizeY - 1); y++)
+				{
+					for (int x = std::max(x0, 0); x <= std::min(x1, sizeX - 1); x++)
+					{
+						density[((size_t)z * sizeY + y) * sizeX + x] += shift;
+					}
+				}
+			}
+			updated.Update(density.data(), x0, y0, z0, x1, y1, z1);
+
+			DensityPyramid rebuilt;
+			rebuilt.Build(density.data(), sizeX, sizeY, sizeZ, blockSize, threadCount);
+			if (updated.m_levels.size() != rebuilt.m_levels.size())
+			{
+				failures++;
+				continue;
+			}
+			for (size_t l = 0; l < rebuilt.m_levels.size(); l++)
+			{
+				const Level& a = updated.m_levels[l];
+				const Level& b = rebuilt.m_levels[l];
+				failures += a.minimum == b.minimum && a.maximum == b.maximum ? 0 : 1;
+			}
+		}
+	}
+
+	return failures;
+}
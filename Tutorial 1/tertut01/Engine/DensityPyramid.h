@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+
+//Min / max pyramid over a 3D density grid, so a mesher can tell which parts of the grid the surface can't be in
+//without looking at the samples.
+//
+//Level 0 cuts the cells into blockSize^3 blocks and keeps the smallest and largest sample of each one (its corner
+//samples included, so neighbouring blocks share a face of samples). Each level above merges 2 x 2 x 2 blocks of
+//the one below, up to a single root block, which makes it an octree stored as flat arrays. A block can only hold
+//part of the surface when its range spans the iso level, so finding the blocks that do is a walk down from the
+//root that stops at every block entirely on one side.
+//
+//Edits only touch the blocks around the changed samples and their parents, so the pyramid can follow a density
+//that is being sculpted without rebuilding it.
+
+class DensityPyramid
+{
+public:
+	DensityPyramid();
+	~DensityPyramid();
+
+	bool Build(const float* density, int sizeX, int sizeY, int sizeZ, int blockSize = 8, int threadCount = 0);
+	//the samples from (x0, y0, z0) to (x1, y1, z1) inclusive have changed in density
+	void Update(const float* density, int x0, int y0, int z0, int x1, int y1, int z1);
+	void Clear();
+
+	//active gets one entry per level 0 block (x fastest), 1 where the surface can be. returns how many are.
+	size_t GetActiveBlocks(float isoLevel, std::vector<uint8_t>& active) const;
+
+	bool IsBuilt() const { return !m_levels.empty(); }
+	bool Matches(int sizeX, int sizeY, int sizeZ) const { return IsBuilt() && sizeX == m_sizeX && sizeY == m_sizeY && sizeZ == m_sizeZ; }
+	int GetBlockSize() const { return m_blockSize; }
+	int GetBlocksX() const { return m_levels.empty() ? 0 : m_levels[0].sizeX; }
+	int GetBlocksY() const { return m_levels.empty() ? 0 : m_levels[0].sizeY; }
+	int GetBlocksZ() const { return m_levels.empty() ? 0 : m_levels[0].sizeZ; }
+	int GetLevelCount() const { return (int)m_levels.size(); }
+
+	//range of a level 0 block
+	void GetRange(int blockX, int blockY, int blockZ, float& minimum, float& maximum) const;
+
+	//edits random boxes (raising and lowering, on block boundaries and the grid edges) and after every one
+	//compares the updated pyramid, every level, with one built from scratch. returns the number of mismatches.
+	static size_t TestUpdate(int trials, int threadCount = 0);
+
+private:
+	struct Level
+	{
+		int sizeX, sizeY, sizeZ;
+		std::vector<float> minimum, maximum;
+	};
+
+	void ScanBlock(const float* density, int blockX, int blockY, int blockZ);
+	void MergeBlock(int level, int blockX, int blockY, int blockZ);
+	void Gather(int level, int blockX, int blockY, int blockZ, float isoLevel, std::vector<uint8_t>& active, size_t& count) const;
+
+private:
+	int m_sizeX, m_sizeY, m_sizeZ;
+	int m_blockSize;
+	std::vector<Level> m_levels;	//0 is the finest
+};
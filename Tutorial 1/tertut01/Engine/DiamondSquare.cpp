@@ -0,0 +1,130 @@
+#include "pch.h"
+#include "DiamondSquare.h"
+#include "Philox.h"
+#include "ParallelFor.h"
+
+
+int DiamondSquare::GetCoarseStep(int width, int height)
+{
+	if (width < 2 || height < 2)
+	{
+		return 0;
+	}
+
+	int step = 1;
+	while (((width - 1) % (step * 2)) == 0 && ((height - 1) % (step * 2)) == 0)
+	{
+		step *= 2;
+	}
+	return step;
+}
+
+bool DiamondSquare::Generate(float* heights, int width, int height, const Settings& settings)
+{
+	int step = GetCoarseStep(width, height);
+	if (step == 0)
+	{
+		return false;
+	}
+
+	Philox random(settings.seed);
+	int periodX = width - 1;
+	int periodZ = height - 1;
+	bool wrap = settings.wrap;
+
+	//points are always written at their own index and read through here, which wraps when tiling.
+	//the last row and column then come out identical to the first without anyone writing to them twice.
+	auto read = [&](int x, int z) -> float
+	{
+		if (wrap)
+		{
+			x = ((x % periodX) + periodX) % periodX;
+			z = ((z % periodZ) + periodZ) % periodZ;
+		}
+		return heights[z * width + x];
+	};
+
+	auto offset = [&](int x, int z, float scale) -> float
+	{
+		if (wrap)
+		{
+			x %= periodX;
+			z %= periodZ;
+		}
+		return (random.GetFloat(x + settings.originX, z + settings.originZ) * 2.0f - 1.0f) * scale;
+	};
+
+	float scale = settings.amplitude;
+
+	//coarse lattice
+	ParallelFor(0, periodZ / step + 1, [&](int row)
+	{
+		int z = row * step;
+		for (int x = 0; x < width; x += step)
+		{
+			heights[z * width + x] = offset(x, z, scale);
+		}
+	}, settings.threadCount);
+
+	for (; step > 1; step /= 2)
+	{
+		int half = step / 2;
+		scale *= settings.roughness;
+
+		//diamond step, square centres from their four corners
+		ParallelFor(0, periodZ / step, [&](int row)
+		{
+			int z = row * step + half;
+			for (int x = half; x < width; x += step)
+			{
+				float sum = read(x - half, z - half) + read(x + half, z - half) + read(x - half, z + half) + read(x + half, z + half);
+				heights[z * width + x] = sum * 0.25f + offset(x, z, scale);
+			}
+		}, settings.threadCount);
+
+		//square step, edge midpoints. even rows hold the horizontal edges and odd rows the vertical ones.
+		ParallelFor(0, periodZ / half + 1, [&](int row)
+		{
+			int z = row * half;
+			bool horizontalEdge = (row % 2) == 0;
+			for (int x = horizontalEdge ? half : 0; x < width; x += step)
+			{
+				float sum = 0.0f;
+				int count = 0;
+
+				if (settings.mode == MODE_MIDPOINT_DISPLACEMENT)
+				{
+					//just the two ends of the edge, which always exist
+					if (horizontalEdge)
+					{
+						sum = read(x - half, z) + read(x + half, z);
+					}
+					else
+					{
+						sum = read(x, z - half) + read(x, z + half);
+					}
+					count = 2;
+				}
+				else
+				{
+					//the four points of the diamond, fewer on the border unless it wraps
+					const int neighbours[4][2] = { { -half, 0 }, { half, 0 }, { 0, -half }, { 0, half } };
+					for (int n = 0; n < 4; n++)
+					{
+						int nx = x + neighbours[n][0];
+						int nz = z + neighbours[n][1];
+						if (wrap || (nx >= 0 && nx < width && nz >= 0 && nz < height))
+						{
+							sum += read(nx, nz);
+							count++;
+						}
+					}
+				}
+
+				heights[z * width + x] = sum / (float)count + offset(x, z, scale);
+			}
+		}, settings.threadCount);
+	}
+
+	return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <stdint.h>
+
+//Fractal heightfields by recursive subdivision.
+//The grid starts as a coarse lattice of random heights. Every level halves the spacing: the centre of each square
+//is the average of its four corners plus a random offset (the diamond step), then the middle of each edge is
+//filled in (the square step). Diamond square averages the four points around an edge midpoint, plain midpoint
+//displacement only the two ends of the edge. The offsets shrink by roughness each level.
+//
+//Within a step every new point only reads points from earlier steps, so each step is a parallel sweep over its
+//rows. The offsets come from Philox keyed on the point's coordinate, so the result doesn't depend on the order
+//or the thread count.
+//
+//The grid can be any number of square chunks across and down: width = a * 2^n + 1 and height = b * 2^n + 1.
+//The coarse lattice then has a spacing of 2^n (the largest power of two that divides both).
+
+class DiamondSquare
+{
+public:
+	enum Mode
+	{
+		MODE_DIAMOND_SQUARE,
+		MODE_MIDPOINT_DISPLACEMENT,
+	};
+
+	struct Settings
+	{
+		Mode mode;
+		float amplitude;		//size of the offsets on the coarse lattice
+		float roughness;		//offset multiplier per level, 0.5 is the classic 1/f look, higher is rougher
+		bool wrap;				//tiles seamlessly, the last row and column repeat the first
+		uint64_t seed;
+		int originX, originZ;	//added to the coordinates the offsets are keyed on
+		int threadCount;
+
+		Settings() : mode(MODE_DIAMOND_SQUARE), amplitude(1.0f), roughness(0.5f), wrap(false), seed(1),
+			originX(0), originZ(0), threadCount(0) {}
+	};
+
+	//spacing of the coarse lattice for a grid, 0 if the grid doesn't fit the a * 2^n + 1 layout
+	static int GetCoarseStep(int width, int height);
+
+	//heights is width * height row major and is completely overwritten
+	static bool Generate(float* heights, int width, int height, const Settings& settings);
+};
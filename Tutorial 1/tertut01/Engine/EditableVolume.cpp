@@ -0,0 +1,560 @@
+#include "pch.h"
+#include "EditableVolume.h"
+#include "MarchingCubes.h"
+#include "ParallelFor.h"
+#include "Philox.h"
+#include <chrono>
+
+using DirectX::SimpleMath::Vector3;
+
+namespace
+{
+	float Component(const Vector3& v, int axis)
+	{
+		return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+	}
+
+	//a triangle's corners and normals, turned so the smallest corner comes first (the winding stays the same)
+	struct TestTriangle
+	{
+		float values[18];
+
+		bool operator<(const TestTriangle& other) const { return std::lexicographical_compare(values, values + 18, other.values, other.values + 18); }
+		bool operator==(const TestTriangle& other) const { return memcmp(values, other.values, sizeof(values)) == 0; }
+	};
+
+	void AddTestTriangles(const MeshData& mesh, std::vector<TestTriangle>& triangles)
+	{
+		for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+		{
+			float corners[3][6];
+			for (int k = 0; k < 3; k++)
+			{
+				const Vector3& p = mesh.positions[mesh.indices[t + k]];
+				const Vector3& n = mesh.normals[mesh.indices[t + k]];
+				float values[6] = { p.x, p.y, p.z, n.x, n.y, n.z };
+				memcpy(corners[k], values, sizeof(values));
+			}
+			int first = 0;
+			for (int k = 1; k < 3; k++)
+			{
+				if (std::lexicographical_compare(corners[k], corners[k] + 3, corners[first], corners[first] + 3))
+				{
+					first = k;
+				}
+			}
+			TestTriangle triangle;
+			for (int k = 0; k < 3; k++)
+			{
+				memcpy(triangle.values + k * 3, corners[(first + k) % 3], 3 * sizeof(float));
+				memcpy(triangle.values + 9 + k * 3, corners[(first + k) % 3] + 3, 3 * sizeof(float));
+			}
+			triangles.push_back(triangle);
+		}
+	}
+
+	//how far p is outside the brush shape (negative inside), in world units
+	float BrushDistance(const EditableVolume::Brush& brush, const Vector3& p)
+	{
+		Vector3 d = p - brush.centre;
+		if (brush.shape == EditableVolume::BRUSH_SPHERE)
+		{
+			return d.Length() - brush.size.x;
+		}
+
+		Vector3 q(fabsf(d.x) - brush.size.x, fabsf(d.y) - brush.size.y, fabsf(d.z) - brush.size.z);
+		Vector3 outside(std::max(q.x, 0.0f), std::max(q.y, 0.0f), std::max(q.z, 0.0f));
+		return outside.Length() + std::min(std::max(q.x, std::max(q.y, q.z)), 0.0f);
+	}
+}
+
+EditableVolume::EditableVolume() : m_sizeX(0), m_sizeY(0), m_sizeZ(0), m_chunksX(0), m_chunksY(0), m_chunksZ(0), m_busy(0), m_stop(false)
+{
+}
+
+EditableVolume::~EditableVolume()
+{
+	Shutdown();
+}
+
+bool EditableVolume::Initialize(const float* density, int sizeX, int sizeY, int sizeZ, const Settings& settings)
+{
+	Shutdown();
+	if (!density || sizeX < 2 || sizeY < 2 || sizeZ < 2 || settings.chunkCells < 1)
+	{
+		return false;
+	}
+
+	m_settings = settings;
+	m_sizeX = sizeX;
+	m_sizeY = sizeY;
+	m_sizeZ = sizeZ;
+	m_density.assign(density, density + (size_t)sizeX * sizeY * sizeZ);
+
+	//the last chunk along an axis takes whatever cells are left
+	int n = settings.chunkCells;
+	m_chunksX = (sizeX - 2) / n + 1;
+	m_chunksY = (sizeY - 2) / n + 1;
+	m_chunksZ = (sizeZ - 2) / n + 1;
+
+	ChunkState empty = {};
+	m_chunks.assign((size_t)m_chunksX * m_chunksY * m_chunksZ, empty);
+	m_updated.clear();
+
+	m_stop = false;
+	m_busy = 0;
+	int workers = ParallelThreadCount(settings.threadCount);
+	for (int i = 0; i < workers; i++)
+	{
+		m_workers.push_back(std::thread(&EditableVolume::Work, this));
+	}
+
+	std::vector<int> all(m_chunks.size());
+	for (size_t i = 0; i < all.size(); i++)
+	{
+		all[i] = (int)i;
+	}
+	Queue(all);
+	return true;
+}
+
+void EditableVolume::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_queueMutex);
+		m_stop = true;
+		m_queue.clear();
+	}
+	m_queueSignal.notify_all();
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+	m_workers.clear();
+
+	m_chunks.clear();
+	m_updated.clear();
+	m_density.clear();
+	m_chunksX = m_chunksY = m_chunksZ = 0;
+}
+
+int EditableVolume::ApplyBrush(const Brush& brush)
+{
+	if (m_chunks.empty())
+	{
+		return 0;
+	}
+
+	//the samples the brush can reach
+	float reach = std::max(brush.size.x, std::max(brush.size.y, brush.size.z)) + std::max(brush.falloff, 0.0f);
+	if (brush.shape == BRUSH_SPHERE)
+	{
+		reach = brush.size.x + std::max(brush.falloff, 0.0f);
+	}
+	Vector3 centre = (brush.centre - m_settings.origin) * (1.0f / m_settings.spacing);
+	float sampleReach = reach / m_settings.spacing;
+	int low[3], high[3], size[3] = { m_sizeX, m_sizeY, m_sizeZ };
+	for (int k = 0; k < 3; k++)
+	{
+		low[k] = std::max((int)ceilf(Component(centre, k) - sampleReach), 0);
+		high[k] = std::min((int)floorf(Component(centre, k) + sampleReach), size[k] - 1);
+		if (low[k] > high[k])
+		{
+			return 0;
+		}
+	}
+
+	float sign = brush.mode == BRUSH_ADD ? 1.0f : -1.0f;
+	float falloff = std::max(brush.falloff, 1e-6f);
+	int n = m_settings.chunkCells;
+	int chunkLow[3], chunkHigh[3], chunks[3] = { m_chunksX, m_chunksY, m_chunksZ };
+	for (int k = 0; k < 3; k++)
+	{
+		//chunk c reads samples c * n to c * n + n, and its normals one further either way
+		chunkLow[k] = std::max(low[k] - 2, 0) / n;
+		chunkHigh[k] = std::min((high[k] + 1) / n, chunks[k] - 1);
+	}
+
+	std::vector<int> dirty;
+	{
+		std::lock_guard<std::mutex> lock(m_densityMutex);
+		for (int z = low[2]; z <= high[2]; z++)
+		{
+			for (int y = low[1]; y <= high[1]; y++)
+			{
+				float* row = m_density.data() + ((size_t)z * m_sizeY + y) * m_sizeX;
+				for (int x = low[0]; x <= high[0]; x++)
+				{
+					Vector3 p = m_settings.origin + Vector3((float)x, (float)y, (float)z) * m_settings.spacing;
+					float distance = BrushDistance(brush, p);
+					if (distance >= falloff)
+					{
+						continue;
+					}
+
+					//full strength inside, smoothstep down to nothing over the falloff
+					float w = 1.0f;
+					if (distance > 0.0f)
+					{
+						float t = 1.0f - distance / falloff;
+						w = t * t * (3.0f - 2.0f * t);
+					}
+					row[x] += sign * brush.strength * w;
+				}
+			}
+		}
+
+		for (int z = chunkLow[2]; z <= chunkHigh[2]; z++)
+		{
+			for (int y = chunkLow[1]; y <= chunkHigh[1]; y++)
+			{
+				for (int x = chunkLow[0]; x <= chunkHigh[0]; x++)
+				{
+					int chunk = (z * m_chunksY + y) * m_chunksX + x;
+					m_chunks[chunk].editVersion++;
+					dirty.push_back(chunk);
+				}
+			}
+		}
+	}
+
+	Queue(dirty);
+	return (int)dirty.size();
+}
+
+void EditableVolume::Queue(const std::vector<int>& chunks)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_queueMutex);
+		for (int chunk : chunks)
+		{
+			//one queued job covers any number of edits, it reads the density when it starts
+			if (!m_chunks[chunk].queued)
+			{
+				m_chunks[chunk].queued = true;
+				m_queue.push_back(chunk);
+			}
+		}
+	}
+	m_queueSignal.notify_all();
+}
+
+void EditableVolume::Flush()
+{
+	std::unique_lock<std::mutex> lock(m_queueMutex);
+	m_idleSignal.wait(lock, [this]() { return m_queue.empty() && m_busy == 0; });
+}
+
+void EditableVolume::Work()
+{
+	std::vector<float> samples, inner;
+	for (;;)
+	{
+		int chunk;
+		{
+			std::unique_lock<std::mutex> lock(m_queueMutex);
+			m_queueSignal.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+			if (m_stop)
+			{
+				return;
+			}
+			chunk = m_queue.front();
+			m_queue.pop_front();
+			//an edit from here on queues it again
+			m_chunks[chunk].queued = false;
+			m_busy++;
+		}
+
+		std::shared_ptr<MeshData> mesh = std::make_shared<MeshData>();
+		uint64_t version;
+		MeshChunk(chunk, samples, inner, *mesh, version);
+
+		{
+			std::lock_guard<std::mutex> lock(m_resultMutex);
+			//two workers can have the same chunk, the one that read the density last wins
+			ChunkState& state = m_chunks[chunk];
+			if (version >= state.publishedVersion)
+			{
+				std::atomic_store(&state.mesh, std::shared_ptr<const MeshData>(mesh));
+				state.publishedVersion = version;
+				if (!state.updated)
+				{
+					state.updated = true;
+					m_updated.push_back(chunk);
+				}
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_queueMutex);
+			m_busy--;
+			if (m_busy == 0 && m_queue.empty())
+			{
+				m_idleSignal.notify_all();
+			}
+		}
+	}
+}
+
+void EditableVolume::MeshChunk(int chunk, std::vector<float>& samples, std::vector<float>& inner, MeshData& mesh, uint64_t& version)
+{
+	int n = m_settings.chunkCells;
+	int cx = chunk % m_chunksX, cy = (chunk / m_chunksX) % m_chunksY, cz = chunk / (m_chunksX * m_chunksY);
+	int base[3] = { cx * n, cy * n, cz * n };
+	int size[3] = { std::min(n, m_sizeX - 1 - base[0]) + 1, std::min(n, m_sizeY - 1 - base[1]) + 1, std::min(n, m_sizeZ - 1 - base[2]) + 1 };
+	int limit[3] = { m_sizeX, m_sizeY, m_sizeZ };
+
+	//the chunk's samples with one more all round for the normals, clamped to the volume
+	int apron[3] = { size[0] + 2, size[1] + 2, size[2] + 2 };
+	samples.resize((size_t)apron[0] * apron[1] * apron[2]);
+	{
+		std::lock_guard<std::mutex> lock(m_densityMutex);
+		version = m_chunks[chunk].editVersion;
+		for (int z = 0; z < apron[2]; z++)
+		{
+			int sz = std::min(std::max(base[2] + z - 1, 0), m_sizeZ - 1);
+			for (int y = 0; y < apron[1]; y++)
+			{
+				int sy = std::min(std::max(base[1] + y - 1, 0), m_sizeY - 1);
+				const float* source = m_density.data() + ((size_t)sz * m_sizeY + sy) * m_sizeX;
+				float* row = samples.data() + ((size_t)z * apron[1] + y) * apron[0];
+				for (int x = 0; x < apron[0]; x++)
+				{
+					row[x] = source[std::min(std::max(base[0] + x - 1, 0), m_sizeX - 1)];
+				}
+			}
+		}
+	}
+
+	inner.resize((size_t)size[0] * size[1] * size[2]);
+	for (int z = 0; z < size[2]; z++)
+	{
+		for (int y = 0; y < size[1]; y++)
+		{
+			const float* source = samples.data() + ((size_t)(z + 1) * apron[1] + y + 1) * apron[0] + 1;
+			std::copy(source, source + size[0], inner.data() + ((size_t)z * size[1] + y) * size[0]);
+		}
+	}
+
+	//a volume sample, from the apron copy
+	auto sample = [&](const int p[3])
+	{
+		return samples[((size_t)(p[2] - base[2] + 1) * apron[1] + (p[1] - base[1] + 1)) * apron[0] + (p[0] - base[0] + 1)];
+	};
+	//central differences, one sided on the edges of the volume, like MarchingCubes
+	auto gradient = [&](const int p[3])
+	{
+		float g[3];
+		for (int k = 0; k < 3; k++)
+		{
+			int a[3] = { p[0], p[1], p[2] }, b[3] = { p[0], p[1], p[2] };
+			a[k] = std::max(p[k] - 1, 0);
+			b[k] = std::min(p[k] + 1, limit[k] - 1);
+			g[k] = (sample(b) - sample(a)) / (float)std::max(b[k] - a[k], 1);
+		}
+		return Vector3(g[0], g[1], g[2]);
+	};
+
+	//meshed in the chunk's own sample units, which says which edge each vertex is on
+	MarchingCubes::Settings settings;
+	settings.isoLevel = m_settings.isoLevel;
+	settings.normals = false;
+	MarchingCubes::Polygonise(inner.data(), size[0], size[1], size[2], settings, mesh, 1);
+
+	mesh.normals.resize(mesh.positions.size());
+	for (size_t i = 0; i < mesh.positions.size(); i++)
+	{
+		//the edge is along the one axis that isn't a whole number (none when the crossing is right on a sample)
+		const Vector3& local = mesh.positions[i];
+		int start[3], axis = -1;
+		float furthest = 0.0f;
+		for (int k = 0; k < 3; k++)
+		{
+			float value = Component(local, k);
+			float nearest = floorf(value + 0.5f);
+			if (fabsf(value - nearest) > furthest)
+			{
+				furthest = fabsf(value - nearest);
+				axis = k;
+			}
+			start[k] = (int)nearest;
+		}
+		if (axis >= 0)
+		{
+			start[axis] = (int)floorf(Component(local, axis));
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			start[k] += base[k];
+		}
+
+		//placed in volume coordinates, so a crossing on a chunk boundary comes out the same in both chunks
+		int end[3] = { start[0], start[1], start[2] };
+		float t = 0.0f;
+		float offset[3] = { 0.0f, 0.0f, 0.0f };
+		if (axis >= 0)
+		{
+			end[axis]++;
+			float value0 = sample(start), value1 = sample(end);
+			t = (m_settings.isoLevel - value0) / (value1 - value0);
+			offset[axis] = t;
+		}
+		mesh.positions[i] = m_settings.origin + Vector3(start[0] + offset[0], start[1] + offset[1], start[2] + offset[2]) * m_settings.spacing;
+
+		Vector3 g = gradient(start) * (1.0f - t) + gradient(end) * t;
+		float length = g.Length();
+		mesh.normals[i] = length > 0.0f ? g * (-1.0f / length) : Vector3(0.0f, 1.0f, 0.0f);
+	}
+}
+
+std::shared_ptr<const MeshData> EditableVolume::GetMesh(int chunk) const
+{
+	if (chunk < 0 || chunk >= (int)m_chunks.size())
+	{
+		return nullptr;
+	}
+	return std::atomic_load(&m_chunks[chunk].mesh);
+}
+
+void EditableVolume::CollectUpdated(std::vector<int>& chunks)
+{
+	std::lock_guard<std::mutex> lock(m_resultMutex);
+	chunks.swap(m_updated);
+	m_updated.clear();
+	for (int chunk : chunks)
+	{
+		m_chunks[chunk].updated = false;
+	}
+}
+
+float EditableVolume::GetDensity(int x, int y, int z) const
+{
+	if (x < 0 || y < 0 || z < 0 || x >= m_sizeX || y >= m_sizeY || z >= m_sizeZ)
+	{
+		return m_settings.isoLevel;
+	}
+	std::lock_guard<std::mutex> lock(m_densityMutex);
+	return m_density[((size_t)z * m_sizeY + y) * m_sizeX + x];
+}
+
+double EditableVolume::Benchmark(int size, int strokes, int threadCount, double* worst)
+{
+	std::vector<float> density;
+	MarchingCubes::BuildBenchmarkVolume(size, density, threadCount);
+
+	EditableVolume volume;
+	Settings settings;
+	settings.threadCount = threadCount;
+	volume.Initialize(density.data(), size, size, size, settings);
+	volume.Flush();
+
+	//brushes on the ground somewhere in the middle, digging and building in turn
+	Philox random(7);
+	double total = 0.0, slowest = 0.0;
+	strokes = std::max(strokes, 1);
+	for (int i = 0; i < strokes; i++)
+	{
+		int x = size / 4 + (int)(random.GetFloat(i, 0, 0) * (size / 2));
+		int z = size / 4 + (int)(random.GetFloat(i, 0, 1) * (size / 2));
+		int y = size - 1;
+		while (y > 0 && volume.GetDensity(x, y, z) < settings.isoLevel)
+		{
+			y--;
+		}
+
+		Brush brush;
+		brush.shape = (i % 4) == 3 ? BRUSH_BOX : BRUSH_SPHERE;
+		brush.mode = (i & 1) ? BRUSH_ADD : BRUSH_SUBTRACT;
+		brush.centre = Vector3((float)x, (float)y, (float)z);
+		brush.size = Vector3(5.0f, 3.0f, 5.0f);
+		brush.falloff = 3.0f;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		volume.ApplyBrush(brush);
+		volume.Flush();
+		auto end = std::chrono::high_resolution_clock::now();
+
+		double ms = std::chrono::duration<double, std::milli>(end - start).count();
+		total += ms;
+		slowest = std::max(slowest, ms);
+	}
+
+	if (worst)
+	{
+		*worst = slowest;
+	}
+	return total / strokes;
+}
+
+size_t EditableVolume::TestAgainstMarchingCubes(int trials, int threadCount)
+{
+	Philox random(49);
+	size_t failures = 0;
+	std::vector<float> density;
+	std::vector<TestTriangle> chunked, whole;
+
+	for (int trial = 0; trial < trials; trial++)
+	{
+		//a size that leaves a part chunk on the far sides
+		const int size = 45;
+		MarchingCubes::BuildBenchmarkVolume(size, density, threadCount);
+
+		EditableVolume volume;
+		Settings settings;
+		settings.chunkCells = 8;
+		settings.threadCount = threadCount;
+		settings.spacing = 0.5f;
+		settings.origin = Vector3(-3.0f, 1.0f, 2.0f);
+		settings.isoLevel = (random.GetFloat(0, trial, 0) - 0.5f) * 0.2f;
+		volume.Initialize(density.data(), size, size, size, settings);
+
+		for (int stroke = 0; stroke < 12; stroke++)
+		{
+			Brush brush;
+			brush.shape = random.GetFloat(stroke, trial, 1) < 0.5f ? BRUSH_SPHERE : BRUSH_BOX;
+			brush.mode = random.GetFloat(stroke, trial, 2) < 0.5f ? BRUSH_ADD : BRUSH_SUBTRACT;
+			//centres from a little outside the volume to a little past it, on a chunk boundary every third one
+			Vector3 sample(random.GetFloat(stroke, trial, 3), random.GetFloat(stroke, trial, 4), random.GetFloat(stroke, trial, 5));
+			sample = sample * (size + 8.0f) - Vector3(4.0f, 4.0f, 4.0f);
+			if (stroke % 3 == 0)
+			{
+				sample.x = floorf(sample.x / 8.0f) * 8.0f;
+			}
+			brush.centre = settings.origin + sample * settings.spacing;
+			brush.size = Vector3(1.0f + random.GetFloat(stroke, trial, 6) * 4.0f, 1.0f + random.GetFloat(stroke, trial, 7) * 4.0f, 1.0f + random.GetFloat(stroke, trial, 8) * 4.0f);
+			brush.falloff = random.GetFloat(stroke, trial, 9) * 2.0f;
+			brush.strength = 0.5f + random.GetFloat(stroke, trial, 10) * 4.0f;
+			volume.ApplyBrush(brush);
+
+			if (stroke % 4 != 3)
+			{
+				continue;
+			}
+			volume.Flush();
+
+			chunked.clear();
+			for (int chunk = 0; chunk < volume.GetChunkCount(); chunk++)
+			{
+				std::shared_ptr<const MeshData> mesh = volume.GetMesh(chunk);
+				if (mesh)
+				{
+					AddTestTriangles(*mesh, chunked);
+				}
+			}
+
+			MarchingCubes::Settings reference;
+			reference.isoLevel = settings.isoLevel;
+			reference.origin = settings.origin;
+			reference.spacing = settings.spacing;
+			MeshData mesh;
+			MarchingCubes::Polygonise(volume.m_density.data(), size, size, size, reference, mesh, threadCount);
+			whole.clear();
+			AddTestTriangles(mesh, whole);
+
+			std::sort(chunked.begin(), chunked.end());
+			std::sort(whole.begin(), whole.end());
+			failures += chunked == whole && !whole.empty() ? 0 : 1;
+		}
+	}
+	return failures;
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <stdint.h>
+#include "MeshData.h"
+
+//A density volume that can be dug into and built on while it is being drawn.
+//
+//The volume is cut into chunks of chunkCells^3 cells, each meshed on its own with MarchingCubes. A brush (a sphere
+//or box that adds or takes away density, fading out over its falloff) changes the samples it covers and queues the
+//chunks that read them: every chunk the samples are in, so the neighbours sharing a boundary too, and the ones
+//whose normals (central differences) reach them. Worker threads take chunks off the queue, copy their samples out
+//under the lock the brushes write with, mesh them without it, and publish the result by swapping a shared pointer,
+//so a reader holds a whole old mesh or a whole new one and never waits on a mesh being built. A chunk edited
+//again while it's being meshed is simply queued again, and a slower, older mesh never replaces a newer one.
+//
+//Vertices are placed from the volume's own samples, with central difference normals that look past the chunk's
+//edges, so the chunks join without seams in position or shading.
+
+class EditableVolume
+{
+public:
+	enum BrushShape
+	{
+		BRUSH_SPHERE = 0,
+		BRUSH_BOX = 1,
+	};
+
+	enum BrushMode
+	{
+		BRUSH_ADD = 0,			//more solid (density up)
+		BRUSH_SUBTRACT = 1,		//dig (density down)
+	};
+
+	struct Brush
+	{
+		BrushShape shape;
+		BrushMode mode;
+		DirectX::SimpleMath::Vector3 centre;
+		DirectX::SimpleMath::Vector3 size;		//radius in x for a sphere, half extents for a box
+		float falloff;							//distance outside the shape over which the strength fades to 0
+		float strength;							//density change inside the shape
+
+		Brush() : shape(BRUSH_SPHERE), mode(BRUSH_SUBTRACT), centre(0.0f, 0.0f, 0.0f), size(4.0f, 4.0f, 4.0f), falloff(2.0f), strength(4.0f) {}
+	};
+
+	struct Settings
+	{
+		float isoLevel;							//like MarchingCubes, below it is outside
+		DirectX::SimpleMath::Vector3 origin;	//where sample (0, 0, 0) sits
+		float spacing;							//distance between samples
+		int chunkCells;							//cells along a chunk side
+		int threadCount;						//mesh workers, 0 for one per hardware thread
+
+		Settings() : isoLevel(0.0f), origin(0.0f, 0.0f, 0.0f), spacing(1.0f), chunkCells(32), threadCount(0) {}
+	};
+
+	EditableVolume();
+	~EditableVolume();
+
+	//copies the density (x fastest, then y, then z) and queues every chunk
+	bool Initialize(const float* density, int sizeX, int sizeY, int sizeZ, const Settings& settings);
+	void Shutdown();
+
+	//returns how many chunks it queued
+	int ApplyBrush(const Brush& brush);
+	//waits until every queued chunk has been meshed
+	void Flush();
+
+	int GetChunksX() const { return m_chunksX; }
+	int GetChunksY() const { return m_chunksY; }
+	int GetChunksZ() const { return m_chunksZ; }
+	int GetChunkCount() const { return (int)m_chunks.size(); }
+	//the chunk's latest mesh in world space (null until its first one is done), safe from any thread
+	std::shared_ptr<const MeshData> GetMesh(int chunk) const;
+	//the chunks with a new mesh since the last call, for re-uploading their buffers
+	void CollectUpdated(std::vector<int>& chunks);
+	float GetDensity(int x, int y, int z) const;
+
+	//brush strokes on a size^3 terrain like volume, each timed from the brush to its last chunk being published.
+	//returns the average milliseconds, worst gets the slowest.
+	static double Benchmark(int size, int strokes, int threadCount = 0, double* worst = nullptr);
+
+	//random brushes (across chunk boundaries and off the edges, several queued before each flush), then every
+	//chunk's mesh together against MarchingCubes::Polygonise on the whole edited volume. triangles are compared
+	//as sets, position and normal exactly. returns the number of meshes that didn't match.
+	static size_t TestAgainstMarchingCubes(int trials, int threadCount = 0);
+
+private:
+	struct ChunkState
+	{
+		std::shared_ptr<const MeshData> mesh;
+		uint64_t editVersion;					//bumped by every brush that touches it, under the density lock
+		uint64_t publishedVersion;				//the version its mesh was made from, under the results lock
+		bool queued;							//under the queue lock
+		bool updated;							//in m_updated, under the results lock
+	};
+
+	void Work();
+	void MeshChunk(int chunk, std::vector<float>& samples, std::vector<float>& inner, MeshData& mesh, uint64_t& version);
+	void Queue(const std::vector<int>& chunks);
+
+private:
+	std::vector<float> m_density;
+	int m_sizeX, m_sizeY, m_sizeZ;
+	int m_chunksX, m_chunksY, m_chunksZ;
+	Settings m_settings;
+	std::vector<ChunkState> m_chunks;
+
+	mutable std::mutex m_densityMutex;
+	mutable std::mutex m_resultMutex;
+	std::vector<int> m_updated;
+
+	std::mutex m_queueMutex;
+	std::condition_variable m_queueSignal;	//work to do, or stopping
+	std::condition_variable m_idleSignal;	//the queue ran dry and nothing is being meshed
+	std::deque<int> m_queue;
+	int m_busy;								//chunks being meshed right now
+	bool m_stop;
+	std::vector<std::thread> m_workers;
+};
@@ -4,6 +4,7 @@
 
 #include "pch.h"
 #include "Game.h"
+#include "MeshSimplifier.h"
 
 
 //toreorganise
@@ -181,6 +182,8 @@ void Game::Initialize(HWND window, int width, int height)
 	m_Light.setDiffuseColour(1.0f, 1.0f, 1.0f, 1.0f);
 	m_Light.setPosition(2.0f, 1.0f, 1.0f);
 	m_Light.setDirection(-1.0f, -1.0f, 0.0f);
+	//the ground lighting was first shaded before there was a light, so shade it again for this one
+	UpdateTerrainLighting();
 
 	//setup camera
 	m_Camera01.setPosition(Vector3(0.0f, 0.0f, 4.0f));
@@ -290,6 +293,27 @@ void Game::Update(DX::StepTimer const& timer)
 
 	//m_Terrain.GenerateHeightMap(device);
 
+    //picks up anything the GUI generated in the background, doesn't wait if it isn't done
+    m_WaterTerrain.UpdateAsync(device);
+
+    //the ocean is evaluated straight from the clock so it doesn't drift with the frame rate
+    if (m_oceanEnabled)
+    {
+        m_ocean.Update((float)timer.GetTotalSeconds());
+        m_WaterTerrain.ApplyOcean(device, m_ocean);
+    }
+
+    //water flowing over the ground terrain, drawn with the water terrain
+    if (m_shallowWaterEnabled)
+    {
+        m_GroundTerrain.GetHeights(m_shallowGround.data());
+        m_shallowWater.SetTerrain(m_shallowGround.data());
+        m_shallowWater.Simulate((float)timer.GetElapsedSeconds());
+
+        //the ground is drawn at y 1.6 and the water at -0.6, both scaled by 0.1
+        m_WaterTerrain.ApplyWaterSurface(device, m_shallowWater, (1.6f + 0.6f) / 0.1f);
+    }
+
 	m_Camera01.Update();	//camera update.s
 	m_view = m_Camera01.getCameraMatrix();
 	m_world = Matrix::Identity;
@@ -297,6 +321,10 @@ void Game::Update(DX::StepTimer const& timer)
 	/*create our UI*/
 	SetupGUI();
 
+    //whatever changed the ground this frame, the splat map, lighting and scatter follow it
+    if (m_GroundTerrain.GetHeightsVersion() != m_groundHeightsVersion)
+        OnGroundChanged();
+
     m_listener.Update(m_Camera01.getPosition(), Vector3::Up, 0.1f);
 
 #ifdef DXTK_AUDIO
@@ -361,29 +389,39 @@ void Game::Render()
 	//context->RSSetState(m_states->Wireframe());
 
 
-	//prepare transform for floor object. 
-	m_world = SimpleMath::Matrix::Identity; //set world back to identity
-	SimpleMath::Matrix newPosition3 = SimpleMath::Matrix::CreateTranslation(0.0f, -0.6f, 0.0f);
-	SimpleMath::Matrix newScale = SimpleMath::Matrix::CreateScale(0.1);
-    SimpleMath::Matrix newRotation = SimpleMath::Matrix::CreateRotationX(0);//scale the terrain down a little. 
-	m_world = m_world * newScale * newPosition3 * newRotation;
+	//prepare transform for floor object. the terrains keep their own placement so height queries match what is drawn
+	m_world = m_WaterTerrain.GetWorldMatrix();
 
     //GenerateVolumetricFogTexture(&m_Cloud);
 
 	//setup and draw water body
-	m_BasicShaderPair.EnableShader(context);
-	m_BasicShaderPair.SetShaderParameters(context, &m_world, &m_view, &m_projection, &m_Light, m_water.Get());
+	EnableTerrainShader(m_WaterTerrain, m_water.Get());
 	m_WaterTerrain.Render(context);
 
 
-    m_world = SimpleMath::Matrix::Identity; //set world back to identity
-    newPosition3 = SimpleMath::Matrix::CreateTranslation(0.0f, 1.6f, 0.0f);
-    m_world = m_world * newScale * newPosition3 * newRotation;
+    m_world = m_GroundTerrain.GetWorldMatrix();
 
-    m_BasicShaderPair.EnableShader(context);
-    m_BasicShaderPair.SetShaderParameters(context, &m_world, &m_view, &m_projection, &m_Light, m_texture1.Get());
+    EnableTerrainShader(m_GroundTerrain, m_texture1.Get(), m_splatEnabled, m_lightingView.Get());
     m_GroundTerrain.Render(context);
 
+    //the scattered objects are in the ground's grid space, so they share its world matrix
+    if (m_scatterEnabled)
+    {
+        CullScatter(context);
+
+        ID3D11ShaderResourceView* textures[2] = { m_treeTexture.Get(), m_texture1.Get() };
+        m_InstancedShaderPair.EnableShader(context);
+        for (int layer = 0; layer < 2; layer++)
+        {
+            m_InstancedShaderPair.SetShaderParameters(context, &m_world, &m_view, &m_projection, &m_Light, textures[layer]);
+            for (int lod = 0; lod < SCATTER_LODS; lod++)
+            {
+                const InstanceCuller::LodRange& range = m_instanceLods[layer][lod];
+                m_scatterModels[layer][lod].RenderInstanced(context, m_instanceBuffers[layer].Get(), sizeof(ObjectScatter::Instance), range.count, range.first);
+            }
+        }
+    }
+
 	//render our GUI
 	ImGui::Render();
 	ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
@@ -694,21 +732,79 @@ void Game::CreateDeviceDependentResources()
 	m_WaterTerrain.Initialize(device, 64, 64);
     m_GroundTerrain.Initialize(device, 64, 64);
 
+    //generated tiles are kept across runs in TileCache next to the exe
+    m_tileCache.Initialize("TileCache", 64 * 1024 * 1024);
+    m_WaterTerrain.SetTileCache(&m_tileCache);
+    m_GroundTerrain.SetTileCache(&m_tileCache);
+
+	//both are scaled down a little, the water sits below and the ground above
+	SimpleMath::Matrix terrainScale = SimpleMath::Matrix::CreateScale(0.1f);
+	m_WaterTerrain.SetWorldMatrix(terrainScale * SimpleMath::Matrix::CreateTranslation(0.0f, -0.6f, 0.0f));
+	m_GroundTerrain.SetWorldMatrix(terrainScale * SimpleMath::Matrix::CreateTranslation(0.0f, 1.6f, 0.0f));
+    m_ocean.Initialize(OceanFFT::Settings());
+    m_shallowWater.Initialize(64, 64);
+    m_shallowGround.resize(m_shallowWater.GetWidth() * m_shallowWater.GetHeight());
+
 	//setup our test model
 	m_BasicModel.InitializeSphere(device);
 	m_BasicModel2.InitializeModel(device,"drone.obj");
 	m_BasicModel3.InitializeBox(device, 10.0f, 0.1f, 10.0f);	//box includes dimensions
+    m_scatterModels[0][0].InitializeModel(device, "tree.obj");
+    m_scatterModels[1][0].InitializeSphere(device);
+
+    //the further LODs are simplified from the full models, each keeping about a third of the triangles before it
+    for (int layer = 0; layer < 2; layer++)
+    {
+        MeshData mesh;
+        std::vector<MeshData> lods;
+        m_scatterModels[layer][0].GetMesh(mesh);
+        MeshSimplifier::BuildLodChain(mesh, lods, SCATTER_LODS, 0.35f, false);
+        for (int lod = 1; lod < SCATTER_LODS; lod++)
+        {
+            MeshData simplified = lods[std::min(lod, (int)lods.size() - 1)];
+            MeshSimplifier::ComputeNormals(simplified);
+            m_scatterModels[layer][lod].InitializeMesh(device, simplified);
+        }
+    }
 
 	//load and set up our Vertex and Pixel Shaders
 	m_BasicShaderPair.InitStandard(device, L"light_vs.cso", L"light_ps.cso");
 	m_BasicShaderPair1.InitStandard(device, L"light_vs.cso", L"light_ps.cso");
 	m_HorizontalBlur.InitStandard(device, L"BlurVS.cso", L"BlurPS.cso");
+	m_CompactShaderPair.InitCompactTerrain(device, L"terrain_compact_vs.cso", L"light_ps.cso");
+	m_SplatShaderPair.InitStandard(device, L"light_vs.cso", L"terrain_splat_ps.cso");
+	m_CompactSplatShaderPair.InitCompactTerrain(device, L"terrain_compact_vs.cso", L"terrain_splat_ps.cso");
+	m_LitShaderPair.InitStandard(device, L"light_vs.cso", L"terrain_lit_ps.cso");
+	m_CompactLitShaderPair.InitCompactTerrain(device, L"terrain_compact_vs.cso", L"terrain_lit_ps.cso");
+	m_InstancedShaderPair.InitInstanced(device, L"instanced_vs.cso", L"instanced_ps.cso");
 
 	//load Textures
 	CreateDDSTextureFromFile(device, L"seafloor.dds",		nullptr,	m_texture1.ReleaseAndGetAddressOf());
 	CreateDDSTextureFromFile(device, L"EvilDrone_Diff.dds", nullptr,	m_texture2.ReleaseAndGetAddressOf());
     CreateDDSTextureFromFile(device, L"cloud.dds",          nullptr,    m_Cloud.ReleaseAndGetAddressOf());
     CreateDDSTextureFromFile(device, L"water.dds",          nullptr,    m_water.ReleaseAndGetAddressOf());
+    CreateDDSTextureFromFile(device, L"tree.dds",           nullptr,    m_treeTexture.ReleaseAndGetAddressOf());
+
+    //splat weights for the ground, one texel per vertex
+    m_splatMap.Initialize(64, 64, 4);
+    m_splatMap.SetNoise(0.08f, 7);
+    CD3D11_TEXTURE2D_DESC splatDesc(DXGI_FORMAT_R8G8B8A8_UNORM, 64, 64, 1, 1);
+    DX::ThrowIfFailed(device->CreateTexture2D(&splatDesc, nullptr, m_splatTexture.ReleaseAndGetAddressOf()));
+    DX::ThrowIfFailed(device->CreateShaderResourceView(m_splatTexture.Get(), nullptr, m_splatView.ReleaseAndGetAddressOf()));
+    UpdateSplatMap();
+
+    //occlusion and sun shadowing baked from the ground's horizons, laid out the same as the splat map
+    m_horizonMap.Initialize(64, 64, 16);
+    CD3D11_TEXTURE2D_DESC lightingDesc(DXGI_FORMAT_R8G8_UNORM, 64, 64, 1, 1);
+    DX::ThrowIfFailed(device->CreateTexture2D(&lightingDesc, nullptr, m_lightingTexture.ReleaseAndGetAddressOf()));
+    DX::ThrowIfFailed(device->CreateShaderResourceView(m_lightingTexture.Get(), nullptr, m_lightingView.ReleaseAndGetAddressOf()));
+    UpdateTerrainLighting();
+
+    //trees and rocks, four by four chunks over the ground
+    m_scatter.Initialize(64, 64, 2, 16.0f);
+    m_scatter.SetSeed(11);
+    UpdateScatter();
+    m_groundHeightsVersion = m_GroundTerrain.GetHeightsVersion();
 
 
 	//Initialise Render to texture
@@ -758,6 +854,263 @@ void Game::CreateWindowSizeDependentResources()
     );
 }
 
+//terrains can be in either vertex format, pick the shader pair that matches what is in their buffers
+void Game::EnableTerrainShader(Terrain& terrain, ID3D11ShaderResourceView* texture, bool splat, ID3D11ShaderResourceView* lighting)
+{
+    auto context = m_deviceResources->GetD3DDeviceContext();
+
+    //the splat shader reads the baked lighting too, so splat needs lighting
+    if (terrain.UsesCompactVertices())
+    {
+        Shader& shader = splat ? m_CompactSplatShaderPair : lighting ? m_CompactLitShaderPair : m_CompactShaderPair;
+        shader.EnableShader(context);
+        shader.SetShaderParameters(context, &m_world, &m_view, &m_projection, &m_Light, texture);
+        shader.SetCompactTerrainParameters(context, terrain.GetCompactParams());
+    }
+    else
+    {
+        Shader& shader = splat ? m_SplatShaderPair : lighting ? m_LitShaderPair : m_BasicShaderPair;
+        shader.EnableShader(context);
+        shader.SetShaderParameters(context, &m_world, &m_view, &m_projection, &m_Light, texture);
+    }
+
+    if (lighting)
+    {
+        m_LitShaderPair.SetTerrainLighting(context, lighting, GetTowardsSun());
+    }
+
+    if (splat)
+    {
+        //texture is material 0, then water in the low ground, cloud on the tops and the drone metal on the steep bits
+        ID3D11ShaderResourceView* materials[3] = { m_water.Get(), m_Cloud.Get(), m_texture2.Get() };
+        m_SplatShaderPair.SetSplatTextures(context, m_splatView.Get(), materials);
+    }
+}
+
+//rebuilds the ground splat weights and uploads whatever changed
+void Game::UpdateSplatMap()
+{
+    auto context = m_deviceResources->GetD3DDeviceContext();
+
+    std::vector<float> heights(m_splatMap.GetWidth() * m_splatMap.GetHeight());
+    m_GroundTerrain.GetHeights(heights.data());
+
+    //bands are picked as fractions of whatever height range the ground has right now
+    float low = *std::min_element(heights.begin(), heights.end());
+    float high = *std::max_element(heights.begin(), heights.end());
+    float range = std::max(high - low, 1e-3f);
+
+    SplatMap::Material base;
+    base.noise = 0.4f;
+    m_splatMap.SetMaterial(0, base);
+
+    SplatMap::Material lowland;
+    lowland.maxHeight = low + range * 0.25f;
+    lowland.heightBlend = range * 0.1f;
+    lowland.curvature = -2.0f;
+    lowland.strength = 1.5f;
+    m_splatMap.SetMaterial(1, lowland);
+
+    SplatMap::Material peaks;
+    peaks.minHeight = low + range * 0.75f;
+    peaks.heightBlend = range * 0.1f;
+    peaks.noise = -0.5f;
+    peaks.strength = 1.5f;
+    m_splatMap.SetMaterial(2, peaks);
+
+    SplatMap::Material cliffs;
+    cliffs.minSlope = 0.3f;
+    cliffs.slopeBlend = 0.15f;
+    cliffs.strength = 3.0f;
+    m_splatMap.SetMaterial(3, cliffs);
+
+    m_splatMap.Generate(heights.data(), 1.0f);
+
+    int x0, z0, x1, z1;
+    if (m_splatMap.TakeDirtyRegion(x0, z0, x1, z1))
+    {
+        D3D11_BOX box = { (UINT)x0, (UINT)z0, 0, (UINT)x1 + 1, (UINT)z1 + 1, 1 };
+        const uint32_t* first = m_splatMap.GetLayer(0) + z0 * m_splatMap.GetWidth() + x0;
+        context->UpdateSubresource(m_splatTexture.Get(), 0, &box, first, m_splatMap.GetWidth() * sizeof(uint32_t), 0);
+    }
+}
+
+//the ground is lit by m_Light as a directional sun, both in the bake and in the terrain shaders
+SimpleMath::Vector3 Game::GetTowardsSun()
+{
+    SimpleMath::Vector3 towardsSun = -m_Light.getDirection();
+    towardsSun.Normalize();
+    return towardsSun;
+}
+
+//rebakes the ground occlusion and sun shadowing where the heights changed and uploads whatever changed
+void Game::UpdateTerrainLighting()
+{
+    auto context = m_deviceResources->GetD3DDeviceContext();
+    int width = m_horizonMap.GetWidth();
+    int height = m_horizonMap.GetHeight();
+
+    std::vector<float> heights(width * height);
+    m_GroundTerrain.GetHeights(heights.data());
+
+    //the ground is scaled evenly, so the light's direction is the same in grid space
+    SimpleMath::Vector3 towardsSun = GetTowardsSun();
+    bool sunMoved = towardsSun != m_bakedSun;
+    if (sunMoved)
+    {
+        m_horizonMap.SetSun(towardsSun.x, towardsSun.y, towardsSun.z, 0.05f);
+        m_bakedSun = towardsSun;
+    }
+
+    if (m_bakedHeights.size() != heights.size())
+    {
+        m_horizonMap.Bake(heights.data(), 1.0f);
+    }
+    else
+    {
+        //only the lines through what actually changed are swept again, carving rivers only touches the channels
+        int x0 = width, z0 = height, x1 = -1, z1 = -1;
+        for (int z = 0; z < height; z++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                if (heights[z * width + x] != m_bakedHeights[z * width + x])
+                {
+                    x0 = std::min(x0, x);
+                    z0 = std::min(z0, z);
+                    x1 = std::max(x1, x);
+                    z1 = std::max(z1, z);
+                }
+            }
+        }
+        if (x1 >= 0)
+        {
+            m_horizonMap.UpdateRegion(heights.data(), 1.0f, x0, z0, x1, z1);
+        }
+        if (sunMoved)
+        {
+            m_horizonMap.UpdateShading();
+        }
+    }
+    m_bakedHeights.swap(heights);
+
+    int x0, z0, x1, z1;
+    if (m_horizonMap.TakeDirtyRegion(x0, z0, x1, z1))
+    {
+        D3D11_BOX box = { (UINT)x0, (UINT)z0, 0, (UINT)x1 + 1, (UINT)z1 + 1, 1 };
+        const uint16_t* first = m_horizonMap.GetShading() + z0 * m_horizonMap.GetWidth() + x0;
+        context->UpdateSubresource(m_lightingTexture.Get(), 0, &box, first, m_horizonMap.GetWidth() * sizeof(uint16_t), 0);
+    }
+}
+
+//rescatters the trees and rocks over the ground, rebuilds their culling hierarchies and instance buffers
+void Game::UpdateScatter()
+{
+    auto device = m_deviceResources->GetD3DDevice();
+
+    std::vector<float> heights(64 * 64);
+    m_GroundTerrain.GetHeights(heights.data());
+
+    float low = *std::min_element(heights.begin(), heights.end());
+    float high = *std::max_element(heights.begin(), heights.end());
+    float range = std::max(high - low, 1e-3f);
+
+    //tree.obj is about 0.016 tall, so this makes them two to three grid squares. they keep to the gentler middle heights.
+    ObjectScatter::Layer trees;
+    trees.spacing = 3.0f;
+    trees.density = 0.6f;
+    trees.minHeight = low + range * 0.2f;
+    trees.maxHeight = low + range * 0.7f;
+    trees.heightBlend = range * 0.1f;
+    trees.maxSlope = 0.15f;
+    trees.slopeBlend = 0.05f;
+    trees.minScale = 130.0f;
+    trees.maxScale = 190.0f;
+    m_scatter.SetLayer(0, trees);
+
+    //rocks (the unit sphere) go anywhere, but mostly on the steeper ground
+    ObjectScatter::Layer rocks;
+    rocks.spacing = 2.0f;
+    rocks.density = 0.5f;
+    rocks.minSlope = 0.1f;
+    rocks.slopeBlend = 0.1f;
+    rocks.minScale = 0.3f;
+    rocks.maxScale = 0.8f;
+    m_scatter.SetLayer(1, rocks);
+
+    m_scatter.Generate(heights.data());
+
+    for (int layer = 0; layer < 2; layer++)
+    {
+        const std::vector<ObjectScatter::Instance>& instances = m_scatter.GetInstances(layer);
+
+        MeshData mesh;
+        float centerY, radius;
+        m_scatterModels[layer][0].GetMesh(mesh);
+        InstanceCuller::GetModelBounds(mesh, centerY, radius);
+        m_instanceCullers[layer].Build(instances.data(), instances.size(), centerY, radius, m_scatter.GetChunkSize());
+
+        m_instanceBuffers[layer].Reset();
+        memset(m_instanceLods[layer], 0, sizeof(m_instanceLods[layer]));
+        if (instances.empty())
+        {
+            continue;
+        }
+
+        //big enough for everything to be visible at once, CullScatter refills it each frame
+        D3D11_BUFFER_DESC desc = {};
+        desc.Usage = D3D11_USAGE_DYNAMIC;
+        desc.ByteWidth = (UINT)(instances.size() * sizeof(ObjectScatter::Instance));
+        desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        DX::ThrowIfFailed(device->CreateBuffer(&desc, nullptr, m_instanceBuffers[layer].ReleaseAndGetAddressOf()));
+    }
+}
+
+//culls the scattered objects against the camera straight into their instance buffers
+void Game::CullScatter(ID3D11DeviceContext* context)
+{
+    //the instances are in the ground's grid space, so the frustum and the eye are taken there too
+    Matrix world = m_GroundTerrain.GetWorldMatrix();
+    Vector3 eye = Vector3::Transform(m_Camera01.getPosition(), world.Invert());
+
+    InstanceCuller::View view;
+    view.SetFrustum(world * m_view * m_projection);
+    view.eyeX = eye.x;
+    view.eyeY = eye.y;
+    view.eyeZ = eye.z;
+    view.lodCount = SCATTER_LODS;
+    view.lodDistances[0] = m_scatterDistance * 0.25f;
+    view.lodDistances[1] = m_scatterDistance * 0.5f;
+    view.lodDistances[2] = m_scatterDistance;
+
+    for (int layer = 0; layer < 2; layer++)
+    {
+        memset(m_instanceLods[layer], 0, sizeof(m_instanceLods[layer]));
+        if (!m_instanceBuffers[layer])
+        {
+            continue;
+        }
+
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        if (FAILED(context->Map(m_instanceBuffers[layer].Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+        {
+            continue;
+        }
+        m_instanceCullers[layer].Cull(view, (ObjectScatter::Instance*)mapped.pData, m_instanceLods[layer]);
+        context->Unmap(m_instanceBuffers[layer].Get(), 0);
+    }
+}
+
+//everything derived from the ground's heights
+void Game::OnGroundChanged()
+{
+    m_groundHeightsVersion = m_GroundTerrain.GetHeightsVersion();
+    UpdateSplatMap();
+    UpdateTerrainLighting();
+    UpdateScatter();
+}
+
 void Game::SetupGUI()
 {
 	auto device = m_deviceResources->GetD3DDevice();
@@ -770,14 +1123,60 @@ void Game::SetupGUI()
 		//ImGui::SliderFloat("Wavelength",		m_Terrain.GetWavelength(), 0.0f, 1.0f);
 		ImGui::BeginChild("Noise Types");
 		{
+			//these run in the background and are swapped in by Update when they finish
 			if(ImGui::Button("Perlin Noise"))
-				m_WaterTerrain.GeneratePerlinNoise(device);
+				m_WaterTerrain.GenerateAsync(Terrain::GENERATOR_PERLIN);
 			if (ImGui::Button("Simplex Noise"))
-				m_WaterTerrain.GenerateSimplexNoise (device);
+				m_WaterTerrain.GenerateAsync(Terrain::GENERATOR_SIMPLEX);
 			if (ImGui::Button("GenerateWaves"))
-				m_WaterTerrain.Update(device); 
+				m_WaterTerrain.GenerateAsync(Terrain::GENERATOR_WAVES);
             if(ImGui::Button("Generate Random Height"))
-                m_WaterTerrain.GenerateHeightField(device);
+                m_WaterTerrain.GenerateAsync(Terrain::GENERATOR_RANDOM);
+            if (m_WaterTerrain.IsGenerating())
+                ImGui::Text("Generating...");
+            TerrainTileCache::Stats cacheStats = m_tileCache.GetStats();
+            ImGui::Text("Tile cache: %llu hits (%llu disk), %llu misses", (unsigned long long)(cacheStats.memoryHits + cacheStats.diskHits),
+                (unsigned long long)cacheStats.diskHits, (unsigned long long)cacheStats.misses);
+            ImGui::Text("%u tiles, %.1f KB in memory, %.1f KB read, %.1f KB written", cacheStats.memoryTiles, cacheStats.memoryBytes / 1024.0f,
+                cacheStats.diskBytesRead / 1024.0f, cacheStats.diskBytesWritten / 1024.0f);
+            if (ImGui::Button("Diamond Square"))
+                m_GroundTerrain.GenerateDiamondSquare(device, 0.55f, m_diamondSquareWrap);
+            if (ImGui::Button("Midpoint Displacement"))
+                m_GroundTerrain.GenerateDiamondSquare(device, 0.55f, m_diamondSquareWrap, DiamondSquare::MODE_MIDPOINT_DISPLACEMENT);
+            ImGui::Checkbox("Tileable", &m_diamondSquareWrap);
+            if (ImGui::Button("Carve Rivers"))
+                m_GroundTerrain.CarveRivers(device, 20.0f, 1.0f);
+            if (ImGui::Button("Save Terrain"))
+                m_WaterTerrain.SaveTileFile("terrain.ttf");
+            if (ImGui::Button("Load Terrain"))
+                m_WaterTerrain.LoadTileFile(device, "terrain.ttf");
+            if (ImGui::Button("Load Heightmap"))
+                m_GroundTerrain.LoadHeightMap(device, "heightmap.pgm", 10.0f);
+            if (ImGui::Button("Export Terrain"))
+                m_GroundTerrain.ExportMesh("terrain.ply");
+            if (ImGui::Button("Export Terrain LOD"))
+                m_GroundTerrain.ExportMesh("terrain_lod.ply", 0.25f);
+            if (ImGui::Button("Adaptive Mesh"))
+                m_GroundTerrain.BuildAdaptiveMesh(device, 0.05f);
+            //both of them write the water terrain, so only one can be on
+            if (ImGui::Checkbox("FFT Ocean", &m_oceanEnabled) && m_oceanEnabled)
+                m_shallowWaterEnabled = false;
+            if (ImGui::Checkbox("Shallow Water", &m_shallowWaterEnabled) && m_shallowWaterEnabled)
+                m_oceanEnabled = false;
+            if (ImGui::Button("Rain"))
+                m_shallowWater.Rain(8, 4.0f, 1.0f);
+            if (ImGui::Checkbox("Compact Vertices", &m_compactVertices))
+            {
+                m_WaterTerrain.SetCompactVertices(device, m_compactVertices);
+                m_GroundTerrain.SetCompactVertices(device, m_compactVertices);
+            }
+            ImGui::Checkbox("Splat Texturing", &m_splatEnabled);
+            ImGui::Checkbox("Scatter Objects", &m_scatterEnabled);
+            ImGui::SliderFloat("Object Distance", &m_scatterDistance, 8.0f, 128.0f);
+            ImGui::Text("Objects drawn: %u / %u / %u",
+                m_instanceLods[0][0].count + m_instanceLods[1][0].count,
+                m_instanceLods[0][1].count + m_instanceLods[1][1].count,
+                m_instanceLods[0][2].count + m_instanceLods[1][2].count);
             if (ImGui::Button("Post Process"))
                 m_postprocess = !m_postprocess;
 		}
@@ -12,6 +12,10 @@
 #include "Camera.h"
 #include "RenderTexture.h"
 #include "Terrain.h"
+#include "SplatMap.h"
+#include "HorizonMap.h"
+#include "ObjectScatter.h"
+#include "InstanceCuller.h"
 #include "ClassicNoise.h"
 #include "SimplexNoise.h"
 #include "PostProcess.h"
@@ -73,6 +77,13 @@ private:
 	void SetupGUI();
     void PostProcess();
     void GenerateVolumetricFogTexture(ID3D11ShaderResourceView** fogTexture);
+    void EnableTerrainShader(Terrain& terrain, ID3D11ShaderResourceView* texture, bool splat = false, ID3D11ShaderResourceView* lighting = nullptr);
+    void UpdateSplatMap();
+    void UpdateTerrainLighting();
+    DirectX::SimpleMath::Vector3 GetTowardsSun();
+    void UpdateScatter();
+    void CullScatter(ID3D11DeviceContext* context);
+    void OnGroundChanged();
 
     // Device resources.
     std::unique_ptr<DX::DeviceResources>    m_deviceResources;
@@ -109,6 +120,11 @@ private:
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>                        m_background;
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>                        m_Cloud;
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>                        m_water;
+    Microsoft::WRL::ComPtr<ID3D11Texture2D>                                 m_splatTexture;
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>                        m_splatView;
+    Microsoft::WRL::ComPtr<ID3D11Texture2D>                                 m_lightingTexture;
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>                        m_lightingView;
+    Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>                        m_treeTexture;
 
 
 
@@ -117,16 +133,40 @@ private:
 	Shader																	m_BasicShaderPair;
     Shader																	m_BasicShaderPair1;
     Shader                                                                  m_HorizontalBlur;
+    Shader                                                                  m_CompactShaderPair;
+    Shader                                                                  m_SplatShaderPair;
+    Shader                                                                  m_CompactSplatShaderPair;
+    Shader                                                                  m_LitShaderPair;
+    Shader                                                                  m_CompactLitShaderPair;
+    Shader                                                                  m_InstancedShaderPair;
 
 
 	//Scene. 
+    TerrainTileCache                                                        m_tileCache;	//before the terrains, their workers use it until they are destroyed
 	Terrain																	m_WaterTerrain;
     Terrain                                                                 m_GroundTerrain;
+    OceanFFT                                                                m_ocean;
+    ShallowWater                                                            m_shallowWater;
+    std::vector<float>                                                      m_shallowGround;    //ground heights handed to m_shallowWater each frame
+    SplatMap                                                                m_splatMap;
+    HorizonMap                                                              m_horizonMap;
+    std::vector<float>                                                      m_bakedHeights;     //what m_horizonMap was last baked from
+    DirectX::SimpleMath::Vector3                                            m_bakedSun;
 	ModelClass																m_BasicModel;
 	ModelClass																m_BasicModel2;
 	ModelClass																m_BasicModel3;
     ModelClass                                                              m_FullScreen;
 
+    //trees and rocks scattered over the ground. every frame each layer is culled into its own dynamic
+    //instance buffer, sorted by LOD, and each LOD is one instanced draw from its part of the buffer.
+    static const int SCATTER_LODS = 3;
+    ObjectScatter                                                           m_scatter;
+    ModelClass                                                              m_scatterModels[2][SCATTER_LODS];	//[layer][lod], trees then rocks
+    InstanceCuller                                                          m_instanceCullers[2];
+    InstanceCuller::LodRange                                                m_instanceLods[2][SCATTER_LODS] = {};
+    Microsoft::WRL::ComPtr<ID3D11Buffer>                                    m_instanceBuffers[2];
+    float                                                                   m_scatterDistance = 64.0f;	//grid units, the LODs change at a quarter and a half of it
+
 	//RenderTextures
 	RenderTexture*															m_FirstRenderPass;
     RenderTexture*                                                          m_offscreenTexture;
@@ -160,6 +200,13 @@ private:
 
     bool                                                                    m_retryDefault;
     bool                                                                    m_postprocess = false;
+    bool                                                                    m_compactVertices = false;
+    bool                                                                    m_oceanEnabled = false;
+    bool                                                                    m_shallowWaterEnabled = false;
+    bool                                                                    m_diamondSquareWrap = false;
+    bool                                                                    m_splatEnabled = false;
+    bool                                                                    m_scatterEnabled = true;
+    unsigned int                                                            m_groundHeightsVersion = 0;
 
 
 
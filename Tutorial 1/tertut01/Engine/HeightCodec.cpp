@@ -0,0 +1,770 @@
+#include "pch.h"
+#include "HeightCodec.h"
+#include "ParallelFor.h"
+#include "DiamondSquare.h"
+#include "Philox.h"
+#include <emmintrin.h>
+#include <chrono>
+#include <atomic>
+
+namespace
+{
+	const uint32_t MAGIC = 0x31544348;		//"HCT1"
+
+	//rANS with 12 bit probabilities and a 32 bit state kept in [L, L << 16), renormalised 16 bits at a time.
+	//a step never needs more than one refill, so the decoder does it without a branch.
+	const int PROB_BITS = 12;
+	const uint32_t PROB_SCALE = 1 << PROB_BITS;
+	const uint32_t RANS_L = 1u << 16;
+
+	//0..15 are literal residuals, after that two tokens per bit length up to 31
+	const int DIRECT_TOKENS = 16;
+	const int TOKEN_COUNT = DIRECT_TOKENS + 28 * 2;
+
+#pragma pack(push, 1)
+	struct StreamHeader
+	{
+		uint32_t magic;
+		uint16_t width, height;
+		uint8_t format;
+		uint8_t symbolCount;		//frequencies stored for tokens below this
+		uint16_t reserved;
+		uint32_t ransBytes;
+		uint32_t bitBytes;
+	};
+#pragma pack(pop)
+
+	inline int HighestBit(uint32_t v)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse(&index, v);
+		return (int)index;
+#else
+		return 31 - __builtin_clz(v);
+#endif
+	}
+
+	//floats as integers in the same order: positives already are, negatives get their magnitude bits flipped.
+	//the same xor undoes it.
+	inline int32_t FloatToOrdered(uint32_t bits)
+	{
+		return (int32_t)(bits ^ ((uint32_t)((int32_t)bits >> 31) & 0x7FFFFFFFu));
+	}
+
+	inline int32_t Median(int32_t a, int32_t b, int32_t c)
+	{
+		int32_t gradient = (int32_t)((uint32_t)a + (uint32_t)b - (uint32_t)c);
+		return std::max(std::min(a, b), std::min(std::max(a, b), gradient));
+	}
+
+	inline uint32_t ZigZag(int32_t r)
+	{
+		return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+	}
+
+	inline int32_t UnZigZag(uint32_t v)
+	{
+		return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+	}
+
+	inline __m128i Min32(__m128i a, __m128i b)
+	{
+		__m128i greater = _mm_cmpgt_epi32(a, b);
+		return _mm_or_si128(_mm_and_si128(greater, b), _mm_andnot_si128(greater, a));
+	}
+
+	inline __m128i Max32(__m128i a, __m128i b)
+	{
+		__m128i greater = _mm_cmpgt_epi32(a, b);
+		return _mm_or_si128(_mm_and_si128(greater, a), _mm_andnot_si128(greater, b));
+	}
+
+	class BitWriter
+	{
+	public:
+		BitWriter(std::vector<uint8_t>& out) : m_out(out), m_buffer(0), m_count(0) {}
+
+		void Write(uint32_t value, int bits)
+		{
+			m_buffer |= (uint64_t)value << m_count;
+			m_count += bits;
+			while (m_count >= 8)
+			{
+				m_out.push_back((uint8_t)m_buffer);
+				m_buffer >>= 8;
+				m_count -= 8;
+			}
+		}
+
+		void Flush()
+		{
+			if (m_count > 0)
+			{
+				m_out.push_back((uint8_t)m_buffer);
+			}
+			m_buffer = 0;
+			m_count = 0;
+		}
+
+	private:
+		std::vector<uint8_t>& m_out;
+		uint64_t m_buffer;
+		int m_count;
+	};
+
+	//reads by peeking 8 bytes at the current byte and shifting, so there's no refill branch in the way
+	class BitReader
+	{
+	public:
+		BitReader(const uint8_t* data, size_t size) : m_data(data), m_size(size), m_position(0) {}
+
+		//bits is at most 31, zeros past the end
+		uint32_t Read(uint32_t bits)
+		{
+			size_t byte = m_position >> 3;
+			uint64_t word = 0;
+			if (byte + 8 <= m_size)
+			{
+				memcpy(&word, m_data + byte, 8);
+			}
+			else
+			{
+				for (size_t k = 0; k < 8 && byte + k < m_size; k++)
+				{
+					word |= (uint64_t)m_data[byte + k] << (k * 8);
+				}
+			}
+
+			uint32_t value = (uint32_t)((word >> (m_position & 7)) & ((1ull << bits) - 1));
+			m_position += bits;
+			return value;
+		}
+
+		bool Overrun() const { return m_position > m_size * 8; }
+
+	private:
+		const uint8_t* m_data;
+		size_t m_size;
+		size_t m_position;		//in bits
+	};
+
+	inline void PutVarint(std::vector<uint8_t>& out, uint32_t value)
+	{
+		while (value >= 0x80)
+		{
+			out.push_back((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back((uint8_t)value);
+	}
+
+	inline bool GetVarint(const uint8_t*& p, const uint8_t* end, uint32_t& value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 35; shift += 7)
+		{
+			if (p >= end)
+			{
+				return false;
+			}
+			uint8_t byte = *p++;
+			value |= (uint32_t)(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	//scales the counts to add up to PROB_SCALE, keeping every used token at least 1
+	void NormaliseFrequencies(const uint32_t* counts, size_t total, uint32_t* freqs)
+	{
+		uint32_t sum = 0;
+		int largest = 0;
+		for (int s = 0; s < TOKEN_COUNT; s++)
+		{
+			freqs[s] = 0;
+			if (counts[s] > 0)
+			{
+				freqs[s] = std::max<uint32_t>(1, (uint32_t)((uint64_t)counts[s] * PROB_SCALE / total));
+				sum += freqs[s];
+				if (freqs[s] > freqs[largest])
+				{
+					largest = s;
+				}
+			}
+		}
+
+		if (sum < PROB_SCALE)
+		{
+			freqs[largest] += PROB_SCALE - sum;
+			return;
+		}
+
+		//rounding the rare ones up to 1 can overshoot, take it back from whichever is biggest
+		while (sum > PROB_SCALE)
+		{
+			int biggest = 0;
+			for (int s = 1; s < TOKEN_COUNT; s++)
+			{
+				if (freqs[s] > freqs[biggest])
+				{
+					biggest = s;
+				}
+			}
+			freqs[biggest]--;
+			sum--;
+		}
+	}
+
+	//residuals of a whole tile, which only needs the samples themselves so it runs four at a time
+	void Predict(const int32_t* samples, int width, int height, uint32_t* residuals)
+	{
+		int32_t previous = 0;
+		for (int i = 0; i < width; i++)
+		{
+			residuals[i] = ZigZag((int32_t)((uint32_t)samples[i] - (uint32_t)previous));
+			previous = samples[i];
+		}
+
+		for (int j = 1; j < height; j++)
+		{
+			const int32_t* row = samples + (size_t)j * width;
+			const int32_t* above = row - width;
+			uint32_t* out = residuals + (size_t)j * width;
+
+			out[0] = ZigZag((int32_t)((uint32_t)row[0] - (uint32_t)above[0]));
+
+			int i = 1;
+			for (; i + 4 <= width; i += 4)
+			{
+				__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i - 1));
+				__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + i));
+				__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + i - 1));
+				__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+
+				__m128i gradient = _mm_sub_epi32(_mm_add_epi32(a, b), c);
+				__m128i prediction = Max32(Min32(a, b), Min32(Max32(a, b), gradient));
+				__m128i r = _mm_sub_epi32(x, prediction);
+				__m128i zigzag = _mm_xor_si128(_mm_slli_epi32(r, 1), _mm_srai_epi32(r, 31));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), zigzag);
+			}
+			for (; i < width; i++)
+			{
+				out[i] = ZigZag((int32_t)((uint32_t)row[i] - (uint32_t)Median(row[i - 1], above[i], above[i - 1])));
+			}
+		}
+	}
+
+	void EncodeSamples(const std::vector<int32_t>& samples, int width, int height, HeightCodec::Format format, std::vector<uint8_t>& out)
+	{
+		size_t count = (size_t)width * height;
+		std::vector<uint32_t> residuals(count);
+		Predict(samples.data(), width, height, residuals.data());
+
+		//tokens forwards, with their raw bits straight into their own stream
+		std::vector<uint8_t> tokens(count);
+		std::vector<uint8_t> bits;
+		bits.reserve(count / 2);
+		BitWriter bitWriter(bits);
+		uint32_t counts[TOKEN_COUNT] = {};
+		for (size_t i = 0; i < count; i++)
+		{
+			uint32_t v = residuals[i];
+			int token = (int)v;
+			if (v >= DIRECT_TOKENS)
+			{
+				int e = HighestBit(v);
+				token = DIRECT_TOKENS + (e - 4) * 2 + (int)((v >> (e - 1)) & 1);
+				bitWriter.Write(v & ((1u << (e - 1)) - 1), e - 1);
+			}
+			tokens[i] = (uint8_t)token;
+			counts[token]++;
+		}
+		bitWriter.Flush();
+
+		uint32_t freqs[TOKEN_COUNT], starts[TOKEN_COUNT];
+		int symbolCount = 0;
+		if (count > 0)
+		{
+			NormaliseFrequencies(counts, count, freqs);
+		}
+		else
+		{
+			memset(freqs, 0, sizeof(freqs));
+		}
+		uint32_t start = 0;
+		for (int s = 0; s < TOKEN_COUNT; s++)
+		{
+			starts[s] = start;
+			start += freqs[s];
+			if (freqs[s] > 0)
+			{
+				symbolCount = s + 1;
+			}
+		}
+
+		//rANS runs backwards so the decoder gets the tokens in order. even columns use one state and odd columns
+		//the other, so the decoder can keep both in registers.
+		std::vector<uint8_t> rans(count * 2 + 8);
+		uint8_t* end = rans.data() + rans.size();
+		uint8_t* p = end;
+		uint32_t states[2] = { RANS_L, RANS_L };
+		for (size_t i = count; i-- > 0;)
+		{
+			uint32_t& x = states[(i % width) & 1];
+			uint32_t freq = freqs[tokens[i]];
+			uint64_t limit = (uint64_t)((RANS_L >> PROB_BITS) << 16) * freq;
+			if (x >= limit)
+			{
+				p -= 2;
+				p[0] = (uint8_t)x;
+				p[1] = (uint8_t)(x >> 8);
+				x >>= 16;
+			}
+			x = ((x / freq) << PROB_BITS) + (x % freq) + starts[tokens[i]];
+		}
+		for (int s = 1; s >= 0; s--)
+		{
+			p -= 4;
+			p[0] = (uint8_t)states[s];
+			p[1] = (uint8_t)(states[s] >> 8);
+			p[2] = (uint8_t)(states[s] >> 16);
+			p[3] = (uint8_t)(states[s] >> 24);
+		}
+
+		StreamHeader header;
+		header.magic = MAGIC;
+		header.width = (uint16_t)width;
+		header.height = (uint16_t)height;
+		header.format = (uint8_t)format;
+		header.symbolCount = (uint8_t)symbolCount;
+		header.reserved = 0;
+		header.ransBytes = (uint32_t)(end - p);
+		header.bitBytes = (uint32_t)bits.size();
+
+		out.clear();
+		out.reserve(sizeof(header) + symbolCount * 2 + header.ransBytes + header.bitBytes);
+		out.insert(out.end(), (const uint8_t*)&header, (const uint8_t*)&header + sizeof(header));
+		for (int s = 0; s < symbolCount; s++)
+		{
+			PutVarint(out, freqs[s]);
+		}
+		out.insert(out.end(), p, end);
+		out.insert(out.end(), bits.begin(), bits.end());
+	}
+
+	//what the decoder needs for one slot of the probability range, packed into a word so the whole table
+	//(16KB) stays in L1: frequency in the low 13 bits, slot - start of the token in the next 12, the token on top
+	inline uint32_t PackSlot(uint32_t freq, uint32_t bias, uint32_t token)
+	{
+		return freq | (bias << 13) | (token << 25);
+	}
+
+	struct Token
+	{
+		uint32_t base;		//the residual with its raw bits all zero
+		uint32_t bits;		//how many raw bits follow
+	};
+
+	//decodes a row at a time into two rows of integers, and hands each finished row to store(j, row)
+	template<typename Store>
+	bool DecodeSamples(const uint8_t* data, size_t size, HeightCodec::Format format, int width, int height, Store store)
+	{
+		StreamHeader header;
+		if (size < sizeof(header))
+		{
+			return false;
+		}
+		memcpy(&header, data, sizeof(header));
+		if (header.magic != MAGIC || header.format != format || header.width != width || header.height != height ||
+			header.symbolCount > TOKEN_COUNT)
+		{
+			return false;
+		}
+
+		const uint8_t* p = data + sizeof(header);
+		const uint8_t* end = data + size;
+
+		uint32_t freqs[TOKEN_COUNT] = {}, starts[TOKEN_COUNT] = {};
+		uint32_t total = 0;
+		for (int s = 0; s < header.symbolCount; s++)
+		{
+			if (!GetVarint(p, end, freqs[s]) || freqs[s] > PROB_SCALE)
+			{
+				return false;
+			}
+			starts[s] = total;
+			total += freqs[s];
+		}
+
+		size_t count = (size_t)width * height;
+		if ((count > 0 && total != PROB_SCALE) || (size_t)(end - p) != (size_t)header.ransBytes + header.bitBytes || header.ransBytes < 8 || (header.ransBytes & 1))
+		{
+			return false;
+		}
+		if (count == 0)
+		{
+			return true;
+		}
+
+		uint32_t slots[PROB_SCALE];
+		Token tokens[TOKEN_COUNT];
+		for (int s = 0; s < header.symbolCount; s++)
+		{
+			tokens[s].base = (uint32_t)s;
+			tokens[s].bits = 0;
+			if (s >= DIRECT_TOKENS)
+			{
+				int e = 4 + (s - DIRECT_TOKENS) / 2;
+				tokens[s].base = (1u << e) | ((uint32_t)(s & 1) << (e - 1));
+				tokens[s].bits = e - 1;
+			}
+			for (uint32_t k = 0; k < freqs[s]; k++)
+			{
+				slots[starts[s] + k] = PackSlot(freqs[s], k, s);
+			}
+		}
+
+		//in 16 bit words from here. running off the end feeds zeros and is caught by the position check at the end.
+		const uint8_t* rans = p;
+		size_t ransWords = header.ransBytes / 2;
+		size_t position = 4;
+		uint32_t x0 = (uint32_t)rans[0] | ((uint32_t)rans[1] << 8) | ((uint32_t)rans[2] << 16) | ((uint32_t)rans[3] << 24);
+		uint32_t x1 = (uint32_t)rans[4] | ((uint32_t)rans[5] << 8) | ((uint32_t)rans[6] << 16) | ((uint32_t)rans[7] << 24);
+		BitReader bitReader(rans + header.ransBytes, header.bitBytes);
+
+		auto next = [&](uint32_t& x) -> int32_t
+		{
+			uint32_t slot = slots[x & (PROB_SCALE - 1)];
+			x = (slot & 0x1FFF) * (x >> PROB_BITS) + ((slot >> 13) & 0xFFF);
+
+			uint32_t word = position < ransWords ? (uint32_t)rans[position * 2] | ((uint32_t)rans[position * 2 + 1] << 8) : 0;
+			bool refill = x < RANS_L;
+			x = refill ? (x << 16) | word : x;
+			position += refill;
+
+			const Token& token = tokens[slot >> 25];
+			return UnZigZag(token.base | bitReader.Read(token.bits));
+		};
+
+		std::vector<int32_t> rows((size_t)width * 2);
+		int32_t* row = rows.data();
+		int32_t* above = row + width;
+
+		for (int j = 0; j < height; j++)
+		{
+			//the first row only has its left neighbour and the first column only the one above
+			row[0] = (int32_t)((uint32_t)(j > 0 ? above[0] : 0) + (uint32_t)next(x0));
+			if (j == 0)
+			{
+				for (int i = 1; i < width; i++)
+				{
+					row[i] = (int32_t)((uint32_t)row[i - 1] + (uint32_t)next((i & 1) ? x1 : x0));
+				}
+			}
+			else
+			{
+				int i = 1;
+				for (; i + 1 < width; i += 2)
+				{
+					row[i] = (int32_t)((uint32_t)Median(row[i - 1], above[i], above[i - 1]) + (uint32_t)next(x1));
+					row[i + 1] = (int32_t)((uint32_t)Median(row[i], above[i + 1], above[i]) + (uint32_t)next(x0));
+				}
+				if (i < width)
+				{
+					row[i] = (int32_t)((uint32_t)Median(row[i - 1], above[i], above[i - 1]) + (uint32_t)next(x1));
+				}
+			}
+
+			store(j, row);
+			std::swap(row, above);
+		}
+
+		//a good stream ends exactly where both parts do
+		return position == ransWords && !bitReader.Overrun() && x0 == RANS_L && x1 == RANS_L;
+	}
+}
+
+
+void HeightCodec::Encode(const float* heights, int width, int height, int stride, std::vector<uint8_t>& out)
+{
+	std::vector<int32_t> samples((size_t)width * height);
+	for (int j = 0; j < height; j++)
+	{
+		const uint32_t* source = (const uint32_t*)(heights + (size_t)j * stride);
+		for (int i = 0; i < width; i++)
+		{
+			samples[(size_t)j * width + i] = FloatToOrdered(source[i]);
+		}
+	}
+	EncodeSamples(samples, width, height, FORMAT_FLOAT, out);
+}
+
+void HeightCodec::Encode(const uint16_t* heights, int width, int height, int stride, std::vector<uint8_t>& out)
+{
+	std::vector<int32_t> samples((size_t)width * height);
+	for (int j = 0; j < height; j++)
+	{
+		for (int i = 0; i < width; i++)
+		{
+			samples[(size_t)j * width + i] = heights[(size_t)j * stride + i];
+		}
+	}
+	EncodeSamples(samples, width, height, FORMAT_UINT16, out);
+}
+
+bool HeightCodec::Decode(const uint8_t* data, size_t size, float* heights, int width, int height, int stride)
+{
+	return DecodeSamples(data, size, FORMAT_FLOAT, width, height, [&](int j, const int32_t* row)
+	{
+		uint32_t* target = (uint32_t*)(heights + (size_t)j * stride);
+		for (int i = 0; i < width; i++)
+		{
+			target[i] = (uint32_t)FloatToOrdered((uint32_t)row[i]);
+		}
+	});
+}
+
+bool HeightCodec::Decode(const uint8_t* data, size_t size, uint16_t* heights, int width, int height, int stride)
+{
+	return DecodeSamples(data, size, FORMAT_UINT16, width, height, [&](int j, const int32_t* row)
+	{
+		uint16_t* target = heights + (size_t)j * stride;
+		for (int i = 0; i < width; i++)
+		{
+			target[i] = (uint16_t)row[i];
+		}
+	});
+}
+
+bool HeightCodec::GetInfo(const uint8_t* data, size_t size, int& width, int& height, Format& format)
+{
+	StreamHeader header;
+	if (size < sizeof(header))
+	{
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != MAGIC || header.format > FORMAT_UINT16)
+	{
+		return false;
+	}
+
+	width = header.width;
+	height = header.height;
+	format = (Format)header.format;
+	return true;
+}
+
+void HeightCodec::EncodeTiles(const float* heights, int width, int height, int tileSize, std::vector<std::vector<uint8_t>>& tiles, int threadCount)
+{
+	int tilesX = (width + tileSize - 1) / tileSize;
+	int tilesZ = (height + tileSize - 1) / tileSize;
+	tiles.resize((size_t)tilesX * tilesZ);
+
+	ParallelFor(0, tilesX * tilesZ, [&](int t)
+	{
+		int x0 = (t % tilesX) * tileSize;
+		int z0 = (t / tilesX) * tileSize;
+		Encode(heights + (size_t)z0 * width + x0, std::min(tileSize, width - x0), std::min(tileSize, height - z0), width, tiles[t]);
+	}, threadCount);
+}
+
+bool HeightCodec::DecodeTiles(const std::vector<std::vector<uint8_t>>& tiles, int width, int height, int tileSize, float* heights, int threadCount)
+{
+	int tilesX = (width + tileSize - 1) / tileSize;
+	int tilesZ = (height + tileSize - 1) / tileSize;
+	if (tiles.size() != (size_t)tilesX * tilesZ)
+	{
+		return false;
+	}
+
+	std::atomic<bool> failed(false);
+	ParallelFor(0, tilesX * tilesZ, [&](int t)
+	{
+		int x0 = (t % tilesX) * tileSize;
+		int z0 = (t / tilesX) * tileSize;
+		if (!Decode(tiles[t].data(), tiles[t].size(), heights + (size_t)z0 * width + x0,
+			std::min(tileSize, width - x0), std::min(tileSize, height - z0), width))
+		{
+			failed = true;
+		}
+	}, threadCount);
+
+	return !failed;
+}
+
+HeightCodec::BenchmarkResult HeightCodec::Benchmark(int size, int tileSize, int iterations, int threadCount)
+{
+	int grid = 2;
+	while (grid + 1 < size)
+	{
+		grid *= 2;
+	}
+	grid += 1;
+
+	DiamondSquare::Settings settings;
+	settings.amplitude = (float)size * 0.1f;
+	settings.roughness = 0.6f;
+	settings.threadCount = threadCount;
+	std::vector<float> generated((size_t)grid * grid);
+	DiamondSquare::Generate(generated.data(), grid, grid, settings);
+
+	std::vector<float> heights((size_t)size * size);
+	for (int z = 0; z < size; z++)
+	{
+		std::copy(&generated[(size_t)z * grid], &generated[(size_t)z * grid] + size, &heights[(size_t)z * size]);
+	}
+
+	BenchmarkResult result;
+	memset(&result, 0, sizeof(result));
+	result.rawBytes = heights.size() * sizeof(float);
+	iterations = std::max(iterations, 1);
+
+	std::vector<std::vector<uint8_t>> tiles;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		EncodeTiles(heights.data(), size, size, tileSize, tiles, threadCount);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	double encodeSeconds = std::chrono::duration<double>(end - start).count() / iterations;
+
+	for (size_t t = 0; t < tiles.size(); t++)
+	{
+		result.storedBytes += tiles[t].size();
+	}
+
+	std::vector<float> decoded(heights.size());
+	start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		DecodeTiles(tiles, size, size, tileSize, decoded.data(), threadCount);
+	}
+	end = std::chrono::high_resolution_clock::now();
+	double decodeSeconds = std::chrono::duration<double>(end - start).count() / iterations;
+
+	result.ratio = result.storedBytes > 0 ? (double)result.rawBytes / result.storedBytes : 0.0;
+	result.encodeGBs = encodeSeconds > 0.0 ? result.rawBytes / encodeSeconds * 1e-9 : 0.0;
+	result.decodeGBs = decodeSeconds > 0.0 ? result.rawBytes / decodeSeconds * 1e-9 : 0.0;
+	return result;
+}
+
+size_t HeightCodec::TestRoundTrip(int threadCount)
+{
+	size_t failures = 0;
+	Philox random(44);
+
+	//bit for bit, so -0, denormals and the like have to survive too
+	auto same = [](const void* a, const void* b, size_t bytes) { return memcmp(a, b, bytes) == 0 ? 0 : 1; };
+
+	const int SIZE = 97;		//not a multiple of the tile size or of four
+	std::vector<float> flat((size_t)SIZE * SIZE, 3.25f);
+	std::vector<float> noisy((size_t)SIZE * SIZE);
+	for (size_t i = 0; i < noisy.size(); i++)
+	{
+		//any bit pattern that isn't a NaN: both signs, zeros, denormals, huge values
+		uint32_t bits = random.Get((int)i, 0, 0);
+		if ((bits & 0x7F800000) == 0x7F800000)
+		{
+			bits &= 0xFF7FFFFF;
+		}
+		memcpy(&noisy[i], &bits, sizeof(bits));
+	}
+	std::vector<float> terrain((size_t)SIZE * SIZE);
+	DiamondSquare::Settings settings;
+	settings.amplitude = 40.0f;
+	settings.roughness = 0.6f;
+	settings.seed = 44;
+	DiamondSquare::Generate(terrain.data(), SIZE, SIZE, settings);
+	for (size_t i = 0; i < terrain.size(); i += 7)
+	{
+		terrain[i] = -terrain[i];	//plenty of sign changes between neighbours
+	}
+
+	const std::vector<float>* maps[] = { &flat, &noisy, &terrain };
+	std::vector<float> decoded;
+	std::vector<uint8_t> stream;
+	std::vector<std::vector<uint8_t>> tiles;
+	for (const std::vector<float>* map : maps)
+	{
+		//tiled, with edge tiles of every shape
+		const int tileSizes[] = { 1, 16, 33, SIZE };
+		for (int tileSize : tileSizes)
+		{
+			decoded.assign(map->size(), 0.0f);
+			EncodeTiles(map->data(), SIZE, SIZE, tileSize, tiles, threadCount);
+			failures += DecodeTiles(tiles, SIZE, SIZE, tileSize, decoded.data(), threadCount) ? 0 : 1;
+			failures += same(decoded.data(), map->data(), map->size() * sizeof(float));
+		}
+
+		//single rows, columns and samples out of the middle, read and written through a stride
+		const int shapes[][2] = { { 1, 1 }, { SIZE - 3, 1 }, { 1, SIZE - 3 }, { 5, 6 } };
+		for (const auto& shape : shapes)
+		{
+			const float* source = map->data() + SIZE + 1;
+			Encode(source, shape[0], shape[1], SIZE, stream);
+			decoded.assign(map->size(), 0.0f);
+			failures += Decode(stream.data(), stream.size(), decoded.data(), shape[0], shape[1], SIZE) ? 0 : 1;
+			for (int z = 0; z < shape[1]; z++)
+			{
+				failures += same(&decoded[(size_t)z * SIZE], source + (size_t)z * SIZE, shape[0] * sizeof(float));
+			}
+		}
+	}
+
+	//16 bit, the full range and a gentle slope
+	std::vector<uint16_t> words((size_t)SIZE * SIZE), decodedWords(words.size());
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (size_t i = 0; i < words.size(); i++)
+		{
+			words[i] = pass == 0 ? (uint16_t)random.Get((int)i, 1, 0) : (uint16_t)(30000 + (i % SIZE) * 3 + (i / SIZE) * 5);
+		}
+		Encode(words.data(), SIZE, SIZE, SIZE, stream);
+		failures += Decode(stream.data(), stream.size(), decodedWords.data(), SIZE, SIZE, SIZE) ? 0 : 1;
+		failures += same(decodedWords.data(), words.data(), words.size() * sizeof(uint16_t));
+	}
+
+	//damaged streams, from a terrain tile. every truncation, a byte too many and the wrong shape or format.
+	Encode(terrain.data(), 24, 24, SIZE, stream);
+	decoded.assign((size_t)24 * 24, 0.0f);
+	for (size_t length = 0; length < stream.size(); length++)
+	{
+		failures += Decode(stream.data(), length, decoded.data(), 24, 24, 24) ? 1 : 0;
+	}
+	std::vector<uint8_t> damaged = stream;
+	damaged.push_back(0);
+	failures += Decode(damaged.data(), damaged.size(), decoded.data(), 24, 24, 24) ? 1 : 0;
+	failures += Decode(stream.data(), stream.size(), decoded.data(), 24, 23, 24) ? 1 : 0;
+	failures += Decode(stream.data(), stream.size(), decodedWords.data(), 24, 24, 24) ? 1 : 0;
+
+	//and bytes flipped in the header, the frequency table and the starting rANS states, which all have to be
+	//caught. (raw residual bits carry no redundancy, so a flip there just gives different heights.)
+	int width, height;
+	Format format;
+	const uint8_t* p = stream.data() + sizeof(StreamHeader);
+	uint32_t frequency;
+	for (int s = 0; s < stream[offsetof(StreamHeader, symbolCount)]; s++)
+	{
+		GetVarint(p, stream.data() + stream.size(), frequency);
+	}
+	size_t checked = (size_t)(p - stream.data()) + 8;
+	for (size_t i = 0; i < checked; i++)
+	{
+		if (i >= offsetof(StreamHeader, reserved) && i < offsetof(StreamHeader, ransBytes))
+		{
+			continue;	//unused
+		}
+		damaged = stream;
+		damaged[i] ^= 0x5A;
+		bool decodedOk = Decode(damaged.data(), damaged.size(), decoded.data(), 24, 24, 24);
+		failures += decodedOk ? 1 : 0;
+	}
+	failures += GetInfo(stream.data(), stream.size(), width, height, format) && width == 24 && height == 24 && format == FORMAT_FLOAT ? 0 : 1;
+
+	return failures;
+}
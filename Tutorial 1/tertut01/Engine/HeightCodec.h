@@ -0,0 +1,57 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+
+//Lossless compression for heightfield tiles, float or 16 bit.
+//
+//Every sample is predicted from its left, upper and upper left neighbours with the MED predictor (from LOCO-I /
+//JPEG-LS): the median of left, up and left + up - upper left. That follows ridges and slopes without smearing
+//across edges, so on terrain the residuals are tiny. Floats are first turned into integers that sort the same
+//way (flip the magnitude bits of negatives), so nearby heights give nearby integers and nothing is rounded.
+//The residuals for a whole tile come from the already known neighbours, so the encoder predicts four at a time
+//with SSE. The decoder needs each left neighbour before the next sample, so it predicts one at a time as it goes.
+//
+//Residuals are zigzagged and split into a token and some raw bits: small values are their own token, larger ones
+//store their bit length and the next bit down in the token and the rest raw. Tokens are entropy coded with rANS
+//(two interleaved states so the decoder has two independent chains to overlap) against a frequency table stored
+//with the tile. The raw bits go in a separate plain bit stream.
+//
+//Each tile is one self contained stream, so any tile can be decoded on its own, and the tiled helpers run one
+//tile per thread.
+
+class HeightCodec
+{
+public:
+	enum Format
+	{
+		FORMAT_FLOAT = 0,
+		FORMAT_UINT16 = 1,
+	};
+
+	struct BenchmarkResult
+	{
+		size_t rawBytes, storedBytes;
+		double ratio;					//raw / stored
+		double encodeGBs, decodeGBs;	//raw bytes per second
+	};
+
+	//one tile, stride is in samples. width and height are at most 65535.
+	static void Encode(const float* heights, int width, int height, int stride, std::vector<uint8_t>& out);
+	static void Encode(const uint16_t* heights, int width, int height, int stride, std::vector<uint8_t>& out);
+	//fails if the data is damaged, in the other format or not width * height (GetInfo says what it is)
+	static bool Decode(const uint8_t* data, size_t size, float* heights, int width, int height, int stride);
+	static bool Decode(const uint8_t* data, size_t size, uint16_t* heights, int width, int height, int stride);
+	//what an encoded tile holds, without decoding it
+	static bool GetInfo(const uint8_t* data, size_t size, int& width, int& height, Format& format);
+
+	//cuts a width * height map into tileSize tiles (smaller on the right and bottom edges), row major
+	static void EncodeTiles(const float* heights, int width, int height, int tileSize, std::vector<std::vector<uint8_t>>& tiles, int threadCount = 0);
+	static bool DecodeTiles(const std::vector<std::vector<uint8_t>>& tiles, int width, int height, int tileSize, float* heights, int threadCount = 0);
+
+	//compresses a diamond square terrain of size * size floats
+	static BenchmarkResult Benchmark(int size, int tileSize, int iterations = 4, int threadCount = 0);
+
+	//flat, noisy and terrain maps (float and 16 bit, odd sizes, strided tiles) must come back bit for bit, and
+	//truncated, extended or damaged streams must be refused. returns the number of failures.
+	static size_t TestRoundTrip(int threadCount = 0);
+};
@@ -0,0 +1,442 @@
+#include "pch.h"
+#include "HeightmapImporter.h"
+#include "TerrainTileFile.h"
+#include "ParallelFor.h"
+#include <ctype.h>
+
+namespace
+{
+	//how many source rows we are happy to keep decoded at once
+	const int SOURCE_ROW_BUDGET = 256;
+
+	float CubicWeight(float t)
+	{
+		//Catmull-Rom (a = -0.5)
+		t = fabsf(t);
+		if (t < 1.0f)
+		{
+			return (1.5f * t - 2.5f) * t * t + 1.0f;
+		}
+		if (t < 2.0f)
+		{
+			return ((-0.5f * t + 2.5f) * t - 4.0f) * t + 2.0f;
+		}
+		return 0.0f;
+	}
+
+	//reads one whitespace separated header token, skipping # comments
+	bool ReadPgmToken(FILE* file, char* token, int size)
+	{
+		int c = fgetc(file);
+		while (c != EOF)
+		{
+			if (c == '#')
+			{
+				while (c != EOF && c != '\n')
+				{
+					c = fgetc(file);
+				}
+			}
+			else if (!isspace(c))
+			{
+				break;
+			}
+			c = fgetc(file);
+		}
+
+		int length = 0;
+		while (c != EOF && !isspace(c) && length < size - 1)
+		{
+			token[length++] = (char)c;
+			c = fgetc(file);
+		}
+		token[length] = 0;
+		//the single whitespace after the last header token has been consumed, which is what the format wants
+		return length > 0;
+	}
+}
+
+
+HeightmapImporter::HeightmapImporter()
+{
+	m_file = 0;
+	m_width = m_height = 0;
+	m_bytesPerSample = 2;
+	m_bigEndian = false;
+	m_maxValue = 65535.0f;
+	m_dataOffset = 0;
+	m_windowFirstRow = 0;
+	m_nextRow = 0;
+}
+
+HeightmapImporter::~HeightmapImporter()
+{
+	Close();
+}
+
+bool HeightmapImporter::OpenRaw(const char* filename, int width, int height, bool bigEndian)
+{
+	errno_t err;
+
+	Close();
+
+	err = fopen_s(&m_file, filename, "rb");
+	if (err != 0)
+	{
+		m_file = 0;
+		return false;
+	}
+
+	if (width <= 0 || height <= 0)
+	{
+		//most RAW heightmaps are square, so guess from the file size
+		_fseeki64(m_file, 0, SEEK_END);
+		int64_t samples = _ftelli64(m_file) / 2;
+		_fseeki64(m_file, 0, SEEK_SET);
+
+		width = height = (int)(sqrt((double)samples) + 0.5);
+		if ((int64_t)width * height != samples)
+		{
+			Close();
+			return false;
+		}
+	}
+
+	m_width = width;
+	m_height = height;
+	m_bytesPerSample = 2;
+	m_bigEndian = bigEndian;
+	m_maxValue = 65535.0f;
+	m_dataOffset = 0;
+	return true;
+}
+
+bool HeightmapImporter::OpenPgm(const char* filename)
+{
+	errno_t err;
+	char token[32];
+
+	Close();
+
+	err = fopen_s(&m_file, filename, "rb");
+	if (err != 0)
+	{
+		m_file = 0;
+		return false;
+	}
+
+	//only the binary greymap variant
+	if (!ReadPgmToken(m_file, token, sizeof(token)) || strcmp(token, "P5") != 0)
+	{
+		Close();
+		return false;
+	}
+
+	int values[3];
+	for (int i = 0; i < 3; i++)
+	{
+		if (!ReadPgmToken(m_file, token, sizeof(token)))
+		{
+			Close();
+			return false;
+		}
+		values[i] = atoi(token);
+	}
+
+	if (values[0] <= 0 || values[1] <= 0 || values[2] <= 0 || values[2] > 65535)
+	{
+		Close();
+		return false;
+	}
+
+	m_width = values[0];
+	m_height = values[1];
+	m_maxValue = (float)values[2];
+	m_bytesPerSample = values[2] > 255 ? 2 : 1;
+	m_bigEndian = true;		//16 bit PGM is always most significant byte first
+	m_dataOffset = _ftelli64(m_file);
+	return true;
+}
+
+bool HeightmapImporter::Open(const char* filename)
+{
+	const char* extension = strrchr(filename, '.');
+	if (extension && (_stricmp(extension, ".pgm") == 0 || _stricmp(extension, ".pnm") == 0))
+	{
+		return OpenPgm(filename);
+	}
+	return OpenRaw(filename);
+}
+
+void HeightmapImporter::Close()
+{
+	if (m_file)
+	{
+		fclose(m_file);
+		m_file = 0;
+	}
+	m_window.clear();
+	m_windowFirstRow = 0;
+	m_nextRow = 0;
+}
+
+bool HeightmapImporter::ReadNextRow(std::vector<float>& row)
+{
+	size_t rowSize = (size_t)m_width * m_bytesPerSample;
+	m_rowBytes.resize(rowSize);
+	if (fread(m_rowBytes.data(), 1, rowSize, m_file) != rowSize)
+	{
+		return false;
+	}
+
+	row.resize(m_width);
+	float scale = 1.0f / m_maxValue;
+	const uint8_t* bytes = m_rowBytes.data();
+
+	if (m_bytesPerSample == 1)
+	{
+		for (int i = 0; i < m_width; i++)
+		{
+			row[i] = bytes[i] * scale;
+		}
+	}
+	else if (m_bigEndian)
+	{
+		for (int i = 0; i < m_width; i++)
+		{
+			row[i] = (float)((bytes[i * 2] << 8) | bytes[i * 2 + 1]) * scale;
+		}
+	}
+	else
+	{
+		for (int i = 0; i < m_width; i++)
+		{
+			row[i] = (float)(bytes[i * 2] | (bytes[i * 2 + 1] << 8)) * scale;
+		}
+	}
+
+	m_nextRow++;
+	return true;
+}
+
+const float* HeightmapImporter::GetRow(int row)
+{
+	row = std::max(0, std::min(row, m_height - 1));
+	if (row < m_windowFirstRow || row >= m_windowFirstRow + (int)m_window.size())
+	{
+		return nullptr;
+	}
+	return m_window[row - m_windowFirstRow].data();
+}
+
+bool HeightmapImporter::Resample(int targetWidth, int targetHeight, Filter filter, float heightScale, const RowCallback& rowOut, int threadCount)
+{
+	if (!m_file || targetWidth < 2 || targetHeight < 2)
+	{
+		return false;
+	}
+
+	//rewind so a second Resample on the same file works
+	_fseeki64(m_file, m_dataOffset, SEEK_SET);
+	m_window.clear();
+	m_windowFirstRow = 0;
+	m_nextRow = 0;
+
+	int support = filter == FILTER_BICUBIC ? 2 : 1;
+	float stepX = (float)(m_width - 1) / (float)(targetWidth - 1);
+	float stepZ = (float)(m_height - 1) / (float)(targetHeight - 1);
+
+	//output rows per band, sized so the source rows a band touches stay within budget
+	int bandRows = std::max(1, (int)(SOURCE_ROW_BUDGET / std::max(1.0f, stepZ)));
+
+	//the horizontal taps are the same for every row so work them out once
+	std::vector<int> tapX(targetWidth);
+	std::vector<float> fracX(targetWidth);
+	for (int i = 0; i < targetWidth; i++)
+	{
+		float sx = i * stepX;
+		tapX[i] = std::min((int)sx, m_width - 1);
+		fracX[i] = sx - tapX[i];
+	}
+
+	std::vector<float> output((size_t)bandRows * targetWidth);
+
+	for (int bandStart = 0; bandStart < targetHeight; bandStart += bandRows)
+	{
+		int bandEnd = std::min(bandStart + bandRows, targetHeight);
+		int firstNeeded = std::max(0, (int)((bandStart)* stepZ) - support + 1);
+		int lastNeeded = std::min(m_height - 1, (int)((bandEnd - 1) * stepZ) + support);
+
+		//drop rows behind the band and stream in the ones ahead of it
+		while (!m_window.empty() && m_windowFirstRow < firstNeeded)
+		{
+			m_window.pop_front();
+			m_windowFirstRow++;
+		}
+		if (m_window.empty())
+		{
+			m_windowFirstRow = m_nextRow;
+		}
+		while (m_nextRow <= lastNeeded)
+		{
+			std::vector<float> row;
+			if (!ReadNextRow(row))
+			{
+				return false;
+			}
+			m_window.push_back(std::move(row));
+			if (m_nextRow - 1 < firstNeeded)
+			{
+				//skipped over while downsampling hard, never needed again
+				m_window.pop_front();
+				m_windowFirstRow = m_nextRow;
+			}
+		}
+
+		ParallelFor(bandStart, bandEnd, [&](int j)
+		{
+			float sz = j * stepZ;
+			int z0 = std::min((int)sz, m_height - 1);
+			float fz = sz - z0;
+			float* out = &output[(size_t)(j - bandStart) * targetWidth];
+
+			if (filter == FILTER_BILINEAR)
+			{
+				const float* r0 = GetRow(z0);
+				const float* r1 = GetRow(z0 + 1);
+				for (int i = 0; i < targetWidth; i++)
+				{
+					int x0 = tapX[i];
+					int x1 = std::min(x0 + 1, m_width - 1);
+					float fx = fracX[i];
+					float top = r0[x0] + (r0[x1] - r0[x0]) * fx;
+					float bottom = r1[x0] + (r1[x1] - r1[x0]) * fx;
+					out[i] = (top + (bottom - top) * fz) * heightScale;
+				}
+			}
+			else
+			{
+				const float* rows[4];
+				float wz[4];
+				for (int k = 0; k < 4; k++)
+				{
+					rows[k] = GetRow(z0 - 1 + k);
+					wz[k] = CubicWeight(fz - (k - 1));
+				}
+				for (int i = 0; i < targetWidth; i++)
+				{
+					float sum = 0.0f;
+					for (int k = 0; k < 4; k++)
+					{
+						float horizontal = 0.0f;
+						for (int m = 0; m < 4; m++)
+						{
+							int x = std::max(0, std::min(tapX[i] - 1 + m, m_width - 1));
+							horizontal += rows[k][x] * CubicWeight(fracX[i] - (m - 1));
+						}
+						sum += horizontal * wz[k];
+					}
+					out[i] = sum * heightScale;
+				}
+			}
+		}, threadCount);
+
+		for (int j = bandStart; j < bandEnd; j++)
+		{
+			if (!rowOut(j, &output[(size_t)(j - bandStart) * targetWidth]))
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool HeightmapImporter::ResampleToTileFile(const char* filename, int targetWidth, int targetHeight, int tileSize, Filter filter, float heightScale, bool compress)
+{
+	TerrainTileWriter writer;
+	if (!writer.Open(filename, targetWidth, targetHeight, tileSize,
+		compress ? TerrainTileFile::COMPRESSION_MED_RANS : TerrainTileFile::COMPRESSION_NONE))
+	{
+		return false;
+	}
+
+	//one strip of tiles plus a row either side for the normals
+	std::vector<float> strip((size_t)(tileSize + 2) * targetWidth);
+	std::vector<float> heights(tileSize * tileSize);
+	std::vector<TerrainTileFile::PackedNormal> normals(tileSize * tileSize);
+	int stripStart = 0;
+
+	//strip row r holds terrain row stripStart - 1 + r
+	auto stripRow = [&](int row) -> float*
+	{
+		int r = std::max(stripStart - 1, std::min(row, std::min(stripStart + tileSize, targetHeight - 1)));
+		r = std::max(0, r);
+		return &strip[(size_t)(r - stripStart + 1) * targetWidth];
+	};
+
+	auto flushStrip = [&]() -> bool
+	{
+		uint32_t tz = stripStart / tileSize;
+		for (uint32_t tx = 0; tx < writer.GetTilesX(); tx++)
+		{
+			for (int j = 0; j < tileSize; j++)
+			{
+				int z = std::min(stripStart + j, targetHeight - 1);
+				const float* up = stripRow(z - 1);
+				const float* row = stripRow(z);
+				const float* down = stripRow(z + 1);
+
+				for (int i = 0; i < tileSize; i++)
+				{
+					int x = std::min((int)tx * tileSize + i, targetWidth - 1);
+					int left = std::max(x - 1, 0);
+					int right = std::min(x + 1, targetWidth - 1);
+
+					//central differences, grid spacing of one like the rest of the terrain
+					float dx = (row[right] - row[left]) / (float)std::max(1, right - left);
+					float dz = (down[x] - up[x]) / (float)std::max(1, std::min(z + 1, targetHeight - 1) - std::max(z - 1, 0));
+					float length = sqrtf(dx * dx + 1.0f + dz * dz);
+
+					heights[j * tileSize + i] = row[x];
+					normals[j * tileSize + i] = TerrainTileFile::PackNormal(-dx / length, 1.0f / length, -dz / length);
+				}
+			}
+			if (!writer.WriteTile(tx, tz, heights.data(), normals.data()))
+			{
+				return false;
+			}
+		}
+		return true;
+	};
+
+	bool result = Resample(targetWidth, targetHeight, filter, heightScale, [&](int row, const float* values) -> bool
+	{
+		//the first row of the next strip is the lookahead the current strip needs
+		if (row == stripStart + tileSize)
+		{
+			memcpy(&strip[(size_t)(tileSize + 1) * targetWidth], values, targetWidth * sizeof(float));
+			if (!flushStrip())
+			{
+				return false;
+			}
+			//slide: the last row of this strip becomes the row before the next one
+			memcpy(&strip[0], &strip[(size_t)tileSize * targetWidth], targetWidth * sizeof(float));
+			stripStart += tileSize;
+		}
+		memcpy(&strip[(size_t)(row - stripStart + 1) * targetWidth], values, targetWidth * sizeof(float));
+		if (row == 0)
+		{
+			memcpy(&strip[0], values, targetWidth * sizeof(float));
+		}
+		return true;
+	});
+
+	if (!result || !flushStrip())
+	{
+		return false;
+	}
+
+	return writer.Close();
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <functional>
+#include <deque>
+
+//Loads externally authored heightmaps (16 bit RAW or binary PGM/PNM) and resamples them to a target grid.
+//The source image is never held in memory as a whole: rows are read forward through a small window,
+//and each band of output rows is resampled across threads before the window moves on.
+//So a 16k x 16k DEM can be turned into a terrain (or a tile file) with only a few hundred source rows resident.
+
+class HeightmapImporter
+{
+public:
+	enum Filter
+	{
+		FILTER_BILINEAR,
+		FILTER_BICUBIC,
+	};
+
+	//called once per output row, in order, with targetWidth heights
+	typedef std::function<bool(int row, const float* heights)> RowCallback;
+
+	HeightmapImporter();
+	~HeightmapImporter();
+
+	//RAW has no header so the size has to be given (width 0 means guess a square from the file size)
+	bool OpenRaw(const char* filename, int width = 0, int height = 0, bool bigEndian = false);
+	//binary greymap "P5", 8 or 16 bit
+	bool OpenPgm(const char* filename);
+	//picks the reader from the file extension
+	bool Open(const char* filename);
+	void Close();
+
+	int GetSourceWidth() const { return m_width; }
+	int GetSourceHeight() const { return m_height; }
+
+	//heights come out as 0..1 * heightScale
+	bool Resample(int targetWidth, int targetHeight, Filter filter, float heightScale, const RowCallback& rowOut, int threadCount = 0);
+
+	//resamples straight into a TerrainTileFile, only one strip of tiles is held at a time
+	bool ResampleToTileFile(const char* filename, int targetWidth, int targetHeight, int tileSize, Filter filter, float heightScale, bool compress = true);
+
+private:
+	bool ReadNextRow(std::vector<float>& row);
+	const float* GetRow(int row);
+
+private:
+	FILE* m_file;
+	int m_width, m_height;
+	int m_bytesPerSample;
+	bool m_bigEndian;
+	float m_maxValue;
+	int64_t m_dataOffset;
+
+	//sliding window of decoded source rows
+	std::deque<std::vector<float>> m_window;
+	int m_windowFirstRow;
+	int m_nextRow;
+	std::vector<uint8_t> m_rowBytes;
+};
@@ -0,0 +1,359 @@
+#include "pch.h"
+#include "HorizonMap.h"
+#include "ParallelFor.h"
+#include <climits>
+#include <mutex>
+
+namespace
+{
+	const float PI = 3.14159265f;
+
+	//counter clockwise from +x towards +z, the odd ones are the knight moves that only 16 directions use
+	const int STEPS[16][2] =
+	{
+		{ 1, 0 }, { 2, 1 }, { 1, 1 }, { 1, 2 }, { 0, 1 }, { -1, 2 }, { -1, 1 }, { -2, 1 },
+		{ -1, 0 }, { -2, -1 }, { -1, -1 }, { -1, -2 }, { 0, -1 }, { 1, -2 }, { 1, -1 }, { 2, -1 },
+	};
+
+	//0..2pi, so the directions come out in increasing order
+	inline float StepAngle(const int step[2])
+	{
+		float angle = atan2f((float)step[1], (float)step[0]);
+		return angle < 0.0f ? angle + 2.0f * PI : angle;
+	}
+}
+
+
+HorizonMap::HorizonMap()
+{
+	m_width = 0;
+	m_height = 0;
+	m_directionCount = 0;
+	m_sunElevation = PI * 0.25f;
+	m_sunSoftness = 0.05f;
+	m_sunDirections[0] = m_sunDirections[1] = 0;
+	m_sunBlend = 0.0f;
+	m_dirty = false;
+	m_dirtyX0 = m_dirtyZ0 = m_dirtyX1 = m_dirtyZ1 = 0;
+}
+
+HorizonMap::~HorizonMap()
+{
+}
+
+bool HorizonMap::Initialize(int width, int height, int directionCount)
+{
+	if (width < 1 || height < 1 || (directionCount != 8 && directionCount != 16))
+	{
+		return false;
+	}
+
+	m_width = width;
+	m_height = height;
+	m_directionCount = directionCount;
+
+	int stride = MAX_DIRECTIONS / directionCount;
+	for (int d = 0; d < directionCount; d++)
+	{
+		m_steps[d][0] = STEPS[d * stride][0];
+		m_steps[d][1] = STEPS[d * stride][1];
+
+		//a line starts wherever the step back would leave the grid
+		m_lineStarts[d].clear();
+		for (int z = 0; z < height; z++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				int previousX = x - m_steps[d][0];
+				int previousZ = z - m_steps[d][1];
+				if (previousX < 0 || previousX >= width || previousZ < 0 || previousZ >= height)
+				{
+					m_lineStarts[d].push_back(z * width + x);
+				}
+			}
+		}
+	}
+
+	m_horizons.assign((size_t)directionCount * width * height, 0.0f);
+	m_shading.assign((size_t)width * height, 0xFFFF);
+	MarkDirty(0, 0, width - 1, height - 1);
+	return true;
+}
+
+void HorizonMap::SetSun(float x, float y, float z, float softness)
+{
+	m_sunElevation = atan2f(y, sqrtf(x * x + z * z));
+	m_sunSoftness = std::max(softness, 0.0f);
+
+	float azimuth = atan2f(z, x);
+	if (azimuth < 0.0f)
+	{
+		azimuth += 2.0f * PI;
+	}
+
+	m_sunDirections[0] = m_sunDirections[1] = 0;
+	m_sunBlend = 0.0f;
+	for (int d = 0; d < m_directionCount; d++)
+	{
+		int next = (d + 1) % m_directionCount;
+		float first = StepAngle(m_steps[d]);
+		float second = next == 0 ? 2.0f * PI : StepAngle(m_steps[next]);
+		if (azimuth >= first && azimuth < second)
+		{
+			m_sunDirections[0] = d;
+			m_sunDirections[1] = next;
+			m_sunBlend = (azimuth - first) / (second - first);
+			break;
+		}
+	}
+}
+
+void HorizonMap::Bake(const float* heights, float cellSize, int threadCount)
+{
+	if (m_width == 0)
+	{
+		return;
+	}
+
+	for (int d = 0; d < m_directionCount; d++)
+	{
+		const std::vector<int>& starts = m_lineStarts[d];
+		ParallelForRanges(0, (int)starts.size(), [&](int first, int last)
+		{
+			std::vector<int> hull;
+			int x0, z0, x1, z1;
+			for (int line = first; line < last; line++)
+			{
+				SweepLine(heights, cellSize, d, starts[line], hull, x0, z0, x1, z1);
+			}
+		}, threadCount);
+	}
+
+	ShadeRegion(0, 0, m_width - 1, m_height - 1, threadCount);
+}
+
+void HorizonMap::UpdateRegion(const float* heights, float cellSize, int x0, int z0, int x1, int z1, int threadCount)
+{
+	if (m_width == 0)
+	{
+		return;
+	}
+
+	x0 = std::max(0, x0);
+	z0 = std::max(0, z0);
+	x1 = std::min(m_width - 1, x1);
+	z1 = std::min(m_height - 1, z1);
+	if (x0 > x1 || z0 > z1)
+	{
+		return;
+	}
+
+	std::mutex boundsMutex;
+	bool changed = false;
+	int changedX0 = m_width, changedZ0 = m_height, changedX1 = -1, changedZ1 = -1;
+
+	for (int d = 0; d < m_directionCount; d++)
+	{
+		//every line that passes through the region, each one only once
+		std::vector<int> starts;
+		for (int z = z0; z <= z1; z++)
+		{
+			for (int x = x0; x <= x1; x++)
+			{
+				starts.push_back(GetLineStart(d, x, z));
+			}
+		}
+		std::sort(starts.begin(), starts.end());
+		starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+
+		ParallelForRanges(0, (int)starts.size(), [&](int first, int last)
+		{
+			std::vector<int> hull;
+			bool rangeChanged = false;
+			int rangeX0 = m_width, rangeZ0 = m_height, rangeX1 = -1, rangeZ1 = -1;
+			for (int line = first; line < last; line++)
+			{
+				rangeChanged |= SweepLine(heights, cellSize, d, starts[line], hull, rangeX0, rangeZ0, rangeX1, rangeZ1);
+			}
+
+			if (rangeChanged)
+			{
+				std::lock_guard<std::mutex> lock(boundsMutex);
+				changed = true;
+				changedX0 = std::min(changedX0, rangeX0);
+				changedZ0 = std::min(changedZ0, rangeZ0);
+				changedX1 = std::max(changedX1, rangeX1);
+				changedZ1 = std::max(changedZ1, rangeZ1);
+			}
+		}, threadCount);
+	}
+
+	if (changed)
+	{
+		ShadeRegion(changedX0, changedZ0, changedX1, changedZ1, threadCount);
+	}
+}
+
+void HorizonMap::UpdateShading(int threadCount)
+{
+	if (m_width == 0)
+	{
+		return;
+	}
+	ShadeRegion(0, 0, m_width - 1, m_height - 1, threadCount);
+}
+
+bool HorizonMap::SweepLine(const float* heights, float cellSize, int direction, int start, std::vector<int>& hull,
+	int& changedX0, int& changedZ0, int& changedX1, int& changedZ1)
+{
+	int stepX = m_steps[direction][0];
+	int stepZ = m_steps[direction][1];
+	int startX = start % m_width;
+	int startZ = start / m_width;
+	int stepIndex = stepZ * m_width + stepX;
+	float stepLength = sqrtf((float)(stepX * stepX + stepZ * stepZ)) * cellSize;
+	float* horizons = m_horizons.data() + (size_t)direction * m_width * m_height;
+
+	int stepsX = stepX > 0 ? (m_width - 1 - startX) / stepX : stepX < 0 ? startX / -stepX : INT_MAX;
+	int stepsZ = stepZ > 0 ? (m_height - 1 - startZ) / stepZ : stepZ < 0 ? startZ / -stepZ : INT_MAX;
+	int count = std::min(stepsX, stepsZ) + 1;
+
+	//hull holds positions along the line, all further on than the vertex being looked at
+	hull.clear();
+	bool changed = false;
+	for (int k = count - 1; k >= 0; k--)
+	{
+		int index = start + k * stepIndex;
+		float height = heights[index];
+
+		//drop the nearest hull vertex while it sits on or under the line to the one behind it
+		while (hull.size() >= 2)
+		{
+			int nearest = hull[hull.size() - 1];
+			int behind = hull[hull.size() - 2];
+			float nearestSlope = (heights[start + nearest * stepIndex] - height) / (float)(nearest - k);
+			float behindSlope = (heights[start + behind * stepIndex] - height) / (float)(behind - k);
+			if (nearestSlope > behindSlope)
+			{
+				break;
+			}
+			hull.pop_back();
+		}
+
+		float tangent = 0.0f;
+		if (!hull.empty())
+		{
+			int top = hull.back();
+			tangent = std::max(0.0f, (heights[start + top * stepIndex] - height) / ((float)(top - k) * stepLength));
+		}
+		hull.push_back(k);
+
+		if (horizons[index] != tangent)
+		{
+			horizons[index] = tangent;
+			int x = startX + k * stepX;
+			int z = startZ + k * stepZ;
+			changedX0 = std::min(changedX0, x);
+			changedZ0 = std::min(changedZ0, z);
+			changedX1 = std::max(changedX1, x);
+			changedZ1 = std::max(changedZ1, z);
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+int HorizonMap::GetLineStart(int direction, int x, int z) const
+{
+	int stepX = m_steps[direction][0];
+	int stepZ = m_steps[direction][1];
+	int backX = stepX > 0 ? x / stepX : stepX < 0 ? (m_width - 1 - x) / -stepX : INT_MAX;
+	int backZ = stepZ > 0 ? z / stepZ : stepZ < 0 ? (m_height - 1 - z) / -stepZ : INT_MAX;
+	int back = std::min(backX, backZ);
+	return (z - back * stepZ) * m_width + (x - back * stepX);
+}
+
+void HorizonMap::ShadeRegion(int x0, int z0, int x1, int z1, int threadCount)
+{
+	size_t plane = (size_t)m_width * m_height;
+	float inverseCount = 1.0f / (float)m_directionCount;
+	const float* sunFirst = m_horizons.data() + m_sunDirections[0] * plane;
+	const float* sunSecond = m_horizons.data() + m_sunDirections[1] * plane;
+
+	ParallelFor(z0, z1 + 1, [&](int z)
+	{
+		for (int x = x0; x <= x1; x++)
+		{
+			size_t index = (size_t)z * m_width + x;
+
+			//cos^2 of the angle is 1 / (1 + tan^2)
+			float sky = 0.0f;
+			for (int d = 0; d < m_directionCount; d++)
+			{
+				float tangent = m_horizons[d * plane + index];
+				sky += 1.0f / (1.0f + tangent * tangent);
+			}
+			float occlusion = sky * inverseCount;
+
+			float horizon = atanf(sunFirst[index]) * (1.0f - m_sunBlend) + atanf(sunSecond[index]) * m_sunBlend;
+			float sun;
+			if (m_sunSoftness > 0.0f)
+			{
+				sun = std::min(1.0f, std::max(0.0f, (m_sunElevation - horizon) / (2.0f * m_sunSoftness) + 0.5f));
+				sun = sun * sun * (3.0f - 2.0f * sun);
+			}
+			else
+			{
+				sun = m_sunElevation > horizon ? 1.0f : 0.0f;
+			}
+
+			m_shading[index] = (uint16_t)((int)(occlusion * 255.0f + 0.5f) | ((int)(sun * 255.0f + 0.5f) << 8));
+		}
+	}, threadCount);
+
+	MarkDirty(x0, z0, x1, z1);
+}
+
+void HorizonMap::MarkDirty(int x0, int z0, int x1, int z1)
+{
+	if (!m_dirty)
+	{
+		m_dirtyX0 = x0;
+		m_dirtyZ0 = z0;
+		m_dirtyX1 = x1;
+		m_dirtyZ1 = z1;
+		m_dirty = true;
+		return;
+	}
+
+	m_dirtyX0 = std::min(m_dirtyX0, x0);
+	m_dirtyZ0 = std::min(m_dirtyZ0, z0);
+	m_dirtyX1 = std::max(m_dirtyX1, x1);
+	m_dirtyZ1 = std::max(m_dirtyZ1, z1);
+}
+
+bool HorizonMap::TakeDirtyRegion(int& x0, int& z0, int& x1, int& z1)
+{
+	if (!m_dirty)
+	{
+		return false;
+	}
+
+	x0 = m_dirtyX0;
+	z0 = m_dirtyZ0;
+	x1 = m_dirtyX1;
+	z1 = m_dirtyZ1;
+	m_dirty = false;
+	return true;
+}
+
+float HorizonMap::GetDirectionAngle(int direction) const
+{
+	return StepAngle(m_steps[direction]);
+}
+
+float HorizonMap::GetHorizon(int direction, int x, int z) const
+{
+	return atanf(m_horizons[(size_t)direction * m_width * m_height + (size_t)z * m_width + x]);
+}
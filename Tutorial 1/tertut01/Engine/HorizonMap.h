@@ -0,0 +1,79 @@
+#pragma once
+#include <vector>
+
+//Horizon angles for every heightfield vertex in a fixed set of directions, and the ambient occlusion and sun
+//shadowing that follow from them, packed as an R8G8 texel per vertex (r occlusion, g sun, 1 is fully lit).
+//
+//The directions are the grid steps (1,0), (1,1), (0,1)... and with 16 also the knight moves (2,1), (1,2)...
+//so every direction runs along exact lines of vertices and nothing has to be interpolated. Each line is swept
+//once from its far end back, keeping the upper convex hull of the vertices already passed on a stack. The
+//highest horizon seen from a vertex is always on that hull, and vertices that fall inside it can never be the
+//horizon for anything nearer, so they are popped for good. Every vertex is pushed and popped at most once,
+//which makes a direction O(vertices) instead of a march out to the edge from every vertex.
+//
+//Occlusion is the cosine weighted sky visible above the horizons (cos^2 of the horizon angle, averaged over the
+//directions). It assumes a roughly level surface, the normal tilt is already in the N.L term. The sun looks up
+//the horizon in its own direction between the two nearest baked ones, and fades over the sun's size.
+//
+//Lines are shared out between threads. After an edit only the lines through it are swept again, and the shading
+//is redone for just the vertices whose horizon actually moved.
+
+class HorizonMap
+{
+public:
+	static const int MAX_DIRECTIONS = 16;
+
+	HorizonMap();
+	~HorizonMap();
+
+	//directionCount is 8 or 16
+	bool Initialize(int width, int height, int directionCount = 8);
+	//direction towards the sun in grid space (y up), softness is its angular radius in radians.
+	//call UpdateShading afterwards if the map has already been baked.
+	void SetSun(float x, float y, float z, float softness);
+
+	//heights are width * height row major, cellSize is the spacing between them in the same units
+	void Bake(const float* heights, float cellSize, int threadCount = 0);
+	//redo only what [x0, x1] x [z0, z1] (inclusive grid coordinates) can affect
+	void UpdateRegion(const float* heights, float cellSize, int x0, int z0, int x1, int z1, int threadCount = 0);
+	//recomputes occlusion and sun from the stored horizons, for when only the sun moved
+	void UpdateShading(int threadCount = 0);
+
+	//texels rewritten since the last call, as an inclusive rectangle. false if nothing changed.
+	bool TakeDirtyRegion(int& x0, int& z0, int& x1, int& z1);
+
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+	int GetDirectionCount() const { return m_directionCount; }
+	//radians counter clockwise from +x towards +z
+	float GetDirectionAngle(int direction) const;
+	//elevation of the horizon in radians, 0 for open sky
+	float GetHorizon(int direction, int x, int z) const;
+	const uint16_t* GetShading() const { return m_shading.data(); }
+	float GetOcclusion(int x, int z) const { return (m_shading[z * m_width + x] & 0xFF) / 255.0f; }
+	float GetSunVisibility(int x, int z) const { return (m_shading[z * m_width + x] >> 8) / 255.0f; }
+
+private:
+	//sweeps one line, returns false if no horizon on it changed. the changed vertices are added to the bounds.
+	bool SweepLine(const float* heights, float cellSize, int direction, int start, std::vector<int>& hull,
+		int& changedX0, int& changedZ0, int& changedX1, int& changedZ1);
+	//the vertex at the near end of the line through (x, z)
+	int GetLineStart(int direction, int x, int z) const;
+	void ShadeRegion(int x0, int z0, int x1, int z1, int threadCount);
+	void MarkDirty(int x0, int z0, int x1, int z1);
+
+private:
+	int m_width, m_height;
+	int m_directionCount;
+	int m_steps[MAX_DIRECTIONS][2];
+	std::vector<int> m_lineStarts[MAX_DIRECTIONS];
+	std::vector<float> m_horizons;			//tangent of the horizon angle, directionCount planes of width * height
+	std::vector<uint16_t> m_shading;		//occlusion in the low byte, sun in the high byte
+
+	float m_sunElevation, m_sunSoftness;
+	int m_sunDirections[2];					//the baked directions either side of the sun
+	float m_sunBlend;						//how far the sun is from the first towards the second
+
+	bool m_dirty;
+	int m_dirtyX0, m_dirtyZ0, m_dirtyX1, m_dirtyZ1;
+};
@@ -0,0 +1,666 @@
+#include "pch.h"
+#include "Hydrology.h"
+#include "DiamondSquare.h"
+#include "ParallelFor.h"
+#include <unordered_map>
+#include <chrono>
+#include <cfloat>
+
+namespace
+{
+	const float PI = 3.14159265358979f;
+	const float QUARTER_PI = PI * 0.25f;
+
+	//neighbour k sits at k * 45 degrees, counter clockwise from +x towards +z. even k are the edge neighbours.
+	const int OFFSET_X[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+	const int OFFSET_Z[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+	const float DISTANCE[8] = { 1.0f, 1.41421356f, 1.0f, 1.41421356f, 1.0f, 1.41421356f, 1.0f, 1.41421356f };
+
+	//float bits rearranged so unsigned comparison gives the same order as comparing the floats
+	inline uint32_t OrderedKey(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+	}
+
+	inline int BitLength(uint32_t value)
+	{
+		int length = 0;
+		if (value >= 1u << 16) { length += 16; value >>= 16; }
+		if (value >= 1u << 8) { length += 8; value >>= 8; }
+		if (value >= 1u << 4) { length += 4; value >>= 4; }
+		if (value >= 1u << 2) { length += 2; value >>= 2; }
+		if (value >= 1u << 1) { length += 1; value >>= 1; }
+		return length + (int)value;
+	}
+
+	//Monotone priority queue. An item lives in the bucket numbered by the highest bit where its key differs from
+	//the last key popped, so it only ever moves down towards bucket 0 and each item is touched O(32) times at most.
+	//Buckets are plain arrays, which keeps the whole thing far more cache friendly than a binary heap.
+	class RadixHeap
+	{
+	public:
+		RadixHeap() : m_last(0), m_size(0) {}
+
+		bool Empty() const { return m_size == 0; }
+
+		//key must not be below the last key popped
+		void Push(uint32_t key, int value)
+		{
+			m_buckets[BitLength(key ^ m_last)].push_back(Item(key, value));
+			m_size++;
+		}
+
+		int Pop()
+		{
+			if (m_buckets[0].empty())
+			{
+				int bucket = 1;
+				while (m_buckets[bucket].empty())
+				{
+					bucket++;
+				}
+
+				//the new minimum comes from the lowest non empty bucket, everything in it then spreads out below
+				uint32_t minimum = m_buckets[bucket][0].first;
+				for (size_t i = 1; i < m_buckets[bucket].size(); i++)
+				{
+					minimum = std::min(minimum, m_buckets[bucket][i].first);
+				}
+				m_last = minimum;
+				for (size_t i = 0; i < m_buckets[bucket].size(); i++)
+				{
+					const Item& item = m_buckets[bucket][i];
+					m_buckets[BitLength(item.first ^ m_last)].push_back(item);
+				}
+				m_buckets[bucket].clear();
+			}
+
+			int value = m_buckets[0].back().second;
+			m_buckets[0].pop_back();
+			m_size--;
+			return value;
+		}
+
+	private:
+		typedef std::pair<uint32_t, int> Item;
+		std::vector<Item> m_buckets[33];
+		uint32_t m_last;
+		size_t m_size;
+	};
+}
+
+
+void Hydrology::FillDepressions(const float* heights, int width, int height, float* filled, bool epsilon,
+	std::vector<int>* lakeIds, std::vector<Lake>* lakes)
+{
+	int count = width * height;
+	if (filled != heights)
+	{
+		std::copy(heights, heights + count, filled);
+	}
+
+	std::vector<int> ownLakeIds;
+	std::vector<Lake> ownLakes;
+	std::vector<int>& region = lakeIds ? *lakeIds : ownLakeIds;
+	std::vector<Lake>& found = lakes ? *lakes : ownLakes;
+	region.assign(count, -1);
+	found.clear();
+
+	std::vector<uint8_t> closed(count, 0);
+	RadixHeap open;
+	//plain FIFO, reset whenever it runs dry so it never grows past the largest single lake
+	std::vector<int> pit;
+	size_t pitHead = 0;
+
+	//the edge drains off the map, so the flood starts from all of it
+	for (int j = 0; j < height; j++)
+	{
+		for (int i = 0; i < width; i++)
+		{
+			if (i == 0 || j == 0 || i == width - 1 || j == height - 1)
+			{
+				int cell = j * width + i;
+				closed[cell] = 1;
+				open.Push(OrderedKey(filled[cell]), cell);
+			}
+		}
+	}
+
+	//region is used for every cell reached from a lake while it is flooding, including ones at the surface
+	//which aren't under it. only the ones below the surface are counted and kept in the output.
+	std::vector<int> flooding(count, -1);
+
+	while (!open.Empty() || pitHead < pit.size())
+	{
+		int cell;
+		if (pitHead < pit.size())
+		{
+			cell = pit[pitHead++];
+		}
+		else
+		{
+			pit.clear();
+			pitHead = 0;
+			cell = open.Pop();
+		}
+
+		int x = cell % width;
+		int z = cell / width;
+		float level = filled[cell];
+		float raised = epsilon ? nextafterf(level, FLT_MAX) : level;
+
+		for (int k = 0; k < 8; k++)
+		{
+			int nx = x + OFFSET_X[k];
+			int nz = z + OFFSET_Z[k];
+			if (nx < 0 || nz < 0 || nx >= width || nz >= height)
+			{
+				continue;
+			}
+
+			int neighbour = nz * width + nx;
+			if (closed[neighbour])
+			{
+				continue;
+			}
+			closed[neighbour] = 1;
+
+			if (filled[neighbour] > raised)
+			{
+				open.Push(OrderedKey(filled[neighbour]), neighbour);
+				continue;
+			}
+
+			//it is below the water coming in from this cell, so it gets raised and joins this cell's lake
+			int lake = flooding[cell];
+			if (lake < 0 && heights[neighbour] < level)
+			{
+				Lake newLake = { cell, level, 0 };
+				lake = (int)found.size();
+				found.push_back(newLake);
+			}
+			if (lake >= 0)
+			{
+				flooding[neighbour] = lake;
+				if (heights[neighbour] < found[lake].level)
+				{
+					region[neighbour] = lake;
+					found[lake].cellCount++;
+				}
+			}
+
+			filled[neighbour] = raised;
+			pit.push_back(neighbour);
+		}
+	}
+}
+
+void Hydrology::FlowDirectionsD8(const float* heights, int width, int height, int* receivers, int threadCount)
+{
+	ParallelFor(0, height, [&](int z)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			int cell = z * width + x;
+			float centre = heights[cell];
+			float steepest = 0.0f;
+			int receiver = -1;
+
+			for (int k = 0; k < 8; k++)
+			{
+				int nx = x + OFFSET_X[k];
+				int nz = z + OFFSET_Z[k];
+				if (nx < 0 || nz < 0 || nx >= width || nz >= height)
+				{
+					continue;
+				}
+
+				int neighbour = nz * width + nx;
+				float slope = (centre - heights[neighbour]) / DISTANCE[k];
+				if (slope > steepest)
+				{
+					steepest = slope;
+					receiver = neighbour;
+				}
+			}
+			receivers[cell] = receiver;
+		}
+	}, threadCount);
+}
+
+void Hydrology::FlowDirectionsDInfinity(const float* heights, int width, int height, float* angles, int threadCount)
+{
+	ParallelFor(0, height, [&](int z)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			int cell = z * width + x;
+			float centre = heights[cell];
+			float steepest = 0.0f;
+			float angle = -1.0f;
+
+			//facet k is the triangle between neighbours k and k + 1, one edge neighbour and one diagonal
+			for (int k = 0; k < 8; k++)
+			{
+				int edgeK = (k % 2 == 0) ? k : (k + 1) % 8;
+				int diagonalK = (k % 2 == 0) ? k + 1 : k;
+
+				int ex = x + OFFSET_X[edgeK], ez = z + OFFSET_Z[edgeK];
+				int dx = x + OFFSET_X[diagonalK], dz = z + OFFSET_Z[diagonalK];
+				if (ex < 0 || ez < 0 || ex >= width || ez >= height || dx < 0 || dz < 0 || dx >= width || dz >= height)
+				{
+					continue;
+				}
+
+				float edge = heights[ez * width + ex];
+				float diagonal = heights[dz * width + dx];
+
+				//slope along the edge direction and across towards the diagonal
+				float s1 = centre - edge;
+				float s2 = edge - diagonal;
+				float r = atan2f(s2, s1);
+				float slope = sqrtf(s1 * s1 + s2 * s2);
+				if (r < 0.0f)
+				{
+					r = 0.0f;
+					slope = s1;
+				}
+				else if (r > QUARTER_PI)
+				{
+					r = QUARTER_PI;
+					slope = (centre - diagonal) / 1.41421356f;
+				}
+
+				if (slope > steepest)
+				{
+					steepest = slope;
+					//r is measured from the edge neighbour towards the diagonal one
+					angle = (k % 2 == 0) ? (float)edgeK * QUARTER_PI + r : (float)edgeK * QUARTER_PI - r;
+					if (angle < 0.0f)
+					{
+						angle += 2.0f * PI;
+					}
+				}
+			}
+			angles[cell] = angle;
+		}
+	}, threadCount);
+}
+
+void Hydrology::FlowAccumulationD8(const int* receivers, int width, int height, const float* weights, float* accumulation,
+	int tileSize, int threadCount)
+{
+	int count = width * height;
+	int tilesAcross = (width + tileSize - 1) / tileSize;
+	int tilesDown = (height + tileSize - 1) / tileSize;
+	int tileCount = tilesAcross * tilesDown;
+
+	auto tileOf = [&](int cell)
+	{
+		return ((cell / width) / tileSize) * tilesAcross + (cell % width) / tileSize;
+	};
+
+	std::vector<uint8_t> donors(count, 0);
+	std::vector<int> exitOf(count);
+	std::vector<std::vector<int>> order(tileCount);
+	std::vector<std::vector<int>> crossing(tileCount);
+
+	//1: every tile on its own, ignoring anything that comes in over its edges. the topological order is kept,
+	//along with where in the tile each cell's water ends up (the exit: a cell that drains into another tile, or a sink).
+	ParallelFor(0, tileCount, [&](int tile)
+	{
+		int x0 = (tile % tilesAcross) * tileSize;
+		int z0 = (tile / tilesAcross) * tileSize;
+		int x1 = std::min(x0 + tileSize, width);
+		int z1 = std::min(z0 + tileSize, height);
+
+		auto inside = [&](int cell)
+		{
+			int x = cell % width;
+			int z = cell / width;
+			return x >= x0 && x < x1 && z >= z0 && z < z1;
+		};
+
+		for (int z = z0; z < z1; z++)
+		{
+			for (int x = x0; x < x1; x++)
+			{
+				int cell = z * width + x;
+				accumulation[cell] = weights ? weights[cell] : 1.0f;
+				int receiver = receivers[cell];
+				if (receiver >= 0 && inside(receiver))
+				{
+					donors[receiver]++;
+				}
+				else if (receiver >= 0)
+				{
+					crossing[tile].push_back(cell);
+				}
+			}
+		}
+
+		std::vector<int>& sorted = order[tile];
+		sorted.reserve((x1 - x0) * (z1 - z0));
+		for (int z = z0; z < z1; z++)
+		{
+			for (int x = x0; x < x1; x++)
+			{
+				if (donors[z * width + x] == 0)
+				{
+					sorted.push_back(z * width + x);
+				}
+			}
+		}
+
+		//Kahn's algorithm, the sorted list doubles as the queue
+		for (size_t head = 0; head < sorted.size(); head++)
+		{
+			int cell = sorted[head];
+			int receiver = receivers[cell];
+			if (receiver >= 0 && inside(receiver))
+			{
+				accumulation[receiver] += accumulation[cell];
+				if (--donors[receiver] == 0)
+				{
+					sorted.push_back(receiver);
+				}
+			}
+		}
+
+		for (size_t i = sorted.size(); i-- > 0;)
+		{
+			int cell = sorted[i];
+			int receiver = receivers[cell];
+			exitOf[cell] = (receiver >= 0 && inside(receiver)) ? exitOf[receiver] : cell;
+		}
+	}, threadCount);
+
+	//2: the flow between tiles. a crossing cell passes its total to the cell over the edge, which carries it on
+	//to its own exit. that only links crossing cells to crossing cells, so it is a small graph to sort.
+	std::vector<int> nodes;
+	for (int tile = 0; tile < tileCount; tile++)
+	{
+		nodes.insert(nodes.end(), crossing[tile].begin(), crossing[tile].end());
+	}
+
+	std::unordered_map<int, int> nodeOf;
+	nodeOf.reserve(nodes.size() * 2);
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		nodeOf[nodes[i]] = (int)i;
+	}
+
+	std::vector<int> next(nodes.size(), -1);
+	std::vector<int> incoming(nodes.size(), 0);
+	std::vector<float> total(nodes.size());
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		total[i] = accumulation[nodes[i]];
+		auto found = nodeOf.find(exitOf[receivers[nodes[i]]]);
+		if (found != nodeOf.end())
+		{
+			next[i] = found->second;
+			incoming[found->second]++;
+		}
+	}
+
+	std::vector<int> queue;
+	queue.reserve(nodes.size());
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		if (incoming[i] == 0)
+		{
+			queue.push_back((int)i);
+		}
+	}
+	for (size_t head = 0; head < queue.size(); head++)
+	{
+		int node = queue[head];
+		if (next[node] >= 0)
+		{
+			total[next[node]] += total[node];
+			if (--incoming[next[node]] == 0)
+			{
+				queue.push_back(next[node]);
+			}
+		}
+	}
+
+	std::vector<float> extra(count, 0.0f);
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		extra[receivers[nodes[i]]] += total[i];
+	}
+
+	//3: push what came in over the edges down through each tile, in the order from step 1
+	ParallelFor(0, tileCount, [&](int tile)
+	{
+		const std::vector<int>& sorted = order[tile];
+		for (size_t i = 0; i < sorted.size(); i++)
+		{
+			int cell = sorted[i];
+			float incomingFlow = extra[cell];
+			if (incomingFlow == 0.0f)
+			{
+				continue;
+			}
+
+			accumulation[cell] += incomingFlow;
+			int receiver = receivers[cell];
+			if (receiver >= 0 && tileOf(receiver) == tile)
+			{
+				extra[receiver] += incomingFlow;
+			}
+		}
+	}, threadCount);
+}
+
+void Hydrology::FlowAccumulationDInfinity(const float* heights, const float* angles, int width, int height,
+	const float* weights, float* accumulation)
+{
+	int count = width * height;
+	for (int i = 0; i < count; i++)
+	{
+		accumulation[i] = weights ? weights[i] : 1.0f;
+	}
+
+	//flow only goes downhill, so handing it on from the highest cell down visits every donor before its receivers
+	std::vector<int> sorted(count);
+	for (int i = 0; i < count; i++)
+	{
+		sorted[i] = i;
+	}
+	std::sort(sorted.begin(), sorted.end(), [heights](int a, int b)
+	{
+		return heights[a] > heights[b] || (heights[a] == heights[b] && a < b);
+	});
+
+	for (int i = 0; i < count; i++)
+	{
+		int cell = sorted[i];
+		float angle = angles[cell];
+		if (angle < 0.0f)
+		{
+			continue;
+		}
+
+		//split between the neighbours either side of the angle
+		float sector = angle / QUARTER_PI;
+		int k = std::min((int)sector, 7);
+		float share = sector - (float)k;
+		int x = cell % width;
+		int z = cell / width;
+
+		int first = (z + OFFSET_Z[k]) * width + (x + OFFSET_X[k]);
+		int secondK = (k + 1) % 8;
+		int second = (z + OFFSET_Z[secondK]) * width + (x + OFFSET_X[secondK]);
+
+		if (share < 1.0f)
+		{
+			accumulation[first] += accumulation[cell] * (1.0f - share);
+		}
+		if (share > 0.0f)
+		{
+			accumulation[second] += accumulation[cell] * share;
+		}
+	}
+}
+
+double Hydrology::Benchmark(int size, int threadCount)
+{
+	int grid = 2;
+	while (grid + 1 < size)
+	{
+		grid *= 2;
+	}
+	grid += 1;
+
+	DiamondSquare::Settings settings;
+	settings.amplitude = (float)size * 0.1f;
+	settings.roughness = 0.6f;
+	settings.threadCount = threadCount;
+	std::vector<float> generated(grid * grid);
+	DiamondSquare::Generate(generated.data(), grid, grid, settings);
+
+	std::vector<float> heights(size * size);
+	for (int z = 0; z < size; z++)
+	{
+		std::copy(&generated[z * grid], &generated[z * grid] + size, &heights[z * size]);
+	}
+
+	std::vector<int> receivers(size * size);
+	std::vector<float> accumulation(size * size);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	FillDepressions(heights.data(), size, size, heights.data());
+	FlowDirectionsD8(heights.data(), size, size, receivers.data(), threadCount);
+	FlowAccumulationD8(receivers.data(), size, size, nullptr, accumulation.data(), 256, threadCount);
+	auto end = std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration<double>(end - start).count();
+}
+
+size_t Hydrology::TestAgainstReference(int trials, int threadCount)
+{
+	size_t mismatches = 0;
+	for (int trial = 0; trial < trials; trial++)
+	{
+		//odd sizes and a bit of noise on top of the generated map, which leaves plenty of pits and flats
+		int width = 17 + (trial * 37) % 120;
+		int height = 17 + (trial * 53) % 120;
+		int grid = 2;
+		while (grid + 1 < std::max(width, height))
+		{
+			grid *= 2;
+		}
+		grid += 1;
+
+		DiamondSquare::Settings settings;
+		settings.amplitude = 20.0f;
+		settings.roughness = 0.5f + (trial % 4) * 0.1f;
+		settings.seed = 1 + trial;
+		std::vector<float> generated(grid * grid);
+		DiamondSquare::Generate(generated.data(), grid, grid, settings);
+
+		std::vector<float> heights(width * height);
+		for (int z = 0; z < height; z++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				float noise = (float)((((unsigned)x * 73856093u) ^ ((unsigned)z * 19349663u) ^ ((unsigned)trial * 83492791u)) & 1023u) / 1023.0f;
+				heights[z * width + x] = generated[z * grid + x] + noise * 2.0f;
+			}
+		}
+
+		//brute force: start the inside full and lower every cell to the highest of itself and its lowest
+		//neighbour until nothing moves
+		std::vector<float> reference(width * height, FLT_MAX);
+		for (int z = 0; z < height; z++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				if (x == 0 || z == 0 || x == width - 1 || z == height - 1)
+				{
+					reference[z * width + x] = heights[z * width + x];
+				}
+			}
+		}
+		bool changed = true;
+		while (changed)
+		{
+			changed = false;
+			for (int z = 1; z < height - 1; z++)
+			{
+				for (int x = 1; x < width - 1; x++)
+				{
+					int cell = z * width + x;
+					for (int k = 0; k < 8; k++)
+					{
+						float level = std::max(heights[cell], reference[cell + OFFSET_Z[k] * width + OFFSET_X[k]]);
+						if (level < reference[cell])
+						{
+							reference[cell] = level;
+							changed = true;
+						}
+					}
+				}
+			}
+		}
+
+		std::vector<float> filled(width * height);
+		FillDepressions(heights.data(), width, height, filled.data(), false);
+		for (int i = 0; i < width * height; i++)
+		{
+			if (filled[i] != reference[i])
+			{
+				mismatches++;
+			}
+		}
+
+		//with epsilon the water level only ever creeps up, and everything inside has somewhere to drain to
+		FillDepressions(heights.data(), width, height, filled.data(), true);
+		std::vector<int> receivers(width * height);
+		FlowDirectionsD8(filled.data(), width, height, receivers.data(), threadCount);
+		for (int z = 0; z < height; z++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				int cell = z * width + x;
+				bool inside = x > 0 && z > 0 && x < width - 1 && z < height - 1;
+				if (filled[cell] < reference[cell] || (inside && receivers[cell] < 0))
+				{
+					mismatches++;
+				}
+			}
+		}
+
+		//serial accumulation, highest cell first, against the tiled one with tiles small enough to cross a lot
+		std::vector<int> order(width * height);
+		for (int i = 0; i < width * height; i++)
+		{
+			order[i] = i;
+		}
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return filled[a] > filled[b]; });
+		std::vector<float> serial(width * height, 1.0f);
+		for (int cell : order)
+		{
+			if (receivers[cell] >= 0)
+			{
+				serial[receivers[cell]] += serial[cell];
+			}
+		}
+
+		std::vector<float> tiled(width * height);
+		FlowAccumulationD8(receivers.data(), width, height, nullptr, tiled.data(), 8 + (trial % 4) * 8, threadCount);
+		for (int i = 0; i < width * height; i++)
+		{
+			if (fabsf(tiled[i] - serial[i]) > serial[i] * 1e-5f)
+			{
+				mismatches++;
+			}
+		}
+	}
+	return mismatches;
+}
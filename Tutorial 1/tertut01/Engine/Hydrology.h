@@ -0,0 +1,48 @@
+#pragma once
+#include <vector>
+
+//Drainage analysis on a heightfield, for finding lakes and carving rivers.
+//
+//FillDepressions is priority flood (Barnes, Lehman and Mulla 2014): the map is flooded inwards from its edge,
+//always from the lowest cell reached so far, and any cell below the water reaching it is raised to that level.
+//Those raised cells make up the lakes, and the cell the water came in over is the lake's spill point. The queue
+//is a radix heap over the heights as ordered integers (pops only ever go up, which is what it needs), and cells
+//that get raised skip it entirely through a plain FIFO. With epsilon on, raised cells go up by the smallest step
+//a float can take, so the filled map always drains and flow directions are defined everywhere.
+//
+//Flow goes either to the single steepest of the eight neighbours (D8) or is split between the two neighbours
+//either side of the steepest downhill facet (D-infinity, Tarboton 1997). D8 accumulation is done per tile in
+//parallel, with the flow that crosses tile edges resolved afterwards on the much smaller graph of edge cells.
+
+class Hydrology
+{
+public:
+	struct Lake
+	{
+		int spillCell;		//where the water leaves, index into the grid
+		float level;		//surface height
+		int cellCount;		//cells under the surface
+	};
+
+	//filled can be the same array as heights. lakeIds gets the lake each cell is under or -1.
+	static void FillDepressions(const float* heights, int width, int height, float* filled, bool epsilon = true,
+		std::vector<int>* lakeIds = nullptr, std::vector<Lake>* lakes = nullptr);
+
+	//index of the steepest downhill neighbour, -1 where there isn't one (pits, and edges that drain off the map)
+	static void FlowDirectionsD8(const float* heights, int width, int height, int* receivers, int threadCount = 0);
+	//steepest facet direction in radians, counter clockwise from +x towards +z, -1 where nothing is downhill
+	static void FlowDirectionsDInfinity(const float* heights, int width, int height, float* angles, int threadCount = 0);
+
+	//total weight (1 per cell if weights is null) flowing through each cell
+	static void FlowAccumulationD8(const int* receivers, int width, int height, const float* weights, float* accumulation,
+		int tileSize = 256, int threadCount = 0);
+	//heights must be the ones the angles came from, the cells are processed from the top down
+	static void FlowAccumulationDInfinity(const float* heights, const float* angles, int width, int height,
+		const float* weights, float* accumulation);
+
+	//fill, D8 and accumulation on a generated size * size map, returns seconds taken
+	static double Benchmark(int size, int threadCount = 0);
+	//random maps of assorted sizes, filled against a brute force fill and accumulated in tiles on threadCount
+	//threads against a plain serial pass. returns how many cells came out different, 0 when it all agrees.
+	static size_t TestAgainstReference(int trials, int threadCount = 0);
+};
@@ -0,0 +1,550 @@
+#include "pch.h"
+#include "InstanceCuller.h"
+#include "ParallelFor.h"
+#include "Philox.h"
+#include <emmintrin.h>
+#include <chrono>
+#include <cfloat>
+
+namespace
+{
+	//padding slots sit this far off, outside any frustum. CullCell masks their lanes off as well, since a last
+	//LOD distance beyond this would still reach them.
+	const float PADDING_POSITION = 1e18f;
+
+	inline uint32_t RoundUp4(uint32_t count)
+	{
+		return (count + 3) & ~3u;
+	}
+
+	//how many LOD distances d2 is at or past, so lodCount means culled
+	inline int GetLod(const InstanceCuller::View& view, const float* limits, float d2)
+	{
+		int lod = 0;
+		while (lod < view.lodCount && d2 >= limits[lod])
+		{
+			lod++;
+		}
+		return lod;
+	}
+}
+
+
+InstanceCuller::View::View()
+{
+	memset(planes, 0, sizeof(planes));
+	eyeX = eyeY = eyeZ = 0.0f;
+	for (int i = 0; i < MAX_LODS; i++)
+	{
+		lodDistances[i] = 1e30f;
+	}
+	lodCount = 1;
+}
+
+void InstanceCuller::View::SetFrustum(const DirectX::SimpleMath::Matrix& m)
+{
+	//clip = v * m, so each clip coordinate is v dotted with a column (Gribb and Hartmann), z runs 0..w
+	float columns[4][4] =
+	{
+		{ m._11, m._21, m._31, m._41 },
+		{ m._12, m._22, m._32, m._42 },
+		{ m._13, m._23, m._33, m._43 },
+		{ m._14, m._24, m._34, m._44 },
+	};
+
+	for (int k = 0; k < 4; k++)
+	{
+		planes[0][k] = columns[3][k] + columns[0][k];	//left
+		planes[1][k] = columns[3][k] - columns[0][k];	//right
+		planes[2][k] = columns[3][k] + columns[1][k];	//bottom
+		planes[3][k] = columns[3][k] - columns[1][k];	//top
+		planes[4][k] = columns[2][k];					//near
+		planes[5][k] = columns[3][k] - columns[2][k];	//far
+	}
+
+	for (int p = 0; p < 6; p++)
+	{
+		float length = sqrtf(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+		float inverse = length > 0.0f ? 1.0f / length : 0.0f;
+		for (int k = 0; k < 4; k++)
+		{
+			planes[p][k] *= inverse;
+		}
+	}
+}
+
+InstanceCuller::InstanceCuller()
+{
+	m_count = 0;
+	m_centerY = 0.0f;
+	m_radius = 0.0f;
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+InstanceCuller::~InstanceCuller()
+{
+}
+
+void InstanceCuller::GetModelBounds(const MeshData& mesh, float& centerY, float& radius)
+{
+	centerY = 0.0f;
+	radius = 0.0f;
+	if (mesh.positions.empty())
+	{
+		return;
+	}
+
+	float minY = mesh.positions[0].y;
+	float maxY = mesh.positions[0].y;
+	for (size_t i = 1; i < mesh.positions.size(); i++)
+	{
+		minY = std::min(minY, mesh.positions[i].y);
+		maxY = std::max(maxY, mesh.positions[i].y);
+	}
+	centerY = (minY + maxY) * 0.5f;
+
+	float radiusSquared = 0.0f;
+	for (size_t i = 0; i < mesh.positions.size(); i++)
+	{
+		const DirectX::SimpleMath::Vector3& p = mesh.positions[i];
+		radiusSquared = std::max(radiusSquared, p.x * p.x + (p.y - centerY) * (p.y - centerY) + p.z * p.z);
+	}
+	radius = sqrtf(radiusSquared);
+}
+
+void InstanceCuller::Clear()
+{
+	m_count = 0;
+	m_x.clear();
+	m_y.clear();
+	m_z.clear();
+	m_centerYs.clear();
+	m_radii.clear();
+	m_rotations.clear();
+	m_scales.clear();
+	m_chunks.clear();
+	m_cells.clear();
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+bool InstanceCuller::Build(const Instance* instances, size_t count, float centerY, float radius, float chunkSize)
+{
+	Clear();
+	if (chunkSize <= 0.0f || count >= 0x40000000)
+	{
+		return false;
+	}
+
+	m_count = count;
+	m_centerY = centerY;
+	m_radius = radius;
+	if (count == 0)
+	{
+		return true;
+	}
+
+	float minX = instances[0].x, maxX = instances[0].x;
+	float minZ = instances[0].z, maxZ = instances[0].z;
+	for (size_t i = 1; i < count; i++)
+	{
+		minX = std::min(minX, instances[i].x);
+		maxX = std::max(maxX, instances[i].x);
+		minZ = std::min(minZ, instances[i].z);
+		maxZ = std::max(maxZ, instances[i].z);
+	}
+
+	int chunksX = std::max(1, (int)ceilf((maxX - minX) / chunkSize));
+	int chunksZ = std::max(1, (int)ceilf((maxZ - minZ) / chunkSize));
+	float cellSize = chunkSize / CELLS;
+	int cellsPerChunk = CELLS * CELLS;
+	size_t cellCount = (size_t)chunksX * chunksZ * cellsPerChunk;
+
+	//every cell of every chunk gets an id, chunk by chunk, and the instances are counting sorted on it
+	std::vector<uint32_t> cellIds(count);
+	std::vector<uint32_t> cellCounts(cellCount, 0);
+	for (size_t i = 0; i < count; i++)
+	{
+		float localX = (instances[i].x - minX) / cellSize;
+		float localZ = (instances[i].z - minZ) / cellSize;
+		int cellX = std::min((int)localX, chunksX * CELLS - 1);
+		int cellZ = std::min((int)localZ, chunksZ * CELLS - 1);
+		int chunk = (cellZ / CELLS) * chunksX + cellX / CELLS;
+		cellIds[i] = (uint32_t)(chunk * cellsPerChunk + (cellZ % CELLS) * CELLS + cellX % CELLS);
+		cellCounts[cellIds[i]]++;
+	}
+
+	//lay the cells out, each starting on a multiple of four, and skip the empty ones
+	std::vector<uint32_t> cellStarts(cellCount);
+	uint32_t slots = 0;
+	for (int chunk = 0; chunk < chunksX * chunksZ; chunk++)
+	{
+		Chunk entry;
+		entry.firstCell = (uint32_t)m_cells.size();
+		entry.cellCount = 0;
+		for (int c = 0; c < cellsPerChunk; c++)
+		{
+			size_t id = (size_t)chunk * cellsPerChunk + c;
+			if (cellCounts[id] == 0)
+			{
+				continue;
+			}
+			Cell cell;
+			cell.first = slots;
+			cell.count = cellCounts[id];
+			cellStarts[id] = slots;
+			slots += RoundUp4(cell.count);
+			m_cells.push_back(cell);
+			entry.cellCount++;
+		}
+		if (entry.cellCount > 0)
+		{
+			m_chunks.push_back(entry);
+		}
+	}
+
+	m_x.assign(slots, PADDING_POSITION);
+	m_y.assign(slots, 0.0f);
+	m_z.assign(slots, PADDING_POSITION);
+	m_centerYs.assign(slots, 0.0f);
+	m_radii.assign(slots, 0.0f);
+	m_rotations.assign(slots, 0.0f);
+	m_scales.assign(slots, 0.0f);
+
+	//stable, so instances that were in order (ObjectScatter's chunks) stay that way within a cell
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t slot = cellStarts[cellIds[i]]++;
+		m_x[slot] = instances[i].x;
+		m_y[slot] = instances[i].y;
+		m_z[slot] = instances[i].z;
+		m_centerYs[slot] = instances[i].y + centerY * instances[i].scale;
+		m_radii[slot] = radius * fabsf(instances[i].scale);
+		m_rotations[slot] = instances[i].rotation;
+		m_scales[slot] = instances[i].scale;
+	}
+
+	for (size_t c = 0; c < m_cells.size(); c++)
+	{
+		Cell& cell = m_cells[c];
+		Bounds& b = cell.bounds;
+		b.minX = b.minY = b.minZ = FLT_MAX;
+		b.maxX = b.maxY = b.maxZ = -FLT_MAX;
+		for (uint32_t i = cell.first; i < cell.first + cell.count; i++)
+		{
+			b.minX = std::min(b.minX, m_x[i] - m_radii[i]);
+			b.minY = std::min(b.minY, m_centerYs[i] - m_radii[i]);
+			b.minZ = std::min(b.minZ, m_z[i] - m_radii[i]);
+			b.maxX = std::max(b.maxX, m_x[i] + m_radii[i]);
+			b.maxY = std::max(b.maxY, m_centerYs[i] + m_radii[i]);
+			b.maxZ = std::max(b.maxZ, m_z[i] + m_radii[i]);
+		}
+	}
+
+	for (size_t c = 0; c < m_chunks.size(); c++)
+	{
+		Chunk& chunk = m_chunks[c];
+		chunk.bounds = m_cells[chunk.firstCell].bounds;
+		for (uint32_t i = chunk.firstCell + 1; i < chunk.firstCell + chunk.cellCount; i++)
+		{
+			const Bounds& b = m_cells[i].bounds;
+			chunk.bounds.minX = std::min(chunk.bounds.minX, b.minX);
+			chunk.bounds.minY = std::min(chunk.bounds.minY, b.minY);
+			chunk.bounds.minZ = std::min(chunk.bounds.minZ, b.minZ);
+			chunk.bounds.maxX = std::max(chunk.bounds.maxX, b.maxX);
+			chunk.bounds.maxY = std::max(chunk.bounds.maxY, b.maxY);
+			chunk.bounds.maxZ = std::max(chunk.bounds.maxZ, b.maxZ);
+		}
+	}
+
+	return true;
+}
+
+size_t InstanceCuller::Cull(const View& view, Instance* output, LodRange* lods, int threadCount)
+{
+	int lodCount = std::max(1, std::min(view.lodCount, (int)MAX_LODS));
+	View clamped = view;
+	clamped.lodCount = lodCount;
+
+	memset(&m_stats, 0, sizeof(m_stats));
+	int chunkCount = (int)m_chunks.size();
+	int blockCount = std::max(1, std::min(ParallelThreadCount(threadCount), chunkCount));
+	m_blocks.resize(blockCount);
+
+	ParallelFor(0, blockCount, [&](int b)
+	{
+		Block& block = m_blocks[b];
+		for (int lod = 0; lod < MAX_LODS; lod++)
+		{
+			block.lists[lod].clear();
+		}
+		memset(&block.stats, 0, sizeof(block.stats));
+
+		int first = (int)((long long)chunkCount * b / blockCount);
+		int last = (int)((long long)chunkCount * (b + 1) / blockCount);
+		for (int c = first; c < last; c++)
+		{
+			const Chunk& chunk = m_chunks[c];
+			int nearLod, farLod;
+			Visibility chunkVisibility = TestBounds(clamped, chunk.bounds, true, nearLod, farLod);
+			if (chunkVisibility == OUTSIDE)
+			{
+				continue;
+			}
+			block.stats.chunksVisible++;
+
+			//once a chunk is fully inside so are its cells, only the distances are left to check
+			bool testPlanes = chunkVisibility != INSIDE;
+			for (uint32_t i = chunk.firstCell; i < chunk.firstCell + chunk.cellCount; i++)
+			{
+				const Cell& cell = m_cells[i];
+				block.stats.cellsTested++;
+				Visibility cellVisibility = TestBounds(clamped, cell.bounds, testPlanes, nearLod, farLod);
+				if (cellVisibility == OUTSIDE)
+				{
+					continue;
+				}
+
+				if (cellVisibility == INSIDE && nearLod == farLod)
+				{
+					block.stats.cellsCopied++;
+					block.stats.instancesVisible += cell.count;
+					for (uint32_t slot = cell.first; slot < cell.first + cell.count; slot++)
+					{
+						Emit(slot, block.lists[nearLod]);
+					}
+					continue;
+				}
+
+				CullCell(clamped, cell, cellVisibility != INSIDE, block);
+			}
+		}
+	}, blockCount);
+
+	//join the blocks LOD by LOD, in block order
+	size_t written = 0;
+	for (int lod = 0; lod < lodCount; lod++)
+	{
+		lods[lod].first = (uint32_t)written;
+		for (int b = 0; b < blockCount; b++)
+		{
+			const std::vector<Instance>& list = m_blocks[b].lists[lod];
+			if (!list.empty())
+			{
+				memcpy(output + written, list.data(), list.size() * sizeof(Instance));
+				written += list.size();
+			}
+		}
+		lods[lod].count = (uint32_t)(written - lods[lod].first);
+	}
+
+	for (int b = 0; b < blockCount; b++)
+	{
+		const Stats& stats = m_blocks[b].stats;
+		m_stats.chunksVisible += stats.chunksVisible;
+		m_stats.cellsTested += stats.cellsTested;
+		m_stats.cellsCopied += stats.cellsCopied;
+		m_stats.instancesTested += stats.instancesTested;
+		m_stats.instancesVisible += stats.instancesVisible;
+	}
+
+	return written;
+}
+
+InstanceCuller::Visibility InstanceCuller::TestBounds(const View& view, const Bounds& b, bool testPlanes, int& nearLod, int& farLod)
+{
+	Visibility visibility = INSIDE;
+	if (testPlanes)
+	{
+		for (int p = 0; p < 6; p++)
+		{
+			const float* plane = view.planes[p];
+
+			//the corners furthest along and furthest against the normal
+			float farthest = plane[3] +
+				plane[0] * (plane[0] >= 0.0f ? b.maxX : b.minX) +
+				plane[1] * (plane[1] >= 0.0f ? b.maxY : b.minY) +
+				plane[2] * (plane[2] >= 0.0f ? b.maxZ : b.minZ);
+			if (farthest < 0.0f)
+			{
+				return OUTSIDE;
+			}
+
+			float nearest = plane[3] +
+				plane[0] * (plane[0] >= 0.0f ? b.minX : b.maxX) +
+				plane[1] * (plane[1] >= 0.0f ? b.minY : b.maxY) +
+				plane[2] * (plane[2] >= 0.0f ? b.minZ : b.maxZ);
+			if (nearest < 0.0f)
+			{
+				visibility = INTERSECTING;
+			}
+		}
+	}
+
+	float limits[MAX_LODS];
+	for (int lod = 0; lod < view.lodCount; lod++)
+	{
+		limits[lod] = view.lodDistances[lod] * view.lodDistances[lod];
+	}
+
+	//nearest and furthest points of the box from the eye
+	float nearX = std::max(std::max(b.minX - view.eyeX, view.eyeX - b.maxX), 0.0f);
+	float nearY = std::max(std::max(b.minY - view.eyeY, view.eyeY - b.maxY), 0.0f);
+	float nearZ = std::max(std::max(b.minZ - view.eyeZ, view.eyeZ - b.maxZ), 0.0f);
+	float farX = std::max(fabsf(view.eyeX - b.minX), fabsf(view.eyeX - b.maxX));
+	float farY = std::max(fabsf(view.eyeY - b.minY), fabsf(view.eyeY - b.maxY));
+	float farZ = std::max(fabsf(view.eyeZ - b.minZ), fabsf(view.eyeZ - b.maxZ));
+
+	nearLod = GetLod(view, limits, nearX * nearX + nearY * nearY + nearZ * nearZ);
+	farLod = GetLod(view, limits, farX * farX + farY * farY + farZ * farZ);
+	if (nearLod >= view.lodCount)
+	{
+		return OUTSIDE;
+	}
+	return visibility;
+}
+
+void InstanceCuller::CullCell(const View& view, const Cell& cell, bool testPlanes, Block& block) const
+{
+	__m128 planes[6][4];
+	for (int p = 0; p < 6; p++)
+	{
+		for (int k = 0; k < 4; k++)
+		{
+			planes[p][k] = _mm_set1_ps(view.planes[p][k]);
+		}
+	}
+
+	__m128 limits[MAX_LODS];
+	for (int lod = 0; lod < view.lodCount; lod++)
+	{
+		limits[lod] = _mm_set1_ps(view.lodDistances[lod] * view.lodDistances[lod]);
+	}
+
+	__m128 eyeX = _mm_set1_ps(view.eyeX);
+	__m128 eyeY = _mm_set1_ps(view.eyeY);
+	__m128 eyeZ = _mm_set1_ps(view.eyeZ);
+	__m128 allSet = _mm_castsi128_ps(_mm_set1_epi32(-1));
+	__m128 zero = _mm_setzero_ps();
+
+	uint32_t last = cell.first + cell.count;
+	uint32_t end = cell.first + RoundUp4(cell.count);
+	block.stats.instancesTested += end - cell.first;
+
+	for (uint32_t i = cell.first; i < end; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(&m_x[i]);
+		__m128 y = _mm_loadu_ps(&m_centerYs[i]);
+		__m128 z = _mm_loadu_ps(&m_z[i]);
+
+		//a sphere is in front of a plane while its centre is no more than the radius behind it
+		__m128 visible = allSet;
+		if (testPlanes)
+		{
+			__m128 radius = _mm_loadu_ps(&m_radii[i]);
+			for (int p = 0; p < 6; p++)
+			{
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, planes[p][0]), _mm_mul_ps(y, planes[p][1])),
+					_mm_add_ps(_mm_mul_ps(z, planes[p][2]), planes[p][3]));
+				visible = _mm_and_ps(visible, _mm_cmpge_ps(_mm_add_ps(d, radius), zero));
+			}
+		}
+
+		__m128 dx = _mm_sub_ps(x, eyeX);
+		__m128 dy = _mm_sub_ps(y, eyeY);
+		__m128 dz = _mm_sub_ps(z, eyeZ);
+		__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+		//the compare masks are -1 per lane, so subtracting them counts the distances passed
+		__m128i lod = _mm_setzero_si128();
+		for (int l = 0; l < view.lodCount - 1; l++)
+		{
+			lod = _mm_sub_epi32(lod, _mm_castps_si128(_mm_cmpge_ps(d2, limits[l])));
+		}
+		visible = _mm_and_ps(visible, _mm_cmplt_ps(d2, limits[view.lodCount - 1]));
+
+		int mask = _mm_movemask_ps(visible);
+		if (last - i < 4)
+		{
+			mask &= (1 << (last - i)) - 1;
+		}
+		if (mask == 0)
+		{
+			continue;
+		}
+
+		int lanes[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), lod);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (mask & (1 << lane))
+			{
+				Emit(i + lane, block.lists[lanes[lane]]);
+				block.stats.instancesVisible++;
+			}
+		}
+	}
+}
+
+void InstanceCuller::Emit(uint32_t index, std::vector<Instance>& list) const
+{
+	Instance instance;
+	instance.x = m_x[index];
+	instance.y = m_y[index];
+	instance.z = m_z[index];
+	instance.rotation = m_rotations[index];
+	instance.scale = m_scales[index];
+	list.push_back(instance);
+}
+
+double InstanceCuller::Benchmark(int count, int iterations, int threadCount, Stats* stats)
+{
+	using namespace DirectX::SimpleMath;
+
+	//about one instance per square unit, scattered like a forest
+	float size = sqrtf((float)std::max(count, 1));
+	Philox random(1);
+	std::vector<Instance> instances(count);
+	for (int i = 0; i < count; i++)
+	{
+		instances[i].x = random.GetFloat(i, 0, 0) * size;
+		instances[i].z = random.GetFloat(i, 0, 1) * size;
+		instances[i].y = random.GetFloat(i, 0, 2) * 10.0f;
+		instances[i].rotation = random.GetFloat(i, 0, 3) * 6.2831853f;
+		instances[i].scale = 0.5f + random.GetFloat(i, 0, 4);
+	}
+
+	InstanceCuller culler;
+	culler.Build(instances.data(), instances.size(), 0.5f, 0.75f, 32.0f);
+
+	//standing at the middle of one edge looking across, about half the instances end up visible over the three LODs
+	Vector3 eye(size * 0.5f, 15.0f, -5.0f);
+	Matrix view = Matrix::CreateLookAt(eye, Vector3(size * 0.5f, 0.0f, size * 0.5f), Vector3::UnitY);
+	Matrix projection = Matrix::CreatePerspectiveFieldOfView(3.14159265f / 3.0f, 16.0f / 9.0f, 0.1f, size * 2.0f);
+
+	View cullView;
+	cullView.SetFrustum(view * projection);
+	cullView.eyeX = eye.x;
+	cullView.eyeY = eye.y;
+	cullView.eyeZ = eye.z;
+	cullView.lodCount = 3;
+	cullView.lodDistances[0] = size * 0.1f;
+	cullView.lodDistances[1] = size * 0.3f;
+	cullView.lodDistances[2] = size * 0.8f;
+
+	std::vector<Instance> output(culler.GetInstanceCount());
+	LodRange lods[MAX_LODS];
+	iterations = std::max(iterations, 1);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		culler.Cull(cullView, output.data(), lods, threadCount);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	if (stats)
+	{
+		*stats = culler.GetStats();
+	}
+	return std::chrono::duration<double>(end - start).count() / iterations;
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include "ObjectScatter.h"
+#include "MeshData.h"
+
+//Frustum and distance culling with LOD selection for large numbers of instances (the ObjectScatter output).
+//
+//The instances are binned into square chunks, and every chunk into CELLS x CELLS cells, each with a bounding box
+//around its instances' spheres. Culling walks that small hierarchy first: a chunk or cell that is outside a plane,
+//or further than the last LOD, is dropped whole, and one that is fully inside every plane doesn't test its
+//instances against the planes at all. A cell that is fully inside and whose nearest and furthest points fall in
+//the same LOD band is copied out without looking at a single instance.
+//
+//Everything else is tested four at a time with SSE. The transforms are kept as separate arrays (x, y, z, radius...)
+//and every cell starts on a multiple of four, padded out to the next one with slots whose lanes are masked off, so
+//the loop has no scalar tail. The loads are unaligned ones (std::vector only promises the alignment of a float),
+//which cost the same as aligned ones on anything recent when the data happens to be aligned. The LOD is the
+//number of LOD distances the instance is past, done as a sum of compare masks, and the survivors are written out
+//grouped by LOD so each group can go straight into one instanced draw.
+//
+//Chunks are shared between threads in contiguous blocks, each block fills its own lists and they are joined in
+//block order, so the output order doesn't depend on the thread count.
+
+class InstanceCuller
+{
+public:
+	static const int MAX_LODS = 4;
+	static const int CELLS = 4;		//cells along each side of a chunk
+
+	typedef ObjectScatter::Instance Instance;
+
+	//all in the instances' space (grid space for the scattered objects)
+	struct View
+	{
+		float planes[6][4];				//ax + by + cz + d >= 0 inside, normalised so d is a distance
+		float eyeX, eyeY, eyeZ;
+		float lodDistances[MAX_LODS];	//far end of each LOD, anything past the last one used is culled
+		int lodCount;
+
+		View();
+		//planes from a (row vector, D3D style) world * view * projection matrix
+		void SetFrustum(const DirectX::SimpleMath::Matrix& worldViewProjection);
+	};
+
+	//where each LOD's instances ended up in the output
+	struct LodRange
+	{
+		uint32_t first, count;
+	};
+
+	struct Stats
+	{
+		int chunksVisible;
+		int cellsTested;
+		int cellsCopied;			//taken whole, no per instance work
+		size_t instancesTested;		//went through the SIMD loop, padding included
+		size_t instancesVisible;
+	};
+
+	InstanceCuller();
+	~InstanceCuller();
+
+	//bounds are the model's sphere, centred on its y axis so turning an instance doesn't move it
+	static void GetModelBounds(const MeshData& mesh, float& centerY, float& radius);
+
+	//sorts the instances into the hierarchy. chunkSize is in the instances' units.
+	bool Build(const Instance* instances, size_t count, float centerY, float radius, float chunkSize);
+	void Clear();
+
+	//output needs room for GetInstanceCount() instances, lods gets View::lodCount entries. returns how many are visible.
+	size_t Cull(const View& view, Instance* output, LodRange* lods, int threadCount = 0);
+
+	size_t GetInstanceCount() const { return m_count; }
+	const Stats& GetStats() const { return m_stats; }
+
+	//culls count random instances spread over a square map from a camera in the middle of one side,
+	//returns the average seconds per cull
+	static double Benchmark(int count, int iterations, int threadCount = 0, Stats* stats = nullptr);
+
+private:
+	struct Bounds
+	{
+		float minX, minY, minZ;
+		float maxX, maxY, maxZ;
+	};
+
+	struct Cell
+	{
+		Bounds bounds;
+		uint32_t first, count;		//count is the real instances, first is a multiple of four
+	};
+
+	struct Chunk
+	{
+		Bounds bounds;
+		uint32_t firstCell, cellCount;
+	};
+
+	enum Visibility
+	{
+		OUTSIDE,
+		INTERSECTING,
+		INSIDE,
+	};
+
+	//scratch lists for one block of chunks
+	struct Block
+	{
+		std::vector<Instance> lists[MAX_LODS];
+		Stats stats;
+	};
+
+	static Visibility TestBounds(const View& view, const Bounds& bounds, bool testPlanes, int& nearLod, int& farLod);
+	void CullCell(const View& view, const Cell& cell, bool testPlanes, Block& block) const;
+	void Emit(uint32_t index, std::vector<Instance>& list) const;
+
+private:
+	size_t m_count;
+	float m_centerY, m_radius;
+
+	//one entry per slot, padding included
+	std::vector<float> m_x, m_y, m_z;		//y is the base, where the instance stands
+	std::vector<float> m_centerYs, m_radii;	//the sphere after scaling
+	std::vector<float> m_rotations, m_scales;
+
+	std::vector<Chunk> m_chunks;
+	std::vector<Cell> m_cells;
+	std::vector<Block> m_blocks;
+	Stats m_stats;
+};
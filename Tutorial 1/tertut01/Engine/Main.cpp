@@ -1,6 +1,7 @@
 
 #include "pch.h"
 #include "Game.h"
+#include "SelfTest.h"
 
 #ifdef DXTK_AUDIO
 #include <Dbt.h>
@@ -34,11 +35,21 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 {
 	//macros to tell the compiler the following parameters are unused and to optimise accordingly
     UNREFERENCED_PARAMETER(hPrevInstance);
-    UNREFERENCED_PARAMETER(lpCmdLine);
 
     if (!XMVerifyCPUSupport())
         return 1;
 
+    //-selftest runs the reference checks instead of the game, the exit code says whether they passed
+    if (lpCmdLine && wcsstr(lpCmdLine, L"-selftest"))
+        return SelfTest::Run() ? 0 : 1;
+
+    //-benchmark prints the headless timings instead
+    if (lpCmdLine && wcsstr(lpCmdLine, L"-benchmark"))
+    {
+        SelfTest::Benchmark();
+        return 0;
+    }
+
     HRESULT hr = CoInitializeEx(nullptr, COINITBASE_MULTITHREADED);
     if (FAILED(hr))
         return 1;
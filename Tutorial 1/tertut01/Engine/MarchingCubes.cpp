@@ -0,0 +1,1147 @@
+#include "pch.h"
+#include "MarchingCubes.h"
+#include "ParallelFor.h"
+#include "DiamondSquare.h"
+#include "Philox.h"
+#include <emmintrin.h>
+#include <chrono>
+
+using DirectX::SimpleMath::Vector3;
+
+namespace
+{
+	//the shader's decal[] offsets in samples, y is up
+	const int CORNERS[8][3] =
+	{
+		{ 0, 0, 0 }, { 1, 0, 0 }, { 1, 0, 1 }, { 0, 0, 1 },
+		{ 0, 1, 0 }, { 1, 1, 0 }, { 1, 1, 1 }, { 0, 1, 1 },
+	};
+
+	//the corners at either end of each vertlist[] edge, in the order the shader interpolates them
+	const int EDGE_CORNERS[12][2] =
+	{
+		{ 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 0 },
+		{ 4, 5 }, { 5, 6 }, { 6, 7 }, { 7, 4 },
+		{ 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 },
+	};
+
+	enum Axis
+	{
+		AXIS_X,
+		AXIS_Y,
+		AXIS_Z,
+	};
+
+	//each edge as the sample it starts from (offset from the cell's corner 0) and the axis it runs along,
+	//which is where its vertex sits in the edge caches
+	struct CachedEdge
+	{
+		int axis, dx, dy, dz;
+	};
+
+	const CachedEdge EDGES[12] =
+	{
+		{ AXIS_X, 0, 0, 0 }, { AXIS_Z, 1, 0, 0 }, { AXIS_X, 0, 0, 1 }, { AXIS_Z, 0, 0, 0 },
+		{ AXIS_X, 0, 1, 0 }, { AXIS_Z, 1, 1, 0 }, { AXIS_X, 0, 1, 1 }, { AXIS_Z, 0, 1, 0 },
+		{ AXIS_Y, 0, 0, 0 }, { AXIS_Y, 1, 0, 0 }, { AXIS_Y, 1, 0, 1 }, { AXIS_Y, 0, 0, 1 },
+	};
+
+	//Paul Bourke's triangle table, the same one the shader loads into tritableTex
+	const int8_t TRIANGLES[256][16] =
+	{
+		{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{0, 1, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{1, 8, 3, 9, 8, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{0, 8, 3, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{9, 2, 10, 0, 2, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{2, 8, 3, 2, 10, 8, 10, 9, 8, -1, -1, -1, -1, -1, -1, -1},
+		{3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{0, 11, 2, 8, 11, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{1, 9, 0, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{1, 11, 2, 1, 9, 11, 9, 8, 11, -1, -1, -1, -1, -1, -1, -1},
+		{3, 10, 1, 11, 10, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{0, 10, 1, 0, 8, 10, 8, 11, 10, -1, -1, -1, -1, -1, -1, -1},
+		{3, 9, 0, 3, 11, 9, 11, 10, 9, -1, -1, -1, -1, -1, -1, -1},
+		{9, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{4, 3, 0, 7, 3, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{0, 1, 9, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{4, 1, 9, 4, 7, 1, 7, 3, 1, -1, -1, -1, -1, -1, -1, -1},
+		{1, 2, 10, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{3, 4, 7, 3, 0, 4, 1, 2, 10, -1, -1, -1, -1, -1, -1, -1},
+		{9, 2, 10, 9, 0, 2, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1},
+		{2, 10, 9, 2, 9, 7, 2, 7, 3, 7, 9, 4, -1, -1, -1, -1},
+		{8, 4, 7, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{11, 4, 7, 11, 2, 4, 2, 0, 4, -1, -1, -1, -1, -1, -1, -1},
+		{9, 0, 1, 8, 4, 7, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1},
+		{4, 7, 11, 9, 4, 11, 9, 11, 2, 9, 2, 1, -1, -1, -1, -1},
+		{3, 10, 1, 3, 11, 10, 7, 8, 4, -1, -1, -1, -1, -1, -1, -1},
+		{1, 11, 10, 1, 4, 11, 1, 0, 4, 7, 11, 4, -1, -1, -1, -1},
+		{4, 7, 8, 9, 0, 11, 9, 11, 10, 11, 0, 3, -1, -1, -1, -1},
+		{4, 7, 11, 4, 11, 9, 9, 11, 10, -1, -1, -1, -1, -1, -1, -1},
+		{9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{9, 5, 4, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{0, 5, 4, 1, 5, 0, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{8, 5, 4, 8, 3, 5, 3, 1, 5, -1, -1, -1, -1, -1, -1, -1},
+		{1, 2, 10, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{3, 0, 8, 1, 2, 10, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1},
+		{5, 2, 10, 5, 4, 2, 4, 0, 2, -1, -1, -1, -1, -1, -1, -1},
+		{2, 10, 5, 3, 2, 5, 3, 5, 4, 3, 4, 8, -1, -1, -1, -1},
+		{9, 5, 4, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{0, 11, 2, 0, 8, 11, 4, 9, 5, -1, -1, -1, -1, -1, -1, -1},
+		{0, 5, 4, 0, 1, 5, 2, 3, 11, -1, -1, -1, -1, -1, -1, -1},
+		{2, 1, 5, 2, 5, 8, 2, 8, 11, 4, 8, 5, -1, -1, -1, -1},
+		{10, 3, 11, 10, 1, 3, 9, 5, 4, -1, -1, -1, -1, -1, -1, -1},
+		{4, 9, 5, 0, 8, 1, 8, 10, 1, 8, 11, 10, -1, -1, -1, -1},
+		{5, 4, 0, 5, 0, 11, 5, 11, 10, 11, 0, 3, -1, -1, -1, -1},
+		{5, 4, 8, 5, 8, 10, 10, 8, 11, -1, -1, -1, -1, -1, -1, -1},
+		{9, 7, 8, 5, 7, 9, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{9, 3, 0, 9, 5, 3, 5, 7, 3, -1, -1, -1, -1, -1, -1, -1},
+		{0, 7, 8, 0, 1, 7, 1, 5, 7, -1, -1, -1, -1, -1, -1, -1},
+		{1, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{9, 7, 8, 9, 5, 7, 10, 1, 2, -1, -1, -1, -1, -1, -1, -1},
+		{10, 1, 2, 9, 5, 0, 5, 3, 0, 5, 7, 3, -1, -1, -1, -1},
+		{8, 0, 2, 8, 2, 5, 8, 5, 7, 10, 5, 2, -1, -1, -1, -1},
+		{2, 10, 5, 2, 5, 3, 3, 5, 7, -1, -1, -1, -1, -1, -1, -1},
+		{7, 9, 5, 7, 8, 9, 3, 11, 2, -1, -1, -1, -1, -1, -1, -1},
+		{9, 5, 7, 9, 7, 2, 9, 2, 0, 2, 7, 11, -1, -1, -1, -1},
+		{2, 3, 11, 0, 1, 8, 1, 7, 8, 1, 5, 7, -1, -1, -1, -1},
+		{11, 2, 1, 11, 1, 7, 7, 1, 5, -1, -1, -1, -1, -1, -1, -1},
+		{9, 5, 8, 8, 5, 7, 10, 1, 3, 10, 3, 11, -1, -1, -1, -1},
+		{5, 7, 0, 5, 0, 9, 7, 11, 0, 1, 0, 10, 11, 10, 0, -1},
+		{11, 10, 0, 11, 0, 3, 10, 5, 0, 8, 0, 7, 5, 7, 0, -1},
+		{11, 10, 5, 7, 11, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{0, 8, 3, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{9, 0, 1, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{1, 8, 3, 1, 9, 8, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1},
+		{1, 6, 5, 2, 6, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{1, 6, 5, 1, 2, 6, 3, 0, 8, -1, -1, -1, -1, -1, -1, -1},
+		{9, 6, 5, 9, 0, 6, 0, 2, 6, -1, -1, -1, -1, -1, -1, -1},
+		{5, 9, 8, 5, 8, 2, 5, 2, 6, 3, 2, 8, -1, -1, -1, -1},
+		{2, 3, 11, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{11, 0, 8, 11, 2, 0, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1},
+		{0, 1, 9, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1, -1, -1, -1},
+		{5, 10, 6, 1, 9, 2, 9, 11, 2, 9, 8, 11, -1, -1, -1, -1},
+		{6, 3, 11, 6, 5, 3, 5, 1, 3, -1, -1, -1, -1, -1, -1, -1},
+		{0, 8, 11, 0, 11, 5, 0, 5, 1, 5, 11, 6, -1, -1, -1, -1},
+		{3, 11, 6, 0, 3, 6, 0, 6, 5, 0, 5, 9, -1, -1, -1, -1},
+		{6, 5, 9, 6, 9, 11, 11, 9, 8, -1, -1, -1, -1, -1, -1, -1},
+		{5, 10, 6, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{4, 3, 0, 4, 7, 3, 6, 5, 10, -1, -1, -1, -1, -1, -1, -1},
+		{1, 9, 0, 5, 10, 6, 8, 4, 7, -1, -1, -1, -1, -1, -1, -1},
+		{10, 6, 5, 1, 9, 7, 1, 7, 3, 7, 9, 4, -1, -1, -1, -1},
+		{6, 1, 2, 6, 5, 1, 4, 7, 8, -1, -1, -1, -1, -1, -1, -1},
+		{1, 2, 5, 5, 2, 6, 3, 0, 4, 3, 4, 7, -1, -1, -1, -1},
+		{8, 4, 7, 9, 0, 5, 0, 6, 5, 0, 2, 6, -1, -1, -1, -1},
+		{7, 3, 9, 7, 9, 4, 3, 2, 9, 5, 9, 6, 2, 6, 9, -1},
+		{3, 11, 2, 7, 8, 4, 10, 6, 5, -1, -1, -1, -1, -1, -1, -1},
+		{5, 10, 6, 4, 7, 2, 4, 2, 0, 2, 7, 11, -1, -1, -1, -1},
+		{0, 1, 9, 4, 7, 8, 2, 3, 11, 5, 10, 6, -1, -1, -1, -1},
+		{9, 2, 1, 9, 11, 2, 9, 4, 11, 7, 11, 4, 5, 10, 6, -1},
+		{8, 4, 7, 3, 11, 5, 3, 5, 1, 5, 11, 6, -1, -1, -1, -1},
+		{5, 1, 11, 5, 11, 6, 1, 0, 11, 7, 11, 4, 0, 4, 11, -1},
+		{0, 5, 9, 0, 6, 5, 0, 3, 6, 11, 6, 3, 8, 4, 7, -1},
+		{6, 5, 9, 6, 9, 11, 4, 7, 9, 7, 11, 9, -1, -1, -1, -1},
+		{10, 4, 9, 6, 4, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{4, 10, 6, 4, 9, 10, 0, 8, 3, -1, -1, -1, -1, -1, -1, -1},
+		{10, 0, 1, 10, 6, 0, 6, 4, 0, -1, -1, -1, -1, -1, -1, -1},
+		{8, 3, 1, 8, 1, 6, 8, 6, 4, 6, 1, 10, -1, -1, -1, -1},
+		{1, 4, 9, 1, 2, 4, 2, 6, 4, -1, -1, -1, -1, -1, -1, -1},
+		{3, 0, 8, 1, 2, 9, 2, 4, 9, 2, 6, 4, -1, -1, -1, -1},
+		{0, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{8, 3, 2, 8, 2, 4, 4, 2, 6, -1, -1, -1, -1, -1, -1, -1},
+		{10, 4, 9, 10, 6, 4, 11, 2, 3, -1, -1, -1, -1, -1, -1, -1},
+		{0, 8, 2, 2, 8, 11, 4, 9, 10, 4, 10, 6, -1, -1, -1, -1},
+		{3, 11, 2, 0, 1, 6, 0, 6, 4, 6, 1, 10, -1, -1, -1, -1},
+		{6, 4, 1, 6, 1, 10, 4, 8, 1, 2, 1, 11, 8, 11, 1, -1},
+		{9, 6, 4, 9, 3, 6, 9, 1, 3, 11, 6, 3, -1, -1, -1, -1},
+		{8, 11, 1, 8, 1, 0, 11, 6, 1, 9, 1, 4, 6, 4, 1, -1},
+		{3, 11, 6, 3, 6, 0, 0, 6, 4, -1, -1, -1, -1, -1, -1, -1},
+		{6, 4, 8, 11, 6, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{7, 10, 6, 7, 8, 10, 8, 9, 10, -1, -1, -1, -1, -1, -1, -1},
+		{0, 7, 3, 0, 10, 7, 0, 9, 10, 6, 7, 10, -1, -1, -1, -1},
+		{10, 6, 7, 1, 10, 7, 1, 7, 8, 1, 8, 0, -1, -1, -1, -1},
+		{10, 6, 7, 10, 7, 1, 1, 7, 3, -1, -1, -1, -1, -1, -1, -1},
+		{1, 2, 6, 1, 6, 8, 1, 8, 9, 8, 6, 7, -1, -1, -1, -1},
+		{2, 6, 9, 2, 9, 1, 6, 7, 9, 0, 9, 3, 7, 3, 9, -1},
+		{7, 8, 0, 7, 0, 6, 6, 0, 2, -1, -1, -1, -1, -1, -1, -1},
+		{7, 3, 2, 6, 7, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{2, 3, 11, 10, 6, 8, 10, 8, 9, 8, 6, 7, -1, -1, -1, -1},
+		{2, 0, 7, 2, 7, 11, 0, 9, 7, 6, 7, 10, 9, 10, 7, -1},
+		{1, 8, 0, 1, 7, 8, 1, 10, 7, 6, 7, 10, 2, 3, 11, -1},
+		{11, 2, 1, 11, 1, 7, 10, 6, 1, 6, 7, 1, -1, -1, -1, -1},
+		{8, 9, 6, 8, 6, 7, 9, 1, 6, 11, 6, 3, 1, 3, 6, -1},
+		{0, 9, 1, 11, 6, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{7, 8, 0, 7, 0, 6, 3, 11, 0, 11, 6, 0, -1, -1, -1, -1},
+		{7, 11, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{3, 0, 8, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{0, 1, 9, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{8, 1, 9, 8, 3, 1, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1},
+		{10, 1, 2, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{1, 2, 10, 3, 0, 8, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1},
+		{2, 9, 0, 2, 10, 9, 6, 11, 7, -1, -1, -1, -1, -1, -1, -1},
+		{6, 11, 7, 2, 10, 3, 10, 8, 3, 10, 9, 8, -1, -1, -1, -1},
+		{7, 2, 3, 6, 2, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{7, 0, 8, 7, 6, 0, 6, 2, 0, -1, -1, -1, -1, -1, -1, -1},
+		{2, 7, 6, 2, 3, 7, 0, 1, 9, -1, -1, -1, -1, -1, -1, -1},
+		{1, 6, 2, 1, 8, 6, 1, 9, 8, 8, 7, 6, -1, -1, -1, -1},
+		{10, 7, 6, 10, 1, 7, 1, 3, 7, -1, -1, -1, -1, -1, -1, -1},
+		{10, 7, 6, 1, 7, 10, 1, 8, 7, 1, 0, 8, -1, -1, -1, -1},
+		{0, 3, 7, 0, 7, 10, 0, 10, 9, 6, 10, 7, -1, -1, -1, -1},
+		{7, 6, 10, 7, 10, 8, 8, 10, 9, -1, -1, -1, -1, -1, -1, -1},
+		{6, 8, 4, 11, 8, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{3, 6, 11, 3, 0, 6, 0, 4, 6, -1, -1, -1, -1, -1, -1, -1},
+		{8, 6, 11, 8, 4, 6, 9, 0, 1, -1, -1, -1, -1, -1, -1, -1},
+		{9, 4, 6, 9, 6, 3, 9, 3, 1, 11, 3, 6, -1, -1, -1, -1},
+		{6, 8, 4, 6, 11, 8, 2, 10, 1, -1, -1, -1, -1, -1, -1, -1},
+		{1, 2, 10, 3, 0, 11, 0, 6, 11, 0, 4, 6, -1, -1, -1, -1},
+		{4, 11, 8, 4, 6, 11, 0, 2, 9, 2, 10, 9, -1, -1, -1, -1},
+		{10, 9, 3, 10, 3, 2, 9, 4, 3, 11, 3, 6, 4, 6, 3, -1},
+		{8, 2, 3, 8, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1},
+		{0, 4, 2, 4, 6, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{1, 9, 0, 2, 3, 4, 2, 4, 6, 4, 3, 8, -1, -1, -1, -1},
+		{1, 9, 4, 1, 4, 2, 2, 4, 6, -1, -1, -1, -1, -1, -1, -1},
+		{8, 1, 3, 8, 6, 1, 8, 4, 6, 6, 10, 1, -1, -1, -1, -1},
+		{10, 1, 0, 10, 0, 6, 6, 0, 4, -1, -1, -1, -1, -1, -1, -1},
+		{4, 6, 3, 4, 3, 8, 6, 10, 3, 0, 3, 9, 10, 9, 3, -1},
+		{10, 9, 4, 6, 10, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{4, 9, 5, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{0, 8, 3, 4, 9, 5, 11, 7, 6, -1, -1, -1, -1, -1, -1, -1},
+		{5, 0, 1, 5, 4, 0, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1},
+		{11, 7, 6, 8, 3, 4, 3, 5, 4, 3, 1, 5, -1, -1, -1, -1},
+		{9, 5, 4, 10, 1, 2, 7, 6, 11, -1, -1, -1, -1, -1, -1, -1},
+		{6, 11, 7, 1, 2, 10, 0, 8, 3, 4, 9, 5, -1, -1, -1, -1},
+		{7, 6, 11, 5, 4, 10, 4, 2, 10, 4, 0, 2, -1, -1, -1, -1},
+		{3, 4, 8, 3, 5, 4, 3, 2, 5, 10, 5, 2, 11, 7, 6, -1},
+		{7, 2, 3, 7, 6, 2, 5, 4, 9, -1, -1, -1, -1, -1, -1, -1},
+		{9, 5, 4, 0, 8, 6, 0, 6, 2, 6, 8, 7, -1, -1, -1, -1},
+		{3, 6, 2, 3, 7, 6, 1, 5, 0, 5, 4, 0, -1, -1, -1, -1},
+		{6, 2, 8, 6, 8, 7, 2, 1, 8, 4, 8, 5, 1, 5, 8, -1},
+		{9, 5, 4, 10, 1, 6, 1, 7, 6, 1, 3, 7, -1, -1, -1, -1},
+		{1, 6, 10, 1, 7, 6, 1, 0, 7, 8, 7, 0, 9, 5, 4, -1},
+		{4, 0, 10, 4, 10, 5, 0, 3, 10, 6, 10, 7, 3, 7, 10, -1},
+		{7, 6, 10, 7, 10, 8, 5, 4, 10, 4, 8, 10, -1, -1, -1, -1},
+		{6, 9, 5, 6, 11, 9, 11, 8, 9, -1, -1, -1, -1, -1, -1, -1},
+		{3, 6, 11, 0, 6, 3, 0, 5, 6, 0, 9, 5, -1, -1, -1, -1},
+		{0, 11, 8, 0, 5, 11, 0, 1, 5, 5, 6, 11, -1, -1, -1, -1},
+		{6, 11, 3, 6, 3, 5, 5, 3, 1, -1, -1, -1, -1, -1, -1, -1},
+		{1, 2, 10, 9, 5, 11, 9, 11, 8, 11, 5, 6, -1, -1, -1, -1},
+		{0, 11, 3, 0, 6, 11, 0, 9, 6, 5, 6, 9, 1, 2, 10, -1},
+		{11, 8, 5, 11, 5, 6, 8, 0, 5, 10, 5, 2, 0, 2, 5, -1},
+		{6, 11, 3, 6, 3, 5, 2, 10, 3, 10, 5, 3, -1, -1, -1, -1},
+		{5, 8, 9, 5, 2, 8, 5, 6, 2, 3, 8, 2, -1, -1, -1, -1},
+		{9, 5, 6, 9, 6, 0, 0, 6, 2, -1, -1, -1, -1, -1, -1, -1},
+		{1, 5, 8, 1, 8, 0, 5, 6, 8, 3, 8, 2, 6, 2, 8, -1},
+		{1, 5, 6, 2, 1, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{1, 3, 6, 1, 6, 10, 3, 8, 6, 5, 6, 9, 8, 9, 6, -1},
+		{10, 1, 0, 10, 0, 6, 9, 5, 0, 5, 6, 0, -1, -1, -1, -1},
+		{0, 3, 8, 5, 6, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{10, 5, 6, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{11, 5, 10, 7, 5, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{11, 5, 10, 11, 7, 5, 8, 3, 0, -1, -1, -1, -1, -1, -1, -1},
+		{5, 11, 7, 5, 10, 11, 1, 9, 0, -1, -1, -1, -1, -1, -1, -1},
+		{10, 7, 5, 10, 11, 7, 9, 8, 1, 8, 3, 1, -1, -1, -1, -1},
+		{11, 1, 2, 11, 7, 1, 7, 5, 1, -1, -1, -1, -1, -1, -1, -1},
+		{0, 8, 3, 1, 2, 7, 1, 7, 5, 7, 2, 11, -1, -1, -1, -1},
+		{9, 7, 5, 9, 2, 7, 9, 0, 2, 2, 11, 7, -1, -1, -1, -1},
+		{7, 5, 2, 7, 2, 11, 5, 9, 2, 3, 2, 8, 9, 8, 2, -1},
+		{2, 5, 10, 2, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1},
+		{8, 2, 0, 8, 5, 2, 8, 7, 5, 10, 2, 5, -1, -1, -1, -1},
+		{9, 0, 1, 5, 10, 3, 5, 3, 7, 3, 10, 2, -1, -1, -1, -1},
+		{9, 8, 2, 9, 2, 1, 8, 7, 2, 10, 2, 5, 7, 5, 2, -1},
+		{1, 3, 5, 3, 7, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{0, 8, 7, 0, 7, 1, 1, 7, 5, -1, -1, -1, -1, -1, -1, -1},
+		{9, 0, 3, 9, 3, 5, 5, 3, 7, -1, -1, -1, -1, -1, -1, -1},
+		{9, 8, 7, 5, 9, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{5, 8, 4, 5, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1},
+		{5, 0, 4, 5, 11, 0, 5, 10, 11, 11, 3, 0, -1, -1, -1, -1},
+		{0, 1, 9, 8, 4, 10, 8, 10, 11, 10, 4, 5, -1, -1, -1, -1},
+		{10, 11, 4, 10, 4, 5, 11, 3, 4, 9, 4, 1, 3, 1, 4, -1},
+		{2, 5, 1, 2, 8, 5, 2, 11, 8, 4, 5, 8, -1, -1, -1, -1},
+		{0, 4, 11, 0, 11, 3, 4, 5, 11, 2, 11, 1, 5, 1, 11, -1},
+		{0, 2, 5, 0, 5, 9, 2, 11, 5, 4, 5, 8, 11, 8, 5, -1},
+		{9, 4, 5, 2, 11, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{2, 5, 10, 3, 5, 2, 3, 4, 5, 3, 8, 4, -1, -1, -1, -1},
+		{5, 10, 2, 5, 2, 4, 4, 2, 0, -1, -1, -1, -1, -1, -1, -1},
+		{3, 10, 2, 3, 5, 10, 3, 8, 5, 4, 5, 8, 0, 1, 9, -1},
+		{5, 10, 2, 5, 2, 4, 1, 9, 2, 9, 4, 2, -1, -1, -1, -1},
+		{8, 4, 5, 8, 5, 3, 3, 5, 1, -1, -1, -1, -1, -1, -1, -1},
+		{0, 4, 5, 1, 0, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{8, 4, 5, 8, 5, 3, 9, 0, 5, 0, 3, 5, -1, -1, -1, -1},
+		{9, 4, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{4, 11, 7, 4, 9, 11, 9, 10, 11, -1, -1, -1, -1, -1, -1, -1},
+		{0, 8, 3, 4, 9, 7, 9, 11, 7, 9, 10, 11, -1, -1, -1, -1},
+		{1, 10, 11, 1, 11, 4, 1, 4, 0, 7, 4, 11, -1, -1, -1, -1},
+		{3, 1, 4, 3, 4, 8, 1, 10, 4, 7, 4, 11, 10, 11, 4, -1},
+		{4, 11, 7, 9, 11, 4, 9, 2, 11, 9, 1, 2, -1, -1, -1, -1},
+		{9, 7, 4, 9, 11, 7, 9, 1, 11, 2, 11, 1, 0, 8, 3, -1},
+		{11, 7, 4, 11, 4, 2, 2, 4, 0, -1, -1, -1, -1, -1, -1, -1},
+		{11, 7, 4, 11, 4, 2, 8, 3, 4, 3, 2, 4, -1, -1, -1, -1},
+		{2, 9, 10, 2, 7, 9, 2, 3, 7, 7, 4, 9, -1, -1, -1, -1},
+		{9, 10, 7, 9, 7, 4, 10, 2, 7, 8, 7, 0, 2, 0, 7, -1},
+		{3, 7, 10, 3, 10, 2, 7, 4, 10, 1, 10, 0, 4, 0, 10, -1},
+		{1, 10, 2, 8, 7, 4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{4, 9, 1, 4, 1, 7, 7, 1, 3, -1, -1, -1, -1, -1, -1, -1},
+		{4, 9, 1, 4, 1, 7, 0, 8, 1, 8, 7, 1, -1, -1, -1, -1},
+		{4, 0, 3, 7, 4, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{4, 8, 7, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{9, 10, 8, 10, 11, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{3, 0, 9, 3, 9, 11, 11, 9, 10, -1, -1, -1, -1, -1, -1, -1},
+		{0, 1, 10, 0, 10, 8, 8, 10, 11, -1, -1, -1, -1, -1, -1, -1},
+		{3, 1, 10, 11, 3, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{1, 2, 11, 1, 11, 9, 9, 11, 8, -1, -1, -1, -1, -1, -1, -1},
+		{3, 0, 9, 3, 9, 11, 1, 2, 9, 2, 11, 9, -1, -1, -1, -1},
+		{0, 2, 11, 8, 0, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{3, 2, 11, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{2, 3, 8, 2, 8, 10, 10, 8, 9, -1, -1, -1, -1, -1, -1, -1},
+		{9, 10, 2, 0, 9, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{2, 3, 8, 2, 8, 10, 0, 1, 8, 1, 10, 8, -1, -1, -1, -1},
+		{1, 10, 2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{1, 3, 8, 9, 1, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{0, 9, 1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{0, 3, 8, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+		{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+	};
+
+	//triangles in each case, the rows of TRIANGLES above counted up
+	const uint8_t TRIANGLE_COUNTS[256] =
+	{
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 2, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 3,
+		1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 3, 2, 3, 3, 2, 3, 4, 4, 3, 3, 4, 4, 3, 4, 5, 5, 2,
+		1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 3, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 4,
+		2, 3, 3, 4, 3, 4, 2, 3, 3, 4, 4, 5, 4, 5, 3, 2, 3, 4, 4, 3, 4, 5, 3, 2, 4, 5, 5, 4, 5, 2, 4, 1,
+		1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 3, 2, 3, 3, 4, 3, 4, 4, 5, 3, 2, 4, 3, 4, 3, 5, 2,
+		2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 4, 3, 4, 4, 3, 4, 5, 5, 4, 4, 3, 5, 2, 5, 4, 2, 1,
+		2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 2, 3, 3, 2, 3, 4, 4, 5, 4, 5, 5, 2, 4, 3, 5, 4, 3, 2, 4, 1,
+		3, 4, 4, 5, 4, 5, 3, 4, 4, 5, 5, 2, 3, 4, 2, 1, 2, 3, 3, 2, 3, 4, 2, 1, 3, 2, 4, 1, 2, 1, 1, 0,
+	};
+
+	//what a pyramid block holds for the iso level being meshed
+	enum BlockClass
+	{
+		BLOCK_ABOVE,		//every sample at or above it
+		BLOCK_BELOW,		//every sample below it
+		BLOCK_SURFACE,		//some of each, the surface can pass through
+	};
+
+	//one plane of samples: whether each is below the iso level, and the vertex on each of its three edges
+	struct PlaneCache
+	{
+		std::vector<uint8_t> below;
+		std::vector<uint32_t> edges[3];
+		std::vector<uint8_t> live;			//block columns with samples worth looking at, with a pyramid
+
+		void Resize(size_t count, size_t columns)
+		{
+			below.resize(count);
+			live.resize(columns);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				edges[axis].resize(count);
+			}
+		}
+	};
+
+	class Mesher
+	{
+	public:
+		Mesher(const float* density, int sizeX, int sizeY, int sizeZ, const MarchingCubes::Settings& settings)
+			: m_density(density), m_sizeX(sizeX), m_sizeY(sizeY), m_sizeZ(sizeZ), m_settings(settings)
+		{
+			m_planeSize = (size_t)sizeX * sizeY;
+			m_pyramid = nullptr;
+			m_blockSize = m_blocksX = m_blocksY = m_blocksZ = 0;
+
+			//a pyramid over some other grid would skip the wrong blocks, so it has to match
+			if (settings.pyramid && settings.pyramid->Matches(sizeX, sizeY, sizeZ))
+			{
+				m_pyramid = settings.pyramid;
+				m_pyramid->GetActiveBlocks(settings.isoLevel, m_blocks);
+				m_blockSize = m_pyramid->GetBlockSize();
+				m_blocksX = m_pyramid->GetBlocksX();
+				m_blocksY = m_pyramid->GetBlocksY();
+				m_blocksZ = m_pyramid->GetBlocksZ();
+
+				//the blocks the surface misses are wholly on one side, which is all their classification needs
+				for (int blockZ = 0; blockZ < m_blocksZ; blockZ++)
+				{
+					for (int blockY = 0; blockY < m_blocksY; blockY++)
+					{
+						for (int blockX = 0; blockX < m_blocksX; blockX++)
+						{
+							uint8_t& block = m_blocks[((size_t)blockZ * m_blocksY + blockY) * m_blocksX + blockX];
+							float minimum, maximum;
+							m_pyramid->GetRange(blockX, blockY, blockZ, minimum, maximum);
+							block = block ? BLOCK_SURFACE : maximum < settings.isoLevel ? BLOCK_BELOW : BLOCK_ABOVE;
+						}
+					}
+				}
+			}
+		}
+
+		//1 for every sample of plane z below the iso level. with a pyramid only the blocks the surface can
+		//cross are read, the others are all on one side and just get filled in.
+		void Classify(int z, std::vector<uint8_t>& below) const
+		{
+			const float* plane = m_density + m_planeSize * z;
+			if (!m_pyramid)
+			{
+				ClassifyRange(plane, below.data(), m_planeSize);
+				return;
+			}
+
+			//the blocks' samples overlap by one, so every sample is given to the block it starts in,
+			//except the very last ones which go to the last block. runs of the same kind of block go together.
+			int blockZ = std::min(z / m_blockSize, m_blocksZ - 1);
+			for (int y = 0; y < m_sizeY; y++)
+			{
+				int blockY = std::min(y / m_blockSize, m_blocksY - 1);
+				const uint8_t* blocks = m_blocks.data() + ((size_t)blockZ * m_blocksY + blockY) * m_blocksX;
+				size_t row = (size_t)y * m_sizeX;
+
+				for (int blockX = 0; blockX < m_blocksX; blockX++)
+				{
+					int start = blockX;
+					while (blockX + 1 < m_blocksX && blocks[blockX + 1] == blocks[start])
+					{
+						blockX++;
+					}
+
+					int x0 = start * m_blockSize;
+					int x1 = blockX + 1 < m_blocksX ? (blockX + 1) * m_blockSize : m_sizeX;
+					if (blocks[start] == BLOCK_SURFACE)
+					{
+						ClassifyRange(plane + row + x0, below.data() + row + x0, x1 - x0);
+					}
+					else
+					{
+						memset(below.data() + row + x0, blocks[start] == BLOCK_BELOW, x1 - x0);
+					}
+				}
+			}
+		}
+
+		//crossings owned by a plane (above is the next plane's classification, null on the top one),
+		//and the triangles and active cells in the slab between them
+		void CountPlane(int z, const uint8_t* below, const uint8_t* above, uint32_t& vertices, uint32_t& triangles, uint32_t& cells, uint32_t& visited) const
+		{
+			size_t count = CountDifferent(below, below + m_sizeX, m_planeSize - m_sizeX);
+			for (int y = 0; y < m_sizeY; y++)
+			{
+				const uint8_t* row = below + (size_t)y * m_sizeX;
+				count += CountDifferent(row, row + 1, m_sizeX - 1);
+			}
+
+			triangles = 0;
+			cells = 0;
+			visited = 0;
+			if (above)
+			{
+				count += CountDifferent(below, above, m_planeSize);
+				visited = (uint32_t)ForActiveCells(z, below, above, [&](int, int, int cubeIndex)
+				{
+					cells++;
+					triangles += TRIANGLE_COUNTS[cubeIndex];
+				});
+			}
+			vertices = (uint32_t)count;
+		}
+
+		//numbers the crossings plane z owns starting at first, in the same order CountPlane counted them.
+		//only the plane's owner writes the vertices, the block below just wants their indices.
+		void FillPlane(int z, uint32_t first, PlaneCache& cache, const uint8_t* above, bool write, MeshData& mesh) const
+		{
+			uint32_t next = first;
+			if (!m_pyramid)
+			{
+				for (int y = 0; y < m_sizeY; y++)
+				{
+					FillRun(z, y, 0, m_sizeX, cache, above, write, next, mesh);
+				}
+				return;
+			}
+
+			//a crossing edge is in some cell of an active block, so only the samples of those blocks need
+			//looking at. a sample on a block boundary is in the blocks either side of it.
+			int blockZ0 = std::min(z / m_blockSize, m_blocksZ - 1);
+			int blockZ1 = z % m_blockSize == 0 ? std::max(z / m_blockSize - 1, 0) : blockZ0;
+			size_t columns = (size_t)m_blocksX * m_blocksY;
+			const uint8_t* layer0 = m_blocks.data() + blockZ0 * columns;
+			const uint8_t* layer1 = m_blocks.data() + blockZ1 * columns;
+			for (size_t i = 0; i < columns; i++)
+			{
+				cache.live[i] = (layer0[i] == BLOCK_SURFACE) | (layer1[i] == BLOCK_SURFACE);
+			}
+
+			for (int y = 0; y < m_sizeY; y++)
+			{
+				int blockY0 = std::min(y / m_blockSize, m_blocksY - 1);
+				int blockY1 = y % m_blockSize == 0 ? std::max(y / m_blockSize - 1, 0) : blockY0;
+				const uint8_t* live0 = cache.live.data() + (size_t)blockY0 * m_blocksX;
+				const uint8_t* live1 = cache.live.data() + (size_t)blockY1 * m_blocksX;
+
+				//neighbouring blocks share their boundary samples, so runs of them are walked as one
+				for (int blockX = 0; blockX < m_blocksX; blockX++)
+				{
+					if (!(live0[blockX] | live1[blockX]))
+					{
+						continue;
+					}
+					int start = blockX;
+					while (blockX + 1 < m_blocksX && (live0[blockX + 1] | live1[blockX + 1]))
+					{
+						blockX++;
+					}
+					FillRun(z, y, start * m_blockSize, std::min((blockX + 1) * m_blockSize + 1, m_sizeX), cache, above, write, next, mesh);
+				}
+			}
+		}
+
+		//samples x0 to x1 (exclusive) of row y in plane z
+		void FillRun(int z, int y, int x0, int x1, PlaneCache& cache, const uint8_t* above, bool write, uint32_t& next, MeshData& mesh) const
+		{
+			const float* plane = m_density + m_planeSize * z;
+			const uint8_t* below = cache.below.data();
+			size_t row = (size_t)y * m_sizeX;
+			bool hasY = y + 1 < m_sizeY;
+
+			for (int x = x0; x < x1; x++)
+			{
+				size_t i = row + x;
+				//jump over sixteen samples at a time while none of their edges cross
+				if (hasY && above && x + 16 <= x1 && x + 16 < m_sizeX && !Crossing16(below + i, above + i))
+				{
+					x += 15;
+					continue;
+				}
+
+				uint8_t b = below[i];
+				int crossX = x + 1 < m_sizeX ? b ^ below[i + 1] : 0;
+				int crossY = hasY ? b ^ below[i + m_sizeX] : 0;
+				int crossZ = above ? b ^ above[i] : 0;
+				if ((crossX | crossY | crossZ) == 0)
+				{
+					continue;
+				}
+
+				if (crossX)
+				{
+					cache.edges[AXIS_X][i] = next;
+					if (write)
+					{
+						AddVertex(x, y, z, AXIS_X, plane[i], plane[i + 1], next, mesh);
+					}
+					next++;
+				}
+				if (crossY)
+				{
+					cache.edges[AXIS_Y][i] = next;
+					if (write)
+					{
+						AddVertex(x, y, z, AXIS_Y, plane[i], plane[i + m_sizeX], next, mesh);
+					}
+					next++;
+				}
+				if (crossZ)
+				{
+					cache.edges[AXIS_Z][i] = next;
+					if (write)
+					{
+						AddVertex(x, y, z, AXIS_Z, plane[i], plane[i + m_planeSize], next, mesh);
+					}
+					next++;
+				}
+			}
+		}
+
+		//the slab between the bottom and top planes, indices go out from triangle first on
+		void EmitSlab(int z, const PlaneCache& bottom, const PlaneCache& top, uint32_t first, MeshData& mesh) const
+		{
+			uint32_t* out = mesh.indices.data() + (size_t)first * 3;
+			const PlaneCache* planes[2] = { &bottom, &top };
+
+			ForActiveCells(z, bottom.below.data(), top.below.data(), [&](int x, int y, int cubeIndex)
+			{
+				//the table's triangles face the side below the iso level, the last two corners are swapped
+				//so they face out of the solid like the terrain grid's
+				const int8_t* triangles = TRIANGLES[cubeIndex];
+				for (int t = 0; triangles[t] != -1; t += 3)
+				{
+					out[0] = Lookup(planes, triangles[t], x, y);
+					out[1] = Lookup(planes, triangles[t + 2], x, y);
+					out[2] = Lookup(planes, triangles[t + 1], x, y);
+					out += 3;
+				}
+			});
+		}
+
+		Vector3 Gradient(int x, int y, int z) const
+		{
+			//central differences, one sided on the edges of the grid
+			int x0 = std::max(x - 1, 0), x1 = std::min(x + 1, m_sizeX - 1);
+			int y0 = std::max(y - 1, 0), y1 = std::min(y + 1, m_sizeY - 1);
+			int z0 = std::max(z - 1, 0), z1 = std::min(z + 1, m_sizeZ - 1);
+			return Vector3(
+				(Sample(x1, y, z) - Sample(x0, y, z)) / (float)std::max(x1 - x0, 1),
+				(Sample(x, y1, z) - Sample(x, y0, z)) / (float)std::max(y1 - y0, 1),
+				(Sample(x, y, z1) - Sample(x, y, z0)) / (float)std::max(z1 - z0, 1));
+		}
+
+		//the surface normal between two samples, t along the way
+		Vector3 Normal(int x0, int y0, int z0, int x1, int y1, int z1, float t) const
+		{
+			Vector3 gradient = Gradient(x0, y0, z0) * (1.0f - t) + Gradient(x1, y1, z1) * t;
+			float length = gradient.Length();
+			return length > 0.0f ? gradient * (-1.0f / length) : Vector3(0.0f, 1.0f, 0.0f);
+		}
+
+		float Sample(int x, int y, int z) const
+		{
+			return m_density[m_planeSize * z + (size_t)y * m_sizeX + x];
+		}
+
+	private:
+		static size_t CountDifferent(const uint8_t* a, const uint8_t* b, size_t count)
+		{
+			__m128i zero = _mm_setzero_si128();
+			__m128i sum = zero;
+			size_t i = 0;
+			for (; i + 16 <= count; i += 16)
+			{
+				__m128i different = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+				sum = _mm_add_epi64(sum, _mm_sad_epu8(different, zero));
+			}
+
+			size_t total = (size_t)_mm_cvtsi128_si32(sum) + (size_t)_mm_cvtsi128_si32(_mm_unpackhi_epi64(sum, sum));
+			for (; i < count; i++)
+			{
+				total += a[i] ^ b[i];
+			}
+			return total;
+		}
+
+		//whether any of the sixteen samples from below has an edge that crosses (the caller keeps them off the
+		//last row and column)
+		bool Crossing16(const uint8_t* below, const uint8_t* above) const
+		{
+			__m128i b = _mm_loadu_si128((const __m128i*)below);
+			__m128i crossing = _mm_xor_si128(b, _mm_loadu_si128((const __m128i*)(below + 1)));
+			crossing = _mm_or_si128(crossing, _mm_xor_si128(b, _mm_loadu_si128((const __m128i*)(below + m_sizeX))));
+			crossing = _mm_or_si128(crossing, _mm_xor_si128(b, _mm_loadu_si128((const __m128i*)above)));
+			return _mm_movemask_epi8(_mm_cmpeq_epi8(crossing, _mm_setzero_si128())) != 0xFFFF;
+		}
+
+		void ClassifyRange(const float* values, uint8_t* below, size_t count) const
+		{
+			__m128 iso = _mm_set1_ps(m_settings.isoLevel);
+			__m128i one = _mm_set1_epi8(1);
+			size_t i = 0;
+
+			for (; i + 16 <= count; i += 16)
+			{
+				__m128i a = _mm_castps_si128(_mm_cmplt_ps(_mm_loadu_ps(values + i), iso));
+				__m128i b = _mm_castps_si128(_mm_cmplt_ps(_mm_loadu_ps(values + i + 4), iso));
+				__m128i c = _mm_castps_si128(_mm_cmplt_ps(_mm_loadu_ps(values + i + 8), iso));
+				__m128i d = _mm_castps_si128(_mm_cmplt_ps(_mm_loadu_ps(values + i + 12), iso));
+				__m128i bytes = _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+				_mm_storeu_si128((__m128i*)(below + i), _mm_and_si128(bytes, one));
+			}
+			for (; i < count; i++)
+			{
+				below[i] = values[i] < m_settings.isoLevel;
+			}
+		}
+
+		//function(x, y, cubeIndex) for every cell of slab z the surface goes through, in row order.
+		//with a pyramid only runs of cells in the blocks it left are walked. returns how many cells were.
+		template<typename Function>
+		size_t ForActiveCells(int z, const uint8_t* bottom, const uint8_t* top, Function function) const
+		{
+			size_t visited = 0;
+			int blockZ = m_pyramid ? z / m_blockSize : 0;
+
+			for (int y = 0; y + 1 < m_sizeY; y++)
+			{
+				if (!m_pyramid)
+				{
+					visited += CellRun(bottom, top, y, 0, m_sizeX - 1, function);
+					continue;
+				}
+
+				//neighbouring active blocks along the row are walked as one run
+				const uint8_t* blocks = m_blocks.data() + ((size_t)blockZ * m_blocksY + y / m_blockSize) * m_blocksX;
+				for (int blockX = 0; blockX < m_blocksX; blockX++)
+				{
+					if (blocks[blockX] != BLOCK_SURFACE)
+					{
+						continue;
+					}
+					int first = blockX;
+					while (blockX + 1 < m_blocksX && blocks[blockX + 1] == BLOCK_SURFACE)
+					{
+						blockX++;
+					}
+					visited += CellRun(bottom, top, y, first * m_blockSize, std::min((blockX + 1) * m_blockSize, m_sizeX - 1), function);
+				}
+			}
+			return visited;
+		}
+
+		//cells x0 to x1 (exclusive) of row y. a run of sixteen cells is passed over whole when every one of them
+		//has all eight corners on the same side.
+		template<typename Function>
+		size_t CellRun(const uint8_t* bottom, const uint8_t* top, int y, int x0, int x1, Function& function) const
+		{
+			size_t row = (size_t)y * m_sizeX;
+			int x = x0;
+			for (; x + 16 <= x1; x += 16)
+			{
+				size_t i = row + x;
+				const uint8_t* rows[4] = { bottom + i, bottom + i + m_sizeX, top + i, top + i + m_sizeX };
+				__m128i any = _mm_setzero_si128();
+				__m128i all = _mm_set1_epi8(1);
+				for (int r = 0; r < 4; r++)
+				{
+					__m128i a = _mm_loadu_si128((const __m128i*)rows[r]);
+					__m128i b = _mm_loadu_si128((const __m128i*)(rows[r] + 1));
+					any = _mm_or_si128(any, _mm_or_si128(a, b));
+					all = _mm_and_si128(all, _mm_and_si128(a, b));
+				}
+				if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, all)) == 0xFFFF)
+				{
+					continue;
+				}
+
+				for (int k = x; k < x + 16; k++)
+				{
+					int cubeIndex = CubeIndex(bottom, top, row + k);
+					if (cubeIndex != 0 && cubeIndex != 255)
+					{
+						function(k, y, cubeIndex);
+					}
+				}
+			}
+			for (; x < x1; x++)
+			{
+				int cubeIndex = CubeIndex(bottom, top, row + x);
+				if (cubeIndex != 0 && cubeIndex != 255)
+				{
+					function(x, y, cubeIndex);
+				}
+			}
+			return x1 - x0;
+		}
+
+		int CubeIndex(const uint8_t* bottom, const uint8_t* top, size_t i) const
+		{
+			size_t up = i + m_sizeX;
+			return bottom[i] | (bottom[i + 1] << 1) | (top[i + 1] << 2) | (top[i] << 3) |
+				(bottom[up] << 4) | (bottom[up + 1] << 5) | (top[up + 1] << 6) | (top[up] << 7);
+		}
+
+		uint32_t Lookup(const PlaneCache* const* planes, int edge, int x, int y) const
+		{
+			const CachedEdge& e = EDGES[edge];
+			return planes[e.dz]->edges[e.axis][(size_t)(y + e.dy) * m_sizeX + x + e.dx];
+		}
+
+		void AddVertex(int x, int y, int z, int axis, float value0, float value1, uint32_t index, MeshData& mesh) const
+		{
+			float t = (m_settings.isoLevel - value0) / (value1 - value0);
+			int dx = axis == AXIS_X, dy = axis == AXIS_Y, dz = axis == AXIS_Z;
+
+			mesh.positions[index] = m_settings.origin + Vector3(x + t * dx, y + t * dy, z + t * dz) * m_settings.spacing;
+			if (m_settings.normals)
+			{
+				mesh.normals[index] = Normal(x, y, z, x + dx, y + dy, z + dz, t);
+			}
+		}
+
+	private:
+		const float* m_density;
+		int m_sizeX, m_sizeY, m_sizeZ;
+		size_t m_planeSize;
+		const MarchingCubes::Settings& m_settings;
+
+		const DensityPyramid* m_pyramid;
+		std::vector<uint8_t> m_blocks;		//a BlockClass per level 0 block
+		int m_blockSize, m_blocksX, m_blocksY, m_blocksZ;
+	};
+
+	//Polygonise of a 4^3 grid around a ball (see TestAgainstReference), kept to catch any change to the mesh itself,
+	//which comparing against PolygoniseReference wouldn't, since that shares the tables
+	const float GOLDEN_POSITIONS[24][3] =
+	{
+		{ 1.000000f, 1.000000f, 0.463034f }, { 2.000000f, 1.000000f, 0.573295f }, { 1.000000f, 2.000000f, 0.357397f },
+		{ 2.000000f, 2.000000f, 0.463034f }, { 1.000000f, 0.500512f, 1.000000f }, { 2.000000f, 0.603911f, 1.000000f },
+		{ 0.417739f, 1.000000f, 1.000000f }, { 2.396089f, 1.000000f, 1.000000f }, { 0.305266f, 2.000000f, 1.000000f },
+		{ 1.000000f, 2.694734f, 1.000000f }, { 2.499488f, 2.000000f, 1.000000f }, { 2.000000f, 2.582261f, 1.000000f },
+		{ 1.000000f, 0.500512f, 2.000000f }, { 2.000000f, 0.603911f, 2.000000f }, { 0.417739f, 1.000000f, 2.000000f },
+		{ 1.000000f, 1.000000f, 2.536966f }, { 2.396089f, 1.000000f, 2.000000f }, { 2.000000f, 1.000000f, 2.426705f },
+		{ 0.305266f, 2.000000f, 2.000000f }, { 1.000000f, 2.694734f, 2.000000f }, { 1.000000f, 2.000000f, 2.642603f },
+		{ 2.499488f, 2.000000f, 2.000000f }, { 2.000000f, 2.582261f, 2.000000f }, { 2.000000f, 2.000000f, 2.536966f },
+	};
+
+	const uint32_t GOLDEN_INDICES[44 * 3] =
+	{
+		4, 6, 0,   4, 1, 5,   0, 1, 4,   1, 7, 5,   0, 8, 2,   6, 8, 0,
+		1, 0, 3,   0, 2, 3,   3, 7, 1,   10, 7, 3,   2, 8, 9,   2, 11, 3,
+		9, 11, 2,   3, 11, 10,   12, 6, 4,   14, 6, 12,   5, 13, 4,   13, 12, 4,
+		16, 5, 7,   13, 5, 16,   6, 14, 8,   8, 14, 18,   7, 10, 16,   10, 21, 16,
+		9, 18, 19,   8, 18, 9,   11, 9, 22,   22, 9, 19,   10, 22, 21,   11, 22, 10,
+		12, 15, 14,   13, 15, 12,   17, 15, 13,   16, 17, 13,   14, 20, 18,   15, 20, 14,
+		17, 23, 15,   15, 23, 20,   21, 17, 16,   23, 17, 21,   18, 20, 19,   23, 19, 20,
+		22, 19, 23,   21, 22, 23,
+	};
+}
+
+
+bool MarchingCubes::Polygonise(const float* density, int sizeX, int sizeY, int sizeZ, const Settings& settings, MeshData& mesh,
+	int threadCount, Stats* stats)
+{
+	mesh.Clear();
+	if (!density || sizeX < 2 || sizeY < 2 || sizeZ < 2)
+	{
+		return false;
+	}
+
+	Mesher mesher(density, sizeX, sizeY, sizeZ, settings);
+	size_t planeSize = (size_t)sizeX * sizeY;
+
+	//count what every plane and slab will write. a block carries the classification of the plane above
+	//over to the next one, so each plane is classified once per block.
+	std::vector<uint32_t> planeVertices(sizeZ + 1), slabTriangles(sizeZ + 1), slabCells(sizeZ), slabVisited(sizeZ);
+	ParallelForRanges(0, sizeZ, [&](int first, int last)
+	{
+		std::vector<uint8_t> below(planeSize), above(planeSize);
+		mesher.Classify(first, below);
+		for (int z = first; z < last; z++)
+		{
+			bool hasAbove = z + 1 < sizeZ;
+			if (hasAbove)
+			{
+				mesher.Classify(z + 1, above);
+			}
+			mesher.CountPlane(z, below.data(), hasAbove ? above.data() : nullptr, planeVertices[z], slabTriangles[z], slabCells[z], slabVisited[z]);
+			below.swap(above);
+		}
+	}, threadCount);
+
+	//exclusive prefix sums, entry z is where plane / slab z starts
+	size_t vertexCount = 0, triangleCount = 0, cellCount = 0, visitedCount = 0;
+	for (int z = 0; z <= sizeZ; z++)
+	{
+		uint32_t vertices = planeVertices[z];
+		uint32_t triangles = slabTriangles[z];
+		planeVertices[z] = (uint32_t)vertexCount;
+		slabTriangles[z] = (uint32_t)triangleCount;
+		vertexCount += vertices;
+		triangleCount += triangles;
+		cellCount += z < sizeZ ? slabCells[z] : 0;
+		visitedCount += z < sizeZ ? slabVisited[z] : 0;
+	}
+
+	if (vertexCount > UINT32_MAX || triangleCount * 3 > UINT32_MAX)
+	{
+		return false;
+	}
+
+	mesh.positions.resize(vertexCount);
+	if (settings.normals)
+	{
+		mesh.normals.resize(vertexCount);
+	}
+	mesh.indices.resize(triangleCount * 3);
+
+	//every block walks its slabs upwards, the top plane's cache turning into the next bottom one.
+	//numbering a plane's crossings needs the plane above it classified too, so that is kept one plane ahead.
+	//the plane above a block's last slab belongs to the next block (or to this one if it's the top of the grid).
+	ParallelForRanges(0, sizeZ - 1, [&](int first, int last)
+	{
+		PlaneCache bottom, top;
+		std::vector<uint8_t> ahead(planeSize);
+		size_t columns = settings.pyramid ? (size_t)settings.pyramid->GetBlocksX() * settings.pyramid->GetBlocksY() : 0;
+		bottom.Resize(planeSize, columns);
+		top.Resize(planeSize, columns);
+
+		mesher.Classify(first, bottom.below);
+		mesher.Classify(first + 1, top.below);
+		mesher.FillPlane(first, planeVertices[first], bottom, top.below.data(), true, mesh);
+		for (int z = first; z < last; z++)
+		{
+			bool hasAhead = z + 2 < sizeZ;
+			if (hasAhead)
+			{
+				mesher.Classify(z + 2, ahead);
+			}
+
+			bool owned = z + 1 < last || z + 1 == sizeZ - 1;
+			mesher.FillPlane(z + 1, planeVertices[z + 1], top, hasAhead ? ahead.data() : nullptr, owned, mesh);
+			mesher.EmitSlab(z, bottom, top, slabTriangles[z], mesh);
+
+			std::swap(bottom, top);
+			top.below.swap(ahead);
+		}
+	}, threadCount);
+
+	if (stats)
+	{
+		stats->visitedCells = visitedCount;
+		stats->activeCells = cellCount;
+		stats->vertices = vertexCount;
+		stats->triangles = triangleCount;
+	}
+	return true;
+}
+
+void MarchingCubes::PolygoniseReference(const float* density, int sizeX, int sizeY, int sizeZ, const Settings& settings, MeshData& mesh)
+{
+	mesh.Clear();
+	if (!density || sizeX < 2 || sizeY < 2 || sizeZ < 2)
+	{
+		return;
+	}
+
+	Settings everyCell = settings;
+	everyCell.pyramid = nullptr;
+	Mesher mesher(density, sizeX, sizeY, sizeZ, everyCell);
+	float iso = settings.isoLevel;
+
+	for (int z = 0; z + 1 < sizeZ; z++)
+	{
+		for (int y = 0; y + 1 < sizeY; y++)
+		{
+			for (int x = 0; x + 1 < sizeX; x++)
+			{
+				float values[8];
+				int cubeIndex = 0;
+				for (int i = 0; i < 8; i++)
+				{
+					values[i] = mesher.Sample(x + CORNERS[i][0], y + CORNERS[i][1], z + CORNERS[i][2]);
+					cubeIndex |= (values[i] < iso) << i;
+				}
+				if (cubeIndex == 0 || cubeIndex == 255)
+				{
+					continue;
+				}
+
+				//vertlist[], straight from the corners the way the shader does it
+				Vector3 positions[12], normals[12];
+				for (int e = 0; e < 12; e++)
+				{
+					const int* c0 = CORNERS[EDGE_CORNERS[e][0]];
+					const int* c1 = CORNERS[EDGE_CORNERS[e][1]];
+					float v0 = values[EDGE_CORNERS[e][0]];
+					float v1 = values[EDGE_CORNERS[e][1]];
+					if ((v0 < iso) == (v1 < iso))
+					{
+						continue;
+					}
+
+					float t = (iso - v0) / (v1 - v0);
+					Vector3 p0((float)(x + c0[0]), (float)(y + c0[1]), (float)(z + c0[2]));
+					Vector3 p1((float)(x + c1[0]), (float)(y + c1[1]), (float)(z + c1[2]));
+					positions[e] = settings.origin + (p0 + (p1 - p0) * t) * settings.spacing;
+					normals[e] = mesher.Normal(x + c0[0], y + c0[1], z + c0[2], x + c1[0], y + c1[1], z + c1[2], t);
+				}
+
+				const int8_t* triangles = TRIANGLES[cubeIndex];
+				for (int t = 0; triangles[t] != -1; t += 3)
+				{
+					int corners[3] = { triangles[t], triangles[t + 2], triangles[t + 1] };
+					for (int k = 0; k < 3; k++)
+					{
+						mesh.indices.push_back((uint32_t)mesh.positions.size());
+						mesh.positions.push_back(positions[corners[k]]);
+						if (settings.normals)
+						{
+							mesh.normals.push_back(normals[corners[k]]);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+const int8_t* MarchingCubes::GetTriangles(int cubeIndex)
+{
+	return TRIANGLES[cubeIndex & 255];
+}
+
+void MarchingCubes::BuildBenchmarkVolume(int size, std::vector<float>& density, int threadCount)
+{
+	int grid = 2;
+	while (grid + 1 < size)
+	{
+		grid *= 2;
+	}
+	grid += 1;
+
+	DiamondSquare::Settings terrain;
+	terrain.amplitude = size * 0.25f;
+	terrain.roughness = 0.55f;
+	terrain.threadCount = threadCount;
+	std::vector<float> heights(grid * grid);
+	DiamondSquare::Generate(heights.data(), grid, grid, terrain);
+
+	//solid below the ground, with some lumps to give it overhangs, y is up
+	density.resize((size_t)size * size * size);
+	ParallelFor(0, size, [&](int z)
+	{
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
+			{
+				float lumps = sinf(x * 0.21f) * sinf(y * 0.17f) * sinf(z * 0.19f) * size * 0.03f;
+				density[((size_t)z * size + y) * size + x] = size * 0.5f + heights[z * grid + x] - y + lumps;
+			}
+		}
+	}, threadCount);
+}
+
+double MarchingCubes::Benchmark(int size, int iterations, bool usePyramid, int threadCount, Stats* stats)
+{
+	std::vector<float> density;
+	BuildBenchmarkVolume(size, density, threadCount);
+
+	//the pyramid is kept up to date as the density changes, so building it isn't part of the timing
+	DensityPyramid pyramid;
+	Settings settings;
+	if (usePyramid)
+	{
+		pyramid.Build(density.data(), size, size, size, 8, threadCount);
+		settings.pyramid = &pyramid;
+	}
+
+	MeshData mesh;
+	iterations = std::max(iterations, 1);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		Polygonise(density.data(), size, size, size, settings, mesh, threadCount, stats);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration<double>(end - start).count() / iterations;
+}
+
+size_t MarchingCubes::TestAgainstReference(int trials, int maxThreads)
+{
+	size_t failures = 0;
+	auto differs = [](const Vector3& a, const Vector3& b, float tolerance)
+	{
+		return fabsf(a.x - b.x) > tolerance || fabsf(a.y - b.y) > tolerance || fabsf(a.z - b.z) > tolerance;
+	};
+
+	Philox random(45);
+	std::vector<float> density;
+	for (int trial = 0; trial < trials; trial++)
+	{
+		//odd sizes, a few overlapping waves and noise on every sample, so every case and plenty of flat
+		//patches and single sample bumps turn up
+		int sizeX = 2 + (int)(random.GetFloat(0, trial, 0) * 30.0f);
+		int sizeY = 2 + (int)(random.GetFloat(1, trial, 0) * 30.0f);
+		int sizeZ = 2 + (int)(random.GetFloat(2, trial, 0) * 30.0f);
+		float frequency = 0.1f + random.GetFloat(3, trial, 0);
+		float noise = random.GetFloat(4, trial, 0);
+		density.resize((size_t)sizeX * sizeY * sizeZ);
+		for (int z = 0; z < sizeZ; z++)
+		{
+			for (int y = 0; y < sizeY; y++)
+			{
+				for (int x = 0; x < sizeX; x++)
+				{
+					density[((size_t)z * sizeY + y) * sizeX + x] = sinf(x * frequency) + cosf(y * frequency * 1.3f) + sinf(z * frequency * 0.7f) +
+						(random.GetFloat(x + y * sizeX, z, 1 + trial) - 0.5f) * noise;
+				}
+			}
+		}
+
+		Settings settings;
+		settings.isoLevel = random.GetFloat(5, trial, 0) - 0.5f;
+		MeshData reference;
+		PolygoniseReference(density.data(), sizeX, sizeY, sizeZ, settings, reference);
+
+		DensityPyramid pyramid;
+		pyramid.Build(density.data(), sizeX, sizeY, sizeZ, 4);
+
+		//the cells are walked in the same order, so triangle t has to be the reference's triangle t. the vertices
+		//come from the same samples but not always through the same arithmetic, so they're allowed a rounding error.
+		MeshData first;
+		for (int threads = 1; threads <= std::max(1, maxThreads); threads++)
+		{
+			for (int usePyramid = 0; usePyramid < 2; usePyramid++)
+			{
+				settings.pyramid = usePyramid ? &pyramid : nullptr;
+				MeshData mesh;
+				Polygonise(density.data(), sizeX, sizeY, sizeZ, settings, mesh, threads);
+				if (mesh.indices.size() != reference.indices.size())
+				{
+					failures++;
+					continue;
+				}
+				for (size_t i = 0; i < mesh.indices.size(); i++)
+				{
+					if (differs(mesh.positions[mesh.indices[i]], reference.positions[i], 1e-4f) ||
+						differs(mesh.normals[mesh.indices[i]], reference.normals[i], 1e-3f))
+					{
+						failures++;
+						break;
+					}
+				}
+
+				//and the thread count doesn't change a single bit
+				if (threads == 1 && !usePyramid)
+				{
+					first = mesh;
+				}
+				else if (mesh.indices != first.indices || mesh.positions.size() != first.positions.size() ||
+					memcmp(mesh.positions.data(), first.positions.data(), mesh.positions.size() * sizeof(Vector3)) != 0)
+				{
+					failures++;
+				}
+			}
+		}
+	}
+
+	//the golden mesh, on one thread and on several
+	const int size = 4;
+	density.resize(size * size * size);
+	for (int z = 0; z < size; z++)
+	{
+		for (int y = 0; y < size; y++)
+		{
+			for (int x = 0; x < size; x++)
+			{
+				density[(z * size + y) * size + x] = 1.3f - (Vector3((float)x, (float)y, (float)z) - Vector3(1.4f, 1.6f, 1.5f)).Length();
+			}
+		}
+	}
+	for (int threads = 1; threads <= 2; threads++)
+	{
+		MeshData mesh;
+		Polygonise(density.data(), size, size, size, Settings(), mesh, threads);
+		if (mesh.positions.size() != 24 || mesh.indices.size() != 44 * 3 ||
+			memcmp(mesh.indices.data(), GOLDEN_INDICES, sizeof(GOLDEN_INDICES)) != 0)
+		{
+			failures++;
+			continue;
+		}
+		for (size_t i = 0; i < mesh.positions.size(); i++)
+		{
+			if (differs(mesh.positions[i], Vector3(GOLDEN_POSITIONS[i][0], GOLDEN_POSITIONS[i][1], GOLDEN_POSITIONS[i][2]), 1e-4f))
+			{
+				failures++;
+				break;
+			}
+		}
+	}
+
+	return failures;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include "MeshData.h"
+#include "DensityPyramid.h"
+
+//CPU marching cubes over a 3D density grid, with the same corner / edge numbering and triangle table as
+//MarchingCube_GS.hlsl (edge e is vertlist[e]), so both turn a density into the same surface.
+//Corner i sets bit i of the case when its density is below the iso level, so the solid side is the
+//one above it (like a terrain density that grows downwards).
+//
+//The shader builds every edge vertex once in each of the (up to four) cells around the edge and emits loose
+//triangles. Here every edge crossing gets exactly one vertex and the triangles index into them. The grid is
+//walked in z slabs, one layer of cells at a time, with an edge cache for the two planes the slab sits between:
+//for every sample, the index of the vertex on its +x, +y and +z edge. The top plane's cache becomes the next
+//slab's bottom one, so nothing is looked up twice or searched for.
+//
+//A first pass counts the crossings each plane owns (its x and y edges plus the z edges up to the next plane)
+//and the triangles in each slab. Prefix sums of those give every plane and slab a fixed place in the output,
+//so the slabs are split between threads and written straight into the final arrays, and the mesh comes out
+//the same whatever the thread count. That makes it safe to compare against stored (golden) meshes.
+//
+//Most cells are nowhere near the surface. Given a DensityPyramid, a plane only reads the density inside blocks
+//the surface can cross, the rest of its classification is filled in from each block's side of the iso level,
+//and only the cells of those blocks are walked.
+
+class MarchingCubes
+{
+public:
+	struct Settings
+	{
+		float isoLevel;							//0 like the shader
+		DirectX::SimpleMath::Vector3 origin;	//where sample (0, 0, 0) sits
+		float spacing;							//distance between samples
+		bool normals;							//down the density gradient, out of the solid, like the shader's
+		const DensityPyramid* pyramid;			//over the same density, blocks it rules out are never looked at
+
+		Settings() : isoLevel(0.0f), origin(0.0f, 0.0f, 0.0f), spacing(1.0f), normals(true), pyramid(nullptr) {}
+	};
+
+	struct Stats
+	{
+		size_t visitedCells;					//cells classified, all of them without a pyramid
+		size_t activeCells;						//cells the surface goes through
+		size_t vertices, triangles;
+	};
+
+	//density is sizeX * sizeY * sizeZ samples, x fastest, then y, then z
+	static bool Polygonise(const float* density, int sizeX, int sizeY, int sizeZ, const Settings& settings, MeshData& mesh,
+		int threadCount = 0, Stats* stats = nullptr);
+
+	//one cell at a time like the geometry shader, three unshared vertices per triangle.
+	//slow, only here to check Polygonise against.
+	static void PolygoniseReference(const float* density, int sizeX, int sizeY, int sizeZ, const Settings& settings, MeshData& mesh);
+
+	//Polygonise against PolygoniseReference on random grids, on 1 to maxThreads threads with and without a
+	//pyramid, and against a stored golden mesh. returns how many meshes didn't match, 0 when they all did.
+	static size_t TestAgainstReference(int trials, int maxThreads = 6);
+
+	//the vertlist index for each of a triangle's corners, -1 terminated
+	static const int8_t* GetTriangles(int cubeIndex);
+
+	//a size^3 terrain like volume (a diamond square heightfield with overhanging lumps) for the benchmarks
+	static void BuildBenchmarkVolume(int size, std::vector<float>& density, int threadCount = 0);
+	//meshes BuildBenchmarkVolume, with or without a pyramid. returns the average seconds per Polygonise.
+	static double Benchmark(int size, int iterations, bool usePyramid, int threadCount = 0, Stats* stats = nullptr);
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+//Plain CPU side indexed triangle mesh, used to pass geometry between the generators, the exporters
+//and the mesh processing code without going through a D3D buffer.
+//normals and uvs are optional but when present they have one entry per position.
+struct MeshData
+{
+	std::vector<DirectX::SimpleMath::Vector3> positions;
+	std::vector<DirectX::SimpleMath::Vector3> normals;
+	std::vector<DirectX::SimpleMath::Vector2> uvs;
+	std::vector<uint32_t> indices;
+
+	size_t GetTriangleCount() const { return indices.size() / 3; }
+	bool HasNormals() const { return !normals.empty() && normals.size() == positions.size(); }
+	bool HasUVs() const { return !uvs.empty() && uvs.size() == positions.size(); }
+
+	void Clear()
+	{
+		positions.clear();
+		normals.clear();
+		uvs.clear();
+		indices.clear();
+	}
+};
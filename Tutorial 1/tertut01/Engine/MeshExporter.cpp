@@ -0,0 +1,337 @@
+#include "pch.h"
+#include "MeshExporter.h"
+
+namespace
+{
+	//big enough that the OS sees a handful of large writes rather than lots of little ones
+	const size_t EXPORT_BUFFER_SIZE = 4 * 1024 * 1024;
+
+	class OutputBuffer
+	{
+	public:
+		OutputBuffer(FILE* file) : m_file(file), m_used(0), m_failed(false)
+		{
+			m_buffer.resize(EXPORT_BUFFER_SIZE);
+		}
+
+		~OutputBuffer()
+		{
+			Flush();
+		}
+
+		//makes sure there is room for count bytes and hands back where to put them
+		char* Reserve(size_t count)
+		{
+			if (m_used + count > m_buffer.size())
+			{
+				Flush();
+			}
+			return &m_buffer[m_used];
+		}
+
+		void Commit(size_t count)
+		{
+			m_used += count;
+		}
+
+		void Write(const void* data, size_t count)
+		{
+			if (count > m_buffer.size())
+			{
+				Flush();
+				m_failed |= fwrite(data, 1, count, m_file) != count;
+				return;
+			}
+			memcpy(Reserve(count), data, count);
+			Commit(count);
+		}
+
+		void Flush()
+		{
+			if (m_used > 0)
+			{
+				m_failed |= fwrite(m_buffer.data(), 1, m_used, m_file) != m_used;
+				m_used = 0;
+			}
+		}
+
+		bool Failed() const { return m_failed; }
+
+	private:
+		FILE* m_file;
+		std::vector<char> m_buffer;
+		size_t m_used;
+		bool m_failed;
+	};
+
+	const uint64_t POWERS_OF_TEN[] = { 1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull, 1000000000ull };
+
+	int FormatUnsigned(uint64_t value, char* out)
+	{
+		char digits[24];
+		int count = 0;
+		do
+		{
+			digits[count++] = (char)('0' + (value % 10));
+			value /= 10;
+		} while (value > 0);
+
+		for (int i = 0; i < count; i++)
+		{
+			out[i] = digits[count - 1 - i];
+		}
+		return count;
+	}
+}
+
+
+int MeshExporter::FormatInt(int64_t value, char* out)
+{
+	if (value < 0)
+	{
+		out[0] = '-';
+		return 1 + FormatUnsigned((uint64_t)(-value), out + 1);
+	}
+	return FormatUnsigned((uint64_t)value, out);
+}
+
+int MeshExporter::FormatFloat(float value, char* out, int decimals)
+{
+	decimals = std::max(0, std::min(decimals, 9));
+
+	//anything the fixed point path can't hold goes through the slow route: magnitude * scale has to stay well
+	//under 2^63 (about 9.2e18), so the limit shrinks as the decimals grow
+	uint64_t scale = POWERS_OF_TEN[decimals];
+	double magnitude = fabs((double)value);
+	if (!(magnitude < 1e18 / (double)scale))
+	{
+		return sprintf_s(out, 32, "%g", value);
+	}
+
+	uint64_t fixed = (uint64_t)(magnitude * (double)scale + 0.5);
+	uint64_t whole = fixed / scale;
+	uint64_t fraction = fixed % scale;
+
+	int length = 0;
+	if (value < 0.0f && fixed != 0)
+	{
+		out[length++] = '-';
+	}
+	length += FormatUnsigned(whole, out + length);
+
+	if (fraction != 0)
+	{
+		//trim the trailing zeros before writing so we know how many digits are left
+		int digits = decimals;
+		while (fraction % 10 == 0)
+		{
+			fraction /= 10;
+			digits--;
+		}
+
+		out[length++] = '.';
+		for (int i = digits - 1; i >= 0; i--)
+		{
+			out[length + i] = (char)('0' + (fraction % 10));
+			fraction /= 10;
+		}
+		length += digits;
+	}
+
+	return length;
+}
+
+bool MeshExporter::WritePly(const char* filename, const MeshData& mesh)
+{
+	FILE* file;
+	errno_t err;
+	char header[512];
+
+	err = fopen_s(&file, filename, "wb");
+	if (err != 0)
+	{
+		return false;
+	}
+
+	bool normals = mesh.HasNormals();
+	bool uvs = mesh.HasUVs();
+	size_t triangles = mesh.GetTriangleCount();
+
+	int headerLength = sprintf_s(header, sizeof(header),
+		"ply\nformat binary_little_endian 1.0\ncomment exported by the terrain generator\n"
+		"element vertex %zu\nproperty float x\nproperty float y\nproperty float z\n%s%s"
+		"element face %zu\nproperty list uchar int vertex_indices\nend_header\n",
+		mesh.positions.size(),
+		normals ? "property float nx\nproperty float ny\nproperty float nz\n" : "",
+		uvs ? "property float s\nproperty float t\n" : "",
+		triangles);
+
+	bool failed;
+	{
+		OutputBuffer out(file);
+		out.Write(header, headerLength);
+
+		//vertices are interleaved in the order the header declares
+		size_t vertexSize = sizeof(float) * (3 + (normals ? 3 : 0) + (uvs ? 2 : 0));
+		for (size_t i = 0; i < mesh.positions.size(); i++)
+		{
+			float v[8];
+			int k = 0;
+			v[k++] = mesh.positions[i].x;
+			v[k++] = mesh.positions[i].y;
+			v[k++] = mesh.positions[i].z;
+			if (normals)
+			{
+				v[k++] = mesh.normals[i].x;
+				v[k++] = mesh.normals[i].y;
+				v[k++] = mesh.normals[i].z;
+			}
+			if (uvs)
+			{
+				v[k++] = mesh.uvs[i].x;
+				v[k++] = mesh.uvs[i].y;
+			}
+			memcpy(out.Reserve(vertexSize), v, vertexSize);
+			out.Commit(vertexSize);
+		}
+
+		//faces are a count byte followed by three int32, 13 bytes each
+		const size_t faceSize = 1 + 3 * sizeof(int32_t);
+		for (size_t t = 0; t < triangles; t++)
+		{
+			char* f = out.Reserve(faceSize);
+			int32_t face[3] = { (int32_t)mesh.indices[t * 3], (int32_t)mesh.indices[t * 3 + 1], (int32_t)mesh.indices[t * 3 + 2] };
+			f[0] = 3;
+			memcpy(f + 1, face, sizeof(face));
+			out.Commit(faceSize);
+		}
+
+		out.Flush();
+		failed = out.Failed();
+	}
+
+	fclose(file);
+	return !failed;
+}
+
+bool MeshExporter::WriteObj(const char* filename, const MeshData& mesh)
+{
+	FILE* file;
+	errno_t err;
+
+	err = fopen_s(&file, filename, "wb");
+	if (err != 0)
+	{
+		return false;
+	}
+
+	bool normals = mesh.HasNormals();
+	bool uvs = mesh.HasUVs();
+	size_t triangles = mesh.GetTriangleCount();
+
+	//the longest line is a face with three v/vt/vn triples or a vertex with three floats
+	const size_t MAX_LINE = 3 * 3 * 24 + 16;
+
+	bool failed;
+	{
+		OutputBuffer out(file);
+		const char comment[] = "# exported by the terrain generator\n";
+		out.Write(comment, sizeof(comment) - 1);
+
+		for (size_t i = 0; i < mesh.positions.size(); i++)
+		{
+			char* line = out.Reserve(MAX_LINE);
+			int length = 0;
+			line[length++] = 'v';
+			line[length++] = ' ';
+			length += FormatFloat(mesh.positions[i].x, line + length);
+			line[length++] = ' ';
+			length += FormatFloat(mesh.positions[i].y, line + length);
+			line[length++] = ' ';
+			length += FormatFloat(mesh.positions[i].z, line + length);
+			line[length++] = '\n';
+			out.Commit(length);
+		}
+
+		if (uvs)
+		{
+			for (size_t i = 0; i < mesh.uvs.size(); i++)
+			{
+				char* line = out.Reserve(MAX_LINE);
+				int length = 0;
+				line[length++] = 'v';
+				line[length++] = 't';
+				line[length++] = ' ';
+				length += FormatFloat(mesh.uvs[i].x, line + length);
+				line[length++] = ' ';
+				length += FormatFloat(mesh.uvs[i].y, line + length);
+				line[length++] = '\n';
+				out.Commit(length);
+			}
+		}
+
+		if (normals)
+		{
+			for (size_t i = 0; i < mesh.normals.size(); i++)
+			{
+				char* line = out.Reserve(MAX_LINE);
+				int length = 0;
+				line[length++] = 'v';
+				line[length++] = 'n';
+				line[length++] = ' ';
+				//normals don't need the full precision
+				length += FormatFloat(mesh.normals[i].x, line + length, 4);
+				line[length++] = ' ';
+				length += FormatFloat(mesh.normals[i].y, line + length, 4);
+				line[length++] = ' ';
+				length += FormatFloat(mesh.normals[i].z, line + length, 4);
+				line[length++] = '\n';
+				out.Commit(length);
+			}
+		}
+
+		for (size_t t = 0; t < triangles; t++)
+		{
+			char* line = out.Reserve(MAX_LINE);
+			int length = 0;
+			line[length++] = 'f';
+			for (int k = 0; k < 3; k++)
+			{
+				int64_t index = (int64_t)mesh.indices[t * 3 + k] + 1;
+				line[length++] = ' ';
+				length += FormatInt(index, line + length);
+				if (uvs || normals)
+				{
+					line[length++] = '/';
+					if (uvs)
+					{
+						length += FormatInt(index, line + length);
+					}
+					if (normals)
+					{
+						line[length++] = '/';
+						length += FormatInt(index, line + length);
+					}
+				}
+			}
+			line[length++] = '\n';
+			out.Commit(length);
+		}
+
+		out.Flush();
+		failed = out.Failed();
+	}
+
+	fclose(file);
+	return !failed;
+}
+
+bool MeshExporter::Write(const char* filename, const MeshData& mesh)
+{
+	const char* extension = strrchr(filename, '.');
+	if (extension && _stricmp(extension, ".obj") == 0)
+	{
+		return WriteObj(filename, mesh);
+	}
+	return WritePly(filename, mesh);
+}
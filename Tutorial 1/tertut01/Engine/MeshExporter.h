@@ -0,0 +1,23 @@
+#pragma once
+#include "MeshData.h"
+
+//Writes CPU meshes out for offline tools.
+//Everything goes through one large output buffer that is flushed in big blocks, and the OBJ path formats
+//numbers with its own fixed point float to text routine instead of printf, so a multi million triangle
+//export is limited by the disk rather than by formatting.
+
+class MeshExporter
+{
+public:
+	//binary little endian PLY: float xyz (+ normal, + uv) and int32 triangle indices
+	static bool WritePly(const char* filename, const MeshData& mesh);
+	//text OBJ, one based indices with v/vt/vn as available
+	static bool WriteObj(const char* filename, const MeshData& mesh);
+	//picks the format from the extension (.ply or .obj)
+	static bool Write(const char* filename, const MeshData& mesh);
+
+	//formats value with the given number of decimals, trailing zeros trimmed. returns characters written.
+	//out needs room for at least 32 characters.
+	static int FormatFloat(float value, char* out, int decimals = 6);
+	static int FormatInt(int64_t value, char* out);
+};
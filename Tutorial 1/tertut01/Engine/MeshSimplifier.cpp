@@ -0,0 +1,689 @@
+#include "pch.h"
+#include "MeshSimplifier.h"
+#include "ParallelFor.h"
+#include <queue>
+#include <unordered_map>
+
+using DirectX::SimpleMath::Vector3;
+
+namespace
+{
+	const uint32_t NONE = 0xFFFFFFFF;
+
+	//a WeldVertices grid cell
+	struct WeldCell
+	{
+		int64_t x, y, z;
+
+		bool operator==(const WeldCell& other) const { return x == other.x && y == other.y && z == other.z; }
+	};
+
+	struct WeldCellHash
+	{
+		size_t operator()(const WeldCell& cell) const
+		{
+			uint64_t h = (uint64_t)cell.x * 0x9E3779B97F4A7C15ull;
+			h = (h ^ (h >> 29) ^ (uint64_t)cell.y) * 0xBF58476D1CE4E5B9ull;
+			h = (h ^ (h >> 32) ^ (uint64_t)cell.z) * 0x94D049BB133111EBull;
+			return (size_t)(h ^ (h >> 31));
+		}
+	};
+
+	int64_t Quantise(float value, double scale)
+	{
+		//clamped so huge (or infinite) coordinates still convert safely, NaN lands in cell 0
+		double cell = floor((double)value * scale + 0.5);
+		return cell > 4e18 ? (int64_t)4e18 : (cell < -4e18 ? (int64_t)-4e18 : (cell == cell ? (int64_t)cell : 0));
+	}
+
+	//symmetric 4x4 error quadric, only the upper triangle is stored
+	struct Quadric
+	{
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+		Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0) {}
+
+		void AddPlane(double a, double b, double c, double d, double weight)
+		{
+			a2 += weight * a * a; ab += weight * a * b; ac += weight * a * c; ad += weight * a * d;
+			b2 += weight * b * b; bc += weight * b * c; bd += weight * b * d;
+			c2 += weight * c * c; cd += weight * c * d;
+			d2 += weight * d * d;
+		}
+
+		void Add(const Quadric& q)
+		{
+			a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+			b2 += q.b2; bc += q.bc; bd += q.bd;
+			c2 += q.c2; cd += q.cd;
+			d2 += q.d2;
+		}
+
+		double Evaluate(const Vector3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+				+ b2 * y * y + 2 * bc * y * z + 2 * bd * y
+				+ c2 * z * z + 2 * cd * z
+				+ d2;
+		}
+
+		//position that minimises the error, false if the system is close to singular
+		bool Optimal(Vector3& p) const
+		{
+			double det = a2 * (b2 * c2 - bc * bc) - ab * (ab * c2 - bc * ac) + ac * (ab * bc - b2 * ac);
+			if (fabs(det) < 1e-12)
+			{
+				return false;
+			}
+			double inv = 1.0 / det;
+			//Cramer's rule on [a2 ab ac; ab b2 bc; ac bc c2] p = -[ad bd cd]
+			double rx = -ad, ry = -bd, rz = -cd;
+			p.x = (float)(inv * (rx * (b2 * c2 - bc * bc) - ab * (ry * c2 - bc * rz) + ac * (ry * bc - b2 * rz)));
+			p.y = (float)(inv * (a2 * (ry * c2 - bc * rz) - rx * (ab * c2 - bc * ac) + ac * (ab * rz - ry * ac)));
+			p.z = (float)(inv * (a2 * (b2 * rz - ry * bc) - ab * (ab * rz - ry * ac) + rx * (ab * bc - b2 * ac)));
+			return true;
+		}
+	};
+
+	struct Collapse
+	{
+		float cost;
+		uint32_t keep, remove;
+		uint32_t keepStamp, removeStamp;
+		Vector3 target;
+
+		bool operator>(const Collapse& other) const { return cost > other.cost; }
+	};
+
+	class QuadricSimplifier
+	{
+	public:
+		void Run(const MeshData& mesh, MeshData& output, const MeshSimplifier::Settings& settings);
+
+	private:
+		void Build(const MeshData& mesh, bool lockBoundary);
+		bool Evaluate(uint32_t u, uint32_t v, Collapse& collapse) const;
+		void PushEdgesAround(uint32_t u);
+		void Neighbours(uint32_t u, std::vector<uint32_t>& out) const;
+		bool IsValid(const Collapse& collapse);
+		void Apply(const Collapse& collapse);
+		Vector3 FaceNormal(uint32_t t, uint32_t swapFrom, const Vector3& swapTo) const;
+
+	private:
+		std::vector<Vector3> m_positions;
+		std::vector<Quadric> m_quadrics;
+		std::vector<uint32_t> m_cornerVertex;		//three per triangle
+		std::vector<uint32_t> m_nextCorner;			//next corner around the same vertex
+		std::vector<uint32_t> m_firstCorner;		//per vertex head of its corner list
+		std::vector<uint32_t> m_stamp;
+		std::vector<uint8_t> m_triangleDead;
+		std::vector<uint8_t> m_vertexDead;
+		std::vector<uint8_t> m_locked;
+		std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> m_heap;
+		size_t m_liveTriangles;
+
+		//scratch kept around to avoid reallocating for every collapse
+		std::vector<uint32_t> m_scratchA, m_scratchB;
+	};
+
+	void QuadricSimplifier::Build(const MeshData& mesh, bool lockBoundary)
+	{
+		size_t vertexCount = mesh.positions.size();
+		size_t triangleCount = mesh.GetTriangleCount();
+
+		m_positions = mesh.positions;
+		m_quadrics.assign(vertexCount, Quadric());
+		m_cornerVertex.assign(mesh.indices.begin(), mesh.indices.begin() + triangleCount * 3);
+		m_nextCorner.assign(triangleCount * 3, NONE);
+		m_firstCorner.assign(vertexCount, NONE);
+		m_stamp.assign(vertexCount, 0);
+		m_triangleDead.assign(triangleCount, 0);
+		m_vertexDead.assign(vertexCount, 0);
+		m_locked.assign(vertexCount, 0);
+		m_liveTriangles = triangleCount;
+
+		for (uint32_t c = 0; c < (uint32_t)m_cornerVertex.size(); c++)
+		{
+			uint32_t v = m_cornerVertex[c];
+			m_nextCorner[c] = m_firstCorner[v];
+			m_firstCorner[v] = c;
+		}
+
+		//every face adds its plane to its three corners, weighted by area
+		for (uint32_t t = 0; t < triangleCount; t++)
+		{
+			const Vector3& p0 = m_positions[m_cornerVertex[t * 3]];
+			const Vector3& p1 = m_positions[m_cornerVertex[t * 3 + 1]];
+			const Vector3& p2 = m_positions[m_cornerVertex[t * 3 + 2]];
+			Vector3 n = (p1 - p0).Cross(p2 - p0);
+			float length = n.Length();
+			if (length <= 0.0f)
+			{
+				continue;
+			}
+			n = n * (1.0f / length);
+			double d = -(double)n.Dot(p0);
+			for (int k = 0; k < 3; k++)
+			{
+				m_quadrics[m_cornerVertex[t * 3 + k]].AddPlane(n.x, n.y, n.z, d, length * 0.5);
+			}
+		}
+
+		//an edge used by only one triangle is on the boundary. sort the edges to count them.
+		std::vector<uint64_t> edges;
+		edges.reserve(triangleCount * 3);
+		for (uint32_t t = 0; t < triangleCount; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t a = m_cornerVertex[t * 3 + k];
+				uint32_t b = m_cornerVertex[t * 3 + (k + 1) % 3];
+				edges.push_back(((uint64_t)std::min(a, b) << 32) | std::max(a, b));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+
+		for (size_t i = 0; i < edges.size();)
+		{
+			size_t j = i + 1;
+			while (j < edges.size() && edges[j] == edges[i])
+			{
+				j++;
+			}
+			if (j - i == 1)
+			{
+				uint32_t a = (uint32_t)(edges[i] >> 32);
+				uint32_t b = (uint32_t)(edges[i] & 0xFFFFFFFF);
+				if (lockBoundary)
+				{
+					m_locked[a] = 1;
+					m_locked[b] = 1;
+				}
+				else
+				{
+					//a steep plane through the edge keeps the outline from wandering too far
+					Vector3 edge = m_positions[b] - m_positions[a];
+					Vector3 n = edge.Cross(Vector3(0.0f, 1.0f, 0.0f));
+					if (n.Length() < 1e-6f)
+					{
+						n = edge.Cross(Vector3(1.0f, 0.0f, 0.0f));
+					}
+					n.Normalize();
+					double d = -(double)n.Dot(m_positions[a]);
+					double weight = edge.Dot(edge) * 10.0;
+					m_quadrics[a].AddPlane(n.x, n.y, n.z, d, weight);
+					m_quadrics[b].AddPlane(n.x, n.y, n.z, d, weight);
+				}
+			}
+			i = j;
+		}
+
+		//seed the heap with every unique edge
+		for (size_t i = 0; i < edges.size(); i++)
+		{
+			if (i > 0 && edges[i] == edges[i - 1])
+			{
+				continue;
+			}
+			Collapse collapse;
+			if (Evaluate((uint32_t)(edges[i] >> 32), (uint32_t)(edges[i] & 0xFFFFFFFF), collapse))
+			{
+				m_heap.push(collapse);
+			}
+		}
+	}
+
+	bool QuadricSimplifier::Evaluate(uint32_t u, uint32_t v, Collapse& collapse) const
+	{
+		if (m_locked[u] && m_locked[v])
+		{
+			return false;
+		}
+		//always fold the unlocked vertex into the locked one
+		if (m_locked[v])
+		{
+			std::swap(u, v);
+		}
+
+		Quadric q = m_quadrics[u];
+		q.Add(m_quadrics[v]);
+
+		collapse.keep = u;
+		collapse.remove = v;
+		collapse.keepStamp = m_stamp[u];
+		collapse.removeStamp = m_stamp[v];
+
+		if (m_locked[u])
+		{
+			collapse.target = m_positions[u];
+			collapse.cost = (float)q.Evaluate(collapse.target);
+			return true;
+		}
+
+		Vector3 optimal;
+		if (q.Optimal(optimal))
+		{
+			collapse.target = optimal;
+			collapse.cost = (float)q.Evaluate(optimal);
+			return true;
+		}
+
+		//singular (flat area), pick the best of the ends and the middle
+		Vector3 candidates[3] = { m_positions[u], m_positions[v], (m_positions[u] + m_positions[v]) * 0.5f };
+		collapse.cost = FLT_MAX;
+		for (int i = 0; i < 3; i++)
+		{
+			float cost = (float)q.Evaluate(candidates[i]);
+			if (cost < collapse.cost)
+			{
+				collapse.cost = cost;
+				collapse.target = candidates[i];
+			}
+		}
+		return true;
+	}
+
+	void QuadricSimplifier::Neighbours(uint32_t u, std::vector<uint32_t>& out) const
+	{
+		out.clear();
+		for (uint32_t c = m_firstCorner[u]; c != NONE; c = m_nextCorner[c])
+		{
+			uint32_t t = c / 3;
+			if (m_triangleDead[t])
+			{
+				continue;
+			}
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t w = m_cornerVertex[t * 3 + k];
+				if (w != u)
+				{
+					out.push_back(w);
+				}
+			}
+		}
+		std::sort(out.begin(), out.end());
+		out.erase(std::unique(out.begin(), out.end()), out.end());
+	}
+
+	void QuadricSimplifier::PushEdgesAround(uint32_t u)
+	{
+		Neighbours(u, m_scratchA);
+		for (size_t i = 0; i < m_scratchA.size(); i++)
+		{
+			Collapse collapse;
+			if (Evaluate(u, m_scratchA[i], collapse))
+			{
+				m_heap.push(collapse);
+			}
+		}
+	}
+
+	Vector3 QuadricSimplifier::FaceNormal(uint32_t t, uint32_t swapFrom, const Vector3& swapTo) const
+	{
+		Vector3 p[3];
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t v = m_cornerVertex[t * 3 + k];
+			p[k] = v == swapFrom ? swapTo : m_positions[v];
+		}
+		return (p[1] - p[0]).Cross(p[2] - p[0]);
+	}
+
+	bool QuadricSimplifier::IsValid(const Collapse& collapse)
+	{
+		uint32_t u = collapse.keep;
+		uint32_t v = collapse.remove;
+
+		//link condition: u and v may only share the neighbours across the faces on the edge itself,
+		//anything more and the collapse pinches the surface
+		Neighbours(u, m_scratchA);
+		Neighbours(v, m_scratchB);
+		size_t shared = 0;
+		for (size_t i = 0, j = 0; i < m_scratchA.size() && j < m_scratchB.size();)
+		{
+			if (m_scratchA[i] < m_scratchB[j]) i++;
+			else if (m_scratchA[i] > m_scratchB[j]) j++;
+			else { shared++; i++; j++; }
+		}
+
+		size_t edgeFaces = 0;
+		for (uint32_t c = m_firstCorner[v]; c != NONE; c = m_nextCorner[c])
+		{
+			uint32_t t = c / 3;
+			if (m_triangleDead[t])
+			{
+				continue;
+			}
+			bool hasU = m_cornerVertex[t * 3] == u || m_cornerVertex[t * 3 + 1] == u || m_cornerVertex[t * 3 + 2] == u;
+			if (hasU)
+			{
+				edgeFaces++;
+			}
+		}
+		if (edgeFaces == 0 || shared > edgeFaces)
+		{
+			return false;
+		}
+
+		//no face around either end may flip or collapse to nothing
+		uint32_t ends[2] = { u, v };
+		for (int e = 0; e < 2; e++)
+		{
+			for (uint32_t c = m_firstCorner[ends[e]]; c != NONE; c = m_nextCorner[c])
+			{
+				uint32_t t = c / 3;
+				if (m_triangleDead[t])
+				{
+					continue;
+				}
+				uint32_t a = m_cornerVertex[t * 3], b = m_cornerVertex[t * 3 + 1], d = m_cornerVertex[t * 3 + 2];
+				if ((a == u || b == u || d == u) && (a == v || b == v || d == v))
+				{
+					continue;	//these are the ones that disappear
+				}
+
+				Vector3 before = FaceNormal(t, NONE, Vector3());
+				Vector3 after = FaceNormal(t, ends[e], collapse.target);
+				float beforeLength = before.Length();
+				float afterLength = after.Length();
+				if (afterLength <= 1e-12f)
+				{
+					return false;
+				}
+				if (beforeLength > 1e-12f && before.Dot(after) < 0.2f * beforeLength * afterLength)
+				{
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	void QuadricSimplifier::Apply(const Collapse& collapse)
+	{
+		uint32_t u = collapse.keep;
+		uint32_t v = collapse.remove;
+
+		//kill the faces on the edge and move the rest of v's corners over to u
+		uint32_t tail = NONE;
+		for (uint32_t c = m_firstCorner[v]; c != NONE; c = m_nextCorner[c])
+		{
+			uint32_t t = c / 3;
+			if (!m_triangleDead[t])
+			{
+				if (m_cornerVertex[t * 3] == u || m_cornerVertex[t * 3 + 1] == u || m_cornerVertex[t * 3 + 2] == u)
+				{
+					m_triangleDead[t] = 1;
+					m_liveTriangles--;
+				}
+			}
+			m_cornerVertex[c] = u;
+			tail = c;
+		}
+
+		if (tail != NONE)
+		{
+			m_nextCorner[tail] = m_firstCorner[u];
+			m_firstCorner[u] = m_firstCorner[v];
+		}
+		m_firstCorner[v] = NONE;
+
+		//drop dead corners from u's list while we are here so it doesn't keep growing
+		uint32_t* link = &m_firstCorner[u];
+		while (*link != NONE)
+		{
+			if (m_triangleDead[*link / 3])
+			{
+				*link = m_nextCorner[*link];
+			}
+			else
+			{
+				link = &m_nextCorner[*link];
+			}
+		}
+
+		m_positions[u] = collapse.target;
+		m_quadrics[u].Add(m_quadrics[v]);
+		m_vertexDead[v] = 1;
+		m_stamp[u]++;
+		m_stamp[v]++;
+	}
+
+	void QuadricSimplifier::Run(const MeshData& mesh, MeshData& output, const MeshSimplifier::Settings& settings)
+	{
+		Build(mesh, settings.lockBoundary);
+
+		while (m_liveTriangles > settings.targetTriangles && !m_heap.empty())
+		{
+			Collapse collapse = m_heap.top();
+			m_heap.pop();
+
+			if (collapse.cost > settings.maxError)
+			{
+				break;
+			}
+
+			//stale entry, one of the ends has moved since this was pushed
+			if (m_vertexDead[collapse.keep] || m_vertexDead[collapse.remove] ||
+				m_stamp[collapse.keep] != collapse.keepStamp || m_stamp[collapse.remove] != collapse.removeStamp)
+			{
+				continue;
+			}
+
+			if (!IsValid(collapse))
+			{
+				continue;
+			}
+
+			Apply(collapse);
+			PushEdgesAround(collapse.keep);
+		}
+
+		//compact the survivors
+		std::vector<uint32_t> remap(m_positions.size(), NONE);
+		output.Clear();
+		bool uvs = mesh.HasUVs();
+
+		for (uint32_t t = 0; t < (uint32_t)m_triangleDead.size(); t++)
+		{
+			if (m_triangleDead[t])
+			{
+				continue;
+			}
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t v = m_cornerVertex[t * 3 + k];
+				if (remap[v] == NONE)
+				{
+					remap[v] = (uint32_t)output.positions.size();
+					output.positions.push_back(m_positions[v]);
+					if (uvs)
+					{
+						output.uvs.push_back(mesh.uvs[v]);
+					}
+				}
+				output.indices.push_back(remap[v]);
+			}
+		}
+
+		if (mesh.HasNormals())
+		{
+			MeshSimplifier::ComputeNormals(output);
+		}
+	}
+}
+
+
+bool MeshSimplifier::Simplify(const MeshData& input, MeshData& output, const Settings& settings)
+{
+	if (input.positions.empty() || input.indices.size() < 3)
+	{
+		return false;
+	}
+
+	QuadricSimplifier simplifier;
+	if (settings.weldVertices)
+	{
+		MeshData welded;
+		WeldVertices(input, welded);
+		simplifier.Run(welded, output, settings);
+	}
+	else
+	{
+		simplifier.Run(input, output, settings);
+	}
+	return true;
+}
+
+void MeshSimplifier::SimplifyChunks(std::vector<MeshData>& chunks, const Settings& settings, int threadCount)
+{
+	//one chunk per task, the chunks are far too small to be worth splitting further
+	ParallelFor(0, (int)chunks.size(), [&](int i)
+	{
+		MeshData simplified;
+		if (Simplify(chunks[i], simplified, settings))
+		{
+			chunks[i] = std::move(simplified);
+		}
+	}, threadCount);
+}
+
+void MeshSimplifier::BuildLodChain(const MeshData& input, std::vector<MeshData>& lods, int levels, float ratio, bool lockBoundary)
+{
+	lods.clear();
+	lods.push_back(input);
+
+	Settings settings;
+	settings.lockBoundary = lockBoundary;
+	for (int level = 1; level < levels; level++)
+	{
+		const MeshData& previous = lods.back();
+		settings.targetTriangles = (size_t)(previous.GetTriangleCount() * ratio);
+		//the first level has already been welded
+		settings.weldVertices = level == 1;
+
+		MeshData next;
+		if (!Simplify(previous, next, settings) || next.GetTriangleCount() >= previous.GetTriangleCount())
+		{
+			break;	//can't get any smaller (everything left is locked)
+		}
+		lods.push_back(std::move(next));
+	}
+}
+
+std::future<std::vector<MeshData>> MeshSimplifier::BuildLodChainAsync(const MeshData& input, int levels, float ratio, bool lockBoundary)
+{
+	//the input is copied so the caller can carry on using theirs
+	return std::async(std::launch::async, [input, levels, ratio, lockBoundary]()
+	{
+		std::vector<MeshData> lods;
+		BuildLodChain(input, lods, levels, ratio, lockBoundary);
+		return lods;
+	});
+}
+
+void MeshSimplifier::WeldVertices(const MeshData& input, MeshData& output, float epsilon)
+{
+	//each epsilon grid cell heads a list of the output vertices in it (through next)
+	std::unordered_map<WeldCell, uint32_t, WeldCellHash> lookup;
+	std::vector<uint32_t> next;
+	std::vector<uint32_t> remap(input.positions.size());
+	bool normals = input.HasNormals();
+	bool uvs = input.HasUVs();
+	double scale = 1.0 / epsilon;
+
+	output.Clear();
+	lookup.reserve(input.positions.size());
+
+	for (size_t i = 0; i < input.positions.size(); i++)
+	{
+		const Vector3& p = input.positions[i];
+		//the full cell coordinates, in double so large meshes don't lose the low bits
+		WeldCell cell = { Quantise(p.x, scale), Quantise(p.y, scale), Quantise(p.z, scale) };
+
+		//anything within epsilon is in this cell or one of its 26 neighbours (two close points can round either
+		//side of a cell edge). the same cell only means close, so check the position too, and take the oldest
+		//match so the result doesn't depend on which cell was probed first.
+		uint32_t match = NONE;
+		for (int64_t dz = -1; dz <= 1; dz++)
+		{
+			for (int64_t dy = -1; dy <= 1; dy++)
+			{
+				for (int64_t dx = -1; dx <= 1; dx++)
+				{
+					WeldCell neighbour = { cell.x + dx, cell.y + dy, cell.z + dz };
+					auto bucket = lookup.find(neighbour);
+					for (uint32_t v = bucket != lookup.end() ? bucket->second : NONE; v != NONE; v = next[v])
+					{
+						const Vector3& q = output.positions[v];
+						if (v < match && fabsf(p.x - q.x) <= epsilon && fabsf(p.y - q.y) <= epsilon && fabsf(p.z - q.z) <= epsilon)
+						{
+							match = v;
+						}
+					}
+				}
+			}
+		}
+		auto found = lookup.find(cell);
+		if (match != NONE)
+		{
+			remap[i] = match;
+			continue;
+		}
+
+		uint32_t index = (uint32_t)output.positions.size();
+		next.push_back(found != lookup.end() ? found->second : NONE);
+		lookup[cell] = index;
+		remap[i] = index;
+		output.positions.push_back(p);
+		if (normals)
+		{
+			output.normals.push_back(input.normals[i]);
+		}
+		if (uvs)
+		{
+			output.uvs.push_back(input.uvs[i]);
+		}
+	}
+
+	output.indices.reserve(input.indices.size());
+	for (size_t t = 0; t + 2 < input.indices.size(); t += 3)
+	{
+		uint32_t a = remap[input.indices[t]];
+		uint32_t b = remap[input.indices[t + 1]];
+		uint32_t c = remap[input.indices[t + 2]];
+		//welding can squash tiny faces down to a line
+		if (a == b || b == c || a == c)
+		{
+			continue;
+		}
+		output.indices.push_back(a);
+		output.indices.push_back(b);
+		output.indices.push_back(c);
+	}
+}
+
+void MeshSimplifier::ComputeNormals(MeshData& mesh)
+{
+	mesh.normals.assign(mesh.positions.size(), Vector3(0.0f, 0.0f, 0.0f));
+
+	//the unnormalised cross product is already weighted by area
+	for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+	{
+		const Vector3& p0 = mesh.positions[mesh.indices[t]];
+		const Vector3& p1 = mesh.positions[mesh.indices[t + 1]];
+		const Vector3& p2 = mesh.positions[mesh.indices[t + 2]];
+		Vector3 n = (p1 - p0).Cross(p2 - p0);
+		mesh.normals[mesh.indices[t]] += n;
+		mesh.normals[mesh.indices[t + 1]] += n;
+		mesh.normals[mesh.indices[t + 2]] += n;
+	}
+
+	for (size_t i = 0; i < mesh.normals.size(); i++)
+	{
+		mesh.normals[i].Normalize();
+	}
+}
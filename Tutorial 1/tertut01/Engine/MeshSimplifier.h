@@ -0,0 +1,40 @@
+#pragma once
+#include <cfloat>
+#include <future>
+#include "MeshData.h"
+
+//Quadric error metric (Garland / Heckbert) mesh simplifier.
+//Edges are collapsed cheapest first from a binary heap, stale heap entries are skipped using per vertex stamps.
+//Connectivity is kept as a corner table: three corners per triangle, and every vertex threads a singly linked
+//list through the corners that touch it, so the whole topology lives in a few flat arrays.
+//Open boundary vertices can be locked, which keeps chunk edges untouched so neighbouring terrain tiles still line up.
+
+class MeshSimplifier
+{
+public:
+	struct Settings
+	{
+		size_t targetTriangles;		//stop once the mesh is this small
+		float maxError;				//or once the cheapest collapse costs more than this. the cost is the quadric error:
+									//squared distance to the face planes weighted by face area (and boundary planes
+									//by edge length squared), so it scales with the fourth power of the mesh size
+		bool lockBoundary;			//leave open edges exactly where they are
+		bool weldVertices;			//merge vertices with the same position first (OBJ models come in unrolled)
+
+		Settings() : targetTriangles(0), maxError(FLT_MAX), lockBoundary(true), weldVertices(true) {}
+	};
+
+	static bool Simplify(const MeshData& input, MeshData& output, const Settings& settings);
+
+	//each chunk is simplified on its own thread, in place
+	static void SimplifyChunks(std::vector<MeshData>& chunks, const Settings& settings, int threadCount = 0);
+
+	//lods[0] is the input, every following level keeps ratio of the triangles of the one before
+	static void BuildLodChain(const MeshData& input, std::vector<MeshData>& lods, int levels, float ratio = 0.5f, bool lockBoundary = true);
+	static std::future<std::vector<MeshData>> BuildLodChainAsync(const MeshData& input, int levels, float ratio = 0.5f, bool lockBoundary = true);
+
+	//merges vertices whose positions match within epsilon, remaps the indices
+	static void WeldVertices(const MeshData& input, MeshData& output, float epsilon = 1e-5f);
+	//area weighted vertex normals
+	static void ComputeNormals(MeshData& mesh);
+};
@@ -0,0 +1,307 @@
+#include "pch.h"
+#include "ObjectScatter.h"
+#include "Philox.h"
+#include "ParallelFor.h"
+
+namespace
+{
+	const float PI = 3.14159265f;
+	const int CANDIDATES = 30;		//tries around an active point before it is retired
+	const int DARTS = 30;			//tries at a random spot to start a chunk off
+
+	//the random numbers for a chunk come from separate streams, so the sampling using more or fewer of them
+	//doesn't shift what the masks and the transforms get
+	enum Stream
+	{
+		STREAM_SAMPLING,
+		STREAM_KEEP,
+		STREAM_ROTATION,
+		STREAM_SCALE,
+		STREAM_COUNT,
+	};
+
+	inline float SmoothStep(float t)
+	{
+		t = std::min(1.0f, std::max(0.0f, t));
+		return t * t * (3.0f - 2.0f * t);
+	}
+
+	//1 inside [low, high], easing to 0 over blend outside it
+	inline float Band(float v, float low, float high, float blend)
+	{
+		float inverse = 1.0f / std::max(blend, 1e-6f);
+		return SmoothStep((v - (low - blend)) * inverse) * SmoothStep(((high + blend) - v) * inverse);
+	}
+
+	//chunk coordinates as one counter word, so the numbers for a chunk don't depend on the size of the map
+	inline int ChunkKey(int chunkX, int chunkZ)
+	{
+		return (chunkX & 0xFFFF) | (chunkZ << 16);
+	}
+}
+
+
+ObjectScatter::ObjectScatter()
+{
+	m_width = 0;
+	m_height = 0;
+	m_layerCount = 0;
+	m_chunkSize = 16.0f;
+	m_chunksX = m_chunksZ = 0;
+	m_seed = 1;
+	m_cellSize = 1.0f;
+	m_gridWidth = m_gridHeight = 0;
+}
+
+ObjectScatter::~ObjectScatter()
+{
+}
+
+bool ObjectScatter::Initialize(int width, int height, int layerCount, float chunkSize)
+{
+	if (width < 2 || height < 2 || layerCount < 1 || layerCount > MAX_LAYERS || chunkSize <= 0.0f)
+	{
+		return false;
+	}
+
+	m_width = width;
+	m_height = height;
+	m_layerCount = layerCount;
+	m_chunkSize = chunkSize;
+	m_chunksX = (int)ceilf((width - 1) / chunkSize);
+	m_chunksZ = (int)ceilf((height - 1) / chunkSize);
+	for (int i = 0; i < MAX_LAYERS; i++)
+	{
+		m_layers[i] = Layer();
+		m_layers[i].spacing = std::min(m_layers[i].spacing, chunkSize / 3.0f);
+		m_instances[i].clear();
+		m_chunkRanges[i].clear();
+	}
+	return true;
+}
+
+void ObjectScatter::SetLayer(int index, const Layer& layer)
+{
+	if (index < 0 || index >= m_layerCount)
+	{
+		return;
+	}
+
+	//a neighbour check reaches under three cells out, which has to stay inside the next chunk over
+	//or chunks sampling at the same time could see each other
+	m_layers[index] = layer;
+	m_layers[index].spacing = std::max(1e-3f, std::min(layer.spacing, m_chunkSize / 3.0f));
+}
+
+void ObjectScatter::Generate(const float* heights, int threadCount)
+{
+	int chunkCount = m_chunksX * m_chunksZ;
+	std::vector<std::vector<Point>> points(chunkCount);
+	std::vector<std::vector<Instance>> chunkInstances(chunkCount);
+
+	for (int layer = 0; layer < m_layerCount; layer++)
+	{
+		m_cellSize = m_layers[layer].spacing / sqrtf(2.0f);
+		m_gridWidth = (int)((m_width - 1) / m_cellSize) + 1;
+		m_gridHeight = (int)((m_height - 1) / m_cellSize) + 1;
+		Point empty = { -1.0f, -1.0f };
+		m_grid.assign((size_t)m_gridWidth * m_gridHeight, empty);
+
+		//the four passes, chunks with the same parity never touch
+		for (int phase = 0; phase < 4; phase++)
+		{
+			int phaseX = phase & 1;
+			int phaseZ = phase >> 1;
+			int across = (m_chunksX - phaseX + 1) / 2;
+			int down = (m_chunksZ - phaseZ + 1) / 2;
+
+			ParallelFor(0, across * down, [&](int i)
+			{
+				int chunkX = phaseX + (i % across) * 2;
+				int chunkZ = phaseZ + (i / across) * 2;
+				SampleChunk(layer, chunkX, chunkZ, points[chunkZ * m_chunksX + chunkX]);
+			}, threadCount);
+		}
+
+		//masks don't touch the grid, so every chunk can be filtered at once
+		ParallelFor(0, chunkCount, [&](int chunk)
+		{
+			FilterChunk(heights, layer, chunk % m_chunksX, chunk / m_chunksX, points[chunk], chunkInstances[chunk]);
+		}, threadCount);
+
+		std::vector<Instance>& instances = m_instances[layer];
+		std::vector<ChunkRange>& ranges = m_chunkRanges[layer];
+		instances.clear();
+		ranges.resize(chunkCount);
+		for (int chunk = 0; chunk < chunkCount; chunk++)
+		{
+			ranges[chunk].first = (uint32_t)instances.size();
+			ranges[chunk].count = (uint32_t)chunkInstances[chunk].size();
+			instances.insert(instances.end(), chunkInstances[chunk].begin(), chunkInstances[chunk].end());
+		}
+	}
+
+	m_grid.clear();
+	m_grid.shrink_to_fit();
+}
+
+void ObjectScatter::SampleChunk(int layer, int chunkX, int chunkZ, std::vector<Point>& points)
+{
+	float spacing = m_layers[layer].spacing;
+	float spacingSquared = spacing * spacing;
+	float x0 = chunkX * m_chunkSize;
+	float z0 = chunkZ * m_chunkSize;
+	float x1 = std::min(x0 + m_chunkSize, (float)(m_width - 1));
+	float z1 = std::min(z0 + m_chunkSize, (float)(m_height - 1));
+
+	Philox random(m_seed);
+	int key = ChunkKey(chunkX, chunkZ);
+	uint32_t stream = layer * STREAM_COUNT + STREAM_SAMPLING;
+	int draw = 0;
+	auto next = [&]() { return random.GetFloat(draw++, key, stream); };
+
+	//inside this chunk (half open, except on the far edges of the map) and clear of every point so far
+	auto accept = [&](float x, float z) -> bool
+	{
+		bool insideX = x >= x0 && (x < x1 || (x1 == m_width - 1 && x <= x1));
+		bool insideZ = z >= z0 && (z < z1 || (z1 == m_height - 1 && z <= z1));
+		if (!insideX || !insideZ)
+		{
+			return false;
+		}
+
+		int cellX = (int)(x / m_cellSize);
+		int cellZ = (int)(z / m_cellSize);
+		for (int j = std::max(0, cellZ - 2); j <= std::min(m_gridHeight - 1, cellZ + 2); j++)
+		{
+			for (int i = std::max(0, cellX - 2); i <= std::min(m_gridWidth - 1, cellX + 2); i++)
+			{
+				const Point& other = m_grid[j * m_gridWidth + i];
+				float dx = other.x - x;
+				float dz = other.z - z;
+				if (other.x >= 0.0f && dx * dx + dz * dz < spacingSquared)
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	};
+
+	std::vector<Point> active;
+	auto add = [&](float x, float z)
+	{
+		Point p = { x, z };
+		m_grid[(int)(z / m_cellSize) * m_gridWidth + (int)(x / m_cellSize)] = p;
+		points.push_back(p);
+		active.push_back(p);
+	};
+
+	points.clear();
+
+	//points already placed in the chunks around seed the sampling too, so it grows in from their edges
+	int cellX0 = std::max(0, (int)((x0 - 2.0f * spacing) / m_cellSize));
+	int cellZ0 = std::max(0, (int)((z0 - 2.0f * spacing) / m_cellSize));
+	int cellX1 = std::min(m_gridWidth - 1, (int)((x1 + 2.0f * spacing) / m_cellSize));
+	int cellZ1 = std::min(m_gridHeight - 1, (int)((z1 + 2.0f * spacing) / m_cellSize));
+	for (int j = cellZ0; j <= cellZ1; j++)
+	{
+		for (int i = cellX0; i <= cellX1; i++)
+		{
+			if (m_grid[j * m_gridWidth + i].x >= 0.0f)
+			{
+				active.push_back(m_grid[j * m_gridWidth + i]);
+			}
+		}
+	}
+
+	for (int dart = 0; dart < DARTS; dart++)
+	{
+		float x = x0 + next() * (x1 - x0);
+		float z = z0 + next() * (z1 - z0);
+		if (accept(x, z))
+		{
+			add(x, z);
+			break;
+		}
+	}
+
+	while (!active.empty())
+	{
+		int index = std::min((int)(next() * active.size()), (int)active.size() - 1);
+		Point from = active[index];
+
+		bool found = false;
+		for (int candidate = 0; candidate < CANDIDATES && !found; candidate++)
+		{
+			float angle = next() * 2.0f * PI;
+			float distance = spacing * (1.0f + next());
+			float x = from.x + cosf(angle) * distance;
+			float z = from.z + sinf(angle) * distance;
+			if (accept(x, z))
+			{
+				add(x, z);
+				found = true;
+			}
+		}
+
+		if (!found)
+		{
+			active[index] = active.back();
+			active.pop_back();
+		}
+	}
+}
+
+void ObjectScatter::FilterChunk(const float* heights, int layer, int chunkX, int chunkZ, const std::vector<Point>& points,
+	std::vector<Instance>& instances) const
+{
+	const Layer& settings = m_layers[layer];
+	Philox random(m_seed);
+	int key = ChunkKey(chunkX, chunkZ);
+	uint32_t streams = layer * STREAM_COUNT;
+
+	instances.clear();
+	for (int i = 0; i < (int)points.size(); i++)
+	{
+		float height, slope;
+		SampleHeight(heights, points[i].x, points[i].z, height, slope);
+
+		float keep = settings.density * Band(height, settings.minHeight, settings.maxHeight, settings.heightBlend) *
+			Band(slope, settings.minSlope, settings.maxSlope, settings.slopeBlend);
+		if (random.GetFloat(i, key, streams + STREAM_KEEP) >= keep)
+		{
+			continue;
+		}
+
+		Instance instance;
+		instance.x = points[i].x;
+		instance.y = height;
+		instance.z = points[i].z;
+		instance.rotation = random.GetFloat(i, key, streams + STREAM_ROTATION) * 2.0f * PI;
+		instance.scale = settings.minScale + random.GetFloat(i, key, streams + STREAM_SCALE) * (settings.maxScale - settings.minScale);
+		instances.push_back(instance);
+	}
+}
+
+void ObjectScatter::SampleHeight(const float* heights, float x, float z, float& height, float& slope) const
+{
+	int i = std::min((int)x, m_width - 2);
+	int j = std::min((int)z, m_height - 2);
+	float fx = x - i;
+	float fz = z - j;
+
+	float h00 = heights[j * m_width + i];
+	float h10 = heights[j * m_width + i + 1];
+	float h01 = heights[(j + 1) * m_width + i];
+	float h11 = heights[(j + 1) * m_width + i + 1];
+
+	float top = h00 + (h10 - h00) * fx;
+	float bottom = h01 + (h11 - h01) * fx;
+	height = top + (bottom - top) * fz;
+
+	//slope from the gradient of the same bilinear patch, 1 - normal.y
+	float gradientX = (h10 - h00) * (1.0f - fz) + (h11 - h01) * fz;
+	float gradientZ = bottom - top;
+	slope = 1.0f - 1.0f / sqrtf(1.0f + gradientX * gradientX + gradientZ * gradientZ);
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+
+//Places objects (trees, rocks...) over a heightfield with Poisson disk sampling: no two instances of a layer
+//closer than its spacing, but otherwise random, which looks far more natural than jittered grids.
+//
+//Sampling is Bridson's: keep a list of active points, try a few random candidates in the ring between one and two
+//spacings around one of them, and accept the first that has no neighbour too close. A background grid of cells
+//spacing / sqrt(2) across holds at most one point each, so a neighbour check only looks at the 5x5 cells around.
+//
+//The map is cut into square chunks and each chunk is sampled on its own, seeded by its chunk coordinate, so the
+//result never depends on the thread count. Chunks run in four passes by the parity of their coordinates, so the
+//chunks running together are at least a chunk apart and can't see each other's points, while a chunk always sees
+//the finished chunks around it and grows its points in from their edges. Nothing ends up too close across a
+//chunk boundary and there are no seams.
+//
+//Height and slope masks (the same bands as SplatMap) and a density then thin the points out. They are applied
+//after sampling so they never change the spacing, just how many points are kept. Every random number is taken
+//from Philox keyed on the chunk and the point, so regenerating with the same settings gives the same instances.
+
+class ObjectScatter
+{
+public:
+	static const int MAX_LAYERS = 4;
+
+	//compact enough to go straight into an instance buffer, 20 bytes. grid space, the same as the terrain vertices.
+	struct Instance
+	{
+		float x, y, z;
+		float rotation;			//about y, radians
+		float scale;
+	};
+
+	struct Layer
+	{
+		float spacing;					//minimum distance between instances, at most a third of the chunk size
+		float density;					//fraction of the points kept where the masks are fully on
+		float minHeight, maxHeight;		//masks, full inside the band and fading out over the blend
+		float heightBlend;
+		float minSlope, maxSlope;		//slope is 1 - normal.y, so 0 is flat and 1 a wall
+		float slopeBlend;
+		float minScale, maxScale;
+
+		Layer() : spacing(2.0f), density(1.0f), minHeight(-1e30f), maxHeight(1e30f), heightBlend(1.0f),
+			minSlope(0.0f), maxSlope(1.0f), slopeBlend(0.1f), minScale(1.0f), maxScale(1.0f) {}
+	};
+
+	//where a chunk's instances sit in its layer's array
+	struct ChunkRange
+	{
+		uint32_t first, count;
+	};
+
+	ObjectScatter();
+	~ObjectScatter();
+
+	bool Initialize(int width, int height, int layerCount, float chunkSize = 16.0f);
+	void SetLayer(int index, const Layer& layer);
+	void SetSeed(uint64_t seed) { m_seed = seed; }
+
+	//heights are width * height row major in grid units
+	void Generate(const float* heights, int threadCount = 0);
+
+	int GetLayerCount() const { return m_layerCount; }
+	int GetChunksX() const { return m_chunksX; }
+	int GetChunksZ() const { return m_chunksZ; }
+	float GetChunkSize() const { return m_chunkSize; }
+	//ordered chunk by chunk, row major
+	const std::vector<Instance>& GetInstances(int layer) const { return m_instances[layer]; }
+	const std::vector<ChunkRange>& GetChunkRanges(int layer) const { return m_chunkRanges[layer]; }
+
+private:
+	struct Point
+	{
+		float x, z;
+	};
+
+	void SampleChunk(int layer, int chunkX, int chunkZ, std::vector<Point>& points);
+	void FilterChunk(const float* heights, int layer, int chunkX, int chunkZ, const std::vector<Point>& points,
+		std::vector<Instance>& instances) const;
+	void SampleHeight(const float* heights, float x, float z, float& height, float& slope) const;
+
+private:
+	int m_width, m_height;
+	int m_layerCount;
+	float m_chunkSize;
+	int m_chunksX, m_chunksZ;
+	uint64_t m_seed;
+	Layer m_layers[MAX_LAYERS];
+
+	//background grid for the layer being sampled, x < 0 marks an empty cell
+	float m_cellSize;
+	int m_gridWidth, m_gridHeight;
+	std::vector<Point> m_grid;
+
+	std::vector<Instance> m_instances[MAX_LAYERS];
+	std::vector<ChunkRange> m_chunkRanges[MAX_LAYERS];
+};
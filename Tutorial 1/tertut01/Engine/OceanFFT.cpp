@@ -0,0 +1,332 @@
+#include "pch.h"
+#include "OceanFFT.h"
+#include "ParallelFor.h"
+#include <random>
+
+using DirectX::SimpleMath::Vector2;
+using DirectX::SimpleMath::Vector3;
+
+namespace
+{
+	const float GRAVITY = 9.81f;
+	const float PI = 3.14159265358979f;
+
+	//Phillips constant picked so the significant wave height lands near the Pierson Moskowitz 0.21 V^2 / g
+	const float PHILLIPS_CONSTANT = 3.5e-3f;
+}
+
+
+OceanFFT::OceanFFT()
+{
+	m_size = 0;
+	m_log2Size = 0;
+}
+
+OceanFFT::~OceanFFT()
+{
+}
+
+float OceanFFT::SpectrumAt(float kx, float kz) const
+{
+	float k = sqrtf(kx * kx + kz * kz);
+	if (k < 1e-6f)
+	{
+		return 0.0f;
+	}
+
+	Vector2 wind = m_settings.windDirection;
+	wind.Normalize();
+	float cosine = (kx * wind.x + kz * wind.y) / k;
+
+	if (m_settings.spectrum == SPECTRUM_JONSWAP)
+	{
+		//JONSWAP is defined over frequency, so convert: P(k) = S(w) dw/dk / k * D(theta)
+		float U = std::max(m_settings.windSpeed, 0.1f);
+		float F = std::max(m_settings.fetch, 1.0f);
+		float omega = sqrtf(GRAVITY * k);
+		float peak = 22.0f * powf(GRAVITY * GRAVITY / (U * F), 1.0f / 3.0f);
+		float alpha = 0.076f * powf(U * U / (F * GRAVITY), 0.22f);
+		float sigma = omega <= peak ? 0.07f : 0.09f;
+		float r = expf(-(omega - peak) * (omega - peak) / (2.0f * sigma * sigma * peak * peak));
+		float S = alpha * GRAVITY * GRAVITY / powf(omega, 5.0f) * expf(-1.25f * powf(peak / omega, 4.0f)) * powf(3.3f, r);
+
+		//cos^2 spreading over the half plane facing the wind, integrates to one
+		float spreading = cosine > 0.0f ? (2.0f / PI) * cosine * cosine : 0.0f;
+		float dOmegaDk = 0.5f * GRAVITY / omega;
+		return m_settings.amplitude * S * dOmegaDk / k * spreading;
+	}
+
+	//Phillips
+	float L = m_settings.windSpeed * m_settings.windSpeed / GRAVITY;
+	float k2 = k * k;
+	float phillips = PHILLIPS_CONSTANT * expf(-1.0f / (k2 * L * L)) / (k2 * k2) * cosine * cosine;
+
+	//waves running against the wind are mostly gone
+	if (cosine < 0.0f)
+	{
+		phillips *= 0.07f;
+	}
+
+	//and very short ones are damped so they don't alias
+	float small = L * 0.001f;
+	phillips *= expf(-k2 * small * small);
+
+	return m_settings.amplitude * phillips;
+}
+
+bool OceanFFT::Initialize(const Settings& settings)
+{
+	int size = settings.size;
+	if (size < 4 || (size & (size - 1)) != 0)
+	{
+		return false;
+	}
+
+	m_settings = settings;
+	m_size = size;
+	m_log2Size = 0;
+	while ((1 << m_log2Size) < size)
+	{
+		m_log2Size++;
+	}
+
+	//bit reversal and twiddles are shared by every row and column transform
+	m_bitReverse.resize(size);
+	for (int i = 0; i < size; i++)
+	{
+		int reversed = 0;
+		for (int b = 0; b < m_log2Size; b++)
+		{
+			reversed |= ((i >> b) & 1) << (m_log2Size - 1 - b);
+		}
+		m_bitReverse[i] = reversed;
+	}
+
+	m_twiddles.resize(size / 2);
+	for (int i = 0; i < size / 2; i++)
+	{
+		//positive exponent, this is the inverse transform
+		float angle = 2.0f * PI * (float)i / (float)size;
+		m_twiddles[i] = Complex(cosf(angle), sinf(angle));
+	}
+
+	int count = size * size;
+	m_h0.resize(count);
+	m_h0MinusConj.resize(count);
+	m_omega.resize(count);
+
+	std::mt19937 random(settings.seed);
+	std::normal_distribution<float> gaussian(0.0f, 1.0f);
+
+	//each mode's amplitude is sqrt(P(k) dk^2 / 2) with a random complex phase
+	float dk = 2.0f * PI / settings.patchSize;
+	for (int m = 0; m < size; m++)
+	{
+		for (int n = 0; n < size; n++)
+		{
+			//standard FFT ordering, the top half of the indices are the negative frequencies
+			float kx = dk * (float)(n < size / 2 ? n : n - size);
+			float kz = dk * (float)(m < size / 2 ? m : m - size);
+			float amplitude = sqrtf(SpectrumAt(kx, kz) * dk * dk * 0.5f);
+			float real = gaussian(random);
+			float imaginary = gaussian(random);
+			m_h0[m * size + n] = Complex(real * amplitude, imaginary * amplitude);
+			m_omega[m * size + n] = sqrtf(GRAVITY * sqrtf(kx * kx + kz * kz));
+		}
+	}
+
+	for (int m = 0; m < size; m++)
+	{
+		for (int n = 0; n < size; n++)
+		{
+			int minus = Wrap(size - m) * size + Wrap(size - n);
+			m_h0MinusConj[m * size + n] = std::conj(m_h0[minus]);
+		}
+	}
+
+	m_heightSlopeX.resize(count);
+	m_slopeZDisplaceX.resize(count);
+	m_displaceZ.resize(count);
+	m_heights.assign(count, 0.0f);
+	m_displacements.assign(count, Vector2(0.0f, 0.0f));
+	m_normals.assign(count, Vector3(0.0f, 1.0f, 0.0f));
+
+	return true;
+}
+
+void OceanFFT::FFTColumns(Complex* data, int firstColumn, int lastColumn) const
+{
+	int size = m_size;
+	int count = lastColumn - firstColumn;
+
+	//iterative radix 2, but every butterfly is applied to a run of columns at once.
+	//the inner loop then walks along a row, which is contiguous and vectorises.
+	for (int i = 0; i < size; i++)
+	{
+		int j = m_bitReverse[i];
+		if (j > i)
+		{
+			std::swap_ranges(data + i * size + firstColumn, data + i * size + lastColumn, data + j * size + firstColumn);
+		}
+	}
+
+	for (int length = 2; length <= size; length <<= 1)
+	{
+		int half = length >> 1;
+		int step = size / length;
+		for (int start = 0; start < size; start += length)
+		{
+			for (int k = 0; k < half; k++)
+			{
+				float* a = reinterpret_cast<float*>(data + (start + k) * size + firstColumn);
+				float* b = reinterpret_cast<float*>(data + (start + k + half) * size + firstColumn);
+				float wr = m_twiddles[k * step].real();
+				float wi = m_twiddles[k * step].imag();
+				for (int c = 0; c < count * 2; c += 2)
+				{
+					float tr = b[c] * wr - b[c + 1] * wi;
+					float ti = b[c] * wi + b[c + 1] * wr;
+					b[c] = a[c] - tr;
+					b[c + 1] = a[c + 1] - ti;
+					a[c] += tr;
+					a[c + 1] += ti;
+				}
+			}
+		}
+	}
+}
+
+void OceanFFT::InverseFFT2D(std::vector<Complex>& data, int threadCount)
+{
+	int size = m_size;
+
+	//the column pass is the fast one (long contiguous inner loops), so rather than doing rows the slow way
+	//the grid is transposed in between and the column pass runs twice. the result is left transposed.
+	ParallelForRanges(0, size, [&](int first, int last)
+	{
+		FFTColumns(data.data(), first, last);
+	}, threadCount);
+
+	ParallelForRanges(0, size, [&](int first, int last)
+	{
+		for (int row = first; row < last; row++)
+		{
+			for (int column = row + 1; column < size; column++)
+			{
+				std::swap(data[row * size + column], data[column * size + row]);
+			}
+		}
+	}, threadCount);
+
+	ParallelForRanges(0, size, [&](int first, int last)
+	{
+		FFTColumns(data.data(), first, last);
+	}, threadCount);
+}
+
+void OceanFFT::Update(float time, int threadCount)
+{
+	int size = m_size;
+	if (size == 0)
+	{
+		return;
+	}
+
+	//every pass touches the whole grid, up to a 128x128 ocean it's quicker to stay on one thread
+	threadCount = ParallelThreadCount(threadCount, size * size, 16384);
+
+	float dk = 2.0f * PI / m_settings.patchSize;
+
+	//move the spectrum to time t and build the derived fields in frequency space
+	ParallelForRanges(0, size, [&](int first, int last)
+	{
+		for (int m = first; m < last; m++)
+		{
+			float kz = dk * (float)(m < size / 2 ? m : m - size);
+			for (int n = 0; n < size; n++)
+			{
+				int index = m * size + n;
+				float kx = dk * (float)(n < size / 2 ? n : n - size);
+				float k = sqrtf(kx * kx + kz * kz);
+
+				float phase = m_omega[index] * time;
+				float c = cosf(phase);
+				float si = sinf(phase);
+
+				//h = h0 e^(iwt) + conj(h0(-k)) e^(-iwt), written out so it doesn't go through the checked complex multiply
+				const Complex& a = m_h0[index];
+				const Complex& b = m_h0MinusConj[index];
+				float hr = (a.real() + b.real()) * c - (a.imag() - b.imag()) * si;
+				float hi = (a.imag() + b.imag()) * c + (a.real() - b.real()) * si;
+
+				//slopes are i k h, choppy displacement is -i k/|k| h
+				float ux = k > 1e-6f ? kx / k : 0.0f;
+				float uz = k > 1e-6f ? kz / k : 0.0f;
+
+				//two hermitian spectra share one transform, a + i b comes back as real a and imaginary b:
+				//height + i slopeX, slopeZ + i displaceX, displaceZ on its own
+				m_heightSlopeX[index] = Complex(hr - kx * hr, hi - kx * hi);
+				m_slopeZDisplaceX[index] = Complex(-kz * hi + ux * hr, kz * hr + ux * hi);
+				m_displaceZ[index] = Complex(uz * hi, -uz * hr);
+			}
+		}
+	}, threadCount);
+
+	InverseFFT2D(m_heightSlopeX, threadCount);
+	InverseFFT2D(m_slopeZDisplaceX, threadCount);
+	InverseFFT2D(m_displaceZ, threadCount);
+
+	float choppiness = m_settings.choppiness;
+	ParallelForRanges(0, size * size, [&](int first, int last)
+	{
+		for (int i = first; i < last; i++)
+		{
+			//the transforms come back transposed
+			int t = (i % size) * size + (i / size);
+			m_heights[i] = m_heightSlopeX[t].real();
+			m_displacements[i] = Vector2(m_slopeZDisplaceX[t].imag(), m_displaceZ[t].real()) * choppiness;
+
+			Vector3 normal(-m_heightSlopeX[t].imag(), 1.0f, -m_slopeZDisplaceX[t].real());
+			normal.Normalize();
+			m_normals[i] = normal;
+		}
+	}, threadCount);
+}
+
+float OceanFFT::GetHeight(int x, int z) const
+{
+	return m_heights[Wrap(z) * m_size + Wrap(x)];
+}
+
+Vector2 OceanFFT::GetDisplacement(int x, int z) const
+{
+	return m_displacements[Wrap(z) * m_size + Wrap(x)];
+}
+
+Vector3 OceanFFT::GetNormal(int x, int z) const
+{
+	return m_normals[Wrap(z) * m_size + Wrap(x)];
+}
+
+void OceanFFT::Sample(float x, float z, float& height, Vector2& displacement, Vector3& normal) const
+{
+	float scale = (float)m_size / m_settings.patchSize;
+	float gx = x * scale;
+	float gz = z * scale;
+	float fx0 = floorf(gx);
+	float fz0 = floorf(gz);
+	float tx = gx - fx0;
+	float tz = gz - fz0;
+	int x0 = (int)fx0;
+	int z0 = (int)fz0;
+
+	float w00 = (1.0f - tx) * (1.0f - tz);
+	float w10 = tx * (1.0f - tz);
+	float w01 = (1.0f - tx) * tz;
+	float w11 = tx * tz;
+
+	height = GetHeight(x0, z0) * w00 + GetHeight(x0 + 1, z0) * w10 + GetHeight(x0, z0 + 1) * w01 + GetHeight(x0 + 1, z0 + 1) * w11;
+	displacement = GetDisplacement(x0, z0) * w00 + GetDisplacement(x0 + 1, z0) * w10 + GetDisplacement(x0, z0 + 1) * w01 + GetDisplacement(x0 + 1, z0 + 1) * w11;
+	normal = GetNormal(x0, z0) * w00 + GetNormal(x0 + 1, z0) * w10 + GetNormal(x0, z0 + 1) * w01 + GetNormal(x0 + 1, z0 + 1) * w11;
+	normal.Normalize();
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <complex>
+
+//Tessendorf style FFT ocean.
+//A random spectrum h0(k) is built once from a Phillips or JONSWAP wave spectrum. Every frame it is moved
+//forward in time in frequency space (each wave just rotates its phase by sqrt(g|k|) t) and turned back into
+//heights, choppy x / z displacement and slopes with inverse 2D FFTs. Five real fields are needed, so they are
+//packed two to a complex transform (both spectra are hermitian, so one ends up in the real part and one in
+//the imaginary part) which leaves three transforms per frame. Each transform is a column pass, a transpose and
+//a second column pass, with the columns split across threads. The result tiles seamlessly, patchSize world units across.
+
+class OceanFFT
+{
+public:
+	enum Spectrum
+	{
+		SPECTRUM_PHILLIPS,
+		SPECTRUM_JONSWAP,
+	};
+
+	struct Settings
+	{
+		int size;					//grid resolution, power of two
+		float patchSize;			//world units covered by one tile
+		float windSpeed;			//m/s
+		DirectX::SimpleMath::Vector2 windDirection;
+		float amplitude;			//overall height scale
+		float choppiness;			//0 is plain heights, ~1 sharpens the crests
+		float fetch;				//JONSWAP only, distance the wind has blown over (m)
+		Spectrum spectrum;
+		unsigned int seed;
+
+		Settings() : size(256), patchSize(64.0f), windSpeed(12.0f), windDirection(1.0f, 0.3f),
+			amplitude(1.0f), choppiness(0.8f), fetch(100000.0f), spectrum(SPECTRUM_PHILLIPS), seed(1337) {}
+	};
+
+	OceanFFT();
+	~OceanFFT();
+
+	bool Initialize(const Settings& settings);
+	//rebuilds every output field for the given time
+	void Update(float time, int threadCount = 0);
+
+	int GetSize() const { return m_size; }
+	float GetPatchSize() const { return m_settings.patchSize; }
+
+	//grid access, wraps
+	float GetHeight(int x, int z) const;
+	DirectX::SimpleMath::Vector2 GetDisplacement(int x, int z) const;
+	DirectX::SimpleMath::Vector3 GetNormal(int x, int z) const;
+
+	//bilinear in world units, wraps every patchSize
+	void Sample(float x, float z, float& height, DirectX::SimpleMath::Vector2& displacement, DirectX::SimpleMath::Vector3& normal) const;
+
+private:
+	typedef std::complex<float> Complex;
+
+	float SpectrumAt(float kx, float kz) const;
+	void InverseFFT2D(std::vector<Complex>& data, int threadCount);
+	void FFTColumns(Complex* data, int firstColumn, int lastColumn) const;
+	int Wrap(int i) const { return i & (m_size - 1); }
+
+private:
+	Settings m_settings;
+	int m_size;
+	int m_log2Size;
+
+	std::vector<Complex> m_h0;				//h0(k)
+	std::vector<Complex> m_h0MinusConj;		//conj(h0(-k))
+	std::vector<float> m_omega;				//dispersion, sqrt(g|k|)
+	std::vector<int> m_bitReverse;
+	std::vector<Complex> m_twiddles;
+
+	//frequency space work, each holds two packed real fields
+	std::vector<Complex> m_heightSlopeX;
+	std::vector<Complex> m_slopeZDisplaceX;
+	std::vector<Complex> m_displaceZ;
+
+	//spatial results
+	std::vector<float> m_heights;
+	std::vector<DirectX::SimpleMath::Vector2> m_displacements;
+	std::vector<DirectX::SimpleMath::Vector3> m_normals;
+};
@@ -0,0 +1,206 @@
+#pragma once
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+
+//Small helpers for splitting a loop across the hardware threads.
+//The range is cut into contiguous blocks (one per thread) so the split only depends on the thread count,
+//which keeps anything seeded per index deterministic.
+//
+//The blocks run on a pool of threads that is started once and kept, so a loop costs a wake up rather than
+//creating and joining threads, which matters for the per frame simulations that run several small loops a
+//frame. The calling thread takes blocks too and only waits for the ones already running elsewhere, so a loop
+//started from inside another one (or with every pool thread busy) still finishes.
+
+class ParallelPool
+{
+public:
+	static ParallelPool& Get()
+	{
+		static ParallelPool pool;
+		return pool;
+	}
+
+	//block(b) for every b in [0, blocks), returns once they have all finished
+	void Run(int blocks, const std::function<void(int)>& block)
+	{
+		Job job;
+		job.block = &block;
+		job.blocks = blocks;
+		job.next = 0;
+		job.finished = 0;
+		job.users = 0;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_jobs.push_back(&job);
+		}
+		m_workSignal.notify_all();
+
+		int ran = RunBlocks(job);
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		job.finished += ran;
+		m_doneSignal.wait(lock, [&job]() { return job.finished == job.blocks && job.users == 0; });
+		for (size_t i = 0; i < m_jobs.size(); i++)
+		{
+			if (m_jobs[i] == &job)
+			{
+				m_jobs.erase(m_jobs.begin() + i);
+				break;
+			}
+		}
+	}
+
+private:
+	struct Job
+	{
+		const std::function<void(int)>* block;
+		int blocks;
+		std::atomic<int> next;		//the next block nobody has taken
+		int finished;				//under m_mutex
+		int users;					//pool threads working on it, under m_mutex
+	};
+
+	ParallelPool() : m_stop(false)
+	{
+		int hardware = (int)std::thread::hardware_concurrency();
+		for (int t = 1; t < hardware; t++)
+		{
+			m_threads.emplace_back(&ParallelPool::Work, this);
+		}
+	}
+
+	~ParallelPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_workSignal.notify_all();
+		for (size_t i = 0; i < m_threads.size(); i++)
+		{
+			m_threads[i].join();
+		}
+	}
+
+	int RunBlocks(Job& job)
+	{
+		int ran = 0;
+		for (int b = job.next++; b < job.blocks; b = job.next++)
+		{
+			(*job.block)(b);
+			ran++;
+		}
+		return ran;
+	}
+
+	Job* FindJob()
+	{
+		for (size_t i = 0; i < m_jobs.size(); i++)
+		{
+			if (m_jobs[i]->next < m_jobs[i]->blocks)
+			{
+				return m_jobs[i];
+			}
+		}
+		return nullptr;
+	}
+
+	void Work()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		for (;;)
+		{
+			Job* job = nullptr;
+			m_workSignal.wait(lock, [&]() { return m_stop || (job = FindJob()) != nullptr; });
+			if (m_stop)
+			{
+				return;
+			}
+
+			job->users++;
+			lock.unlock();
+			int ran = RunBlocks(*job);
+			lock.lock();
+			job->users--;
+			job->finished += ran;
+			if (job->finished == job->blocks && job->users == 0)
+			{
+				m_doneSignal.notify_all();
+			}
+		}
+	}
+
+private:
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::condition_variable m_workSignal;
+	std::condition_variable m_doneSignal;
+	std::deque<Job*> m_jobs;
+	bool m_stop;
+};
+
+inline int ParallelThreadCount(int requested = 0)
+{
+	if (requested > 0)
+	{
+		return requested;
+	}
+	int hardware = (int)std::thread::hardware_concurrency();
+	return hardware > 0 ? hardware : 1;
+}
+
+//as above, but when the count is left to the hardware small jobs use fewer threads (down to just the caller),
+//so loops over a few thousand cells don't pay for a wake up they can't win back
+inline int ParallelThreadCount(int requested, int work, int minWorkPerThread)
+{
+	if (requested > 0)
+	{
+		return requested;
+	}
+	return std::max(1, std::min(ParallelThreadCount(), work / minWorkPerThread));
+}
+
+//function(first, last) is called once per block with last exclusive
+template<typename Function>
+void ParallelForRanges(int begin, int end, Function function, int threadCount = 0)
+{
+	int count = end - begin;
+	if (count <= 0)
+	{
+		return;
+	}
+
+	threadCount = std::min(ParallelThreadCount(threadCount), count);
+	if (threadCount == 1)
+	{
+		function(begin, end);
+		return;
+	}
+
+	ParallelPool::Get().Run(threadCount, [=, &function](int t)
+	{
+		int first = begin + (int)((long long)count * t / threadCount);
+		int last = begin + (int)((long long)count * (t + 1) / threadCount);
+		function(first, last);
+	});
+}
+
+//function(i) is called for every index in [begin, end)
+template<typename Function>
+void ParallelFor(int begin, int end, Function function, int threadCount = 0)
+{
+	ParallelForRanges(begin, end, [&function](int first, int last)
+	{
+		for (int i = first; i < last; i++)
+		{
+			function(i);
+		}
+	}, threadCount);
+}
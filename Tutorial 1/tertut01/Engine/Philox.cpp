@@ -0,0 +1,274 @@
+#include "pch.h"
+#include "Philox.h"
+#include <emmintrin.h>
+#include <vector>
+
+namespace
+{
+	const uint32_t MULTIPLIER0 = 0xD2511F53;
+	const uint32_t MULTIPLIER1 = 0xCD9E8D57;
+	const uint32_t WEYL0 = 0x9E3779B9;		//golden ratio
+	const uint32_t WEYL1 = 0xBB67AE85;		//sqrt(3) - 1
+	const int ROUNDS = 10;
+
+	//the grid and the flat stream use different last words so they never share a counter
+	const uint32_t GRID_TAG = 0;
+	const uint32_t STREAM_TAG = 1;
+
+	inline void MulHiLo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo)
+	{
+		uint64_t product = (uint64_t)a * b;
+		hi = (uint32_t)(product >> 32);
+		lo = (uint32_t)product;
+	}
+
+	//four counters side by side, word w of counter i in lane i of c[w]
+	inline void MulHiLo4(__m128i a, uint32_t multiplier, __m128i& hi, __m128i& lo)
+	{
+		//SSE2 only multiplies the even lanes to 64 bits, so the odd ones get shifted down and done separately
+		__m128i m = _mm_set1_epi32((int)multiplier);
+		__m128i even = _mm_mul_epu32(a, m);
+		__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);
+		__m128i lowLanes = _mm_set_epi32(0, -1, 0, -1);
+		lo = _mm_or_si128(_mm_and_si128(even, lowLanes), _mm_slli_epi64(odd, 32));
+		hi = _mm_or_si128(_mm_srli_epi64(even, 32), _mm_andnot_si128(lowLanes, odd));
+	}
+
+	inline void Block4(__m128i c[4], uint32_t key0, uint32_t key1)
+	{
+		for (int round = 0; round < ROUNDS; round++)
+		{
+			__m128i hi0, lo0, hi1, lo1;
+			MulHiLo4(c[0], MULTIPLIER0, hi0, lo0);
+			MulHiLo4(c[2], MULTIPLIER1, hi1, lo1);
+			__m128i next0 = _mm_xor_si128(_mm_xor_si128(hi1, c[1]), _mm_set1_epi32((int)key0));
+			__m128i next2 = _mm_xor_si128(_mm_xor_si128(hi0, c[3]), _mm_set1_epi32((int)key1));
+			c[0] = next0;
+			c[1] = lo1;
+			c[2] = next2;
+			c[3] = lo0;
+			key0 += WEYL0;
+			key1 += WEYL1;
+		}
+	}
+
+	inline __m128i ToFloat4(__m128i values)
+	{
+		__m128 f = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(values, 8)), _mm_set1_ps(1.0f / 16777216.0f));
+		return _mm_castps_si128(f);
+	}
+}
+
+
+Philox::Philox(uint64_t seed)
+{
+	SetSeed(seed);
+}
+
+void Philox::SetSeed(uint64_t seed)
+{
+	m_key0 = (uint32_t)seed;
+	m_key1 = (uint32_t)(seed >> 32);
+}
+
+void Philox::Block(const uint32_t counter[4], uint32_t key0, uint32_t key1, uint32_t out[4])
+{
+	uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+	for (int round = 0; round < ROUNDS; round++)
+	{
+		uint32_t hi0, lo0, hi1, lo1;
+		MulHiLo(MULTIPLIER0, c0, hi0, lo0);
+		MulHiLo(MULTIPLIER1, c2, hi1, lo1);
+		uint32_t next0 = hi1 ^ c1 ^ key0;
+		uint32_t next2 = hi0 ^ c3 ^ key1;
+		c0 = next0;
+		c1 = lo1;
+		c2 = next2;
+		c3 = lo0;
+		key0 += WEYL0;
+		key1 += WEYL1;
+	}
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+uint32_t Philox::Get(int x, int z, uint32_t stream) const
+{
+	uint32_t counter[4] = { (uint32_t)x, (uint32_t)z, stream, GRID_TAG };
+	uint32_t out[4];
+	Block(counter, m_key0, m_key1, out);
+	return out[0];
+}
+
+float Philox::GetFloat(int x, int z, uint32_t stream) const
+{
+	return ToFloat(Get(x, z, stream));
+}
+
+void Philox::FillGrid(uint32_t* out, int x0, int z0, int width, int height, uint32_t stream) const
+{
+	for (int j = 0; j < height; j++)
+	{
+		uint32_t* row = out + (size_t)j * width;
+		int i = 0;
+		for (; i + 4 <= width; i += 4)
+		{
+			//only the first word is used, which is also what Get returns
+			__m128i c[4];
+			c[0] = _mm_add_epi32(_mm_set1_epi32(x0 + i), _mm_set_epi32(3, 2, 1, 0));
+			c[1] = _mm_set1_epi32(z0 + j);
+			c[2] = _mm_set1_epi32((int)stream);
+			c[3] = _mm_set1_epi32((int)GRID_TAG);
+			Block4(c, m_key0, m_key1);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(row + i), c[0]);
+		}
+		for (; i < width; i++)
+		{
+			row[i] = Get(x0 + i, z0 + j, stream);
+		}
+	}
+}
+
+void Philox::Fill(uint32_t* out, size_t count, uint64_t first, uint32_t stream) const
+{
+	size_t done = 0;
+
+	//value n of the stream is word n % 4 of counter n / 4
+	auto scalar = [&](uint64_t position) -> uint32_t
+	{
+		uint64_t index = position >> 2;
+		uint32_t counter[4] = { (uint32_t)index, (uint32_t)(index >> 32), stream, STREAM_TAG };
+		uint32_t block[4];
+		Block(counter, m_key0, m_key1, block);
+		return block[position & 3];
+	};
+
+	//finish off a counter that starts part way through
+	while (done < count && ((first + done) & 3) != 0)
+	{
+		out[done] = scalar(first + done);
+		done++;
+	}
+
+	//then four whole counters, sixteen values, per pass
+	for (; done + 16 <= count; done += 16)
+	{
+		uint64_t index = (first + done) >> 2;
+		__m128i c[4];
+		c[0] = _mm_add_epi32(_mm_set1_epi32((int)(uint32_t)index), _mm_set_epi32(3, 2, 1, 0));
+		//the low word only wraps inside a group of four if index is within 3 of it, which gives a carry per lane
+		__m128i carry = _mm_and_si128(_mm_cmplt_epi32(_mm_xor_si128(c[0], _mm_set1_epi32((int)0x80000000)),
+			_mm_xor_si128(_mm_set1_epi32((int)(uint32_t)index), _mm_set1_epi32((int)0x80000000))), _mm_set1_epi32(1));
+		c[1] = _mm_add_epi32(_mm_set1_epi32((int)(uint32_t)(index >> 32)), carry);
+		c[2] = _mm_set1_epi32((int)stream);
+		c[3] = _mm_set1_epi32((int)STREAM_TAG);
+		Block4(c, m_key0, m_key1);
+
+		//lanes are counters and registers are words, transpose so each counter's four words land together
+		__m128i t0 = _mm_unpacklo_epi32(c[0], c[1]);
+		__m128i t1 = _mm_unpacklo_epi32(c[2], c[3]);
+		__m128i t2 = _mm_unpackhi_epi32(c[0], c[1]);
+		__m128i t3 = _mm_unpackhi_epi32(c[2], c[3]);
+		__m128i* destination = reinterpret_cast<__m128i*>(out + done);
+		_mm_storeu_si128(destination + 0, _mm_unpacklo_epi64(t0, t1));
+		_mm_storeu_si128(destination + 1, _mm_unpackhi_epi64(t0, t1));
+		_mm_storeu_si128(destination + 2, _mm_unpacklo_epi64(t2, t3));
+		_mm_storeu_si128(destination + 3, _mm_unpackhi_epi64(t2, t3));
+	}
+
+	for (; done < count; done++)
+	{
+		out[done] = scalar(first + done);
+	}
+}
+
+void Philox::FillFloats(float* out, size_t count, uint64_t first, uint32_t stream) const
+{
+	//generate into the output itself and convert in place, a cache sized chunk at a time
+	const size_t CHUNK = 4096;
+	for (size_t start = 0; start < count; start += CHUNK)
+	{
+		size_t length = std::min(CHUNK, count - start);
+		uint32_t* bits = reinterpret_cast<uint32_t*>(out + start);
+		Fill(bits, length, first + start, stream);
+
+		size_t i = 0;
+		for (; i + 4 <= length; i += 4)
+		{
+			__m128i* p = reinterpret_cast<__m128i*>(bits + i);
+			_mm_storeu_si128(p, ToFloat4(_mm_loadu_si128(p)));
+		}
+		for (; i < length; i++)
+		{
+			out[start + i] = ToFloat(bits[i]);
+		}
+	}
+}
+
+size_t Philox::TestAgainstReference()
+{
+	size_t failures = 0;
+
+	//the known answer vectors from the Random123 distribution (kat_vectors, philox4x32 with 10 rounds)
+	const uint32_t counters[3][4] = { { 0, 0, 0, 0 }, { 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF }, { 0x243F6A88, 0x85A308D3, 0x13198A2E, 0x03707344 } };
+	const uint32_t keys[3][2] = { { 0, 0 }, { 0xFFFFFFFF, 0xFFFFFFFF }, { 0xA4093822, 0x299F31D0 } };
+	const uint32_t answers[3][4] = { { 0x6627E8D5, 0xE169C58D, 0xBC57AC4C, 0x9B00DBD8 }, { 0x408F276D, 0x41C83B0E, 0xA20BC7C6, 0x6D5451FD }, { 0xD16CFE09, 0x94FDCCEB, 0x5001E420, 0x24126EA1 } };
+	for (int i = 0; i < 3; i++)
+	{
+		uint32_t out[4];
+		Block(counters[i], keys[i][0], keys[i][1], out);
+		for (int w = 0; w < 4; w++)
+		{
+			failures += out[w] == answers[i][w] ? 0 : 1;
+		}
+	}
+
+	//FillGrid against Get, with widths that leave every tail length and corners at negative coordinates
+	//and either side of the 32 bit wrap
+	Philox random(0x123456789ABCDEFull);
+	const int origins[][2] = { { 0, 0 }, { -7, -3 }, { 0x7FFFFFFA, 5 }, { -0x7FFFFFFF - 1, 0x7FFFFFFF - 2 } };
+	std::vector<uint32_t> grid;
+	for (const auto& origin : origins)
+	{
+		for (int width = 1; width <= 9; width++)
+		{
+			int height = 3;
+			grid.assign((size_t)width * height, 0);
+			random.FillGrid(grid.data(), origin[0], origin[1], width, height, 7);
+			for (int j = 0; j < height; j++)
+			{
+				for (int i = 0; i < width; i++)
+				{
+					//the same wrap the vector path does, without signed overflow
+					int x = (int)((uint32_t)origin[0] + (uint32_t)i);
+					int z = (int)((uint32_t)origin[1] + (uint32_t)j);
+					failures += grid[(size_t)j * width + i] == random.Get(x, z, 7) ? 0 : 1;
+				}
+			}
+		}
+	}
+
+	//Fill against Block, value n being word n % 4 of counter n / 4. the starts put the low counter word
+	//just below 2^32 at every offset within a counter, so each carry lane of the vector path gets used.
+	const uint64_t wrap = (uint64_t)1 << 32;
+	std::vector<uint32_t> stream;
+	for (uint64_t offset = 0; offset < 24; offset++)
+	{
+		uint64_t first = wrap * 4 * 5 - 40 + offset;	//counter index 5 * 2^32 - 10, the high word goes 4 to 5
+		size_t count = 64 + (size_t)offset;
+		stream.assign(count, 0);
+		random.Fill(stream.data(), count, first, 3);
+		for (size_t n = 0; n < count; n++)
+		{
+			uint64_t index = (first + n) >> 2;
+			uint32_t counter[4] = { (uint32_t)index, (uint32_t)(index >> 32), 3, STREAM_TAG };
+			uint32_t block[4];
+			Block(counter, random.m_key0, random.m_key1, block);
+			failures += stream[n] == block[(first + n) & 3] ? 0 : 1;
+		}
+	}
+
+	return failures;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+
+//Philox 4x32-10 counter based random numbers (Salmon et al, "Parallel random numbers: as easy as 1, 2, 3").
+//There is no state to step: the output is a keyed bijection of a 128 bit counter, so the value for any
+//(x, z, stream) or any position in a stream can be worked out on its own, by any thread, in any order,
+//and always comes out the same. The seed is the key.
+//
+//Get / GetFloat are the per sample versions. FillGrid gives exactly the same numbers for a block of grid
+//coordinates and Fill / FillFloats produce a flat stream; those three run four counters at a time with SSE2.
+
+class Philox
+{
+public:
+	explicit Philox(uint64_t seed = 0);
+
+	void SetSeed(uint64_t seed);
+
+	//the full 4 x 32 bit block for one counter
+	static void Block(const uint32_t counter[4], uint32_t key0, uint32_t key1, uint32_t out[4]);
+
+	//one value per grid coordinate. stream picks an independent set of values for the same coordinates.
+	uint32_t Get(int x, int z, uint32_t stream = 0) const;
+	//[0, 1)
+	float GetFloat(int x, int z, uint32_t stream = 0) const;
+
+	//Get(x0 + i, z0 + j, stream) into out[j * width + i]
+	void FillGrid(uint32_t* out, int x0, int z0, int width, int height, uint32_t stream = 0) const;
+
+	//count values of the flat stream starting at first, every counter gives four of them
+	void Fill(uint32_t* out, size_t count, uint64_t first = 0, uint32_t stream = 0) const;
+	void FillFloats(float* out, size_t count, uint64_t first = 0, uint32_t stream = 0) const;
+
+	//top 24 bits to a float in [0, 1)
+	static float ToFloat(uint32_t value) { return (float)(value >> 8) * (1.0f / 16777216.0f); }
+
+	//Block against the published Philox4x32-10 answers, FillGrid against Get and Fill against Block one value
+	//at a time, including runs where the low counter word wraps past 2^32. returns the number of mismatches.
+	static size_t TestAgainstReference();
+
+private:
+	uint32_t m_key0, m_key1;
+};
@@ -0,0 +1,189 @@
+#include "pch.h"
+#include "RtinMesher.h"
+
+namespace
+{
+	const uint32_t NO_VERTEX = 0xFFFFFFFF;
+}
+
+
+RtinMesher::RtinMesher()
+{
+	m_gridSize = 0;
+}
+
+RtinMesher::~RtinMesher()
+{
+}
+
+int RtinMesher::GetGridSize(int width, int height)
+{
+	int size = std::max(width, height) - 1;
+	int tiles = 1;
+	while (tiles < size)
+	{
+		tiles <<= 1;
+	}
+	return tiles + 1;
+}
+
+void RtinMesher::BuildCoordinates(int gridSize)
+{
+	int tileSize = gridSize - 1;
+	int triangleCount = tileSize * tileSize * 2 - 2;
+
+	//the tree is numbered like a heap: ids 2 and 3 are the two halves of the square and id n splits into 2n and 2n + 1.
+	//walking the bits of the id from the top gives the path down to the triangle.
+	m_coordinates.resize(triangleCount * 4);
+	for (int i = 0; i < triangleCount; i++)
+	{
+		int id = i + 2;
+		int ax = 0, ay = 0, bx = 0, by = 0, cx = 0, cy = 0;
+		if (id & 1)
+		{
+			bx = by = cx = tileSize;	//bottom left half
+		}
+		else
+		{
+			ax = ay = cy = tileSize;	//top right half
+		}
+
+		while ((id >>= 1) > 1)
+		{
+			int mx = (ax + bx) >> 1;
+			int my = (ay + by) >> 1;
+			if (id & 1)
+			{
+				//left child
+				bx = ax; by = ay;
+				ax = cx; ay = cy;
+			}
+			else
+			{
+				//right child
+				ax = bx; ay = by;
+				bx = cx; by = cy;
+			}
+			cx = mx;
+			cy = my;
+		}
+
+		m_coordinates[i * 4] = (uint16_t)ax;
+		m_coordinates[i * 4 + 1] = (uint16_t)ay;
+		m_coordinates[i * 4 + 2] = (uint16_t)bx;
+		m_coordinates[i * 4 + 3] = (uint16_t)by;
+	}
+}
+
+bool RtinMesher::Build(const float* heights, int gridSize)
+{
+	int tileSize = gridSize - 1;
+	if (tileSize < 1 || (tileSize & (tileSize - 1)) != 0 || gridSize > 65536)
+	{
+		return false;	//needs 2^k + 1
+	}
+
+	//the tree only depends on the size so it can be kept between builds
+	if (gridSize != m_gridSize)
+	{
+		BuildCoordinates(gridSize);
+		m_gridSize = gridSize;
+		m_vertexMap.assign(gridSize * gridSize, NO_VERTEX);
+	}
+	m_errors.assign(gridSize * gridSize, 0.0f);
+
+	int triangleCount = tileSize * tileSize * 2 - 2;
+	int parentCount = triangleCount - tileSize * tileSize;
+
+	//children always have bigger ids than their parents so going backwards visits the leaves first
+	for (int i = triangleCount - 1; i >= 0; i--)
+	{
+		int ax = m_coordinates[i * 4];
+		int ay = m_coordinates[i * 4 + 1];
+		int bx = m_coordinates[i * 4 + 2];
+		int by = m_coordinates[i * 4 + 3];
+		int mx = (ax + bx) >> 1;
+		int my = (ay + by) >> 1;
+		int cx = mx + my - ay;
+		int cy = my + ax - mx;
+
+		//how far the real height at the midpoint is from the hypotenuse
+		float interpolated = (heights[ay * gridSize + ax] + heights[by * gridSize + bx]) * 0.5f;
+		int middle = my * gridSize + mx;
+		float error = fabsf(interpolated - heights[middle]);
+		m_errors[middle] = std::max(m_errors[middle], error);
+
+		if (i < parentCount)
+		{
+			//pull up the error of both children so a split here is forced whenever one below is
+			int left = ((ay + cy) >> 1) * gridSize + ((ax + cx) >> 1);
+			int right = ((by + cy) >> 1) * gridSize + ((bx + cx) >> 1);
+			m_errors[middle] = std::max(m_errors[middle], std::max(m_errors[left], m_errors[right]));
+		}
+	}
+
+	return true;
+}
+
+uint32_t RtinMesher::AddVertex(int x, int y, std::vector<uint32_t>& vertices)
+{
+	uint32_t gridIndex = y * m_gridSize + x;
+	if (m_vertexMap[gridIndex] == NO_VERTEX)
+	{
+		m_vertexMap[gridIndex] = (uint32_t)vertices.size();
+		vertices.push_back(gridIndex);
+	}
+	return m_vertexMap[gridIndex];
+}
+
+void RtinMesher::Emit(int ax, int ay, int bx, int by, int cx, int cy, float maxError, std::vector<uint32_t>& vertices, std::vector<uint32_t>& indices)
+{
+	int mx = (ax + bx) >> 1;
+	int my = (ay + by) >> 1;
+
+	//keep splitting until the triangle is a single grid cell or the midpoint error is acceptable
+	if (abs(ax - cx) + abs(ay - cy) > 1 && m_errors[my * m_gridSize + mx] > maxError)
+	{
+		Emit(cx, cy, ax, ay, mx, my, maxError, vertices, indices);
+		Emit(bx, by, cx, cy, mx, my, maxError, vertices, indices);
+		return;
+	}
+
+	uint32_t a = AddVertex(ax, ay, vertices);
+	uint32_t b = AddVertex(bx, by, vertices);
+	uint32_t c = AddVertex(cx, cy, vertices);
+
+	//the tree alternates handedness as it goes down, so fix the winding to match the terrain grid
+	int cross = (by - ay) * (cx - ax) - (bx - ax) * (cy - ay);
+	indices.push_back(a);
+	if (cross > 0)
+	{
+		indices.push_back(b);
+		indices.push_back(c);
+	}
+	else
+	{
+		indices.push_back(c);
+		indices.push_back(b);
+	}
+}
+
+void RtinMesher::Mesh(float maxError, std::vector<uint32_t>& vertices, std::vector<uint32_t>& indices)
+{
+	vertices.clear();
+	indices.clear();
+	if (m_gridSize == 0)
+	{
+		return;
+	}
+
+	int tileSize = m_gridSize - 1;
+	Emit(0, 0, tileSize, tileSize, tileSize, 0, maxError, vertices, indices);
+	Emit(tileSize, tileSize, 0, 0, 0, tileSize, maxError, vertices, indices);
+
+	//only reset the entries that were used so a coarse remesh of a big grid stays cheap
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		m_vertexMap[vertices[i]] = NO_VERTEX;
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+//Right triangulated irregular network (longest edge bisection) mesher for square heightfields.
+//The grid has to be 2^k + 1 on a side. Build() walks every triangle of the full bisection tree once, leaves
+//first, and stores at each edge midpoint the largest error of the whole subtree under it. Because a parent
+//always carries its children's error the refinement is forced to split neighbours together, so the mesh
+//that comes out has no T junctions. After that Mesh() is just a walk down the tree that stops wherever the
+//error is small enough, so changing the threshold never touches the heights again.
+
+class RtinMesher
+{
+public:
+	RtinMesher();
+	~RtinMesher();
+
+	//smallest 2^k + 1 grid that covers width x height
+	static int GetGridSize(int width, int height);
+
+	//heights is gridSize * gridSize, row major
+	bool Build(const float* heights, int gridSize);
+
+	//vertices gets the grid index (row * gridSize + column) of every vertex used, indices the triangles into
+	//that list. triangles are wound the same way as the terrain grid (x along columns, z along rows).
+	void Mesh(float maxError, std::vector<uint32_t>& vertices, std::vector<uint32_t>& indices);
+
+	int GetGridSize() const { return m_gridSize; }
+	const float* GetErrors() const { return m_errors.data(); }
+
+private:
+	void BuildCoordinates(int gridSize);
+	void Emit(int ax, int ay, int bx, int by, int cx, int cy, float maxError, std::vector<uint32_t>& vertices, std::vector<uint32_t>& indices);
+	uint32_t AddVertex(int x, int y, std::vector<uint32_t>& vertices);
+
+private:
+	int m_gridSize;
+	std::vector<uint16_t> m_coordinates;	//ax, ay, bx, by of the hypotenuse for every triangle in the tree
+	std::vector<float> m_errors;			//per grid vertex
+	std::vector<uint32_t> m_vertexMap;		//grid index to output vertex, only valid during Mesh()
+};
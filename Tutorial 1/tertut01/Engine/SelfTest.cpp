@@ -0,0 +1,94 @@
+#include "pch.h"
+#include "SelfTest.h"
+#include "Hydrology.h"
+#include "MarchingCubes.h"
+#include "VolumeLod.h"
+#include "DensityPyramid.h"
+#include "SurfaceNets.h"
+#include "EditableVolume.h"
+#include "SparseVolume.h"
+#include "ShallowWater.h"
+#include "InstanceCuller.h"
+#include "HeightCodec.h"
+#include "CompactVertex.h"
+#include "Philox.h"
+
+namespace
+{
+	void Print(const char* line)
+	{
+		OutputDebugStringA(line);
+		fputs(line, stdout);
+		fflush(stdout);
+	}
+
+	bool Report(const char* name, size_t failures)
+	{
+		char buff[256];
+		sprintf_s(buff, sizeof(buff), "%s: %s (%zu failures)\n", name, failures == 0 ? "passed" : "FAILED", failures);
+		Print(buff);
+		return failures == 0;
+	}
+}
+
+bool SelfTest::Run(int threadCount)
+{
+	bool passed = true;
+	passed &= Report("hydrology fill and accumulation against reference", Hydrology::TestAgainstReference(40, threadCount));
+	passed &= Report("marching cubes against reference and golden mesh", MarchingCubes::TestAgainstReference(200));
+	passed &= Report("volume lod open edges across chunks and levels", VolumeLod::TestWatertight(20, threadCount));
+	passed &= Report("density pyramid updates against a rebuild", DensityPyramid::TestUpdate(40, threadCount));
+	passed &= Report("surface nets and dual contouring watertight", SurfaceNets::TestWatertight(20, threadCount));
+	passed &= Report("surface nets and dual contouring across thread counts", SurfaceNets::TestThreadCounts(10));
+	passed &= Report("editable volume chunks after brushes against marching cubes", EditableVolume::TestAgainstMarchingCubes(8, threadCount));
+	passed &= Report("sparse volume meshes against the dense volume", SparseVolume::TestAgainstDense(threadCount));
+	passed &= Report("philox known answers, grid and stream fills", Philox::TestAgainstReference());
+	passed &= Report("compact vertex round trip at the range ends and grazing normals", CompactVertex::TestRoundTrip());
+	passed &= Report("height codec round trip and damaged streams", HeightCodec::TestRoundTrip(threadCount));
+	return passed;
+}
+
+void SelfTest::Benchmark(int threadCount)
+{
+	char buff[256];
+
+	double cells = ShallowWater::Benchmark(256, 256, 200, threadCount);
+	sprintf_s(buff, sizeof(buff), "shallow water 256x256, 200 steps: %.1f M cells/s\n", cells / 1.0e6);
+	Print(buff);
+
+	InstanceCuller::Stats cull;
+	double seconds = InstanceCuller::Benchmark(1000000, 20, threadCount, &cull);
+	sprintf_s(buff, sizeof(buff), "instance culler 1M instances: %.3f ms per cull, %zu visible, %zu tested, %d cells copied whole\n",
+		seconds * 1000.0, cull.instancesVisible, cull.instancesTested, cull.cellsCopied);
+	Print(buff);
+
+	HeightCodec::BenchmarkResult codec = HeightCodec::Benchmark(1024, 64, 4, threadCount);
+	sprintf_s(buff, sizeof(buff), "height codec 1024x1024 in 64x64 tiles: %.2f:1, encode %.2f GB/s, decode %.2f GB/s\n",
+		codec.ratio, codec.encodeGBs, codec.decodeGBs);
+	Print(buff);
+
+	const char* netModes[] = { "surface nets", "dual contouring" };
+	for (int mode = 0; mode < 2; mode++)
+	{
+		SurfaceNets::Stats nets;
+		seconds = SurfaceNets::Benchmark(128, 8, (SurfaceNets::Mode)mode, threadCount, &nets);
+		sprintf_s(buff, sizeof(buff), "%s 128^3: %.2f ms, %zu vertices, %zu triangles\n", netModes[mode], seconds * 1000.0, nets.vertices, nets.triangles);
+		Print(buff);
+	}
+
+	double worst = 0.0;
+	double average = EditableVolume::Benchmark(128, 40, threadCount, &worst);
+	sprintf_s(buff, sizeof(buff), "editable volume 128^3, 40 brush strokes: %.2f ms average, %.2f ms worst\n", average, worst);
+	Print(buff);
+
+	const char* precisions[] = { "32", "16", "8" };
+	for (int precision = 0; precision < 3; precision++)
+	{
+		SparseVolume::Stats sparse;
+		float error = 0.0f;
+		double nanoseconds = SparseVolume::Benchmark(128, (SparseVolume::Precision)precision, 1000000, threadCount, &sparse, &error);
+		sprintf_s(buff, sizeof(buff), "sparse volume 128^3 at %s bits: %.1f ns per sample, %.1f KB against %.1f KB dense, error %g\n",
+			precisions[precision], nanoseconds, sparse.bytes / 1024.0, sparse.denseBytes / 1024.0, error);
+		Print(buff);
+	}
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+//Checks the terrain and volume code against slow, obviously right versions of itself, no window or device needed.
+//Starting the game with -selftest runs them all instead of the game: each one writes a line to the debugger
+//output (and stdout, when it is redirected somewhere) and the exit code is 0 only if they all passed.
+//-benchmark runs the headless timings the same way, one line per benchmark.
+
+class SelfTest
+{
+public:
+	static bool Run(int threadCount = 0);
+	static void Benchmark(int threadCount = 0);
+};
@@ -12,11 +12,75 @@ Shader::~Shader()
 }
 
 bool Shader::InitStandard(ID3D11Device * device, WCHAR * vsFilename, WCHAR * psFilename)
+{
+	// Create the vertex input layout description.
+	// This setup needs to match the VertexType stucture in the MeshClass and in the shader.
+	D3D11_INPUT_ELEMENT_DESC polygonLayout[] = {
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
+		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+	};
+
+	// Get a count of the elements in the layout.
+	unsigned int numElements;
+	numElements = sizeof(polygonLayout) / sizeof(polygonLayout[0]);
+
+	return InitShaderPair(device, vsFilename, psFilename, polygonLayout, numElements);
+}
+
+bool Shader::InitCompactTerrain(ID3D11Device * device, WCHAR * vsFilename, WCHAR * psFilename)
+{
+	D3D11_BUFFER_DESC	compactBufferDesc;
+
+	// Matches CompactVertexType, x / z / uv come from SV_VertexID in the shader.
+	D3D11_INPUT_ELEMENT_DESC polygonLayout[] = {
+		{ "HEIGHT", 0, DXGI_FORMAT_R16_UNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 4, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+	};
+
+	unsigned int numElements;
+	numElements = sizeof(polygonLayout) / sizeof(polygonLayout[0]);
+
+	if (!InitShaderPair(device, vsFilename, psFilename, polygonLayout, numElements))
+	{
+		return false;
+	}
+
+	compactBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	compactBufferDesc.ByteWidth = sizeof(CompactTerrainParams);
+	compactBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	compactBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	compactBufferDesc.MiscFlags = 0;
+	compactBufferDesc.StructureByteStride = 0;
+
+	HRESULT result = device->CreateBuffer(&compactBufferDesc, NULL, &m_compactTerrainBuffer);
+	return result == S_OK;
+}
+
+bool Shader::InitInstanced(ID3D11Device * device, WCHAR * vsFilename, WCHAR * psFilename)
+{
+	// The model's vertices in slot 0 as usual, then one ObjectScatter::Instance per instance from slot 1.
+	D3D11_INPUT_ELEMENT_DESC polygonLayout[] = {
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
+		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "INSTANCEPOSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "INSTANCEPARAMS", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 12, D3D11_INPUT_PER_INSTANCE_DATA, 1 }
+	};
+
+	unsigned int numElements;
+	numElements = sizeof(polygonLayout) / sizeof(polygonLayout[0]);
+
+	return InitShaderPair(device, vsFilename, psFilename, polygonLayout, numElements);
+}
+
+bool Shader::InitShaderPair(ID3D11Device * device, WCHAR * vsFilename, WCHAR * psFilename, const D3D11_INPUT_ELEMENT_DESC * polygonLayout, unsigned int numElements)
 {
 	D3D11_BUFFER_DESC	matrixBufferDesc;
 	D3D11_SAMPLER_DESC	samplerDesc;
 	D3D11_BUFFER_DESC	lightBufferDesc;
 	D3D11_BUFFER_DESC screenSizeBufferDesc;
+	D3D11_BUFFER_DESC sunBufferDesc;
 
 
 	//LOAD SHADER:	VERTEX
@@ -28,18 +92,6 @@ bool Shader::InitStandard(ID3D11Device * device, WCHAR * vsFilename, WCHAR * psF
 		return false;
 	}
 
-	// Create the vertex input layout description.
-	// This setup needs to match the VertexType stucture in the MeshClass and in the shader.
-	D3D11_INPUT_ELEMENT_DESC polygonLayout[] = {
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0},
-		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 }
-	};
-
-	// Get a count of the elements in the layout.
-	unsigned int numElements;
-	numElements = sizeof(polygonLayout) / sizeof(polygonLayout[0]);
-
 	// Create the vertex input layout.
 	device->CreateInputLayout(polygonLayout, numElements, vertexShaderBuffer.data(), vertexShaderBuffer.size(), &m_layout);
 	
@@ -87,6 +139,15 @@ bool Shader::InitStandard(ID3D11Device * device, WCHAR * vsFilename, WCHAR * psF
 
 	device->CreateBuffer(&screenSizeBufferDesc, NULL, &m_screenSizeBuffer);
 
+	sunBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	sunBufferDesc.ByteWidth = sizeof(SunBufferType);
+	sunBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	sunBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	sunBufferDesc.MiscFlags = 0;
+	sunBufferDesc.StructureByteStride = 0;
+
+	device->CreateBuffer(&sunBufferDesc, NULL, &m_sunBuffer);
+
 
 	// Create the constant buffer pointer so we can access the vertex shader constant buffer from within this class.
 
@@ -197,6 +258,47 @@ bool Shader::SetShaderParametersBlur(ID3D11DeviceContext* context, DirectX::Simp
 	return false;
 }
 
+bool Shader::SetCompactTerrainParameters(ID3D11DeviceContext * context, const CompactTerrainParams & params)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+
+	if (!m_compactTerrainBuffer)
+	{
+		return false;
+	}
+
+	context->Map(m_compactTerrainBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	memcpy(mappedResource.pData, &params, sizeof(CompactTerrainParams));
+	context->Unmap(m_compactTerrainBuffer, 0);
+	//slot 1 is taken by the screen size buffer
+	context->VSSetConstantBuffers(2, 1, &m_compactTerrainBuffer);
+
+	return true;
+}
+
+void Shader::SetSplatTextures(ID3D11DeviceContext * context, ID3D11ShaderResourceView* splat, ID3D11ShaderResourceView* const* materials)
+{
+	//slot 0 is set by SetShaderParameters, see terrain_splat_ps for the rest
+	context->PSSetShaderResources(1, 3, materials);
+	context->PSSetShaderResources(4, 1, &splat);
+}
+
+void Shader::SetTerrainLighting(ID3D11DeviceContext * context, ID3D11ShaderResourceView* lighting, const DirectX::SimpleMath::Vector3 & towardsSun)
+{
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	SunBufferType* sunPtr;
+
+	context->PSSetShaderResources(5, 1, &lighting);
+
+	//the shaders light with the same direction the texture was baked for, so the shadows line up with N.L
+	context->Map(m_sunBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	sunPtr = (SunBufferType*)mappedResource.pData;
+	sunPtr->towardsSun = towardsSun;
+	sunPtr->padding = 0.0f;
+	context->Unmap(m_sunBuffer, 0);
+	context->PSSetConstantBuffers(1, 1, &m_sunBuffer);
+}
+
 void Shader::EnableShader(ID3D11DeviceContext * context)
 {
 	context->IASetInputLayout(m_layout);							//set the input layout for the shader to match out geometry
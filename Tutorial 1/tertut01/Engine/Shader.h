@@ -2,6 +2,7 @@
 
 #include "DeviceResources.h"
 #include "Light.h"
+#include "CompactVertex.h"
 
 //Class from which we create all shader objects used by the framework
 //This single class can be expanded to accomodate shaders of all different types with different parameters
@@ -14,11 +15,18 @@ public:
 	//we could extend this to load in only a vertex shader, only a pixel shader etc.  or specialised init for Geometry or domain shader. 
 	//All the methods here simply create new versions corresponding to your needs
 	bool InitStandard(ID3D11Device * device, WCHAR * vsFilename, WCHAR * psFilename);		//Loads the Vert / pixel Shader pair
+	bool InitCompactTerrain(ID3D11Device * device, WCHAR * vsFilename, WCHAR * psFilename);	//same, but for the 8 byte CompactVertexType grid
+	bool InitInstanced(ID3D11Device * device, WCHAR * vsFilename, WCHAR * psFilename);		//standard vertices plus an ObjectScatter::Instance stream in slot 1
 	bool SetShaderParameters(ID3D11DeviceContext * context, DirectX::SimpleMath::Matrix  *world, DirectX::SimpleMath::Matrix  *view, DirectX::SimpleMath::Matrix  *projection, Light *sceneLight1, ID3D11ShaderResourceView* texture1, float fogdensity=1.0f);
 	void EnableShader(ID3D11DeviceContext * context);
+	bool SetCompactTerrainParameters(ID3D11DeviceContext * context, const CompactTerrainParams & params);
+	void SetSplatTextures(ID3D11DeviceContext * context, ID3D11ShaderResourceView* splat, ID3D11ShaderResourceView* const* materials);	//materials 1-3, material 0 is the usual texture
+	void SetTerrainLighting(ID3D11DeviceContext * context, ID3D11ShaderResourceView* lighting, const DirectX::SimpleMath::Vector3 & towardsSun);	//baked occlusion and sun, see HorizonMap. towardsSun is what it was baked for
 	bool SetShaderParametersBlur(ID3D11DeviceContext* context, DirectX::SimpleMath::Matrix* world, DirectX::SimpleMath::Matrix* view, DirectX::SimpleMath::Matrix* projection, Light* sceneLight1, ID3D11ShaderResourceView* texture1, float screenWidth);
 
 private:
+	bool InitShaderPair(ID3D11Device * device, WCHAR * vsFilename, WCHAR * psFilename, const D3D11_INPUT_ELEMENT_DESC * polygonLayout, unsigned int numElements);
+
 	//standard matrix buffer supplied to all shaders
 	struct MatrixBufferType
 	{
@@ -42,6 +50,13 @@ private:
 		DirectX::SimpleMath::Vector3 padding;
 	};
 
+	//directional sun for the lit terrain shaders
+	struct SunBufferType
+	{
+		DirectX::SimpleMath::Vector3 towardsSun;
+		float padding;
+	};
+
 	//buffer to pass in camera world Position
 	struct CameraBufferType
 	{
@@ -65,5 +80,7 @@ private:
 	ID3D11SamplerState*														m_sampleState;
 	ID3D11Buffer*															m_lightBuffer;
 	ID3D11Buffer*															m_screenSizeBuffer = 0;
+	ID3D11Buffer*															m_compactTerrainBuffer = 0;
+	ID3D11Buffer*															m_sunBuffer = 0;
 };
 
@@ -0,0 +1,348 @@
+#include "pch.h"
+#include "ShallowWater.h"
+#include "ParallelFor.h"
+#include <emmintrin.h>
+#include <chrono>
+
+
+ShallowWater::ShallowWater()
+{
+	m_width = 0;
+	m_height = 0;
+	gravity = 9.81f;
+	damping = 0.998f;
+	cellSize = 1.0f;
+}
+
+ShallowWater::~ShallowWater()
+{
+}
+
+bool ShallowWater::Initialize(int width, int height, unsigned int seed)
+{
+	if (width < 2 || height < 2)
+	{
+		return false;
+	}
+
+	m_width = width;
+	m_height = height;
+	m_terrain.assign(width * height, 0.0f);
+	m_depth.assign(width * height, 0.0f);
+	m_flowX.assign((width + 1) * height, 0.0f);
+	m_flowZ.assign(width * (height + 1), 0.0f);
+	m_limit.assign(width * height, 1.0f);
+	m_random.seed(seed);
+	return true;
+}
+
+void ShallowWater::SetTerrain(const float* heights)
+{
+	m_terrain.assign(heights, heights + m_width * m_height);
+}
+
+void ShallowWater::Clear()
+{
+	std::fill(m_depth.begin(), m_depth.end(), 0.0f);
+	std::fill(m_flowX.begin(), m_flowX.end(), 0.0f);
+	std::fill(m_flowZ.begin(), m_flowZ.end(), 0.0f);
+}
+
+void ShallowWater::AddWater(float x, float z, float radius, float depth)
+{
+	int x0 = std::max(0, (int)floorf(x - radius));
+	int x1 = std::min(m_width - 1, (int)ceilf(x + radius));
+	int z0 = std::max(0, (int)floorf(z - radius));
+	int z1 = std::min(m_height - 1, (int)ceilf(z + radius));
+
+	//smooth bump so the drop doesn't start with a vertical wall of water
+	for (int j = z0; j <= z1; j++)
+	{
+		for (int i = x0; i <= x1; i++)
+		{
+			float dx = (float)i - x;
+			float dz = (float)j - z;
+			float t = 1.0f - (dx * dx + dz * dz) / (radius * radius);
+			if (t > 0.0f)
+			{
+				m_depth[j * m_width + i] += depth * t * t;
+			}
+		}
+	}
+}
+
+void ShallowWater::Rain(int count, float radius, float depth)
+{
+	std::uniform_real_distribution<float> across(0.0f, (float)(m_width - 1));
+	std::uniform_real_distribution<float> down(0.0f, (float)(m_height - 1));
+	for (int i = 0; i < count; i++)
+	{
+		float x = across(m_random);
+		float z = down(m_random);
+		AddWater(x, z, radius, depth);
+	}
+}
+
+double ShallowWater::GetTotalVolume() const
+{
+	double total = 0.0;
+	for (size_t i = 0; i < m_depth.size(); i++)
+	{
+		total += m_depth[i];
+	}
+	return total * cellSize * cellSize;
+}
+
+void ShallowWater::UpdateFlowRows(int first, int last, float dt)
+{
+	int width = m_width;
+	int stride = width + 1;
+	float scale = dt * gravity * cellSize;
+	__m128 scale4 = _mm_set1_ps(scale);
+	__m128 damping4 = _mm_set1_ps(damping);
+
+	for (int j = first; j < last; j++)
+	{
+		const float* terrain = &m_terrain[j * width];
+		const float* depth = &m_depth[j * width];
+		float* flow = &m_flowX[j * stride];
+
+		//x faces 1 .. width - 1, the outer two are walls and stay at zero.
+		//flow += dt g h (surface on the left - surface on the right)
+		int i = 1;
+		for (; i + 4 <= width; i += 4)
+		{
+			__m128 left = _mm_add_ps(_mm_loadu_ps(terrain + i - 1), _mm_loadu_ps(depth + i - 1));
+			__m128 right = _mm_add_ps(_mm_loadu_ps(terrain + i), _mm_loadu_ps(depth + i));
+			__m128 f = _mm_mul_ps(_mm_loadu_ps(flow + i), damping4);
+			f = _mm_add_ps(f, _mm_mul_ps(scale4, _mm_sub_ps(left, right)));
+			_mm_storeu_ps(flow + i, f);
+		}
+		for (; i < width; i++)
+		{
+			float left = terrain[i - 1] + depth[i - 1];
+			float right = terrain[i] + depth[i];
+			flow[i] = flow[i] * damping + scale * (left - right);
+		}
+
+		//z face j sits between rows j - 1 and j. it belongs to whichever band owns row j.
+		if (j == 0)
+		{
+			continue;
+		}
+		const float* terrainUp = &m_terrain[(j - 1) * width];
+		const float* depthUp = &m_depth[(j - 1) * width];
+		float* flowZ = &m_flowZ[j * width];
+
+		i = 0;
+		for (; i + 4 <= width; i += 4)
+		{
+			__m128 up = _mm_add_ps(_mm_loadu_ps(terrainUp + i), _mm_loadu_ps(depthUp + i));
+			__m128 down = _mm_add_ps(_mm_loadu_ps(terrain + i), _mm_loadu_ps(depth + i));
+			__m128 f = _mm_mul_ps(_mm_loadu_ps(flowZ + i), damping4);
+			f = _mm_add_ps(f, _mm_mul_ps(scale4, _mm_sub_ps(up, down)));
+			_mm_storeu_ps(flowZ + i, f);
+		}
+		for (; i < width; i++)
+		{
+			float up = terrainUp[i] + depthUp[i];
+			float down = terrain[i] + depth[i];
+			flowZ[i] = flowZ[i] * damping + scale * (up - down);
+		}
+	}
+}
+
+void ShallowWater::ComputeLimitRows(int first, int last, float dt)
+{
+	int width = m_width;
+	int stride = width + 1;
+	float area = cellSize * cellSize;
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 dt4 = _mm_set1_ps(dt);
+	__m128 area4 = _mm_set1_ps(area);
+	__m128 tiny = _mm_set1_ps(1e-20f);
+
+	//a cell can't send out more water than it holds, so work out how much its outflows have to be scaled by
+	for (int j = first; j < last; j++)
+	{
+		const float* depth = &m_depth[j * width];
+		const float* flowX = &m_flowX[j * stride];
+		const float* flowUp = &m_flowZ[j * width];
+		const float* flowDown = &m_flowZ[(j + 1) * width];
+		float* limit = &m_limit[j * width];
+
+		int i = 0;
+		for (; i + 4 <= width; i += 4)
+		{
+			//positive flow on the right / lower face leaves the cell, negative flow on the left / upper face does
+			__m128 out = _mm_max_ps(_mm_loadu_ps(flowX + i + 1), zero);
+			out = _mm_add_ps(out, _mm_max_ps(_mm_sub_ps(zero, _mm_loadu_ps(flowX + i)), zero));
+			out = _mm_add_ps(out, _mm_max_ps(_mm_loadu_ps(flowDown + i), zero));
+			out = _mm_add_ps(out, _mm_max_ps(_mm_sub_ps(zero, _mm_loadu_ps(flowUp + i)), zero));
+
+			__m128 volume = _mm_mul_ps(_mm_loadu_ps(depth + i), area4);
+			__m128 wanted = _mm_max_ps(_mm_mul_ps(out, dt4), tiny);
+			_mm_storeu_ps(limit + i, _mm_min_ps(one, _mm_div_ps(volume, wanted)));
+		}
+		for (; i < width; i++)
+		{
+			float out = std::max(flowX[i + 1], 0.0f) + std::max(-flowX[i], 0.0f) + std::max(flowDown[i], 0.0f) + std::max(-flowUp[i], 0.0f);
+			float volume = depth[i] * area;
+			limit[i] = std::min(1.0f, volume / std::max(out * dt, 1e-20f));
+		}
+	}
+}
+
+void ShallowWater::ApplyLimitRows(int first, int last)
+{
+	int width = m_width;
+	int stride = width + 1;
+	__m128 zero = _mm_setzero_ps();
+
+	for (int j = first; j < last; j++)
+	{
+		const float* limit = &m_limit[j * width];
+		float* flow = &m_flowX[j * stride];
+
+		//each face is scaled by the limit of the cell the water is coming out of
+		int i = 1;
+		for (; i + 4 <= width; i += 4)
+		{
+			__m128 f = _mm_loadu_ps(flow + i);
+			__m128 fromLeft = _mm_cmpgt_ps(f, zero);
+			__m128 k = _mm_or_ps(_mm_and_ps(fromLeft, _mm_loadu_ps(limit + i - 1)), _mm_andnot_ps(fromLeft, _mm_loadu_ps(limit + i)));
+			_mm_storeu_ps(flow + i, _mm_mul_ps(f, k));
+		}
+		for (; i < width; i++)
+		{
+			flow[i] *= flow[i] > 0.0f ? limit[i - 1] : limit[i];
+		}
+
+		if (j == 0)
+		{
+			continue;
+		}
+		const float* limitUp = &m_limit[(j - 1) * width];
+		float* flowZ = &m_flowZ[j * width];
+
+		i = 0;
+		for (; i + 4 <= width; i += 4)
+		{
+			__m128 f = _mm_loadu_ps(flowZ + i);
+			__m128 fromUp = _mm_cmpgt_ps(f, zero);
+			__m128 k = _mm_or_ps(_mm_and_ps(fromUp, _mm_loadu_ps(limitUp + i)), _mm_andnot_ps(fromUp, _mm_loadu_ps(limit + i)));
+			_mm_storeu_ps(flowZ + i, _mm_mul_ps(f, k));
+		}
+		for (; i < width; i++)
+		{
+			flowZ[i] *= flowZ[i] > 0.0f ? limitUp[i] : limit[i];
+		}
+	}
+}
+
+void ShallowWater::UpdateDepthRows(int first, int last, float dt)
+{
+	int width = m_width;
+	int stride = width + 1;
+	float scale = dt / (cellSize * cellSize);
+	__m128 scale4 = _mm_set1_ps(scale);
+	__m128 zero = _mm_setzero_ps();
+
+	for (int j = first; j < last; j++)
+	{
+		float* depth = &m_depth[j * width];
+		const float* flowX = &m_flowX[j * stride];
+		const float* flowUp = &m_flowZ[j * width];
+		const float* flowDown = &m_flowZ[(j + 1) * width];
+
+		//in through the left and top faces, out through the right and bottom
+		int i = 0;
+		for (; i + 4 <= width; i += 4)
+		{
+			__m128 net = _mm_sub_ps(_mm_loadu_ps(flowX + i), _mm_loadu_ps(flowX + i + 1));
+			net = _mm_add_ps(net, _mm_sub_ps(_mm_loadu_ps(flowUp + i), _mm_loadu_ps(flowDown + i)));
+			__m128 d = _mm_add_ps(_mm_loadu_ps(depth + i), _mm_mul_ps(scale4, net));
+			_mm_storeu_ps(depth + i, _mm_max_ps(d, zero));
+		}
+		for (; i < width; i++)
+		{
+			float net = flowX[i] - flowX[i + 1] + flowUp[i] - flowDown[i];
+			depth[i] = std::max(depth[i] + scale * net, 0.0f);
+		}
+	}
+}
+
+void ShallowWater::Step(float dt, int threadCount)
+{
+	if (m_width == 0)
+	{
+		return;
+	}
+
+	//four passes over a small grid finish before the threads would have woken up
+	threadCount = ParallelThreadCount(threadCount, m_width * m_height, 16384);
+
+	//each ParallelForRanges returns only once every band is done, which is the halo exchange:
+	//the next pass can safely read its neighbours' edge rows
+	ParallelForRanges(0, m_height, [&](int first, int last) { UpdateFlowRows(first, last, dt); }, threadCount);
+	ParallelForRanges(0, m_height, [&](int first, int last) { ComputeLimitRows(first, last, dt); }, threadCount);
+	ParallelForRanges(0, m_height, [&](int first, int last) { ApplyLimitRows(first, last); }, threadCount);
+	ParallelForRanges(0, m_height, [&](int first, int last) { UpdateDepthRows(first, last, dt); }, threadCount);
+}
+
+void ShallowWater::Simulate(float dt, int threadCount)
+{
+	if (m_width == 0 || dt <= 0.0f)
+	{
+		return;
+	}
+
+	//waves travel at sqrt(g h), keep each substep well inside one cell
+	float deepest = 0.0f;
+	for (size_t i = 0; i < m_depth.size(); i++)
+	{
+		deepest = std::max(deepest, m_depth[i]);
+	}
+	float speed = sqrtf(gravity * std::max(deepest, 0.01f));
+	float maxStep = 0.25f * cellSize / speed;
+	int steps = std::min(64, std::max(1, (int)ceilf(dt / maxStep)));
+
+	for (int i = 0; i < steps; i++)
+	{
+		Step(dt / (float)steps, threadCount);
+	}
+}
+
+double ShallowWater::Benchmark(int width, int height, int steps, int threadCount)
+{
+	ShallowWater water;
+	if (!water.Initialize(width, height, 1) || steps <= 0)
+	{
+		return 0.0;
+	}
+
+	//a bowl with a ripple in it so water moves about for the whole run
+	std::vector<float> ground(width * height);
+	for (int j = 0; j < height; j++)
+	{
+		for (int i = 0; i < width; i++)
+		{
+			float x = (float)i / (float)width - 0.5f;
+			float z = (float)j / (float)height - 0.5f;
+			ground[j * width + i] = (x * x + z * z) * 20.0f + sinf(x * 30.0f) * 0.3f;
+		}
+	}
+	water.SetTerrain(ground.data());
+	water.Rain(64, (float)std::max(2, width / 32), 1.0f);
+
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < steps; i++)
+	{
+		water.Step(0.02f, threadCount);
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	double seconds = std::chrono::duration<double>(end - start).count();
+	return seconds > 0.0 ? (double)width * (double)height * (double)steps / seconds : 0.0;
+}
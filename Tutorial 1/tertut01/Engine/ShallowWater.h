@@ -0,0 +1,64 @@
+#pragma once
+#include <random>
+
+//Height field water on top of a terrain, using the virtual pipe form of the shallow water equations.
+//The grid is staggered: water depth lives at the cell centres and the flow between two cells lives on the face
+//they share (flowX on the vertical faces, flowZ on the horizontal ones). Everything is stored as separate flat
+//arrays so each pass streams through one or two rows at a time and the inner loops run four cells per SSE op.
+//
+//A step is four passes (face flow, outflow limit, apply limit, depth) and every pass only reads what the pass
+//before it wrote. The rows are split into bands, one per thread, and a band reads the edge rows of its
+//neighbours (its halo) only after the previous pass has finished everywhere. Since every value is written by
+//exactly one thread from the same inputs, the result is bit identical whatever the thread count.
+
+class ShallowWater
+{
+public:
+	ShallowWater();
+	~ShallowWater();
+
+	bool Initialize(int width, int height, unsigned int seed = 1);
+
+	//ground heights, width * height row major. can be changed at any time.
+	void SetTerrain(const float* heights);
+
+	void AddWater(float x, float z, float radius, float depth);
+	//drops count blobs of water at positions from the seeded generator
+	void Rain(int count, float radius, float depth);
+	void Clear();
+
+	//advances by dt, split into as many substeps as the wave speed needs to stay stable
+	void Simulate(float dt, int threadCount = 0);
+	void Step(float dt, int threadCount = 0);
+
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+	const float* GetDepth() const { return m_depth.data(); }
+	const float* GetTerrain() const { return m_terrain.data(); }
+	float GetSurface(int x, int z) const { return m_terrain[z * m_width + x] + m_depth[z * m_width + x]; }
+	double GetTotalVolume() const;
+
+	//headless run on a generated bowl, returns cells updated per second
+	static double Benchmark(int width, int height, int steps, int threadCount = 0);
+
+	float gravity;
+	float damping;		//per step multiplier on the face flows, lets ripples die out
+	float cellSize;
+
+private:
+	void UpdateFlowRows(int first, int last, float dt);
+	void ComputeLimitRows(int first, int last, float dt);
+	void ApplyLimitRows(int first, int last);
+	void UpdateDepthRows(int first, int last, float dt);
+
+private:
+	int m_width, m_height;
+
+	std::vector<float> m_terrain;		//width * height
+	std::vector<float> m_depth;			//width * height
+	std::vector<float> m_flowX;			//(width + 1) * height, face i sits between cells i - 1 and i
+	std::vector<float> m_flowZ;			//width * (height + 1), face j sits between rows j - 1 and j
+	std::vector<float> m_limit;			//width * height, outflow scale for each cell
+
+	std::mt19937 m_random;
+};
@@ -1,35 +1,15 @@
 #include "pch.h"
 #include "SimplexNoise.h"
 
-SimplexNoise::SimplexNoise()
-{
-}
-
-SimplexNoise::~SimplexNoise()
-{
-}
-
-double SimplexNoise::nNoise(double xin, double yin, double zin)
+namespace
 {
-	static int perm[512];
-	static int** zero = new int*[1];
-	zero[0] = new int[4] {0, 0, 0, 0};
+	//the tables are only ever read, so any number of threads can be making noise at once
+	const int GRAD3[12][3] = {
+		{ 1, 1, 0 }, { -1, 1, 0 }, { 1, -1, 0 }, { -1, -1, 0 },
+		{ 1, 0, 1 }, { -1, 0, 1 }, { 1, 0, -1 }, { -1, 0, -1 },
+		{ 0, 1, 1 }, { 0, -1, 1 }, { 0, 1, -1 }, { 0, -1, -1 } };
 
-	static int** grad3 = new int* [12];
-	grad3[0] = new int[3] { 1, 1, 0 };
-	grad3[1] = new int[3] {-1, 1, 0};
-	grad3[2] = new int[3] { 1, -1, 0 };
-	grad3[3] = new int[3] {-1, -1, 0};
-	grad3[4] = new int[3] { 1, 0, 1 };
-	grad3[5] = new int[3] { -1, 0, 1 };
-	grad3[6] = new int[3] { 1, 0, -1 };
-	grad3[7] = new int[3] { -1, 0, -1 };
-	grad3[8] = new int[3] { 0, 1, 1 };
-	grad3[9] = new int[3] { 0, -1, 1 };
-	grad3[10] = new int[3] { 0, 1, -1 };
-	grad3[11] = new int[3] { 0, -1, -1 };
-
-	static int p[256] = { 151,160,137,91,90,15,
+	const int PERMUTATION[256] = { 151,160,137,91,90,15,
 	131,13,201,95,96,53,194,233,7,225,140,36,103,30,69,142,8,99,37,240,21,10,23,
 	190, 6,148,247,120,234,75,0,26,197,62,94,252,219,203,117,35,11,32,57,177,33,
 	88,237,149,56,87,174,20,125,136,171,168, 68,175,74,165,71,134,139,48,27,166,
@@ -43,84 +23,24 @@ double SimplexNoise::nNoise(double xin, double yin, double zin)
 	49,192,214, 31,181,199,106,157,184, 84,204,176,115,121,50,45,127, 4,150,254,
 	138,236,205,93,222,114,67,29,24,72,243,141,128,195,78,66,215,61,156,180 };
 
-
-	for (int i = 0; i < 512; i++)
+	//the usual doubled 512 entry table, wrapped instead of stored twice
+	inline int perm(int i)
 	{
-		perm[i] = p[i & 255];
+		return PERMUTATION[i & 255];
 	}
+}
 
-	static int** simplex = new int* [64];
-	simplex[0] = new int[4] {0, 1, 2, 3};
-	simplex[1] = new int[4] {0, 1, 3, 2};
-	simplex[2] = zero[0];
-	simplex[3] = new int[4] {0, 2, 3, 1};
-	simplex[4] = zero[0];
-	simplex[5] = zero[0];
-	simplex[6] = zero[0];
-	simplex[7] = new int[4] {1, 2, 3, 0};
-	simplex[8] = new int[4] {0, 2, 1, 3};
-
-	simplex[9] = zero[0];
-	simplex[10] = new int[4] {0, 3, 1, 2};
-	simplex[11] = new int[4] {0, 3, 2, 1};
-	simplex[12] = zero[0];
-	simplex[13] = zero[0];
-	simplex[14] = zero[0];
-	simplex[15] = zero[0];
-	simplex[16] = new int[4] {1, 3, 2, 0};
-	simplex[17] = zero[0];
-
-	simplex[18] = zero[0];
-	simplex[19] = zero[0];
-	simplex[20] = zero[0];
-	simplex[21] = zero[0];
-	simplex[22] = zero[0];
-	simplex[23] = zero[0];
-	simplex[24] = zero[0];
-	simplex[25] = new int[4] { 1,2,0,3 };
-	simplex[26] = zero[0];
-	simplex[27] = new int[4] { 1, 3, 0, 2 };
-
-	simplex[28] = zero[0];
-	simplex[29] = zero[0];
-	simplex[30] = zero[0];
-	simplex[31] = new int[4] { 2, 3, 0, 1 };
-	simplex[32] = new int[4] { 2, 3, 1, 0 };
-	simplex[33] = new int[4] {1, 0, 2, 3};
-	simplex[34] = new int[4] {1, 0, 3, 2};
-	simplex[35] = zero[0];
-	simplex[36] = zero[0];
-	simplex[37] = zero[0];
-
-	simplex[38] = new int[4] { 2,0,3,1 };
-	simplex[39] = zero[0];
-	simplex[40] = new int[4] { 2, 1, 3, 0 };
-	simplex[41] = zero[0];
-	simplex[42] = zero[0];
-	simplex[43] = zero[0];
-	simplex[44] = zero[0];
-	simplex[45] = zero[0];
-	simplex[46] = zero[0];
-	simplex[47] = zero[0];
 
-	simplex[48] = new int[4] {2, 0, 1, 3};
-	simplex[49] = zero[0];
-	simplex[50] = zero[0];
-	simplex[51] = zero[0];
-	simplex[52] = new int[4] { 3, 0, 1, 2 };
-	simplex[53] = new int[4] { 3, 0, 2, 1 };
-	simplex[54] = zero[0];
-	simplex[55] = new int[4] { 3, 1, 2, 0 };
-	simplex[56] = new int[4] { 2,1,0,3 };
-	simplex[57] = zero[0];
+SimplexNoise::SimplexNoise()
+{
+}
 
-	simplex[58] = zero[0];
-	simplex[59] = zero[0];
-	simplex[60] = new int[4] { 3, 1, 0, 2 };
-	simplex[61] = zero[0];
-	simplex[62] = new int[4] { 3, 2, 0, 1 };
-	simplex[63] = new int[4] { 3, 2, 1, 0 };
+SimplexNoise::~SimplexNoise()
+{
+}
 
+double SimplexNoise::nNoise(double xin, double yin, double zin)
+{
 	double n0, n1, n2, n3; // Noise contributions from the four corners
 	// Skew the input space to determine which simplex cell we're in
 	double F3 = 1.0 / 3.0;
@@ -170,41 +90,41 @@ double SimplexNoise::nNoise(double xin, double yin, double zin)
 	int ii = i & 255;
 	int jj = j & 255;
 	int kk = k & 255;
-	int gi0 = perm[ii + perm[jj + perm[kk]]] % 12;
-	int gi1 = perm[ii + i1 + perm[jj + j1 + perm[kk + k1]]] % 12;
-	int gi2 = perm[ii + i2 + perm[jj + j2 + perm[kk + k2]]] % 12;
-	int gi3 = perm[ii + 1 + perm[jj + 1 + perm[kk + 1]]] % 12;
+	int gi0 = perm(ii + perm(jj + perm(kk))) % 12;
+	int gi1 = perm(ii + i1 + perm(jj + j1 + perm(kk + k1))) % 12;
+	int gi2 = perm(ii + i2 + perm(jj + j2 + perm(kk + k2))) % 12;
+	int gi3 = perm(ii + 1 + perm(jj + 1 + perm(kk + 1))) % 12;
 	// Calculate the contribution from the four corners
 	double t0 = 0.6 - x0 * x0 - y0 * y0 - z0 * z0;
 	if (t0 < 0) n0 = 0.0;
 	else {
 		t0 *= t0;
-		n0 = t0 * t0 * dot(grad3[gi0], x0, y0, z0);
+		n0 = t0 * t0 * dot(GRAD3[gi0], x0, y0, z0);
 	}
 	double t1 = 0.6 - x1 * x1 - y1 * y1 - z1 * z1;
 	if (t1 < 0) n1 = 0.0;
 	else {
 		t1 *= t1;
-		n1 = t1 * t1 * dot(grad3[gi1], x1, y1, z1);
+		n1 = t1 * t1 * dot(GRAD3[gi1], x1, y1, z1);
 	}
 	double t2 = 0.6 - x2 * x2 - y2 * y2 - z2 * z2;
 	if (t2 < 0) n2 = 0.0;
 	else {
 		t2 *= t2;
-		n2 = t2 * t2 * dot(grad3[gi2], x2, y2, z2);
+		n2 = t2 * t2 * dot(GRAD3[gi2], x2, y2, z2);
 	}
 	double t3 = 0.6 - x3 * x3 - y3 * y3 - z3 * z3;
 	if (t3 < 0) n3 = 0.0;
 	else {
 		t3 *= t3;
-		n3 = t3 * t3 * dot(grad3[gi3], x3, y3, z3);
+		n3 = t3 * t3 * dot(GRAD3[gi3], x3, y3, z3);
 	}
 	// Add contributions from each corner to get the final noise value.
 	// The result is scaled to stay just inside [-1,1]
 	return 32.0 * (n0 + n1 + n2 + n3);
 }
 
-double SimplexNoise::dot(int g[], double x, double y, double z) {
+double SimplexNoise::dot(const int g[], double x, double y, double z) {
 	return (g[0] * x + g[1] * y + g[2] * z);
 }
 
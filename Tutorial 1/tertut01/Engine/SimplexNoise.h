@@ -3,7 +3,7 @@ class SimplexNoise
 {
 
 private:
-	static double dot(int g[], double x, double y, double z);
+	static double dot(const int g[], double x, double y, double z);
 	static double noise(double x, double y, double z);
 	static int fastfloor(double x);
 
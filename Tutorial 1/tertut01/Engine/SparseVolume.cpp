@@ -0,0 +1,396 @@
+#include "pch.h"
+#include "SparseVolume.h"
+#include "MarchingCubes.h"
+#include "ParallelFor.h"
+#include "Philox.h"
+#include <chrono>
+
+using DirectX::SimpleMath::Vector3;
+
+namespace
+{
+	//the biggest change between neighbouring samples of a size^3 volume
+	float GetLargestStep(const std::vector<float>& density, int size)
+	{
+		float step = 0.0f;
+		for (int z = 0; z < size; z++)
+		{
+			for (int y = 0; y < size; y++)
+			{
+				const float* row = density.data() + ((size_t)z * size + y) * size;
+				for (int x = 0; x < size; x++)
+				{
+					if (x + 1 < size) step = std::max(step, fabsf(row[x + 1] - row[x]));
+					if (y + 1 < size) step = std::max(step, fabsf(row[x + size] - row[x]));
+					if (z + 1 < size) step = std::max(step, fabsf(row[x + (size_t)size * size] - row[x]));
+				}
+			}
+		}
+		return step;
+	}
+}
+
+
+SparseVolume::SparseVolume() : m_sizeX(0), m_sizeY(0), m_sizeZ(0), m_bricksX(0), m_bricksY(0), m_bricksZ(0), m_shift(0), m_mask(0)
+{
+}
+
+void SparseVolume::Clear()
+{
+	m_sizeX = m_sizeY = m_sizeZ = 0;
+	m_bricksX = m_bricksY = m_bricksZ = 0;
+	m_bricks.clear();
+	m_samples32.clear();
+	m_samples16.clear();
+	m_samples8.clear();
+}
+
+bool SparseVolume::Build(const float* density, int sizeX, int sizeY, int sizeZ, const Settings& settings, int threadCount)
+{
+	Clear();
+	int shift = 1;
+	while (shift < 6 && (1 << shift) < settings.brickSize)
+	{
+		shift++;
+	}
+	if (!density || sizeX < 1 || sizeY < 1 || sizeZ < 1 || (1 << shift) != settings.brickSize)
+	{
+		return false;
+	}
+
+	m_settings = settings;
+	m_sizeX = sizeX;
+	m_sizeY = sizeY;
+	m_sizeZ = sizeZ;
+	m_shift = shift;
+	m_mask = (1 << shift) - 1;
+	int b = settings.brickSize;
+	m_bricksX = (sizeX + b - 1) / b;
+	m_bricksY = (sizeY + b - 1) / b;
+	m_bricksZ = (sizeZ + b - 1) / b;
+	m_bricks.resize((size_t)m_bricksX * m_bricksY * m_bricksZ);
+
+	bool clamp = settings.band > 0.0f;
+	float low = settings.isoLevel - settings.band, high = settings.isoLevel + settings.band;
+	size_t brickSamples = (size_t)b * b * b;
+
+	//a brick's samples, clamped to the band. bricks hanging over the edge repeat the last sample, so they can still
+	//come out uniform and the trilinear sampling never needs to know.
+	auto gather = [&](int bx, int by, int bz, float* out)
+	{
+		for (int z = 0; z < b; z++)
+		{
+			int sz = std::min(bz * b + z, sizeZ - 1);
+			for (int y = 0; y < b; y++)
+			{
+				int sy = std::min(by * b + y, sizeY - 1);
+				const float* row = density + ((size_t)sz * sizeY + sy) * sizeX;
+				for (int x = 0; x < b; x++)
+				{
+					float value = row[std::min(bx * b + x, sizeX - 1)];
+					*out++ = clamp ? std::min(std::max(value, low), high) : value;
+				}
+			}
+		}
+	};
+
+	//first pass: the range of every brick, which says whether it needs its samples
+	ParallelFor(0, m_bricksZ, [&](int bz)
+	{
+		std::vector<float> samples(brickSamples);
+		for (int by = 0; by < m_bricksY; by++)
+		{
+			for (int bx = 0; bx < m_bricksX; bx++)
+			{
+				gather(bx, by, bz, samples.data());
+				float minimum = samples[0], maximum = samples[0];
+				for (float value : samples)
+				{
+					minimum = std::min(minimum, value);
+					maximum = std::max(maximum, value);
+				}
+
+				Brick& brick = m_bricks[((size_t)bz * m_bricksY + by) * m_bricksX + bx];
+				if (maximum - minimum <= settings.tolerance)
+				{
+					brick.value = settings.tolerance > 0.0f ? (minimum + maximum) * 0.5f : minimum;
+					brick.scale = 0.0f;
+					brick.offset = UNIFORM;
+				}
+				else
+				{
+					int levels = settings.precision == PRECISION_16 ? 65535 : 255;
+					brick.value = minimum;
+					brick.scale = settings.precision == PRECISION_32 ? 0.0f : (maximum - minimum) / levels;
+					brick.offset = 0;
+				}
+			}
+		}
+	}, threadCount);
+
+	//the dense bricks take their places in order
+	size_t dense = 0;
+	for (Brick& brick : m_bricks)
+	{
+		if (brick.offset != UNIFORM)
+		{
+			brick.offset = (uint32_t)(dense * brickSamples);
+			dense++;
+		}
+	}
+	if (dense * brickSamples >= UNIFORM)
+	{
+		Clear();
+		return false;
+	}
+
+	switch (settings.precision)
+	{
+	case PRECISION_16:
+		m_samples16.resize(dense * brickSamples);
+		break;
+	case PRECISION_8:
+		m_samples8.resize(dense * brickSamples);
+		break;
+	default:
+		m_samples32.resize(dense * brickSamples);
+		break;
+	}
+
+	//second pass: fill them in
+	ParallelFor(0, m_bricksZ, [&](int bz)
+	{
+		std::vector<float> samples(brickSamples);
+		for (int by = 0; by < m_bricksY; by++)
+		{
+			for (int bx = 0; bx < m_bricksX; bx++)
+			{
+				const Brick& brick = m_bricks[((size_t)bz * m_bricksY + by) * m_bricksX + bx];
+				if (brick.offset == UNIFORM)
+				{
+					continue;
+				}
+
+				gather(bx, by, bz, samples.data());
+				float inverse = brick.scale > 0.0f ? 1.0f / brick.scale : 0.0f;
+				for (size_t i = 0; i < brickSamples; i++)
+				{
+					float level = (samples[i] - brick.value) * inverse + 0.5f;
+					switch (settings.precision)
+					{
+					case PRECISION_16:
+						m_samples16[brick.offset + i] = (uint16_t)std::min(level, 65535.0f);
+						break;
+					case PRECISION_8:
+						m_samples8[brick.offset + i] = (uint8_t)std::min(level, 255.0f);
+						break;
+					default:
+						m_samples32[brick.offset + i] = samples[i];
+						break;
+					}
+				}
+			}
+		}
+	}, threadCount);
+
+	return true;
+}
+
+void SparseVolume::GetStats(Stats& stats) const
+{
+	stats = Stats();
+	stats.bricks = m_bricks.size();
+	for (const Brick& brick : m_bricks)
+	{
+		if (brick.offset == UNIFORM)
+		{
+			stats.uniformBricks++;
+		}
+	}
+	stats.denseBricks = stats.bricks - stats.uniformBricks;
+	stats.bytes = m_bricks.size() * sizeof(Brick) + m_samples32.size() * sizeof(float) + m_samples16.size() * sizeof(uint16_t) + m_samples8.size();
+	stats.denseBytes = (size_t)m_sizeX * m_sizeY * m_sizeZ * sizeof(float);
+}
+
+float SparseVolume::Sample(const Vector3& p) const
+{
+	float x = std::min(std::max(p.x, 0.0f), (float)(m_sizeX - 1));
+	float y = std::min(std::max(p.y, 0.0f), (float)(m_sizeY - 1));
+	float z = std::min(std::max(p.z, 0.0f), (float)(m_sizeZ - 1));
+	int x0 = (int)x, y0 = (int)y, z0 = (int)z;
+	float fx = x - x0, fy = y - y0, fz = z - z0;
+	int x1 = std::min(x0 + 1, m_sizeX - 1), y1 = std::min(y0 + 1, m_sizeY - 1), z1 = std::min(z0 + 1, m_sizeZ - 1);
+
+	float c[8];
+	if ((x0 & m_mask) != m_mask && (y0 & m_mask) != m_mask && (z0 & m_mask) != m_mask)
+	{
+		//all eight in one brick (the brick repeats its edge past the volume, so x1 == x0 there is the same value)
+		const Brick& brick = m_bricks[((size_t)(z0 >> m_shift) * m_bricksY + (y0 >> m_shift)) * m_bricksX + (x0 >> m_shift)];
+		if (brick.offset == UNIFORM)
+		{
+			return brick.value;
+		}
+		uint32_t row = (uint32_t)m_settings.brickSize, plane = row * row;
+		uint32_t index = brick.offset + ((((uint32_t)(z0 & m_mask) << m_shift) + (y0 & m_mask)) << m_shift) + (x0 & m_mask);
+		c[0] = Decode(brick, index);
+		c[1] = Decode(brick, index + 1);
+		c[2] = Decode(brick, index + row);
+		c[3] = Decode(brick, index + row + 1);
+		c[4] = Decode(brick, index + plane);
+		c[5] = Decode(brick, index + plane + 1);
+		c[6] = Decode(brick, index + plane + row);
+		c[7] = Decode(brick, index + plane + row + 1);
+	}
+	else
+	{
+		c[0] = Get(x0, y0, z0);
+		c[1] = Get(x1, y0, z0);
+		c[2] = Get(x0, y1, z0);
+		c[3] = Get(x1, y1, z0);
+		c[4] = Get(x0, y0, z1);
+		c[5] = Get(x1, y0, z1);
+		c[6] = Get(x0, y1, z1);
+		c[7] = Get(x1, y1, z1);
+	}
+
+	float c00 = c[0] + (c[1] - c[0]) * fx;
+	float c10 = c[2] + (c[3] - c[2]) * fx;
+	float c01 = c[4] + (c[5] - c[4]) * fx;
+	float c11 = c[6] + (c[7] - c[6]) * fx;
+	float c0 = c00 + (c10 - c00) * fy;
+	float c1 = c01 + (c11 - c01) * fy;
+	return c0 + (c1 - c0) * fz;
+}
+
+void SparseVolume::Extract(int x0, int y0, int z0, int sizeX, int sizeY, int sizeZ, float* out) const
+{
+	for (int z = z0; z < z0 + sizeZ; z++)
+	{
+		for (int y = y0; y < y0 + sizeY; y++)
+		{
+			//a brick at a time along the row
+			const Brick* bricks = m_bricks.data() + ((size_t)(z >> m_shift) * m_bricksY + (y >> m_shift)) * m_bricksX;
+			uint32_t rowStart = (((uint32_t)(z & m_mask) << m_shift) + (y & m_mask)) << m_shift;
+			int x = x0;
+			while (x < x0 + sizeX)
+			{
+				const Brick& brick = bricks[x >> m_shift];
+				int end = std::min((x | m_mask) + 1, x0 + sizeX);
+				if (brick.offset == UNIFORM)
+				{
+					std::fill(out, out + (end - x), brick.value);
+					out += end - x;
+				}
+				else
+				{
+					uint32_t index = brick.offset + rowStart + (x & m_mask);
+					for (int i = x; i < end; i++)
+					{
+						*out++ = Decode(brick, index++);
+					}
+				}
+				x = end;
+			}
+		}
+	}
+}
+
+double SparseVolume::Benchmark(int size, Precision precision, int samples, int threadCount, Stats* stats, float* error)
+{
+	std::vector<float> density;
+	MarchingCubes::BuildBenchmarkVolume(size, density, threadCount);
+
+	//twice the biggest change between neighbouring samples, so the band leaves its meshes as they are
+	Settings settings;
+	settings.precision = precision;
+	settings.band = GetLargestStep(density, size) * 2.0f + 0.01f;
+	SparseVolume volume;
+	volume.Build(density.data(), size, size, size, settings, threadCount);
+	if (stats)
+	{
+		volume.GetStats(*stats);
+	}
+
+	//points within the band, where sampling matters
+	Philox random(11);
+	std::vector<Vector3> points;
+	samples = std::max(samples, 1);
+	points.reserve(samples);
+	for (int i = 0; points.size() < (size_t)samples; i++)
+	{
+		Vector3 p(random.GetFloat(i, 0, 0) * (size - 1), random.GetFloat(i, 0, 1) * (size - 1), random.GetFloat(i, 0, 2) * (size - 1));
+		if (fabsf(volume.Sample(p) - settings.isoLevel) < settings.band || i > samples * 64)
+		{
+			points.push_back(p);
+		}
+	}
+
+	float sum = 0.0f;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (const Vector3& p : points)
+	{
+		sum += volume.Sample(p);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	if (error)
+	{
+		//against the same trilinear sampling of the clamped original
+		*error = 0.0f;
+		for (const Vector3& p : points)
+		{
+			int x0 = (int)p.x, y0 = (int)p.y, z0 = (int)p.z;
+			float fx = p.x - x0, fy = p.y - y0, fz = p.z - z0;
+			float value = 0.0f;
+			for (int corner = 0; corner < 8; corner++)
+			{
+				int x = std::min(x0 + (corner & 1), size - 1), y = std::min(y0 + ((corner >> 1) & 1), size - 1), z = std::min(z0 + (corner >> 2), size - 1);
+				float sample = std::min(std::max(density[((size_t)z * size + y) * size + x], settings.isoLevel - settings.band), settings.isoLevel + settings.band);
+				value += sample * ((corner & 1) ? fx : 1.0f - fx) * (((corner >> 1) & 1) ? fy : 1.0f - fy) * ((corner >> 2) ? fz : 1.0f - fz);
+			}
+			*error = std::max(*error, fabsf(value - volume.Sample(p)));
+		}
+	}
+
+	//keeps the loop from being optimised away
+	volatile float sink = sum;
+	(void)sink;
+	return std::chrono::duration<double, std::nano>(end - start).count() / points.size();
+}
+
+size_t SparseVolume::TestAgainstDense(int threadCount)
+{
+	//not a whole number of bricks, so the edge bricks are partly outside
+	const int size = 75;
+	std::vector<float> density;
+	MarchingCubes::BuildBenchmarkVolume(size, density, threadCount);
+
+	MarchingCubes::Settings meshSettings;
+	MeshData dense, sparse;
+	MarchingCubes::Polygonise(density.data(), size, size, size, meshSettings, dense, threadCount);
+	size_t failures = dense.indices.empty() ? 1 : 0;
+
+	std::vector<float> extracted(density.size());
+	const int brickSizes[] = { 2, 4, 8, 16 };
+	for (int brickSize : brickSizes)
+	{
+		Settings settings;
+		settings.brickSize = brickSize;
+		settings.band = GetLargestStep(density, size) * 2.0f + 0.01f;
+		SparseVolume volume;
+		volume.Build(density.data(), size, size, size, settings, threadCount);
+
+		//the band has to have actually made bricks uniform, or this proves nothing
+		Stats stats;
+		volume.GetStats(stats);
+		failures += stats.uniformBricks > 0 ? 0 : 1;
+
+		volume.Extract(0, 0, 0, size, size, size, extracted.data());
+		MarchingCubes::Polygonise(extracted.data(), size, size, size, meshSettings, sparse, threadCount);
+		bool same = sparse.indices == dense.indices && sparse.positions.size() == dense.positions.size() &&
+			memcmp(sparse.positions.data(), dense.positions.data(), dense.positions.size() * sizeof(Vector3)) == 0 &&
+			memcmp(sparse.normals.data(), dense.normals.data(), dense.normals.size() * sizeof(Vector3)) == 0;
+		failures += same ? 0 : 1;
+	}
+	return failures;
+}
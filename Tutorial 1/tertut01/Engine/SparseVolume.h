@@ -0,0 +1,116 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include "MeshData.h"
+
+//Sparse storage for a density volume (x fastest, then y, then z), a two level grid in the spirit of OpenVDB.
+//
+//The volume is cut into bricks of brickSize^3 samples. A brick whose samples are all the same (to within the
+//tolerance) is kept as that one value, the others keep all their samples, as floats or quantised to 16 or 8 bits
+//between the brick's own minimum and maximum. Densities like the terrain's keep changing far from the surface, so
+//few bricks are ever uniform as they are: a band clamps everything to within band of the iso level first, which
+//makes everything deep inside or far outside a constant and leaves only the bricks near the surface with samples,
+//so the memory grows with the surface area instead of the volume. A crossing only reads the samples either side of
+//it and the normals one further, so as long as band is more than twice the biggest change between neighbouring
+//samples the meshes come out the same as from the full volume.
+//
+//Trilinear sampling reads all eight corners from one brick when they are in it (the usual case), and looks each
+//one up on its own where they straddle bricks, so it is seamless across brick boundaries.
+
+class SparseVolume
+{
+public:
+	enum Precision
+	{
+		PRECISION_32 = 0,						//floats, exact
+		PRECISION_16 = 1,
+		PRECISION_8 = 2,
+	};
+
+	struct Settings
+	{
+		int brickSize;							//samples along a brick side, a power of two from 2 to 64
+		Precision precision;
+		float isoLevel;
+		float band;								//clamp to isoLevel +- band, 0 keeps every value as it is
+		float tolerance;						//a brick spreading no more than this is stored as one value
+
+		Settings() : brickSize(8), precision(PRECISION_32), isoLevel(0.0f), band(0.0f), tolerance(0.0f) {}
+	};
+
+	struct Stats
+	{
+		size_t bricks;
+		size_t uniformBricks;
+		size_t denseBricks;
+		size_t bytes;							//bricks and their samples
+		size_t denseBytes;						//the same volume as plain floats
+	};
+
+	SparseVolume();
+
+	bool Build(const float* density, int sizeX, int sizeY, int sizeZ, const Settings& settings, int threadCount = 0);
+	void Clear();
+
+	int GetSizeX() const { return m_sizeX; }
+	int GetSizeY() const { return m_sizeY; }
+	int GetSizeZ() const { return m_sizeZ; }
+	void GetStats(Stats& stats) const;
+
+	//one sample, which has to be inside the volume
+	float Get(int x, int y, int z) const
+	{
+		const Brick& brick = m_bricks[((size_t)(z >> m_shift) * m_bricksY + (y >> m_shift)) * m_bricksX + (x >> m_shift)];
+		if (brick.offset == UNIFORM)
+		{
+			return brick.value;
+		}
+		return Decode(brick, brick.offset + ((((uint32_t)(z & m_mask) << m_shift) + (y & m_mask)) << m_shift) + (x & m_mask));
+	}
+
+	//trilinear between the samples, p in samples and clamped to the volume
+	float Sample(const DirectX::SimpleMath::Vector3& p) const;
+	//a box of samples as plain floats (x fastest), to feed the meshers. it has to be inside the volume.
+	void Extract(int x0, int y0, int z0, int sizeX, int sizeY, int sizeZ, float* out) const;
+
+	//stores a size^3 MarchingCubes::BuildBenchmarkVolume and samples it at random. returns the average nanoseconds
+	//per trilinear sample, error gets the largest difference from sampling the original.
+	static double Benchmark(int size, Precision precision, int samples, int threadCount = 0, Stats* stats = nullptr, float* error = nullptr);
+
+	//BuildBenchmarkVolume stored with a band of twice the biggest neighbour step, for a few brick sizes, then
+	//meshed from Extract and from the original. the meshes have to be identical. returns the mismatches.
+	static size_t TestAgainstDense(int threadCount = 0);
+
+private:
+	static const uint32_t UNIFORM = 0xffffffff;
+
+	struct Brick
+	{
+		float value;							//the uniform value, or the minimum the samples are quantised from
+		float scale;							//quantised step
+		uint32_t offset;						//its first sample in the sample arrays, UNIFORM for none
+	};
+
+	float Decode(const Brick& brick, uint32_t index) const
+	{
+		switch (m_settings.precision)
+		{
+		case PRECISION_16:
+			return brick.value + m_samples16[index] * brick.scale;
+		case PRECISION_8:
+			return brick.value + m_samples8[index] * brick.scale;
+		default:
+			return m_samples32[index];
+		}
+	}
+
+private:
+	Settings m_settings;
+	int m_sizeX, m_sizeY, m_sizeZ;
+	int m_bricksX, m_bricksY, m_bricksZ;
+	int m_shift, m_mask;
+	std::vector<Brick> m_bricks;
+	std::vector<float> m_samples32;
+	std::vector<uint16_t> m_samples16;
+	std::vector<uint8_t> m_samples8;
+};
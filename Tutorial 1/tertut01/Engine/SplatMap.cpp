@@ -0,0 +1,287 @@
+#include "pch.h"
+#include "SplatMap.h"
+#include "SimplexNoise.h"
+#include "ParallelFor.h"
+#include <emmintrin.h>
+
+namespace
+{
+	//scratch pitch for one tile plus its border, rounded so a four wide load past the last column stays inside
+	const int BLOCK_PITCH = SplatMap::TILE_SIZE + 8;
+
+	inline __m128 Saturate(__m128 v)
+	{
+		return _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+	}
+
+	inline __m128 SmoothStep(__m128 t)
+	{
+		t = Saturate(t);
+		return _mm_mul_ps(_mm_mul_ps(t, t), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_add_ps(t, t)));
+	}
+
+	//1 inside [low, high], easing to 0 over blend outside it
+	inline __m128 Band(__m128 v, float low, float high, float blend)
+	{
+		__m128 inverse = _mm_set1_ps(1.0f / std::max(blend, 1e-6f));
+		__m128 rise = SmoothStep(_mm_mul_ps(_mm_sub_ps(v, _mm_set1_ps(low - blend)), inverse));
+		__m128 fall = SmoothStep(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps(high + blend), v), inverse));
+		return _mm_mul_ps(rise, fall);
+	}
+}
+
+
+SplatMap::SplatMap()
+{
+	m_width = 0;
+	m_height = 0;
+	m_materialCount = 0;
+	m_dirty = false;
+	m_dirtyX0 = m_dirtyZ0 = m_dirtyX1 = m_dirtyZ1 = 0;
+}
+
+SplatMap::~SplatMap()
+{
+}
+
+bool SplatMap::Initialize(int width, int height, int materialCount)
+{
+	if (width < 1 || height < 1 || materialCount < 1 || materialCount > MAX_MATERIALS)
+	{
+		return false;
+	}
+
+	m_width = width;
+	m_height = height;
+	m_materialCount = materialCount;
+	for (int i = 0; i < MAX_MATERIALS; i++)
+	{
+		m_materials[i] = Material();
+	}
+
+	//padded by a few floats so the last four wide load of the last row stays in the array
+	m_noise.assign(width * height + 4, 0.5f);
+	for (int layer = 0; layer < 2; layer++)
+	{
+		m_layers[layer].assign(layer < GetLayerCount() ? width * height : 0, 0);
+	}
+	m_dirty = false;
+	return true;
+}
+
+void SplatMap::SetMaterial(int index, const Material& material)
+{
+	if (index >= 0 && index < MAX_MATERIALS)
+	{
+		m_materials[index] = material;
+	}
+}
+
+void SplatMap::SetNoise(float frequency, unsigned int seed)
+{
+	//simplex noise has no seed of its own, so the seed just moves the sample window
+	double offset = (double)(seed % 4096) * 17.31;
+	ParallelFor(0, m_height, [&](int z)
+	{
+		for (int x = 0; x < m_width; x++)
+		{
+			double n = SimplexNoise::nNoise(x * frequency + offset, z * frequency + offset, 0.5);
+			m_noise[z * m_width + x] = (float)(n * 0.5 + 0.5);
+		}
+	});
+}
+
+void SplatMap::GenerateTile(const float* heights, float cellSize, int tileX, int tileZ)
+{
+	int x0 = tileX * TILE_SIZE;
+	int z0 = tileZ * TILE_SIZE;
+	int tileWidth = std::min(TILE_SIZE, m_width - x0);
+	int tileHeight = std::min(TILE_SIZE, m_height - z0);
+
+	//heights with a one texel border, clamped at the edges of the map
+	float block[(TILE_SIZE + 2) * BLOCK_PITCH];
+	for (int r = 0; r < tileHeight + 2; r++)
+	{
+		int z = std::max(0, std::min(z0 + r - 1, m_height - 1));
+		for (int c = 0; c < BLOCK_PITCH; c++)
+		{
+			int x = std::max(0, std::min(x0 + c - 1, m_width - 1));
+			block[r * BLOCK_PITCH + c] = heights[z * m_width + x];
+		}
+	}
+
+	__m128 halfInverseCell = _mm_set1_ps(0.5f / cellSize);
+	__m128 inverseCell = _mm_set1_ps(1.0f / cellSize);
+	__m128 one = _mm_set1_ps(1.0f);
+
+	for (int r = 0; r < tileHeight; r++)
+	{
+		const float* above = block + r * BLOCK_PITCH;
+		const float* row = above + BLOCK_PITCH;
+		const float* below = row + BLOCK_PITCH;
+		int z = z0 + r;
+
+		for (int c = 0; c < tileWidth; c += 4)
+		{
+			__m128 centre = _mm_loadu_ps(row + c + 1);
+			__m128 left = _mm_loadu_ps(row + c);
+			__m128 right = _mm_loadu_ps(row + c + 2);
+			__m128 up = _mm_loadu_ps(above + c + 1);
+			__m128 down = _mm_loadu_ps(below + c + 1);
+
+			//slope from the normal of the central difference plane
+			__m128 gx = _mm_mul_ps(_mm_sub_ps(right, left), halfInverseCell);
+			__m128 gz = _mm_mul_ps(_mm_sub_ps(down, up), halfInverseCell);
+			__m128 lengthSq = _mm_add_ps(one, _mm_add_ps(_mm_mul_ps(gx, gx), _mm_mul_ps(gz, gz)));
+			__m128 slope = _mm_sub_ps(one, _mm_div_ps(one, _mm_sqrt_ps(lengthSq)));
+
+			//negative laplacian, positive on ridges and peaks. scaled by one cell so it reads as a height change per cell.
+			__m128 sum = _mm_add_ps(_mm_add_ps(left, right), _mm_add_ps(up, down));
+			__m128 convexity = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(centre, _mm_set1_ps(4.0f)), sum), inverseCell);
+
+			__m128 mask = _mm_loadu_ps(&m_noise[z * m_width + x0 + c]);
+
+			float weights[MAX_MATERIALS][4];
+			for (int m = 0; m < m_materialCount; m++)
+			{
+				const Material& material = m_materials[m];
+				__m128 weight = _mm_set1_ps(material.strength);
+				weight = _mm_mul_ps(weight, Band(centre, material.minHeight, material.maxHeight, material.heightBlend));
+				weight = _mm_mul_ps(weight, Band(slope, material.minSlope, material.maxSlope, material.slopeBlend));
+
+				if (material.curvature != 0.0f)
+				{
+					weight = _mm_mul_ps(weight, Saturate(_mm_add_ps(one, _mm_mul_ps(convexity, _mm_set1_ps(material.curvature)))));
+				}
+
+				if (material.noise != 0.0f)
+				{
+					float amount = std::min(fabsf(material.noise), 1.0f);
+					__m128 follow = material.noise > 0.0f ? mask : _mm_sub_ps(one, mask);
+					weight = _mm_mul_ps(weight, _mm_add_ps(_mm_set1_ps(1.0f - amount), _mm_mul_ps(follow, _mm_set1_ps(amount))));
+				}
+
+				_mm_storeu_ps(weights[m], weight);
+			}
+
+			//normalise and quantise. whatever rounding loses goes to the strongest material so every texel sums to 255.
+			int lanes = std::min(4, tileWidth - c);
+			for (int lane = 0; lane < lanes; lane++)
+			{
+				float total = 0.0f;
+				int strongest = 0;
+				for (int m = 0; m < m_materialCount; m++)
+				{
+					total += weights[m][lane];
+					if (weights[m][lane] > weights[strongest][lane])
+					{
+						strongest = m;
+					}
+				}
+
+				int quantised[MAX_MATERIALS] = {};
+				if (total > 1e-6f)
+				{
+					int used = 0;
+					for (int m = 0; m < m_materialCount; m++)
+					{
+						quantised[m] = (int)(weights[m][lane] / total * 255.0f + 0.5f);
+						used += quantised[m];
+					}
+					quantised[strongest] += 255 - used;
+				}
+				else
+				{
+					//nothing asked for this texel, fall back to the first material
+					quantised[0] = 255;
+				}
+
+				int index = z * m_width + x0 + c + lane;
+				for (int layer = 0; layer < GetLayerCount(); layer++)
+				{
+					uint32_t packed = 0;
+					for (int channel = 0; channel < 4; channel++)
+					{
+						packed |= (uint32_t)quantised[layer * 4 + channel] << (channel * 8);
+					}
+					m_layers[layer][index] = packed;
+				}
+			}
+		}
+	}
+}
+
+void SplatMap::Generate(const float* heights, float cellSize, int threadCount)
+{
+	UpdateRegion(heights, cellSize, 0, 0, m_width - 1, m_height - 1, threadCount);
+}
+
+void SplatMap::UpdateRegion(const float* heights, float cellSize, int x0, int z0, int x1, int z1, int threadCount)
+{
+	if (m_width == 0)
+	{
+		return;
+	}
+
+	//slope and curvature look one texel out, so the neighbours of the changed region change too
+	x0 = std::max(0, x0 - 1);
+	z0 = std::max(0, z0 - 1);
+	x1 = std::min(m_width - 1, x1 + 1);
+	z1 = std::min(m_height - 1, z1 + 1);
+	if (x0 > x1 || z0 > z1)
+	{
+		return;
+	}
+
+	int tileX0 = x0 / TILE_SIZE;
+	int tileZ0 = z0 / TILE_SIZE;
+	int tilesAcross = x1 / TILE_SIZE - tileX0 + 1;
+	int tilesDown = z1 / TILE_SIZE - tileZ0 + 1;
+
+	ParallelFor(0, tilesAcross * tilesDown, [&](int tile)
+	{
+		GenerateTile(heights, cellSize, tileX0 + tile % tilesAcross, tileZ0 + tile / tilesAcross);
+	}, threadCount);
+
+	MarkDirty(tileX0 * TILE_SIZE, tileZ0 * TILE_SIZE,
+		std::min(m_width, (tileX0 + tilesAcross) * TILE_SIZE) - 1, std::min(m_height, (tileZ0 + tilesDown) * TILE_SIZE) - 1);
+}
+
+void SplatMap::MarkDirty(int x0, int z0, int x1, int z1)
+{
+	if (!m_dirty)
+	{
+		m_dirtyX0 = x0;
+		m_dirtyZ0 = z0;
+		m_dirtyX1 = x1;
+		m_dirtyZ1 = z1;
+		m_dirty = true;
+		return;
+	}
+
+	m_dirtyX0 = std::min(m_dirtyX0, x0);
+	m_dirtyZ0 = std::min(m_dirtyZ0, z0);
+	m_dirtyX1 = std::max(m_dirtyX1, x1);
+	m_dirtyZ1 = std::max(m_dirtyZ1, z1);
+}
+
+bool SplatMap::TakeDirtyRegion(int& x0, int& z0, int& x1, int& z1)
+{
+	if (!m_dirty)
+	{
+		return false;
+	}
+
+	x0 = m_dirtyX0;
+	z0 = m_dirtyZ0;
+	x1 = m_dirtyX1;
+	z1 = m_dirtyZ1;
+	m_dirty = false;
+	return true;
+}
+
+float SplatMap::GetWeight(int material, int x, int z) const
+{
+	uint32_t packed = m_layers[material / 4][z * m_width + x];
+	return (float)((packed >> ((material % 4) * 8)) & 0xff) / 255.0f;
+}
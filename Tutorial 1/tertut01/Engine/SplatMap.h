@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+
+//Texture blend weights for up to eight terrain materials, one texel per heightfield vertex.
+//Each material asks for a height band, a slope band, a curvature preference and optionally a noise mask.
+//The weights are normalised per texel and packed four to an RGBA8 texel, so four materials need one layer
+//and eight need two (layer 0 holds materials 0-3 in r, g, b, a).
+//
+//The map is worked on in square tiles which are shared out between threads. Each tile copies its heights with
+//a one texel border into scratch first, so the inner loops can do slope and curvature four texels at a time
+//with SSE and never have to test for the edges. Changing part of the heightfield only redoes the tiles it touches.
+
+class SplatMap
+{
+public:
+	static const int MAX_MATERIALS = 8;
+	static const int TILE_SIZE = 32;
+
+	struct Material
+	{
+		float minHeight, maxHeight;		//full weight inside the band
+		float heightBlend;				//fades out over this distance either side of it
+		float minSlope, maxSlope;		//slope is 1 - normal.y, so 0 is flat and 1 a wall
+		float slopeBlend;
+		float curvature;				//> 0 favours ridges, < 0 favours gullies, 0 doesn't care
+		float noise;					//> 0 follows the noise mask, < 0 its inverse, 0 ignores it
+		float strength;
+
+		Material() : minHeight(-1e30f), maxHeight(1e30f), heightBlend(1.0f), minSlope(0.0f), maxSlope(1.0f),
+			slopeBlend(0.1f), curvature(0.0f), noise(0.0f), strength(1.0f) {}
+	};
+
+	SplatMap();
+	~SplatMap();
+
+	bool Initialize(int width, int height, int materialCount);
+	void SetMaterial(int index, const Material& material);
+	//rebuilds the noise mask, it doesn't depend on the heights so it is kept between updates
+	void SetNoise(float frequency, unsigned int seed);
+
+	//heights are width * height row major, cellSize is the spacing between them in the same units
+	void Generate(const float* heights, float cellSize, int threadCount = 0);
+	//redo only what [x0, x1] x [z0, z1] (inclusive grid coordinates) can affect
+	void UpdateRegion(const float* heights, float cellSize, int x0, int z0, int x1, int z1, int threadCount = 0);
+
+	//texels rewritten since the last call, as an inclusive rectangle. false if nothing changed.
+	bool TakeDirtyRegion(int& x0, int& z0, int& x1, int& z1);
+
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+	int GetMaterialCount() const { return m_materialCount; }
+	int GetLayerCount() const { return (m_materialCount + 3) / 4; }
+	const uint32_t* GetLayer(int layer) const { return m_layers[layer].data(); }
+	//unpacked weight of one material at one texel, 0..1
+	float GetWeight(int material, int x, int z) const;
+
+private:
+	void GenerateTile(const float* heights, float cellSize, int tileX, int tileZ);
+	void MarkDirty(int x0, int z0, int x1, int z1);
+
+private:
+	int m_width, m_height;
+	int m_materialCount;
+	Material m_materials[MAX_MATERIALS];
+	std::vector<float> m_noise;				//0..1 mask, width * height
+	std::vector<uint32_t> m_layers[2];		//packed RGBA8 weights
+
+	bool m_dirty;
+	int m_dirtyX0, m_dirtyZ0, m_dirtyX1, m_dirtyZ1;
+};
@@ -0,0 +1,751 @@
+#include "pch.h"
+#include "SurfaceNets.h"
+#include "MarchingCubes.h"
+#include "ParallelFor.h"
+#include "Philox.h"
+#include <emmintrin.h>
+#include <chrono>
+#include <cfloat>
+#include <unordered_map>
+
+using DirectX::SimpleMath::Vector3;
+
+namespace
+{
+	//cell corner c is at (c & 1, (c >> 1) & 1, c >> 2), and the twelve cell edges join these pairs of them
+	const int EDGES[12][2] =
+	{
+		{ 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 },
+		{ 0, 2 }, { 1, 3 }, { 4, 6 }, { 5, 7 },
+		{ 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 },
+	};
+
+	//a few solid balls with noise on every sample (plenty of ambiguous faces), the border left outside so the
+	//surface is closed
+	void BuildTestVolume(Philox& random, int trial, int size, std::vector<float>& density)
+	{
+		int balls = 2 + (int)(random.GetFloat(0, trial, 0) * 5.0f);
+		float noise = random.GetFloat(1, trial, 0) * 1.5f;
+		Vector3 centres[8];
+		float radii[8];
+		for (int i = 0; i < balls; i++)
+		{
+			centres[i] = Vector3(random.GetFloat(i, trial, 1), random.GetFloat(i, trial, 2), random.GetFloat(i, trial, 3)) * (size - 16.0f) + Vector3(8.0f, 8.0f, 8.0f);
+			radii[i] = 3.0f + random.GetFloat(i, trial, 4) * 8.0f;
+		}
+
+		density.resize((size_t)size * size * size);
+		for (int z = 0; z < size; z++)
+		{
+			for (int y = 0; y < size; y++)
+			{
+				for (int x = 0; x < size; x++)
+				{
+					size_t index = ((size_t)z * size + y) * size + x;
+					if (x == 0 || y == 0 || z == 0 || x == size - 1 || y == size - 1 || z == size - 1)
+					{
+						density[index] = -1.0f;
+						continue;
+					}
+
+					float value = -FLT_MAX;
+					for (int i = 0; i < balls; i++)
+					{
+						value = std::max(value, radii[i] - (Vector3((float)x, (float)y, (float)z) - centres[i]).Length());
+					}
+					density[index] = value + (random.GetFloat(x + y * size, z, 5 + trial) - 0.5f) * noise;
+				}
+			}
+		}
+	}
+
+	Vector3 Corner(int corner)
+	{
+		return Vector3((float)(corner & 1), (float)((corner >> 1) & 1), (float)(corner >> 2));
+	}
+
+	//eigen decomposition of a symmetric 3 x 3 matrix by Jacobi rotations. a ends up diagonal (the eigenvalues),
+	//the columns of vectors are the eigenvectors.
+	void Jacobi(float a[3][3], float vectors[3][3])
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				vectors[i][j] = i == j ? 1.0f : 0.0f;
+			}
+		}
+
+		const int pairs[3][2] = { { 0, 1 }, { 0, 2 }, { 1, 2 } };
+		for (int sweep = 0; sweep < 6; sweep++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				int p = pairs[k][0], q = pairs[k][1];
+				if (fabsf(a[p][q]) < 1e-12f)
+				{
+					continue;
+				}
+
+				float theta = (a[q][q] - a[p][p]) / (2.0f * a[p][q]);
+				float t = (theta >= 0.0f ? 1.0f : -1.0f) / (fabsf(theta) + sqrtf(theta * theta + 1.0f));
+				float c = 1.0f / sqrtf(t * t + 1.0f), s = t * c;
+
+				for (int i = 0; i < 3; i++)
+				{
+					float ip = a[i][p], iq = a[i][q];
+					a[i][p] = c * ip - s * iq;
+					a[i][q] = s * ip + c * iq;
+				}
+				for (int i = 0; i < 3; i++)
+				{
+					float pi = a[p][i], qi = a[q][i];
+					a[p][i] = c * pi - s * qi;
+					a[q][i] = s * pi + c * qi;
+				}
+				for (int i = 0; i < 3; i++)
+				{
+					float ip = vectors[i][p], iq = vectors[i][q];
+					vectors[i][p] = c * ip - s * iq;
+					vectors[i][q] = s * ip + c * iq;
+				}
+			}
+		}
+	}
+
+	class Mesher
+	{
+	public:
+		Mesher(const float* density, int sizeX, int sizeY, int sizeZ, const SurfaceNets::Settings& settings)
+			: m_density(density), m_sizeX(sizeX), m_sizeY(sizeY), m_sizeZ(sizeZ), m_settings(settings)
+		{
+			m_planeSize = (size_t)sizeX * sizeY;
+			m_cellsX = sizeX - 1;
+		}
+
+		size_t GetCellPlaneSize() const { return (size_t)m_cellsX * (m_sizeY - 1); }
+
+		//1 for every sample of plane z below the iso level
+		void Classify(int z, std::vector<uint8_t>& below) const
+		{
+			const float* values = m_density + m_planeSize * z;
+			__m128 iso = _mm_set1_ps(m_settings.isoLevel);
+			__m128i one = _mm_set1_epi8(1);
+			size_t i = 0;
+
+			for (; i + 16 <= m_planeSize; i += 16)
+			{
+				__m128i a = _mm_castps_si128(_mm_cmplt_ps(_mm_loadu_ps(values + i), iso));
+				__m128i b = _mm_castps_si128(_mm_cmplt_ps(_mm_loadu_ps(values + i + 4), iso));
+				__m128i c = _mm_castps_si128(_mm_cmplt_ps(_mm_loadu_ps(values + i + 8), iso));
+				__m128i d = _mm_castps_si128(_mm_cmplt_ps(_mm_loadu_ps(values + i + 12), iso));
+				__m128i bytes = _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+				_mm_storeu_si128((__m128i*)(below.data() + i), _mm_and_si128(bytes, one));
+			}
+			for (; i < m_planeSize; i++)
+			{
+				below[i] = values[i] < m_settings.isoLevel;
+			}
+		}
+
+		//the cells of slab z (between planes bottom and top) with a vertex, and the crossings it owns: the x and y
+		//edges of its bottom plane and its z edges. only edges with four cells round them (off the sides of the
+		//grid) make quads, so only those count.
+		void CountSlab(int z, const uint8_t* bottom, const uint8_t* top, uint32_t& cells, uint32_t& crossings) const
+		{
+			size_t active = 0;
+			for (int y = 0; y + 1 < m_sizeY; y++)
+			{
+				size_t row = (size_t)y * m_sizeX;
+				int x = 0;
+				for (; x + 16 <= m_cellsX; x += 16)
+				{
+					active += CountBits(MixedCells16(bottom, top, row + x));
+				}
+				for (; x < m_cellsX; x++)
+				{
+					active += IsMixed(bottom, top, row + x);
+				}
+			}
+			cells = (uint32_t)active;
+
+			//the same edges ForCrossings visits
+			size_t count = 0;
+			if (z > 0 && z + 1 < m_sizeZ)
+			{
+				for (int y = 1; y + 1 < m_sizeY; y++)
+				{
+					const uint8_t* row = bottom + (size_t)y * m_sizeX;
+					count += CountDifferent(row, row + 1, m_sizeX - 1);
+				}
+				for (int y = 0; y + 1 < m_sizeY; y++)
+				{
+					const uint8_t* row = bottom + (size_t)y * m_sizeX;
+					count += CountDifferent(row + 1, row + 1 + m_sizeX, m_sizeX - 2);
+				}
+			}
+			for (int y = 1; y + 1 < m_sizeY; y++)
+			{
+				size_t row = (size_t)y * m_sizeX;
+				count += CountDifferent(bottom + row + 1, top + row + 1, m_sizeX - 2);
+			}
+			crossings = (uint32_t)count;
+		}
+
+		//numbers the cells of slab z starting at first, in the order CountSlab found them. indices gets each cell's
+		//vertex. only the slab's owner writes the vertices, the block above just wants the indices.
+		void FillSlab(int z, const uint8_t* bottom, const uint8_t* top, uint32_t first, uint32_t* indices, bool write, MeshData& mesh) const
+		{
+			uint32_t next = first;
+			ForActiveCells(bottom, top, [&](int x, int y)
+			{
+				indices[(size_t)y * m_cellsX + x] = next;
+				if (write)
+				{
+					PlaceVertex(x, y, z, next, mesh);
+				}
+				next++;
+			});
+		}
+
+		//a quad (two triangles) for every crossing slab z owns, joining the cells around it. previous holds the
+		//indices of slab z - 1 and current those of slab z. the quad faces the end of the edge that is below.
+		void EmitSlab(int z, const uint8_t* bottom, const uint8_t* top, const uint32_t* previous, const uint32_t* current,
+			uint32_t first, MeshData& mesh) const
+		{
+			uint32_t* out = mesh.indices.data() + (size_t)first * 6;
+			size_t cellsX = m_cellsX;
+			ForCrossings(z, bottom, top, [&](int edge, int x, int y, bool positive)
+			{
+				size_t cell = (size_t)y * cellsX + x;
+				uint32_t quad[4];
+				if (edge == 0)
+				{
+					//x edge, cells round it anticlockwise in (y, z)
+					quad[0] = previous[cell - cellsX];
+					quad[1] = previous[cell];
+					quad[2] = current[cell];
+					quad[3] = current[cell - cellsX];
+				}
+				else if (edge == 1)
+				{
+					//y edge, in (z, x)
+					quad[0] = previous[cell - 1];
+					quad[1] = current[cell - 1];
+					quad[2] = current[cell];
+					quad[3] = previous[cell];
+				}
+				else
+				{
+					//z edge, in (x, y)
+					quad[0] = current[cell - cellsX - 1];
+					quad[1] = current[cell - cellsX];
+					quad[2] = current[cell];
+					quad[3] = current[cell - 1];
+				}
+
+				if (!positive)
+				{
+					std::swap(quad[1], quad[3]);
+				}
+				out[0] = quad[0];
+				out[1] = quad[1];
+				out[2] = quad[2];
+				out[3] = quad[0];
+				out[4] = quad[2];
+				out[5] = quad[3];
+				out += 6;
+			});
+		}
+
+	private:
+		//function(x, y) for every cell of the slab that isn't all on one side, in row order
+		template<typename Function>
+		void ForActiveCells(const uint8_t* bottom, const uint8_t* top, Function function) const
+		{
+			for (int y = 0; y + 1 < m_sizeY; y++)
+			{
+				size_t row = (size_t)y * m_sizeX;
+				int x = 0;
+				for (; x + 16 <= m_cellsX; x += 16)
+				{
+					int mixed = MixedCells16(bottom, top, row + x);
+					while (mixed)
+					{
+						function(x + CountTrailingZeros(mixed), y);
+						mixed &= mixed - 1;
+					}
+				}
+				for (; x < m_cellsX; x++)
+				{
+					if (IsMixed(bottom, top, row + x))
+					{
+						function(x, y);
+					}
+				}
+			}
+		}
+
+		//a bit for each of the sixteen cells from sample i that has corners on both sides
+		int MixedCells16(const uint8_t* bottom, const uint8_t* top, size_t i) const
+		{
+			const uint8_t* rows[4] = { bottom + i, bottom + i + m_sizeX, top + i, top + i + m_sizeX };
+			__m128i any = _mm_setzero_si128();
+			__m128i all = _mm_set1_epi8(1);
+			for (int r = 0; r < 4; r++)
+			{
+				__m128i a = _mm_loadu_si128((const __m128i*)rows[r]);
+				__m128i b = _mm_loadu_si128((const __m128i*)(rows[r] + 1));
+				any = _mm_or_si128(any, _mm_or_si128(a, b));
+				all = _mm_and_si128(all, _mm_and_si128(a, b));
+			}
+			return _mm_movemask_epi8(_mm_cmpeq_epi8(any, all)) ^ 0xFFFF;
+		}
+
+		bool IsMixed(const uint8_t* bottom, const uint8_t* top, size_t i) const
+		{
+			int sum = bottom[i] + bottom[i + 1] + bottom[i + m_sizeX] + bottom[i + m_sizeX + 1] +
+				top[i] + top[i + 1] + top[i + m_sizeX] + top[i + m_sizeX + 1];
+			return sum != 0 && sum != 8;
+		}
+
+		//function(edge, x, y, positive) for the crossings slab z owns, edge 0 / 1 / 2 for x / y / z and positive when
+		//the far end is the one below
+		template<typename Function>
+		void ForCrossings(int z, const uint8_t* bottom, const uint8_t* top, Function function) const
+		{
+			bool inner = z > 0 && z + 1 < m_sizeZ;
+			if (inner)
+			{
+				for (int y = 1; y + 1 < m_sizeY; y++)
+				{
+					const uint8_t* row = bottom + (size_t)y * m_sizeX;
+					ForDifferent(row, row + 1, 0, m_sizeX - 1, [&](int x) { function(0, x, y, row[x + 1] != 0); });
+				}
+				for (int y = 0; y + 1 < m_sizeY; y++)
+				{
+					const uint8_t* row = bottom + (size_t)y * m_sizeX;
+					ForDifferent(row, row + m_sizeX, 1, m_sizeX - 1, [&](int x) { function(1, x, y, row[x + m_sizeX] != 0); });
+				}
+			}
+			for (int y = 1; y + 1 < m_sizeY; y++)
+			{
+				size_t row = (size_t)y * m_sizeX;
+				ForDifferent(bottom + row, top + row, 1, m_sizeX - 1, [&](int x) { function(2, x, y, top[row + x] != 0); });
+			}
+		}
+
+		//function(i) for each i in [first, last) where a and b differ, sixteen at a time
+		template<typename Function>
+		static void ForDifferent(const uint8_t* a, const uint8_t* b, int first, int last, Function function)
+		{
+			int i = first;
+			for (; i + 16 <= last; i += 16)
+			{
+				__m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+				int different = _mm_movemask_epi8(equal) ^ 0xFFFF;
+				while (different)
+				{
+					function(i + CountTrailingZeros(different));
+					different &= different - 1;
+				}
+			}
+			for (; i < last; i++)
+			{
+				if (a[i] != b[i])
+				{
+					function(i);
+				}
+			}
+		}
+
+		static int CountTrailingZeros(int mask)
+		{
+			int count = 0;
+			while (!(mask & 1))
+			{
+				mask >>= 1;
+				count++;
+			}
+			return count;
+		}
+
+		static int CountBits(int mask)
+		{
+			int count = 0;
+			for (; mask; mask &= mask - 1)
+			{
+				count++;
+			}
+			return count;
+		}
+
+		static size_t CountDifferent(const uint8_t* a, const uint8_t* b, size_t count)
+		{
+			__m128i zero = _mm_setzero_si128();
+			__m128i sum = zero;
+			size_t i = 0;
+			for (; i + 16 <= count; i += 16)
+			{
+				__m128i different = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+				sum = _mm_add_epi64(sum, _mm_sad_epu8(different, zero));
+			}
+
+			size_t total = (size_t)_mm_cvtsi128_si32(sum) + (size_t)_mm_cvtsi128_si32(_mm_unpackhi_epi64(sum, sum));
+			for (; i < count; i++)
+			{
+				total += a[i] ^ b[i];
+			}
+			return total;
+		}
+
+		//the vertex of cell (x, y, z), in the cell's own 0 to 1 coordinates until the end
+		void PlaceVertex(int x, int y, int z, uint32_t index, MeshData& mesh) const
+		{
+			bool dual = m_settings.mode == SurfaceNets::MODE_DUAL_CONTOURING;
+			float values[8];
+			Vector3 gradients[8];
+			for (int c = 0; c < 8; c++)
+			{
+				int cx = x + (c & 1), cy = y + ((c >> 1) & 1), cz = z + (c >> 2);
+				values[c] = Sample(cx, cy, cz);
+				if (dual)
+				{
+					gradients[c] = Gradient(cx, cy, cz);
+				}
+			}
+
+			//the crossings' average, and for dual contouring the normal equations of the planes through them
+			//(a^t a and a^t b, a being one row per plane) taken about the average so the solve stays well scaled
+			Vector3 points[12], normals[12];
+			Vector3 mass(0.0f, 0.0f, 0.0f);
+			int count = 0;
+			for (int e = 0; e < 12; e++)
+			{
+				int c0 = EDGES[e][0], c1 = EDGES[e][1];
+				if ((values[c0] < m_settings.isoLevel) == (values[c1] < m_settings.isoLevel))
+				{
+					continue;
+				}
+
+				float t = (m_settings.isoLevel - values[c0]) / (values[c1] - values[c0]);
+				points[count] = Corner(c0) + (Corner(c1) - Corner(c0)) * t;
+				mass += points[count];
+				if (dual)
+				{
+					Vector3 gradient = gradients[c0] * (1.0f - t) + gradients[c1] * t;
+					float length = gradient.Length();
+					normals[count] = length > 0.0f ? gradient * (1.0f / length) : Vector3(0.0f, 0.0f, 0.0f);
+				}
+				count++;
+			}
+			Vector3 vertex = mass * (1.0f / count);
+
+			if (dual)
+			{
+				float ata[3][3] = {}, atb[3] = {};
+				for (int i = 0; i < count; i++)
+				{
+					const Vector3& n = normals[i];
+					float nv[3] = { n.x, n.y, n.z };
+					float distance = n.Dot(points[i] - vertex);
+					for (int r = 0; r < 3; r++)
+					{
+						for (int c = 0; c < 3; c++)
+						{
+							ata[r][c] += nv[r] * nv[c];
+						}
+						atb[r] += nv[r] * distance;
+					}
+				}
+
+				//pseudo inverse, dropping the directions the planes barely constrain
+				float vectors[3][3];
+				Jacobi(ata, vectors);
+				float largest = std::max(fabsf(ata[0][0]), std::max(fabsf(ata[1][1]), fabsf(ata[2][2])));
+				float offset[3] = {};
+				for (int k = 0; k < 3; k++)
+				{
+					float value = ata[k][k];
+					if (fabsf(value) <= m_settings.featureThreshold * largest || value == 0.0f)
+					{
+						continue;
+					}
+					float along = (vectors[0][k] * atb[0] + vectors[1][k] * atb[1] + vectors[2][k] * atb[2]) / value;
+					for (int r = 0; r < 3; r++)
+					{
+						offset[r] += vectors[r][k] * along;
+					}
+				}
+
+				//kept inside the cell so the quads can't fold over their neighbours
+				vertex.x = std::min(std::max(vertex.x + offset[0], 0.0f), 1.0f);
+				vertex.y = std::min(std::max(vertex.y + offset[1], 0.0f), 1.0f);
+				vertex.z = std::min(std::max(vertex.z + offset[2], 0.0f), 1.0f);
+			}
+
+			mesh.positions[index] = m_settings.origin + (Vector3((float)x, (float)y, (float)z) + vertex) * m_settings.spacing;
+			if (m_settings.normals)
+			{
+				//dual contouring has the corner gradients already, blended trilinearly to the vertex. surface nets takes
+				//the gradient of the cell's own trilinear density there instead, which needs no more samples.
+				Vector3 gradient(0.0f, 0.0f, 0.0f);
+				float weights[3][2] = { { 1.0f - vertex.x, vertex.x }, { 1.0f - vertex.y, vertex.y }, { 1.0f - vertex.z, vertex.z } };
+				for (int c = 0; c < 8; c++)
+				{
+					int bits[3] = { c & 1, (c >> 1) & 1, c >> 2 };
+					if (dual)
+					{
+						gradient += gradients[c] * (weights[0][bits[0]] * weights[1][bits[1]] * weights[2][bits[2]]);
+						continue;
+					}
+					//each edge from a lower corner, weighted by where the vertex is across the other two axes
+					if (!bits[0])
+					{
+						gradient.x += (values[c | 1] - values[c]) * weights[1][bits[1]] * weights[2][bits[2]];
+					}
+					if (!bits[1])
+					{
+						gradient.y += (values[c | 2] - values[c]) * weights[0][bits[0]] * weights[2][bits[2]];
+					}
+					if (!bits[2])
+					{
+						gradient.z += (values[c | 4] - values[c]) * weights[0][bits[0]] * weights[1][bits[1]];
+					}
+				}
+				float length = gradient.Length();
+				mesh.normals[index] = length > 0.0f ? gradient * (-1.0f / length) : Vector3(0.0f, 1.0f, 0.0f);
+			}
+		}
+
+		Vector3 Gradient(int x, int y, int z) const
+		{
+			//central differences, one sided on the edges of the grid
+			int x0 = std::max(x - 1, 0), x1 = std::min(x + 1, m_sizeX - 1);
+			int y0 = std::max(y - 1, 0), y1 = std::min(y + 1, m_sizeY - 1);
+			int z0 = std::max(z - 1, 0), z1 = std::min(z + 1, m_sizeZ - 1);
+			return Vector3(
+				(Sample(x1, y, z) - Sample(x0, y, z)) / (float)std::max(x1 - x0, 1),
+				(Sample(x, y1, z) - Sample(x, y0, z)) / (float)std::max(y1 - y0, 1),
+				(Sample(x, y, z1) - Sample(x, y, z0)) / (float)std::max(z1 - z0, 1));
+		}
+
+		float Sample(int x, int y, int z) const
+		{
+			return m_density[m_planeSize * z + (size_t)y * m_sizeX + x];
+		}
+
+	private:
+		const float* m_density;
+		int m_sizeX, m_sizeY, m_sizeZ;
+		int m_cellsX;
+		size_t m_planeSize;
+		const SurfaceNets::Settings& m_settings;
+	};
+}
+
+bool SurfaceNets::Polygonise(const float* density, int sizeX, int sizeY, int sizeZ, const Settings& settings, MeshData& mesh,
+	int threadCount, Stats* stats)
+{
+	mesh.Clear();
+	if (!density || sizeX < 2 || sizeY < 2 || sizeZ < 2)
+	{
+		return false;
+	}
+
+	Mesher mesher(density, sizeX, sizeY, sizeZ, settings);
+	size_t planeSize = (size_t)sizeX * sizeY;
+	int slabs = sizeZ - 1;
+
+	//count the cells and crossings of every slab
+	std::vector<uint32_t> slabVertices(slabs + 1), slabQuads(slabs + 1);
+	ParallelForRanges(0, slabs, [&](int first, int last)
+	{
+		std::vector<uint8_t> bottom(planeSize), top(planeSize);
+		mesher.Classify(first, bottom);
+		for (int z = first; z < last; z++)
+		{
+			mesher.Classify(z + 1, top);
+			mesher.CountSlab(z, bottom.data(), top.data(), slabVertices[z], slabQuads[z]);
+			bottom.swap(top);
+		}
+	}, threadCount);
+
+	//exclusive prefix sums, entry z is where slab z starts
+	size_t vertexCount = 0, quadCount = 0;
+	for (int z = 0; z <= slabs; z++)
+	{
+		uint32_t vertices = slabVertices[z];
+		uint32_t quads = slabQuads[z];
+		slabVertices[z] = (uint32_t)vertexCount;
+		slabQuads[z] = (uint32_t)quadCount;
+		vertexCount += vertices;
+		quadCount += quads;
+	}
+
+	if (vertexCount > UINT32_MAX || quadCount * 6 > UINT32_MAX)
+	{
+		return false;
+	}
+
+	mesh.positions.resize(vertexCount);
+	if (settings.normals)
+	{
+		mesh.normals.resize(vertexCount);
+	}
+	mesh.indices.resize(quadCount * 6);
+
+	//every block walks its slabs upwards keeping the cell indices of the slab below. the first block's slab
+	//below belongs to the block before it, so that is numbered again without writing its vertices.
+	ParallelForRanges(0, slabs, [&](int first, int last)
+	{
+		std::vector<uint8_t> bottom(planeSize), top(planeSize), extra(planeSize);
+		std::vector<uint32_t> previous(mesher.GetCellPlaneSize()), current(mesher.GetCellPlaneSize());
+
+		mesher.Classify(first, bottom);
+		mesher.Classify(first + 1, top);
+		if (first > 0)
+		{
+			mesher.Classify(first - 1, extra);
+			mesher.FillSlab(first - 1, extra.data(), bottom.data(), slabVertices[first - 1], previous.data(), false, mesh);
+		}
+
+		for (int z = first; z < last; z++)
+		{
+			mesher.FillSlab(z, bottom.data(), top.data(), slabVertices[z], current.data(), true, mesh);
+			mesher.EmitSlab(z, bottom.data(), top.data(), previous.data(), current.data(), slabQuads[z], mesh);
+
+			previous.swap(current);
+			bottom.swap(top);
+			if (z + 2 < sizeZ)
+			{
+				mesher.Classify(z + 2, top);
+			}
+		}
+	}, threadCount);
+
+	//with every vertex in place, each quad is split along its shorter diagonal
+	ParallelForRanges(0, (int)quadCount, [&](int first, int last)
+	{
+		for (int q = first; q < last; q++)
+		{
+			uint32_t* quad = mesh.indices.data() + (size_t)q * 6;
+			uint32_t a = quad[0], b = quad[1], c = quad[2], d = quad[5];
+			if ((mesh.positions[b] - mesh.positions[d]).LengthSquared() < (mesh.positions[a] - mesh.positions[c]).LengthSquared())
+			{
+				quad[0] = a;
+				quad[1] = b;
+				quad[2] = d;
+				quad[3] = b;
+				quad[4] = c;
+				quad[5] = d;
+			}
+		}
+	}, threadCount);
+
+	if (stats)
+	{
+		stats->activeCells = vertexCount;
+		stats->crossings = quadCount;
+		stats->vertices = vertexCount;
+		stats->triangles = quadCount * 2;
+	}
+	return true;
+}
+
+double SurfaceNets::Benchmark(int size, int iterations, Mode mode, int threadCount, Stats* stats)
+{
+	std::vector<float> density;
+	MarchingCubes::BuildBenchmarkVolume(size, density, threadCount);
+
+	Settings settings;
+	settings.mode = mode;
+	MeshData mesh;
+	iterations = std::max(iterations, 1);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		Polygonise(density.data(), size, size, size, settings, mesh, threadCount, stats);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	return std::chrono::duration<double>(end - start).count() / iterations;
+}
+
+size_t SurfaceNets::TestWatertight(int trials, int threadCount)
+{
+	Philox random(48);
+	std::vector<float> density;
+	MeshData mesh;
+	std::unordered_map<uint64_t, int> edges;
+	size_t open = 0;
+
+	for (int trial = 0; trial < trials; trial++)
+	{
+		const int size = 40;
+		BuildTestVolume(random, trial, size, density);
+
+		for (int mode = 0; mode < 2; mode++)
+		{
+			Settings settings;
+			settings.mode = (Mode)mode;
+			settings.isoLevel = (random.GetFloat(2, trial, 0) - 0.5f) * 0.5f;
+			Polygonise(density.data(), size, size, size, settings, mesh, threadCount);
+
+			//vertices are shared by index already (one per cell), so no welding. +1 for u -> v and -1 for v -> u.
+			edges.clear();
+			for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					uint32_t a = mesh.indices[t + k];
+					uint32_t b = mesh.indices[t + (k + 1) % 3];
+					if (a != b)
+					{
+						edges[((uint64_t)std::min(a, b) << 32) | std::max(a, b)] += a < b ? 1 : -1;
+					}
+				}
+			}
+			for (const auto& edge : edges)
+			{
+				open += edge.second != 0 ? 1 : 0;
+			}
+			//an empty mesh would pass trivially
+			open += mesh.indices.empty() ? 1 : 0;
+		}
+	}
+	return open;
+}
+
+size_t SurfaceNets::TestThreadCounts(int trials, int maxThreads)
+{
+	Philox random(148);
+	std::vector<float> density;
+	MeshData reference, mesh;
+	size_t failures = 0;
+
+	for (int trial = 0; trial < trials; trial++)
+	{
+		//an odd size so the slabs don't split evenly
+		const int size = 37;
+		BuildTestVolume(random, trial, size, density);
+
+		for (int mode = 0; mode < 2; mode++)
+		{
+			Settings settings;
+			settings.mode = (Mode)mode;
+			Polygonise(density.data(), size, size, size, settings, reference, 1);
+			for (int threads = 2; threads <= maxThreads; threads++)
+			{
+				Polygonise(density.data(), size, size, size, settings, mesh, threads);
+				bool same = mesh.positions.size() == reference.positions.size() && mesh.normals.size() == reference.normals.size() &&
+					mesh.indices == reference.indices &&
+					memcmp(mesh.positions.data(), reference.positions.data(), mesh.positions.size() * sizeof(Vector3)) == 0 &&
+					memcmp(mesh.normals.data(), reference.normals.data(), mesh.normals.size() * sizeof(Vector3)) == 0;
+				failures += same ? 0 : 1;
+			}
+		}
+	}
+	return failures;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include "MeshData.h"
+
+//Dual meshers over the same density grids as MarchingCubes (x fastest, then y, then z, below the iso level is
+//outside), as a lighter alternative to it.
+//
+//Instead of up to five triangles per cell with their corners on the cell edges, every cell the surface passes
+//through gets one vertex inside it, and every edge the surface crosses gets a quad joining the four cells around
+//it. That is about one vertex per cell and two triangles per crossing, against marching cubes' one vertex per
+//crossing and about two triangles per cell. So the counts end up close to MarchingCubes' shared vertex mesh (and
+//a sixth of the vertices the geometry shader emits), but the thin slivers marching cubes makes where the surface
+//passes near a sample are gone. A cell only ever gets one vertex, so where two sheets of surface squeeze through
+//the same cell (an ambiguous face) they are pinched together there, which marching cubes keeps apart.
+//
+//Naive surface nets puts the cell's vertex at the average of its edge crossings, which smooths everything
+//(corners included). Dual contouring places it where the planes through the crossings (along the density
+//gradient) best meet, the least squares fit of Ju et al.'s QEF solved with a truncated pseudo inverse, so sharp
+//edges and corners in the density survive. Flat stretches, where the planes don't pin a point down, fall back
+//towards the average.
+//
+//The grid is walked in z slabs the same way as MarchingCubes: a first pass counts the cells and crossings of
+//every slab, prefix sums give each slab its place in the output, and the slabs are shared between threads
+//keeping the cell indices of the slab below, so the mesh is the same whatever the thread count.
+
+class SurfaceNets
+{
+public:
+	enum Mode
+	{
+		MODE_SURFACE_NETS = 0,
+		MODE_DUAL_CONTOURING = 1,
+	};
+
+	struct Settings
+	{
+		Mode mode;
+		float isoLevel;
+		DirectX::SimpleMath::Vector3 origin;	//where sample (0, 0, 0) sits
+		float spacing;							//distance between samples
+		bool normals;							//down the density gradient, out of the solid
+		float featureThreshold;					//dual contouring: QEF directions weaker than this share of the strongest are ignored
+
+		Settings() : mode(MODE_SURFACE_NETS), isoLevel(0.0f), origin(0.0f, 0.0f, 0.0f), spacing(1.0f), normals(true), featureThreshold(0.1f) {}
+	};
+
+	struct Stats
+	{
+		size_t activeCells;						//one vertex each
+		size_t crossings;						//one quad each
+		size_t vertices, triangles;
+	};
+
+	static bool Polygonise(const float* density, int sizeX, int sizeY, int sizeZ, const Settings& settings, MeshData& mesh,
+		int threadCount = 0, Stats* stats = nullptr);
+
+	//meshes MarchingCubes::BuildBenchmarkVolume. returns the average seconds per Polygonise.
+	static double Benchmark(int size, int iterations, Mode mode, int threadCount = 0, Stats* stats = nullptr);
+
+	//random closed blobs with noise, both modes. every edge has to be used as often in one direction as in the
+	//other (a pinched cell joins four triangles on an edge, so it can't be exactly two). returns the edges that
+	//aren't, 0 when watertight.
+	static size_t TestWatertight(int trials, int threadCount = 0);
+	//the same blobs with 1 to maxThreads threads, the meshes have to be identical. returns the mismatches.
+	static size_t TestThreadCounts(int trials, int maxThreads = 6);
+};
@@ -2,16 +2,42 @@
 #include "Terrain.h"
 #include "ClassicNoise.h"
 #include "SimplexNoise.h"
+#include "TerrainTileFile.h"
+#include "HeightmapImporter.h"
+#include "MeshExporter.h"
+#include "MeshSimplifier.h"
+#include "Philox.h"
+#include "ParallelFor.h"
+#include <emmintrin.h>
 
 
 Terrain::Terrain()
 {
 	m_terrainGeneratedToggle = false;
+	m_heightFieldSeed = 1;
+	m_latestJob = 0;
+	m_swappedJob = 0;
+	m_cancelBefore = 0;
+	m_stopWorker = false;
+	m_hasFinishedJob = false;
+	m_tileCache = nullptr;
+	m_cacheTileSize = 32;
+	m_rtinValid = false;
+	m_heightsVersion = 0;
+	m_indexFormat = DXGI_FORMAT_R32_UINT;
+	m_compactVertices = false;
+	m_buffersCompact = false;
+	m_buffersDynamic = false;
+	m_vertexBuffer = 0;
+	m_indexBuffer = 0;
+	m_world = DirectX::SimpleMath::Matrix::Identity;
+	m_worldInverse = DirectX::SimpleMath::Matrix::Identity;
 }
 
 
 Terrain::~Terrain()
 {
+	StopAsync();
 }
 
 float waveSpeed = 1.0f;
@@ -33,7 +59,8 @@ bool Terrain::Initialize(ID3D11Device* device, int terrainWidth, int terrainHeig
 	m_wavelength = 1;
 
 	// Create the structure to hold the terrain data.
-	m_heightMap = new HeightMapType[m_terrainWidth * m_terrainHeight];
+	m_heightStorage.resize(m_terrainWidth * m_terrainHeight);
+	m_heightMap = m_heightStorage.data();
 	if (!m_heightMap)
 	{
 		return false;
@@ -46,7 +73,7 @@ bool Terrain::Initialize(ID3D11Device* device, int terrainWidth, int terrainHeig
 	{
 		for (int i = 0; i<m_terrainWidth; i++)
 		{
-			index = (m_terrainHeight * j) + i;
+			index = (m_terrainWidth * j) + i;
 
 			m_heightMap[index].x = (float)i;
 			m_heightMap[index].y = (float)height;
@@ -89,6 +116,11 @@ void Terrain::Render(ID3D11DeviceContext * deviceContext)
 
 
 bool Terrain::CalculateNormals()
+{
+	return CalculateNormals(m_heightMap);
+}
+
+bool Terrain::CalculateNormals(HeightMapType* map)
 {
 	int i, j, index1, index2, index3, index, count;
 	float vertex1[3], vertex2[3], vertex3[3], vector1[3], vector2[3], sum[3], length;
@@ -107,22 +139,22 @@ bool Terrain::CalculateNormals()
 	{
 		for (i = 0; i<(m_terrainWidth - 1); i++)
 		{
-			index1 = (j * m_terrainHeight) + i;
-			index2 = (j * m_terrainHeight) + (i + 1);
-			index3 = ((j + 1) * m_terrainHeight) + i;
+			index1 = (j * m_terrainWidth) + i;
+			index2 = (j * m_terrainWidth) + (i + 1);
+			index3 = ((j + 1) * m_terrainWidth) + i;
 
 			// Get three vertices from the face.
-			vertex1[0] = m_heightMap[index1].x;
-			vertex1[1] = m_heightMap[index1].y;
-			vertex1[2] = m_heightMap[index1].z;
+			vertex1[0] = map[index1].x;
+			vertex1[1] = map[index1].y;
+			vertex1[2] = map[index1].z;
 
-			vertex2[0] = m_heightMap[index2].x;
-			vertex2[1] = m_heightMap[index2].y;
-			vertex2[2] = m_heightMap[index2].z;
+			vertex2[0] = map[index2].x;
+			vertex2[1] = map[index2].y;
+			vertex2[2] = map[index2].z;
 
-			vertex3[0] = m_heightMap[index3].x;
-			vertex3[1] = m_heightMap[index3].y;
-			vertex3[2] = m_heightMap[index3].z;
+			vertex3[0] = map[index3].x;
+			vertex3[1] = map[index3].y;
+			vertex3[2] = map[index3].z;
 
 			// Calculate the two vectors for this face.
 			vector1[0] = vertex1[0] - vertex3[0];
@@ -132,7 +164,7 @@ bool Terrain::CalculateNormals()
 			vector2[1] = vertex3[1] - vertex2[1];
 			vector2[2] = vertex3[2] - vertex2[2];
 
-			index = (j * (m_terrainHeight - 1)) + i;
+			index = (j * (m_terrainWidth - 1)) + i;
 
 			// Calculate the cross product of those two vectors to get the un-normalized value for this face normal.
 			normals[index].x = (vector1[1] * vector2[2]) - (vector1[2] * vector2[1]);
@@ -158,7 +190,7 @@ bool Terrain::CalculateNormals()
 			// Bottom left face.
 			if (((i - 1) >= 0) && ((j - 1) >= 0))
 			{
-				index = ((j - 1) * (m_terrainHeight - 1)) + (i - 1);
+				index = ((j - 1) * (m_terrainWidth - 1)) + (i - 1);
 
 				sum[0] += normals[index].x;
 				sum[1] += normals[index].y;
@@ -169,7 +201,7 @@ bool Terrain::CalculateNormals()
 			// Bottom right face.
 			if ((i < (m_terrainWidth - 1)) && ((j - 1) >= 0))
 			{
-				index = ((j - 1) * (m_terrainHeight - 1)) + i;
+				index = ((j - 1) * (m_terrainWidth - 1)) + i;
 
 				sum[0] += normals[index].x;
 				sum[1] += normals[index].y;
@@ -180,7 +212,7 @@ bool Terrain::CalculateNormals()
 			// Upper left face.
 			if (((i - 1) >= 0) && (j < (m_terrainHeight - 1)))
 			{
-				index = (j * (m_terrainHeight - 1)) + (i - 1);
+				index = (j * (m_terrainWidth - 1)) + (i - 1);
 
 				sum[0] += normals[index].x;
 				sum[1] += normals[index].y;
@@ -191,7 +223,7 @@ bool Terrain::CalculateNormals()
 			// Upper right face.
 			if ((i < (m_terrainWidth - 1)) && (j < (m_terrainHeight - 1)))
 			{
-				index = (j * (m_terrainHeight - 1)) + i;
+				index = (j * (m_terrainWidth - 1)) + i;
 
 				sum[0] += normals[index].x;
 				sum[1] += normals[index].y;
@@ -208,12 +240,12 @@ bool Terrain::CalculateNormals()
 			length = sqrt((sum[0] * sum[0]) + (sum[1] * sum[1]) + (sum[2] * sum[2]));
 
 			// Get an index to the vertex location in the height map array.
-			index = (j * m_terrainHeight) + i;
+			index = (j * m_terrainWidth) + i;
 
 			// Normalize the final shared normal for this vertex and store it in the height map array.
-			m_heightMap[index].nx = (sum[0] / length);
-			m_heightMap[index].ny = (sum[1] / length);
-			m_heightMap[index].nz = (sum[2] / length);
+			map[index].nx = (sum[0] / length);
+			map[index].ny = (sum[1] / length);
+			map[index].nz = (sum[2] / length);
 		}
 	}
 
@@ -245,105 +277,142 @@ void Terrain::Shutdown()
 
 bool Terrain::InitializeBuffers(ID3D11Device * device )
 {
-	VertexType* vertices;
-	unsigned long* indices;
-	D3D11_BUFFER_DESC vertexBufferDesc, indexBufferDesc;
-	D3D11_SUBRESOURCE_DATA vertexData, indexData;
+	//every generator ends up here after changing the heights
+	m_rtinValid = false;
+	m_heightsVersion++;
+	RefreshSamples();
+
+	return CreateGridBuffers(device, false);
+}
+
+bool Terrain::UpdateDynamicBuffers(ID3D11Device* device)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
 	HRESULT result;
-	int index, i, j;
-	int index1, index2, index3, index4; //geometric indices. 
 
-	// Calculate the number of vertices in the terrain mesh.
-	m_vertexCount = (m_terrainWidth - 1) * (m_terrainHeight - 1) * 6;
+	m_rtinValid = false;
+	m_heightsVersion++;
+	RefreshSamples();
 
-	// Set the index count to the same as the vertex count.
-	m_indexCount = m_vertexCount;
+	//the buffers are only made once, after that the vertices are rewritten in place every frame
+	if (!m_buffersDynamic || m_buffersCompact != m_compactVertices)
+	{
+		if (!CreateGridBuffers(device, true))
+		{
+			return false;
+		}
+	}
 
-	// Create the vertex array.
-	vertices = new VertexType[m_vertexCount];
-	if (!vertices)
+	device->GetImmediateContext(context.GetAddressOf());
+	result = context->Map(m_vertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+	if (FAILED(result))
 	{
 		return false;
 	}
 
-	// Create the index array.
-	indices = new unsigned long[m_indexCount];
-	if (!indices)
+	if (m_buffersCompact)
 	{
-		return false;
+		EncodeCompactVertices((CompactVertexType*)mapped.pData);
+	}
+	else
+	{
+		FillGridVertices((VertexType*)mapped.pData);
 	}
 
-	// Initialize the index to the vertex buffer.
-	index = 0;
+	context->Unmap(m_vertexBuffer, 0);
+	return true;
+}
 
-	for (j = 0; j<(m_terrainHeight - 1); j++)
+bool Terrain::CreateGridBuffers(ID3D11Device* device, bool dynamic)
+{
+	D3D11_BUFFER_DESC vertexBufferDesc, indexBufferDesc;
+	D3D11_SUBRESOURCE_DATA vertexData, indexData;
+	HRESULT result;
+	int index1, index2, index3, index4; //geometric indices. 
+
+	//the old buffers go first, otherwise every rebuild leaks a pair
+	Shutdown();
+	bool compact = m_compactVertices;
+
+	std::vector<VertexType> vertices;
+	std::vector<CompactVertexType> compactVertices;
+	std::vector<uint32_t> indices;
+
+	if (compact)
 	{
-		for (i = 0; i<(m_terrainWidth - 1); i++)
+		//one shared vertex per grid point, the shader works out x / z / uv from its index
+		m_vertexCount = m_terrainWidth * m_terrainHeight;
+		m_indexCount = (m_terrainWidth - 1) * (m_terrainHeight - 1) * 6;
+
+		//same winding as the full size grid
+		indices.reserve(m_indexCount);
+		for (int j = 0; j < (m_terrainHeight - 1); j++)
+		{
+			for (int i = 0; i < (m_terrainWidth - 1); i++)
+			{
+				index1 = (m_terrainWidth * j) + i;          // Bottom left.
+				index2 = (m_terrainWidth * j) + (i + 1);      // Bottom right.
+				index3 = (m_terrainWidth * (j + 1)) + i;      // Upper left.
+				index4 = (m_terrainWidth * (j + 1)) + (i + 1);  // Upper right.
+
+				indices.push_back(index3);
+				indices.push_back(index4);
+				indices.push_back(index1);
+				indices.push_back(index1);
+				indices.push_back(index4);
+				indices.push_back(index2);
+			}
+		}
+
+		if (!dynamic)
 		{
-			index1 = (m_terrainHeight * j) + i;          // Bottom left.
-			index2 = (m_terrainHeight * j) + (i + 1);      // Bottom right.
-			index3 = (m_terrainHeight * (j + 1)) + i;      // Upper left.
-			index4 = (m_terrainHeight * (j + 1)) + (i + 1);  // Upper right.
-
-															 // Upper left.
-			vertices[index].position = DirectX::SimpleMath::Vector3(m_heightMap[index3].x, m_heightMap[index3].y, m_heightMap[index3].z);
-			vertices[index].normal = DirectX::SimpleMath::Vector3(m_heightMap[index3].nx, m_heightMap[index3].ny, m_heightMap[index3].nz);
-			vertices[index].texture = DirectX::SimpleMath::Vector2(m_heightMap[index3].u, m_heightMap[index3].v);
-			indices[index] = index;
-			index++;
-
-			// Upper right.
-			vertices[index].position = DirectX::SimpleMath::Vector3(m_heightMap[index4].x, m_heightMap[index4].y, m_heightMap[index4].z);
-			vertices[index].normal = DirectX::SimpleMath::Vector3(m_heightMap[index4].nx, m_heightMap[index4].ny, m_heightMap[index4].nz);
-			vertices[index].texture = DirectX::SimpleMath::Vector2(m_heightMap[index4].u, m_heightMap[index4].v);
-			indices[index] = index;
-			index++;
-
-			// Bottom left.
-			vertices[index].position = DirectX::SimpleMath::Vector3(m_heightMap[index1].x, m_heightMap[index1].y, m_heightMap[index1].z);
-			vertices[index].normal = DirectX::SimpleMath::Vector3(m_heightMap[index1].nx, m_heightMap[index1].ny, m_heightMap[index1].nz);
-			vertices[index].texture = DirectX::SimpleMath::Vector2(m_heightMap[index1].u, m_heightMap[index1].v);
-			indices[index] = index;
-			index++;
-
-			// Bottom left.
-			vertices[index].position = DirectX::SimpleMath::Vector3(m_heightMap[index1].x, m_heightMap[index1].y, m_heightMap[index1].z);
-			vertices[index].normal = DirectX::SimpleMath::Vector3(m_heightMap[index1].nx, m_heightMap[index1].ny, m_heightMap[index1].nz);
-			vertices[index].texture = DirectX::SimpleMath::Vector2(m_heightMap[index1].u, m_heightMap[index1].v);
-			indices[index] = index;
-			index++;
-
-			// Upper right.
-			vertices[index].position = DirectX::SimpleMath::Vector3(m_heightMap[index4].x, m_heightMap[index4].y, m_heightMap[index4].z);
-			vertices[index].normal = DirectX::SimpleMath::Vector3(m_heightMap[index4].nx, m_heightMap[index4].ny, m_heightMap[index4].nz);
-			vertices[index].texture = DirectX::SimpleMath::Vector2(m_heightMap[index4].u, m_heightMap[index4].v);
-			indices[index] = index;
-			index++;
-
-			// Bottom right.
-			vertices[index].position = DirectX::SimpleMath::Vector3(m_heightMap[index2].x, m_heightMap[index2].y, m_heightMap[index2].z);
-			vertices[index].normal = DirectX::SimpleMath::Vector3(m_heightMap[index2].nx, m_heightMap[index2].ny, m_heightMap[index2].nz);
-			vertices[index].texture = DirectX::SimpleMath::Vector2(m_heightMap[index2].u, m_heightMap[index2].v);
-			indices[index] = index;
-			index++;
+			compactVertices.resize(m_vertexCount);
+			EncodeCompactVertices(compactVertices.data());
 		}
 	}
+	else
+	{
+		//six unshared vertices per square
+		m_vertexCount = (m_terrainWidth - 1) * (m_terrainHeight - 1) * 6;
+		m_indexCount = m_vertexCount;
 
-	// Set up the description of the static vertex buffer.
-	vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	vertexBufferDesc.ByteWidth = sizeof(VertexType) * m_vertexCount;
+		indices.resize(m_indexCount);
+		for (int i = 0; i < m_indexCount; i++)
+		{
+			indices[i] = i;
+		}
+
+		if (!dynamic)
+		{
+			vertices.resize(m_vertexCount);
+			FillGridVertices(vertices.data());
+		}
+	}
+
+	//written straight as 16 bit when the grid is small enough
+	std::vector<uint16_t> shortIndices;
+	bool shortFormat = compact && m_vertexCount <= 65536;
+	if (shortFormat)
+	{
+		shortIndices.assign(indices.begin(), indices.end());
+	}
+
+	// Set up the description of the vertex buffer, dynamic ones are filled with Map.
+	vertexBufferDesc.Usage = dynamic ? D3D11_USAGE_DYNAMIC : D3D11_USAGE_DEFAULT;
+	vertexBufferDesc.ByteWidth = (compact ? sizeof(CompactVertexType) : sizeof(VertexType)) * m_vertexCount;
 	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	vertexBufferDesc.CPUAccessFlags = 0;
+	vertexBufferDesc.CPUAccessFlags = dynamic ? D3D11_CPU_ACCESS_WRITE : 0;
 	vertexBufferDesc.MiscFlags = 0;
 	vertexBufferDesc.StructureByteStride = 0;
 
 	// Give the subresource structure a pointer to the vertex data.
-	vertexData.pSysMem = vertices;
+	vertexData.pSysMem = compact ? (const void*)compactVertices.data() : (const void*)vertices.data();
 	vertexData.SysMemPitch = 0;
 	vertexData.SysMemSlicePitch = 0;
 
 	// Now create the vertex buffer.
-	result = device->CreateBuffer(&vertexBufferDesc, &vertexData, &m_vertexBuffer);
+	result = device->CreateBuffer(&vertexBufferDesc, dynamic ? nullptr : &vertexData, &m_vertexBuffer);
 	if (FAILED(result))
 	{
 		return false;
@@ -351,14 +420,14 @@ bool Terrain::InitializeBuffers(ID3D11Device * device )
 
 	// Set up the description of the static index buffer.
 	indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	indexBufferDesc.ByteWidth = sizeof(unsigned long) * m_indexCount;
+	indexBufferDesc.ByteWidth = (shortFormat ? sizeof(uint16_t) : sizeof(uint32_t)) * m_indexCount;
 	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
 	indexBufferDesc.CPUAccessFlags = 0;
 	indexBufferDesc.MiscFlags = 0;
 	indexBufferDesc.StructureByteStride = 0;
 
 	// Give the subresource structure a pointer to the index data.
-	indexData.pSysMem = indices;
+	indexData.pSysMem = shortFormat ? (const void*)shortIndices.data() : (const void*)indices.data();
 	indexData.SysMemPitch = 0;
 	indexData.SysMemSlicePitch = 0;
 
@@ -369,14 +438,75 @@ bool Terrain::InitializeBuffers(ID3D11Device * device )
 		return false;
 	}
 
-	// Release the arrays now that the vertex and index buffers have been created and loaded.
-	delete[] vertices;
-	vertices = 0;
+	m_indexFormat = shortFormat ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+	m_buffersCompact = compact;
+	m_buffersDynamic = dynamic;
+	return true;
+}
 
-	delete[] indices;
-	indices = 0;
+void Terrain::FillGridVertices(VertexType* vertices) const
+{
+	int index, i, j;
+	int index1, index2, index3, index4; //geometric indices. 
 
-	return true;
+	// Initialize the index to the vertex buffer.
+	index = 0;
+
+	for (j = 0; j<(m_terrainHeight - 1); j++)
+	{
+		for (i = 0; i<(m_terrainWidth - 1); i++)
+		{
+			index1 = (m_terrainWidth * j) + i;          // Bottom left.
+			index2 = (m_terrainWidth * j) + (i + 1);      // Bottom right.
+			index3 = (m_terrainWidth * (j + 1)) + i;      // Upper left.
+			index4 = (m_terrainWidth * (j + 1)) + (i + 1);  // Upper right.
+
+			//upper left, upper right, bottom left, bottom left, upper right, bottom right
+			const int corners[6] = { index3, index4, index1, index1, index4, index2 };
+			for (int k = 0; k < 6; k++)
+			{
+				const HeightMapType& point = m_heightMap[corners[k]];
+				vertices[index].position = DirectX::SimpleMath::Vector3(point.x, point.y, point.z);
+				vertices[index].normal = DirectX::SimpleMath::Vector3(point.nx, point.ny, point.nz);
+				vertices[index].texture = DirectX::SimpleMath::Vector2(point.u, point.v);
+				index++;
+			}
+		}
+	}
+}
+
+void Terrain::EncodeCompactVertices(CompactVertexType* vertices)
+{
+	int count = m_terrainWidth * m_terrainHeight;
+	std::vector<float> heights(count);
+	for (int i = 0; i < count; i++)
+	{
+		heights[i] = m_heightMap[i].y;
+	}
+
+	//the whole terrain is quantised as one chunk
+	CompactVertex::ComputeHeightRange(heights.data(), heights.size(), m_compactParams);
+	m_compactParams.gridWidth = m_terrainWidth;	//row stride of the height map
+	m_compactParams.uvStep = m_heightMap[1].u - m_heightMap[0].u;
+
+	std::vector<DirectX::SimpleMath::Vector3> normals(count);
+	for (int i = 0; i < count; i++)
+	{
+		normals[i] = DirectX::SimpleMath::Vector3(m_heightMap[i].nx, m_heightMap[i].ny, m_heightMap[i].nz);
+		vertices[i] = CompactVertex::Encode(heights[i], normals[i], m_compactParams);
+	}
+
+#ifdef _DEBUG
+	//decode everything straight back, the shader sees exactly this
+	float worstHeight, worstNormal;
+	if (!CompactVertex::VerifyRoundTrip(heights.data(), normals.data(), heights.size(), m_compactParams, 0.05f, &worstHeight, &worstNormal))
+	{
+		char buff[128] = {};
+		sprintf_s(buff, sizeof(buff), "Compact terrain vertices off by up to %g in height, %g degrees in normal\n", worstHeight, worstNormal);
+		OutputDebugStringA(buff);
+		assert(false);
+	}
+#endif
 }
 
 void Terrain::RenderBuffers(ID3D11DeviceContext * deviceContext)
@@ -385,14 +515,14 @@ void Terrain::RenderBuffers(ID3D11DeviceContext * deviceContext)
 	unsigned int offset;
 
 	// Set vertex buffer stride and offset.
-	stride = sizeof(VertexType);
+	stride = m_buffersCompact ? sizeof(CompactVertexType) : sizeof(VertexType);
 	offset = 0;
 
 	// Set the vertex buffer to active in the input assembler so it can be rendered.
 	deviceContext->IASetVertexBuffers(0, 1, &m_vertexBuffer, &stride, &offset);
 
 	// Set the index buffer to active in the input assembler so it can be rendered.
-	deviceContext->IASetIndexBuffer(m_indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	deviceContext->IASetIndexBuffer(m_indexBuffer, m_indexFormat, 0);
 
 	// Set the type of primitive that should be rendered from this vertex buffer, in this case triangles.
 	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
@@ -404,32 +534,21 @@ int Terrain::GenerateHeightField(ID3D11Device* device)
 {
 	bool result;
 
-	int index;
-	float height = 0.0;
 	float totalHeight = 0.0f;
-	double b;
 
 	//m_frequency = (6.283 / m_terrainHeight) / m_wavelength; //we want a wavelength of 1 to be a single wave over the whole terrain.  A single wave is 2 pi which is about 6.283
 
-	//loop through the terrain and set the heights how we want. This is where we generate the terrain
-	//in this case I will run a sin-wave through the terrain in one axis.
+	//every sample is keyed on its own grid position, so any seed always gives the same field.
+	//each press moves on to the next seed.
+	GeneratorSettings settings;
+	settings.seed = m_heightFieldSeed++;
+	result = RunGenerator(GENERATOR_RANDOM, m_heightMap, settings);
 
-	for (int j = 0; j < m_terrainHeight; j++)
+	for (int index = 0; index < m_terrainWidth * m_terrainHeight; index++)
 	{
-		for (int i = 0; i < m_terrainWidth; i++)
-		{
-			index = (m_terrainHeight * j) + i;
-
-			m_heightMap[index].x = (float)i;
-			m_heightMap[index].y = (float)((rand() % 10)/2);
-			totalHeight += m_heightMap[index].y;
-			m_heightMap[index].z = (float)j;
-
-		}
+		totalHeight += m_heightMap[index].y;
 	}
-	return (totalHeight / index);
 
-	result = CalculateNormals();
 	if (!result)
 	{
 		return false;
@@ -440,6 +559,55 @@ int Terrain::GenerateHeightField(ID3D11Device* device)
 	{
 		return false;
 	}
+
+	return (int)(totalHeight / (m_terrainWidth * m_terrainHeight));
+}
+
+bool Terrain::GenerateDiamondSquare(ID3D11Device* device, float roughness, bool wrap, DiamondSquare::Mode mode)
+{
+	bool result;
+
+	//subdivision works on a * 2^n + 1 by b * 2^n + 1 points. the coarse spacing is the largest power of two that
+	//fits in the shorter side, and each side is rounded up to a whole number of coarse squares plus one. a grid
+	//that already has that layout is used as it is. one that is a whole number of squares gets one extra row and
+	//column, which with wrap repeat the first ones, so dropping them still tiles seamlessly.
+	int step = 1;
+	while (step * 2 <= std::min(m_terrainWidth, m_terrainHeight) - 1)
+	{
+		step *= 2;
+	}
+	int width = (m_terrainWidth - 1 + step - 1) / step * step + 1;
+	int height = (m_terrainHeight - 1 + step - 1) / step * step + 1;
+
+	DiamondSquare::Settings settings;
+	settings.mode = mode;
+	settings.amplitude = m_amplitude;
+	settings.roughness = roughness;
+	settings.wrap = wrap;
+	settings.seed = m_heightFieldSeed++;
+
+	std::vector<float> heights(width * height);
+	if (!DiamondSquare::Generate(heights.data(), width, height, settings))
+	{
+		return false;
+	}
+
+	for (int j = 0; j < m_terrainHeight; j++)
+	{
+		for (int i = 0; i < m_terrainWidth; i++)
+		{
+			int index = (m_terrainWidth * j) + i;
+			m_heightMap[index].y = heights[(width * j) + i];
+		}
+	}
+
+	result = CalculateNormals();
+	if (!result)
+	{
+		return false;
+	}
+
+	return InitializeBuffers(device);
 }
 
 bool Terrain::GenerateHeightMap(ID3D11Device* device)
@@ -464,18 +632,10 @@ bool Terrain::GenerateHeightMap(ID3D11Device* device)
 
 	waveSpeed = m_frequency * deltaTime;
 
-
-	for (int j = 0; j<m_terrainHeight; j++)
-	{
-		for (int i = 0; i<m_terrainWidth; i++)
-		{
-			index = (m_terrainHeight * j) + i;
-
-			//m_heightMap[index].x = (float)i;
-			m_heightMap[index].y = (float)(sin((float)i *(waveSpeed))*m_amplitude); 
-			//m_heightMap[index].z = (float)j;
-		}
-	}
+	GeneratorSettings settings;
+	settings.waveSpeed = waveSpeed;
+	settings.amplitude = m_amplitude;
+	result = RunGenerator(GENERATOR_WAVES, m_heightMap, settings);
 	//m_amplitude += waveSpeed * deltaTime;    // Adjust amplitude over time
 
 
@@ -484,7 +644,6 @@ bool Terrain::GenerateHeightMap(ID3D11Device* device)
 	//GeneratePerlinNoise(device);
  
 
- 	result = CalculateNormals();
 	if (!result)
 	{
 		return false;
@@ -509,7 +668,7 @@ bool Terrain::SmoothTerrain(ID3D11Device* device)
 	{
 		for (int i = 0; i < m_terrainWidth; i++)
 		{
-			index = (m_terrainHeight * j) + i;
+			index = (m_terrainWidth * j) + i;
 				if(m_heightMap[index].y <= averageHeight)
 				{
 					m_heightMap[index].y += 0.1f;
@@ -548,19 +707,7 @@ bool Terrain::GeneratePerlinNoise(ID3D11Device* device)
 	//loop through the terrain and set the hieghts how we want. This is where we generate the terrain
 	//in this case I will run a sin-wave through the terrain in one axis.
 	
-	for (int j = 0; j < m_terrainHeight; j++)
-	{
-		for (int i = 0; i < m_terrainWidth; i++)
-		{
-			index = (m_terrainHeight * j) + i;
-
-			double f = ClassicNoise::noise((double)j / 10,(double)i / 10, 1);
-			m_heightMap[index].y += f;
-			//m_heightMap[index].z = (float)j;
-		}
-	}
-
-	result = CalculateNormals();
+	result = RunGenerator(GENERATOR_PERLIN, m_heightMap, GeneratorSettings());
 	if (!result)
 	{
 		return false;
@@ -587,19 +734,7 @@ bool Terrain::GenerateSimplexNoise(ID3D11Device* device)
 	//loop through the terrain and set the hieghts how we want. This is where we generate the terrain
 	//in this case I will run a sin-wave through the terrain in one axis.
 
-	for (int j = 0; j < m_terrainHeight; j++)
-	{
-		for (int i = 0; i < m_terrainWidth; i++)
-		{
-			index = (m_terrainHeight * j) + i;
-
-			double f = SimplexNoise::nNoise((double)j / 10, (double)i / 10, 1);
-			m_heightMap[index].y += f;
-			//m_heightMap[index].z = (float)j;
-		}
-	}
-
-	result = CalculateNormals();
+	result = RunGenerator(GENERATOR_SIMPLEX, m_heightMap, GeneratorSettings());
 	if (!result)
 	{
 		return false;
@@ -619,6 +754,981 @@ bool Terrain::Update(ID3D11Device* device)
 	return true; 
 }
 
+bool Terrain::FillGenerator(Generator generator, HeightMapType* map, const GeneratorSettings& settings, const std::function<bool()>& cancelled)
+{
+	Philox random(settings.seed);
+	std::atomic<bool> stopped(false);
+
+	//rows are independent for every generator, so they are split across threads.
+	//cancellation is checked once a row, which is often enough to drop a stale job within a frame.
+	ParallelForRanges(0, m_terrainHeight, [&](int first, int last)
+	{
+		std::vector<uint32_t> values(generator == GENERATOR_RANDOM ? m_terrainWidth : 0);
+		for (int j = first; j < last; j++)
+		{
+			if (stopped || (cancelled && cancelled()))
+			{
+				stopped = true;
+				return;
+			}
+
+			if (generator == GENERATOR_RANDOM)
+			{
+				random.FillGrid(values.data(), 0, j, m_terrainWidth, 1);
+			}
+
+			for (int i = 0; i < m_terrainWidth; i++)
+			{
+				int index = (m_terrainWidth * j) + i;
+				switch (generator)
+				{
+				case GENERATOR_PERLIN:
+					map[index].y += (float)ClassicNoise::noise((double)j / 10, (double)i / 10, 1);
+					break;
+				case GENERATOR_SIMPLEX:
+					map[index].y += (float)SimplexNoise::nNoise((double)j / 10, (double)i / 10, 1);
+					break;
+				case GENERATOR_WAVES:
+					map[index].y = (float)(sin((float)i * settings.waveSpeed) * settings.amplitude);
+					break;
+				case GENERATOR_RANDOM:
+					map[index].x = (float)i;
+					map[index].y = (float)((values[i] % 10) / 2);
+					map[index].z = (float)j;
+					break;
+				}
+			}
+		}
+	});
+
+	return !stopped;
+}
+
+bool Terrain::RunGenerator(Generator generator, HeightMapType* map, const GeneratorSettings& settings, const std::function<bool()>& cancelled)
+{
+	if (!m_tileCache)
+	{
+		if (!FillGenerator(generator, map, settings, cancelled))
+		{
+			return false;
+		}
+		return CalculateNormals(map);
+	}
+
+	uint64_t config = GetGeneratorHash(generator, map, settings);
+	int tileSize = m_cacheTileSize;
+	int tilesX = (m_terrainWidth + tileSize - 1) / tileSize;
+	int tilesZ = (m_terrainHeight + tileSize - 1) / tileSize;
+
+	//the normals along a tile's edge depend on the tiles either side, so it's all the tiles or run the generator.
+	//the lookup stops at the first miss, a tile found before that doesn't need storing again afterwards.
+	std::vector<TerrainTileCache::Tile> tiles(tilesX * tilesZ);
+	std::vector<bool> found(tilesX * tilesZ, false);
+	bool complete = true;
+	for (int t = 0; t < tilesX * tilesZ && complete; t++)
+	{
+		int tileX = t % tilesX, tileZ = t / tilesX;
+		int width = std::min(tileSize, m_terrainWidth - tileX * tileSize);
+		int height = std::min(tileSize, m_terrainHeight - tileZ * tileSize);
+		found[t] = m_tileCache->Find(TerrainTileCache::TileKey(config, tileX, tileZ), tiles[t]) &&
+			tiles[t].width == (uint32_t)width && tiles[t].height == (uint32_t)height;
+		complete = found[t];
+	}
+
+	if (!complete)
+	{
+		if (!FillGenerator(generator, map, settings, cancelled) || !CalculateNormals(map))
+		{
+			return false;
+		}
+	}
+
+	for (int t = 0; t < tilesX * tilesZ; t++)
+	{
+		int tileX = t % tilesX, tileZ = t / tilesX;
+		TerrainTileCache::Tile& tile = tiles[t];
+		if (!found[t])
+		{
+			tile.width = std::min(tileSize, m_terrainWidth - tileX * tileSize);
+			tile.height = std::min(tileSize, m_terrainHeight - tileZ * tileSize);
+			tile.heights.resize(tile.width * tile.height);
+			tile.normals.resize(tile.width * tile.height * 3);
+		}
+
+		for (uint32_t z = 0; z < tile.height; z++)
+		{
+			for (uint32_t x = 0; x < tile.width; x++)
+			{
+				int index = (m_terrainWidth * (tileZ * tileSize + z)) + tileX * tileSize + x;
+				size_t sample = z * tile.width + x;
+				if (complete)
+				{
+					map[index].y = tile.heights[sample];
+					map[index].nx = tile.normals[sample * 3 + 0];
+					map[index].ny = tile.normals[sample * 3 + 1];
+					map[index].nz = tile.normals[sample * 3 + 2];
+				}
+				else if (!found[t])
+				{
+					tile.heights[sample] = map[index].y;
+					tile.normals[sample * 3 + 0] = map[index].nx;
+					tile.normals[sample * 3 + 1] = map[index].ny;
+					tile.normals[sample * 3 + 2] = map[index].nz;
+				}
+			}
+		}
+
+		if (!found[t])
+		{
+			m_tileCache->Store(TerrainTileCache::TileKey(config, tileX, tileZ), tile);
+		}
+	}
+
+	return true;
+}
+
+uint64_t Terrain::GetGeneratorHash(Generator generator, const HeightMapType* map, const GeneratorSettings& settings) const
+{
+	//bump this when a generator changes, so tiles cached by the old code stop matching
+	const uint32_t GENERATOR_VERSION = 1;
+
+	//only the settings a generator actually reads go in, otherwise the sync and async paths
+	//(which fill the unused ones differently) would never share tiles
+	struct
+	{
+		uint32_t version;
+		uint32_t generator;
+		int32_t width, height, tileSize;
+		float waveSpeed, amplitude;
+		uint32_t seed;
+	} key;
+	memset(&key, 0, sizeof(key));
+	key.version = GENERATOR_VERSION;
+	key.generator = (uint32_t)generator;
+	key.width = m_terrainWidth;
+	key.height = m_terrainHeight;
+	key.tileSize = m_cacheTileSize;
+	if (generator == GENERATOR_WAVES)
+	{
+		key.waveSpeed = settings.waveSpeed;
+		key.amplitude = settings.amplitude;
+	}
+	if (generator == GENERATOR_RANDOM)
+	{
+		key.seed = settings.seed;
+	}
+
+	uint64_t hash = TerrainTileCache::Hash(&key, sizeof(key));
+
+	//perlin and simplex add onto whatever is there, so the starting heights are part of the configuration
+	if (generator == GENERATOR_PERLIN || generator == GENERATOR_SIMPLEX)
+	{
+		std::vector<float> heights(m_terrainWidth * m_terrainHeight);
+		for (size_t i = 0; i < heights.size(); i++)
+		{
+			heights[i] = map[i].y;
+		}
+		hash = TerrainTileCache::Hash(heights.data(), heights.size() * sizeof(float), hash);
+	}
+
+	return hash;
+}
+
+void Terrain::SetTileCache(TerrainTileCache* cache, int tileSize)
+{
+	m_tileCache = cache;
+	m_cacheTileSize = std::max(1, tileSize);
+}
+
+void Terrain::GenerateAsync(Generator generator)
+{
+	//the job starts from whatever is on screen now, which is what the synchronous versions build on too.
+	//perlin and simplex add onto the heights though, so while an earlier job is still on its way they
+	//build on its result instead, otherwise its contribution would be lost when this one is swapped in.
+	bool additive = generator == GENERATOR_PERLIN || generator == GENERATOR_SIMPLEX;
+	GeneratorJob job;
+	job.generator = generator;
+	job.chained = additive && IsGenerating();
+	job.serial = ++m_latestJob;
+	job.heights.assign(m_heightMap, m_heightMap + m_terrainWidth * m_terrainHeight);
+	job.settings.amplitude = m_amplitude;
+	if (generator == GENERATOR_WAVES)
+	{
+		//same steps as Update, the frequency bookkeeping stays on this thread
+		m_frequency += 0.01f;
+		if (m_frequency >= 1.0f)
+		{
+			m_frequency = 0.3f;
+		}
+		waveSpeed = m_frequency * deltaTime;
+		job.settings.waveSpeed = waveSpeed;
+	}
+	if (generator == GENERATOR_RANDOM)
+	{
+		job.settings.seed = m_heightFieldSeed++;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_jobMutex);
+		//anything else replaces the whole map, so everything before it, waiting or running, is pointless
+		if (!additive)
+		{
+			m_pendingJobs.clear();
+			m_cancelBefore = job.serial;
+		}
+		m_pendingJobs.push_back(std::move(job));
+	}
+	m_jobSignal.notify_one();
+
+	if (!m_worker.joinable())
+	{
+		m_stopWorker = false;
+		m_worker = std::thread(&Terrain::WorkerLoop, this);
+	}
+}
+
+void Terrain::WorkerLoop()
+{
+	for (;;)
+	{
+		GeneratorJob job;
+		{
+			std::unique_lock<std::mutex> lock(m_jobMutex);
+			m_jobSignal.wait(lock, [this]() { return m_stopWorker || !m_pendingJobs.empty(); });
+			if (m_stopWorker)
+			{
+				return;
+			}
+			job = std::move(m_pendingJobs.front());
+			m_pendingJobs.pop_front();
+		}
+
+		//the jobs run in order, so the last result is the one a chained job was queued behind
+		if (job.chained && m_chainHeights.size() == job.heights.size())
+		{
+			job.heights = m_chainHeights;
+		}
+
+		//a newer job that replaces the whole map makes this one pointless, so it gives up at the next row
+		unsigned int serial = job.serial;
+		auto superseded = [this, serial]() { return m_stopWorker || serial < m_cancelBefore; };
+		if (!RunGenerator(job.generator, job.heights.data(), job.settings, superseded))
+		{
+			continue;
+		}
+		m_chainHeights = job.heights;
+
+		//a result with more chained behind it is still swapped in, the next one just replaces it
+		std::lock_guard<std::mutex> lock(m_jobMutex);
+		if (serial >= m_cancelBefore)
+		{
+			m_finishedJob = std::move(job);
+			m_hasFinishedJob = true;
+		}
+	}
+}
+
+bool Terrain::UpdateAsync(ID3D11Device* device)
+{
+	//the worker only holds the lock to hand jobs over, but if it has it right now the swap waits for next frame
+	std::unique_lock<std::mutex> lock(m_jobMutex, std::try_to_lock);
+	if (!lock.owns_lock() || !m_hasFinishedJob)
+	{
+		return false;
+	}
+
+	//a job that replaces the whole map may have been queued after this one finished, then it's already stale
+	if (m_finishedJob.serial < m_cancelBefore)
+	{
+		m_hasFinishedJob = false;
+		return false;
+	}
+
+	//the finished heights become the front buffer, the old front goes back to the job to be reused
+	m_swappedJob = m_finishedJob.serial;
+	std::swap(m_heightStorage, m_finishedJob.heights);
+	m_heightMap = m_heightStorage.data();
+	m_hasFinishedJob = false;
+	lock.unlock();
+
+	return InitializeBuffers(device);
+}
+
+bool Terrain::IsGenerating() const
+{
+	return m_latestJob != m_swappedJob;
+}
+
+void Terrain::StopAsync()
+{
+	if (!m_worker.joinable())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_jobMutex);
+		m_stopWorker = true;
+	}
+	m_jobSignal.notify_one();
+	m_worker.join();
+}
+
+bool Terrain::ApplyOcean(ID3D11Device* device, const OceanFFT& ocean, float heightScale)
+{
+	int index;
+	float height;
+	DirectX::SimpleMath::Vector2 displacement, unused;
+	DirectX::SimpleMath::Vector3 normal;
+
+	//one grid unit is one ocean unit, so the ocean tile repeats every GetPatchSize() squares
+	for (int j = 0; j < m_terrainHeight; j++)
+	{
+		for (int i = 0; i < m_terrainWidth; i++)
+		{
+			index = (m_terrainWidth * j) + i;
+
+			//the choppy displacement moves water sideways, rather than moving our vertices we look up
+			//whatever ended up over this grid point, which keeps the grid regular
+			ocean.Sample((float)i, (float)j, height, displacement, normal);
+			ocean.Sample((float)i - displacement.x, (float)j - displacement.y, height, unused, normal);
+
+			//scaling the heights scales the slopes too
+			normal.x *= heightScale;
+			normal.z *= heightScale;
+			normal.Normalize();
+
+			m_heightMap[index].y = height * heightScale;
+			m_heightMap[index].nx = normal.x;
+			m_heightMap[index].ny = normal.y;
+			m_heightMap[index].nz = normal.z;
+		}
+	}
+
+	//the ocean already has exact normals, no need for CalculateNormals.
+	//it changes every frame, so the vertices are rewritten in place rather than rebuilt
+	return UpdateDynamicBuffers(device);
+}
+
+bool Terrain::ApplyWaterSurface(ID3D11Device* device, const ShallowWater& water, float verticalOffset)
+{
+	int index;
+	bool result;
+
+	if (water.GetWidth() != m_terrainWidth || water.GetHeight() != m_terrainHeight)
+	{
+		return false;
+	}
+
+	//verticalOffset moves the surface from the ground's space into ours (the two terrains are drawn at different heights).
+	//dry cells are tucked just under the ground so they don't show.
+	const float* depth = water.GetDepth();
+	const float* ground = water.GetTerrain();
+	for (int j = 0; j < m_terrainHeight; j++)
+	{
+		for (int i = 0; i < m_terrainWidth; i++)
+		{
+			index = (m_terrainWidth * j) + i;
+			int cell = (m_terrainWidth * j) + i;
+			float surface = depth[cell] > 0.01f ? ground[cell] + depth[cell] : ground[cell] - 0.5f;
+			m_heightMap[index].y = surface + verticalOffset;
+		}
+	}
+
+	result = CalculateNormals();
+	if (!result)
+	{
+		return false;
+	}
+
+	//runs every frame, like the ocean
+	return UpdateDynamicBuffers(device);
+}
+
+void Terrain::GetHeights(float* heights) const
+{
+	for (int j = 0; j < m_terrainHeight; j++)
+	{
+		for (int i = 0; i < m_terrainWidth; i++)
+		{
+			heights[(m_terrainWidth * j) + i] = m_heightMap[(m_terrainWidth * j) + i].y;
+		}
+	}
+}
+
+bool Terrain::CarveRivers(ID3D11Device* device, float threshold, float depth)
+{
+	bool result;
+	int count = m_terrainWidth * m_terrainHeight;
+
+	std::vector<float> heights(count);
+	GetHeights(heights.data());
+
+	std::vector<int> receivers(count);
+	std::vector<float> accumulation(count);
+	Hydrology::FillDepressions(heights.data(), m_terrainWidth, m_terrainHeight, heights.data());
+	Hydrology::FlowDirectionsD8(heights.data(), m_terrainWidth, m_terrainHeight, receivers.data());
+	Hydrology::FlowAccumulationD8(receivers.data(), m_terrainWidth, m_terrainHeight, nullptr, accumulation.data());
+
+	//the cut deepens with the log of the flow, which only grows downstream, so the channels still run downhill
+	for (int j = 0; j < m_terrainHeight; j++)
+	{
+		for (int i = 0; i < m_terrainWidth; i++)
+		{
+			float flow = accumulation[(m_terrainWidth * j) + i];
+			float cut = flow > threshold ? std::min(log2f(flow / threshold) * 0.25f, 1.0f) * depth : 0.0f;
+			m_heightMap[(m_terrainWidth * j) + i].y = heights[(m_terrainWidth * j) + i] - cut;
+		}
+	}
+
+	result = CalculateNormals();
+	if (!result)
+	{
+		return false;
+	}
+
+	return InitializeBuffers(device);
+}
+
+bool Terrain::SaveTileFile(const char* filename, int tileSize, bool compress)
+{
+	TerrainTileWriter writer;
+	int index;
+
+	if (!writer.Open(filename, m_terrainWidth, m_terrainHeight, tileSize,
+		compress ? TerrainTileFile::COMPRESSION_MED_RANS : TerrainTileFile::COMPRESSION_NONE))
+	{
+		return false;
+	}
+
+	//one tile worth of scratch, the writer streams each tile straight out
+	std::vector<float> heights(tileSize * tileSize);
+	std::vector<TerrainTileFile::PackedNormal> normals(tileSize * tileSize);
+
+	for (uint32_t tz = 0; tz < writer.GetTilesZ(); tz++)
+	{
+		for (uint32_t tx = 0; tx < writer.GetTilesX(); tx++)
+		{
+			for (int j = 0; j < tileSize; j++)
+			{
+				for (int i = 0; i < tileSize; i++)
+				{
+					//clamp so the edge tiles repeat the last row / column
+					int x = std::min((int)tx * tileSize + i, m_terrainWidth - 1);
+					int z = std::min((int)tz * tileSize + j, m_terrainHeight - 1);
+					index = (m_terrainWidth * z) + x;
+
+					heights[j * tileSize + i] = m_heightMap[index].y;
+					normals[j * tileSize + i] = TerrainTileFile::PackNormal(m_heightMap[index].nx, m_heightMap[index].ny, m_heightMap[index].nz);
+				}
+			}
+
+			if (!writer.WriteTile(tx, tz, heights.data(), normals.data()))
+			{
+				return false;
+			}
+		}
+	}
+
+	return writer.Close();
+}
+
+bool Terrain::LoadTileFile(ID3D11Device* device, const char* filename)
+{
+	TerrainTileReader reader;
+	int index;
+
+	if (!reader.Open(filename))
+	{
+		return false;
+	}
+
+	//only terrains of the same size for now, the grid and buffers are sized in Initialize
+	const TerrainTileFile::Header& header = reader.GetHeader();
+	if ((int)header.width != m_terrainWidth || (int)header.height != m_terrainHeight)
+	{
+		return false;
+	}
+
+	int tileSize = (int)header.tileSize;
+	std::vector<float> heights(tileSize * tileSize);
+	std::vector<TerrainTileFile::PackedNormal> normals(tileSize * tileSize);
+
+	for (uint32_t tz = 0; tz < header.tilesZ; tz++)
+	{
+		for (uint32_t tx = 0; tx < header.tilesX; tx++)
+		{
+			if (!reader.ReadTile(tx, tz, heights.data(), normals.data()))
+			{
+				return false;
+			}
+
+			for (int j = 0; j < tileSize; j++)
+			{
+				for (int i = 0; i < tileSize; i++)
+				{
+					int x = (int)tx * tileSize + i;
+					int z = (int)tz * tileSize + j;
+					if (x >= m_terrainWidth || z >= m_terrainHeight)
+					{
+						continue;
+					}
+					index = (m_terrainWidth * z) + x;
+
+					m_heightMap[index].y = heights[j * tileSize + i];
+					TerrainTileFile::UnpackNormal(normals[j * tileSize + i], m_heightMap[index].nx, m_heightMap[index].ny, m_heightMap[index].nz);
+				}
+			}
+		}
+	}
+
+	//the stored normals are only 8 bit, rebuild them at full precision
+	if (!CalculateNormals())
+	{
+		return false;
+	}
+
+	return InitializeBuffers(device);
+}
+
+bool Terrain::LoadHeightMap(ID3D11Device* device, const char* filename, float heightScale, bool bicubic)
+{
+	HeightmapImporter importer;
+	bool result;
+
+	if (!importer.Open(filename))
+	{
+		return false;
+	}
+
+	//resample whatever size the file is onto our grid, a row at a time
+	result = importer.Resample(m_terrainWidth, m_terrainHeight,
+		bicubic ? HeightmapImporter::FILTER_BICUBIC : HeightmapImporter::FILTER_BILINEAR, heightScale,
+		[this](int row, const float* heights) -> bool
+	{
+		for (int i = 0; i < m_terrainWidth; i++)
+		{
+			m_heightMap[(m_terrainWidth * row) + i].y = heights[i];
+		}
+		return true;
+	});
+	if (!result)
+	{
+		return false;
+	}
+
+	result = CalculateNormals();
+	if (!result)
+	{
+		return false;
+	}
+
+	return InitializeBuffers(device);
+}
+
+void Terrain::GetMesh(MeshData& mesh)
+{
+	int index;
+	int index1, index2, index3, index4;
+
+	mesh.Clear();
+
+	//unlike the render buffers the exported mesh shares its vertices between quads
+	mesh.positions.resize(m_terrainWidth * m_terrainHeight);
+	mesh.normals.resize(m_terrainWidth * m_terrainHeight);
+	mesh.uvs.resize(m_terrainWidth * m_terrainHeight);
+	for (int j = 0; j < m_terrainHeight; j++)
+	{
+		for (int i = 0; i < m_terrainWidth; i++)
+		{
+			index = (m_terrainWidth * j) + i;
+			mesh.positions[index] = DirectX::SimpleMath::Vector3(m_heightMap[index].x, m_heightMap[index].y, m_heightMap[index].z);
+			mesh.normals[index] = DirectX::SimpleMath::Vector3(m_heightMap[index].nx, m_heightMap[index].ny, m_heightMap[index].nz);
+			mesh.uvs[index] = DirectX::SimpleMath::Vector2(m_heightMap[index].u, m_heightMap[index].v);
+		}
+	}
+
+	//same winding as InitializeBuffers
+	mesh.indices.reserve((m_terrainWidth - 1) * (m_terrainHeight - 1) * 6);
+	for (int j = 0; j < (m_terrainHeight - 1); j++)
+	{
+		for (int i = 0; i < (m_terrainWidth - 1); i++)
+		{
+			index1 = (m_terrainWidth * j) + i;          // Bottom left.
+			index2 = (m_terrainWidth * j) + (i + 1);      // Bottom right.
+			index3 = (m_terrainWidth * (j + 1)) + i;      // Upper left.
+			index4 = (m_terrainWidth * (j + 1)) + (i + 1);  // Upper right.
+
+			mesh.indices.push_back(index3);
+			mesh.indices.push_back(index4);
+			mesh.indices.push_back(index1);
+
+			mesh.indices.push_back(index1);
+			mesh.indices.push_back(index4);
+			mesh.indices.push_back(index2);
+		}
+	}
+}
+
+bool Terrain::ExportMesh(const char* filename, float keepRatio)
+{
+	MeshData mesh;
+	GetMesh(mesh);
+
+	//reduced copies keep their outer edge so they still line up with the neighbouring tiles
+	if (keepRatio < 1.0f)
+	{
+		MeshSimplifier::Settings settings;
+		settings.targetTriangles = (size_t)(mesh.GetTriangleCount() * keepRatio);
+		settings.weldVertices = false;
+
+		MeshData simplified;
+		if (MeshSimplifier::Simplify(mesh, simplified, settings))
+		{
+			return MeshExporter::Write(filename, simplified);
+		}
+	}
+
+	return MeshExporter::Write(filename, mesh);
+}
+
+void Terrain::SampleHeightMap(float x, float z, HeightMapType& out)
+{
+	int i = std::max(0, std::min((int)x, m_terrainWidth - 2));
+	int j = std::max(0, std::min((int)z, m_terrainHeight - 2));
+	float fx = x - (float)i;
+	float fz = z - (float)j;
+
+	const HeightMapType& p00 = m_heightMap[(m_terrainWidth * j) + i];
+	const HeightMapType& p10 = m_heightMap[(m_terrainWidth * j) + (i + 1)];
+	const HeightMapType& p01 = m_heightMap[(m_terrainWidth * (j + 1)) + i];
+	const HeightMapType& p11 = m_heightMap[(m_terrainWidth * (j + 1)) + (i + 1)];
+
+	auto blend = [fx, fz](float a, float b, float c, float d)
+	{
+		return (a + (b - a) * fx) + ((c + (d - c) * fx) - (a + (b - a) * fx)) * fz;
+	};
+
+	out.x = blend(p00.x, p10.x, p01.x, p11.x);
+	out.y = blend(p00.y, p10.y, p01.y, p11.y);
+	out.z = blend(p00.z, p10.z, p01.z, p11.z);
+	out.u = blend(p00.u, p10.u, p01.u, p11.u);
+	out.v = blend(p00.v, p10.v, p01.v, p11.v);
+
+	DirectX::SimpleMath::Vector3 normal(
+		blend(p00.nx, p10.nx, p01.nx, p11.nx),
+		blend(p00.ny, p10.ny, p01.ny, p11.ny),
+		blend(p00.nz, p10.nz, p01.nz, p11.nz));
+	normal.Normalize();
+	out.nx = normal.x;
+	out.ny = normal.y;
+	out.nz = normal.z;
+}
+
+namespace
+{
+	//where a batch of four world positions lands on the grid: the lower corner of each cell, the blend
+	//factors inside it and the unclamped local position. the world matrix is assumed to keep y up (scale,
+	//translation and spin about y), so the world height of the query point doesn't change where it lands.
+	struct SampleCells4
+	{
+		__m128 localX, localZ;
+		__m128 fx, fz;
+		int corner[4];
+	};
+
+	inline void LocateCells4(const float* x, const float* z, const DirectX::SimpleMath::Matrix& inverse,
+		int width, int height, SampleCells4& cells)
+	{
+		__m128 wx = _mm_loadu_ps(x);
+		__m128 wz = _mm_loadu_ps(z);
+		cells.localX = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, _mm_set1_ps(inverse._11)), _mm_mul_ps(wz, _mm_set1_ps(inverse._31))), _mm_set1_ps(inverse._41));
+		cells.localZ = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, _mm_set1_ps(inverse._13)), _mm_mul_ps(wz, _mm_set1_ps(inverse._33))), _mm_set1_ps(inverse._43));
+
+		//clamp onto the grid, then the cell is the truncation capped one short of the last vertex
+		__m128 gx = _mm_min_ps(_mm_max_ps(cells.localX, _mm_setzero_ps()), _mm_set1_ps((float)(width - 1)));
+		__m128 gz = _mm_min_ps(_mm_max_ps(cells.localZ, _mm_setzero_ps()), _mm_set1_ps((float)(height - 1)));
+		__m128 cx = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(gx)), _mm_set1_ps((float)(width - 2)));
+		__m128 cz = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(gz)), _mm_set1_ps((float)(height - 2)));
+		cells.fx = _mm_sub_ps(gx, cx);
+		cells.fz = _mm_sub_ps(gz, cz);
+
+		//same row stride as m_heightMap
+		__m128 corner = _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps((float)width)), cx);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(cells.corner), _mm_cvttps_epi32(corner));
+	}
+
+	inline __m128 Bilinear4(__m128 a, __m128 b, __m128 c, __m128 d, __m128 fx, __m128 fz)
+	{
+		__m128 bottom = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), fx));
+		__m128 top = _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(d, c), fx));
+		return _mm_add_ps(bottom, _mm_mul_ps(_mm_sub_ps(top, bottom), fz));
+	}
+}
+
+void Terrain::SetWorldMatrix(const DirectX::SimpleMath::Matrix& world)
+{
+	m_world = world;
+	m_worldInverse = world.Invert();
+}
+
+void Terrain::RefreshSamples()
+{
+	int count = m_terrainWidth * m_terrainHeight;
+	m_sampleHeights.resize(count);
+	m_sampleNormals.resize(count * 3);
+	for (int i = 0; i < count; i++)
+	{
+		m_sampleHeights[i] = m_heightMap[i].y;
+		m_sampleNormals[i] = m_heightMap[i].nx;
+		m_sampleNormals[count + i] = m_heightMap[i].ny;
+		m_sampleNormals[count * 2 + i] = m_heightMap[i].nz;
+	}
+}
+
+void Terrain::SampleHeights(const float* x, const float* z, float* heights, size_t n) const
+{
+	if (m_sampleHeights.empty())
+	{
+		return;
+	}
+	const DirectX::SimpleMath::Matrix& world = m_world;
+	const float* grid = m_sampleHeights.data();
+	int stride = m_terrainWidth;
+
+	size_t k = 0;
+	for (; k + 4 <= n; k += 4)
+	{
+		SampleCells4 cells;
+		LocateCells4(x + k, z + k, m_worldInverse, m_terrainWidth, m_terrainHeight, cells);
+
+		//SSE2 has no gather, so the corners are picked up one lane at a time
+		const int* c = cells.corner;
+		__m128 h00 = _mm_setr_ps(grid[c[0]], grid[c[1]], grid[c[2]], grid[c[3]]);
+		__m128 h10 = _mm_setr_ps(grid[c[0] + 1], grid[c[1] + 1], grid[c[2] + 1], grid[c[3] + 1]);
+		__m128 h01 = _mm_setr_ps(grid[c[0] + stride], grid[c[1] + stride], grid[c[2] + stride], grid[c[3] + stride]);
+		__m128 h11 = _mm_setr_ps(grid[c[0] + stride + 1], grid[c[1] + stride + 1], grid[c[2] + stride + 1], grid[c[3] + stride + 1]);
+		__m128 local = Bilinear4(h00, h10, h01, h11, cells.fx, cells.fz);
+
+		//back to world space, only y is wanted
+		__m128 y = _mm_mul_ps(cells.localX, _mm_set1_ps(world._12));
+		y = _mm_add_ps(y, _mm_mul_ps(local, _mm_set1_ps(world._22)));
+		y = _mm_add_ps(y, _mm_mul_ps(cells.localZ, _mm_set1_ps(world._32)));
+		y = _mm_add_ps(y, _mm_set1_ps(world._42));
+		_mm_storeu_ps(heights + k, y);
+	}
+
+	//the tail goes through the same path with the last sample repeated
+	if (k < n)
+	{
+		float tailX[4], tailZ[4], tailHeights[4];
+		for (int i = 0; i < 4; i++)
+		{
+			size_t source = std::min(k + i, n - 1);
+			tailX[i] = x[source];
+			tailZ[i] = z[source];
+		}
+		SampleHeights(tailX, tailZ, tailHeights, 4);
+		for (size_t i = k; i < n; i++)
+		{
+			heights[i] = tailHeights[i - k];
+		}
+	}
+}
+
+void Terrain::SampleNormals(const float* x, const float* z, DirectX::SimpleMath::Vector3* normals, size_t n) const
+{
+	if (m_sampleNormals.empty())
+	{
+		return;
+	}
+	//normals go through the inverse transpose so non uniform scales still tilt them the right way.
+	//they come from the same snapshot as SampleHeights, not the live heights a generator may be rewriting.
+	const DirectX::SimpleMath::Matrix& inverse = m_worldInverse;
+	size_t plane = m_sampleHeights.size();
+	int stride = m_terrainWidth;
+
+	size_t k = 0;
+	for (; k + 4 <= n; k += 4)
+	{
+		SampleCells4 cells;
+		LocateCells4(x + k, z + k, inverse, m_terrainWidth, m_terrainHeight, cells);
+
+		__m128 local[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const float* grid = m_sampleNormals.data() + plane * axis;
+			const int* c = cells.corner;
+			__m128 n00 = _mm_setr_ps(grid[c[0]], grid[c[1]], grid[c[2]], grid[c[3]]);
+			__m128 n10 = _mm_setr_ps(grid[c[0] + 1], grid[c[1] + 1], grid[c[2] + 1], grid[c[3] + 1]);
+			__m128 n01 = _mm_setr_ps(grid[c[0] + stride], grid[c[1] + stride], grid[c[2] + stride], grid[c[3] + stride]);
+			__m128 n11 = _mm_setr_ps(grid[c[0] + stride + 1], grid[c[1] + stride + 1], grid[c[2] + stride + 1], grid[c[3] + stride + 1]);
+			local[axis] = Bilinear4(n00, n10, n01, n11, cells.fx, cells.fz);
+		}
+
+		__m128 wx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(local[0], _mm_set1_ps(inverse._11)), _mm_mul_ps(local[1], _mm_set1_ps(inverse._12))), _mm_mul_ps(local[2], _mm_set1_ps(inverse._13)));
+		__m128 wy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(local[0], _mm_set1_ps(inverse._21)), _mm_mul_ps(local[1], _mm_set1_ps(inverse._22))), _mm_mul_ps(local[2], _mm_set1_ps(inverse._23)));
+		__m128 wz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(local[0], _mm_set1_ps(inverse._31)), _mm_mul_ps(local[1], _mm_set1_ps(inverse._32))), _mm_mul_ps(local[2], _mm_set1_ps(inverse._33)));
+		__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, wx), _mm_mul_ps(wy, wy)), _mm_mul_ps(wz, wz));
+		__m128 scale = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_max_ps(lengthSq, _mm_set1_ps(1e-20f))));
+
+		float out[3][4];
+		_mm_storeu_ps(out[0], _mm_mul_ps(wx, scale));
+		_mm_storeu_ps(out[1], _mm_mul_ps(wy, scale));
+		_mm_storeu_ps(out[2], _mm_mul_ps(wz, scale));
+		for (int lane = 0; lane < 4; lane++)
+		{
+			normals[k + lane] = DirectX::SimpleMath::Vector3(out[0][lane], out[1][lane], out[2][lane]);
+		}
+	}
+
+	if (k < n)
+	{
+		float tailX[4], tailZ[4];
+		DirectX::SimpleMath::Vector3 tailNormals[4];
+		for (int i = 0; i < 4; i++)
+		{
+			size_t source = std::min(k + i, n - 1);
+			tailX[i] = x[source];
+			tailZ[i] = z[source];
+		}
+		SampleNormals(tailX, tailZ, tailNormals, 4);
+		for (size_t i = k; i < n; i++)
+		{
+			normals[i] = tailNormals[i - k];
+		}
+	}
+}
+
+float Terrain::SampleHeight(float x, float z) const
+{
+	float height;
+	SampleHeights(&x, &z, &height, 1);
+	return height;
+}
+
+void Terrain::GetAdaptiveMesh(MeshData& mesh, float maxError)
+{
+	HeightMapType sample;
+	std::vector<uint32_t> vertices;
+
+	//the mesher wants 2^k + 1 on a side, so anything else (like our 64 x 64) is resampled onto the next size up
+	int gridSize = RtinMesher::GetGridSize(m_terrainWidth, m_terrainHeight);
+	float stepX = (float)(m_terrainWidth - 1) / (float)(gridSize - 1);
+	float stepZ = (float)(m_terrainHeight - 1) / (float)(gridSize - 1);
+
+	//the error map only has to be rebuilt when the heights have changed, a new threshold is just a tree walk
+	if (!m_rtinValid)
+	{
+		std::vector<float> heights(gridSize * gridSize);
+		for (int j = 0; j < gridSize; j++)
+		{
+			for (int i = 0; i < gridSize; i++)
+			{
+				SampleHeightMap(i * stepX, j * stepZ, sample);
+				heights[(gridSize * j) + i] = sample.y;
+			}
+		}
+		m_rtinValid = m_rtin.Build(heights.data(), gridSize);
+	}
+
+	mesh.Clear();
+	m_rtin.Mesh(maxError, vertices, mesh.indices);
+
+	mesh.positions.resize(vertices.size());
+	mesh.normals.resize(vertices.size());
+	mesh.uvs.resize(vertices.size());
+	for (size_t k = 0; k < vertices.size(); k++)
+	{
+		SampleHeightMap((vertices[k] % gridSize) * stepX, (vertices[k] / gridSize) * stepZ, sample);
+		mesh.positions[k] = DirectX::SimpleMath::Vector3(sample.x, sample.y, sample.z);
+		mesh.normals[k] = DirectX::SimpleMath::Vector3(sample.nx, sample.ny, sample.nz);
+		mesh.uvs[k] = DirectX::SimpleMath::Vector2(sample.u, sample.v);
+	}
+}
+
+bool Terrain::BuildAdaptiveMesh(ID3D11Device* device, float maxError)
+{
+	MeshData mesh;
+	GetAdaptiveMesh(mesh, maxError);
+	if (mesh.indices.empty())
+	{
+		return false;
+	}
+	return InitializeMeshBuffers(device, mesh);
+}
+
+bool Terrain::InitializeMeshBuffers(ID3D11Device* device, const MeshData& mesh)
+{
+	D3D11_BUFFER_DESC vertexBufferDesc, indexBufferDesc;
+	D3D11_SUBRESOURCE_DATA vertexData, indexData;
+	HRESULT result;
+
+	//drop the grid buffers, this mesh replaces them until the next regenerate
+	Shutdown();
+	m_buffersCompact = false;
+	m_buffersDynamic = false;
+	m_indexFormat = DXGI_FORMAT_R32_UINT;
+
+	m_vertexCount = (int)mesh.positions.size();
+	m_indexCount = (int)mesh.indices.size();
+
+	std::vector<VertexType> vertices(m_vertexCount);
+	for (int i = 0; i < m_vertexCount; i++)
+	{
+		vertices[i].position = mesh.positions[i];
+		vertices[i].normal = mesh.normals[i];
+		vertices[i].texture = mesh.uvs[i];
+	}
+
+	std::vector<unsigned long> indices(mesh.indices.begin(), mesh.indices.end());
+
+	// Set up the description of the static vertex buffer.
+	vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	vertexBufferDesc.ByteWidth = sizeof(VertexType) * m_vertexCount;
+	vertexBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	vertexBufferDesc.CPUAccessFlags = 0;
+	vertexBufferDesc.MiscFlags = 0;
+	vertexBufferDesc.StructureByteStride = 0;
+
+	vertexData.pSysMem = vertices.data();
+	vertexData.SysMemPitch = 0;
+	vertexData.SysMemSlicePitch = 0;
+
+	result = device->CreateBuffer(&vertexBufferDesc, &vertexData, &m_vertexBuffer);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	// Set up the description of the static index buffer.
+	indexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	indexBufferDesc.ByteWidth = sizeof(unsigned long) * m_indexCount;
+	indexBufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	indexBufferDesc.CPUAccessFlags = 0;
+	indexBufferDesc.MiscFlags = 0;
+	indexBufferDesc.StructureByteStride = 0;
+
+	indexData.pSysMem = indices.data();
+	indexData.SysMemPitch = 0;
+	indexData.SysMemSlicePitch = 0;
+
+	result = device->CreateBuffer(&indexBufferDesc, &indexData, &m_indexBuffer);
+	if (FAILED(result))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+bool Terrain::SetCompactVertices(ID3D11Device* device, bool compact)
+{
+	//only the vertex format changes, the heights stay as they are
+	m_compactVertices = compact;
+	return CreateGridBuffers(device, false);
+}
+
 float* Terrain::GetWavelength()
 {
 	return &m_wavelength;
@@ -1,6 +1,20 @@
 #pragma once
 #include "ClassicNoise.h"
 #include "SimplexNoise.h"
+#include "MeshData.h"
+#include "RtinMesher.h"
+#include "CompactVertex.h"
+#include "OceanFFT.h"
+#include "ShallowWater.h"
+#include "DiamondSquare.h"
+#include "Hydrology.h"
+#include "TerrainTileCache.h"
+#include <thread>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
 
 using namespace DirectX;
 
@@ -20,6 +34,15 @@ private:
 		float u, v;
 	};
 public:
+	//the generators that can also run in the background
+	enum Generator
+	{
+		GENERATOR_PERLIN,
+		GENERATOR_SIMPLEX,
+		GENERATOR_WAVES,
+		GENERATOR_RANDOM,
+	};
+
 	Terrain();
 	~Terrain();
 	float averageHeight;
@@ -32,30 +55,132 @@ public:
 	bool GeneratePerlinNoise(ID3D11Device*);
 	bool GenerateSimplexNoise(ID3D11Device* device);
 	int GenerateHeightField(ID3D11Device* device);
+	bool GenerateDiamondSquare(ID3D11Device* device, float roughness = 0.5f, bool wrap = false, DiamondSquare::Mode mode = DiamondSquare::MODE_DIAMOND_SQUARE);
 	bool SmoothTerrain(ID3D11Device*);
 	bool Update(ID3D11Device* device);
+	bool SaveTileFile(const char* filename, int tileSize = 32, bool compress = true);
+	bool LoadTileFile(ID3D11Device* device, const char* filename);
+	bool LoadHeightMap(ID3D11Device* device, const char* filename, float heightScale, bool bicubic = true);
+	void GetMesh(MeshData& mesh);
+	bool ExportMesh(const char* filename, float keepRatio = 1.0f);
+	void GetAdaptiveMesh(MeshData& mesh, float maxError);
+	bool BuildAdaptiveMesh(ID3D11Device* device, float maxError);
+	bool SetCompactVertices(ID3D11Device* device, bool compact);
+	bool ApplyOcean(ID3D11Device* device, const OceanFFT& ocean, float heightScale = 1.0f);
+	bool ApplyWaterSurface(ID3D11Device* device, const ShallowWater& water, float verticalOffset);
+	void GetHeights(float* heights) const;
+	//bumped every time the heights change, so whatever is derived from them can tell when to rebuild
+	unsigned int GetHeightsVersion() const { return m_heightsVersion; }
+	//fills the depressions into lakes and cuts channels where more than threshold cells drain through
+	bool CarveRivers(ID3D11Device* device, float threshold, float depth);
+
+	//runs a generator on a worker thread into a back copy of the heights, normals included.
+	//a newer request cancels whatever is still running, apart from perlin and simplex: they add onto the
+	//heights, so they queue up behind whatever hasn't been swapped in yet and start from its result, and
+	//clicking them twice quickly adds both. UpdateAsync, once a frame, swaps a finished result in and
+	//rebuilds the buffers, and never waits on the worker.
+	void GenerateAsync(Generator generator);
+	bool UpdateAsync(ID3D11Device* device);
+	bool IsGenerating() const;
+	//generators with the same settings (and for the additive ones the same starting heights) reuse earlier
+	//tiles from here instead of running again. the cache can be shared between terrains, null turns it off.
+	//the worker reads it, so set it up before the first GenerateAsync.
+	void SetTileCache(TerrainTileCache* cache, int tileSize = 32);
+
+	//world space queries. x / z are world positions, the terrain is placed with the same matrix it is drawn with.
+	//outside the grid the edge values are used. both take any n, four at a time go through SSE.
+	void SetWorldMatrix(const DirectX::SimpleMath::Matrix& world);
+	const DirectX::SimpleMath::Matrix& GetWorldMatrix() const { return m_world; }
+	void SampleHeights(const float* x, const float* z, float* heights, size_t n) const;
+	void SampleNormals(const float* x, const float* z, DirectX::SimpleMath::Vector3* normals, size_t n) const;
+	float SampleHeight(float x, float z) const;
+	bool UsesCompactVertices() const { return m_buffersCompact; }
+	const CompactTerrainParams& GetCompactParams() const { return m_compactParams; }
 	float* GetWavelength();
 
 	float* GetAmplitude();
 
 private:
 	bool CalculateNormals();
+	bool CalculateNormals(HeightMapType* map);
 	void Shutdown();
 	bool InitializeBuffers(ID3D11Device*);
+	//for heights that change every frame: a dynamic vertex buffer made once and rewritten with Map
+	bool UpdateDynamicBuffers(ID3D11Device*);
+	//copies the heights and normals for SampleHeights / SampleNormals, so both see the same version
+	void RefreshSamples();
+	bool CreateGridBuffers(ID3D11Device*, bool dynamic);
+	void FillGridVertices(VertexType* vertices) const;
+	void EncodeCompactVertices(CompactVertexType* vertices);
 	void RenderBuffers(ID3D11DeviceContext*);
+	bool InitializeMeshBuffers(ID3D11Device*, const MeshData& mesh);
+	void SampleHeightMap(float x, float z, HeightMapType& out);
+
+	struct GeneratorSettings
+	{
+		float waveSpeed;
+		float amplitude;
+		uint32_t seed;
+
+		GeneratorSettings() : waveSpeed(0.0f), amplitude(1.0f), seed(1) {}
+	};
+	struct GeneratorJob
+	{
+		Generator generator;
+		unsigned int serial;
+		bool chained;				//start from the previous job's result rather than heights
+		GeneratorSettings settings;
+		std::vector<HeightMapType> heights;
+	};
+	//the height pass of a generator on any copy of the heights. false if cancelled part way.
+	bool FillGenerator(Generator generator, HeightMapType* map, const GeneratorSettings& settings, const std::function<bool()>& cancelled = nullptr);
+	//FillGenerator plus the normals, through the tile cache when there is one
+	bool RunGenerator(Generator generator, HeightMapType* map, const GeneratorSettings& settings, const std::function<bool()>& cancelled = nullptr);
+	uint64_t GetGeneratorHash(Generator generator, const HeightMapType* map, const GeneratorSettings& settings) const;
+	void WorkerLoop();
+	void StopAsync();
 	
 
 private:
 	bool m_terrainGeneratedToggle;
+	uint32_t m_heightFieldSeed;		//GenerateHeightField uses the next one each time
 	int m_terrainWidth, m_terrainHeight;
 	ID3D11Buffer * m_vertexBuffer, *m_indexBuffer;
 	int m_vertexCount, m_indexCount;
+	DXGI_FORMAT m_indexFormat;
+	bool m_compactVertices;			//use the 8 byte vertex for the grid
+	bool m_buffersCompact;			//what is actually in the buffers right now (the adaptive mesh is always full size)
+	bool m_buffersDynamic;			//the grid's vertex buffer is dynamic, UpdateDynamicBuffers writes it in place
+	CompactTerrainParams m_compactParams;
 	float m_frequency, m_amplitude, m_wavelength;
-	HeightMapType* m_heightMap;
+	HeightMapType* m_heightMap;				//points into m_heightStorage
+	std::vector<HeightMapType> m_heightStorage;
+	RtinMesher m_rtin;
+	bool m_rtinValid;		//cleared whenever the heights change
+	unsigned int m_heightsVersion;
+	DirectX::SimpleMath::Matrix m_world;
+	DirectX::SimpleMath::Matrix m_worldInverse;
+	std::vector<float> m_sampleHeights;		//packed copy of the heights for the samplers, refreshed with the buffers
+	std::vector<float> m_sampleNormals;		//and of the normals, one plane each of x, y and z
 
 	//arrays for our generated objects Made by directX
 	std::vector<VertexPositionNormalTexture> preFabVertices;
 	std::vector<uint16_t> preFabIndices;
+	//background generation. jobs are numbered, and anything older than m_cancelBefore is abandoned.
+	std::thread m_worker;
+	std::mutex m_jobMutex;
+	std::condition_variable m_jobSignal;
+	std::atomic<unsigned int> m_latestJob;
+	std::atomic<unsigned int> m_swappedJob;
+	std::atomic<unsigned int> m_cancelBefore;
+	std::atomic<bool> m_stopWorker;
+	bool m_hasFinishedJob;
+	std::deque<GeneratorJob> m_pendingJobs;
+	GeneratorJob m_finishedJob;
+	std::vector<HeightMapType> m_chainHeights;	//the worker's copy of its last result, for chained jobs
+	TerrainTileCache* m_tileCache;
+	int m_cacheTileSize;
+
 	ClassicNoise classicNoise;
 	SimplexNoise simplexNoise;
 };
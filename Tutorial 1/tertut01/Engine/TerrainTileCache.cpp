@@ -0,0 +1,319 @@
+#include "pch.h"
+#include "TerrainTileCache.h"
+#include "TerrainTileFile.h"
+
+namespace
+{
+	//splitmix64 finalizer, every input bit ends up affecting every output bit
+	inline uint64_t Mix(uint64_t x)
+	{
+		x ^= x >> 30;
+		x *= 0xBF58476D1CE4E5B9ull;
+		x ^= x >> 27;
+		x *= 0x94D049BB133111EBull;
+		x ^= x >> 31;
+		return x;
+	}
+}
+
+
+uint64_t TerrainTileCache::Hash(const void* data, size_t size, uint64_t seed)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	uint64_t hash = Mix(seed ^ ((uint64_t)size * 0x9E3779B97F4A7C15ull));
+
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, bytes + i, 8);
+		hash = Mix(hash ^ word);
+	}
+
+	if (i < size)
+	{
+		uint64_t word = 0;
+		memcpy(&word, bytes + i, size - i);
+		hash = Mix(hash ^ word ^ 0xFF00000000000000ull);
+	}
+
+	return hash;
+}
+
+uint64_t TerrainTileCache::TileKey(uint64_t configHash, int tileX, int tileZ)
+{
+	int32_t coordinate[2] = { tileX, tileZ };
+	return Hash(coordinate, sizeof(coordinate), configHash);
+}
+
+TerrainTileCache::TerrainTileCache()
+{
+	m_memoryBudget = 0;
+	m_tempCounter = 0;
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+bool TerrainTileCache::Initialize(const char* directory, size_t memoryBudget)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_entries.clear();
+	m_index.clear();
+	memset(&m_stats, 0, sizeof(m_stats));
+	m_memoryBudget = memoryBudget;
+	m_directory = directory ? directory : "";
+
+	if (m_directory.empty())
+	{
+		return true;
+	}
+
+	//fails harmlessly if it's already there, anything else shows up as failed writes later
+	CreateDirectoryA(m_directory.c_str(), nullptr);
+	return true;
+}
+
+bool TerrainTileCache::Find(uint64_t key, Tile& tile)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto found = m_index.find(key);
+		if (found != m_index.end())
+		{
+			m_entries.splice(m_entries.begin(), m_entries, found->second);
+			tile = found->second->tile;
+			m_stats.memoryHits++;
+			return true;
+		}
+	}
+
+	//the disk is read without the lock so a slow read doesn't hold up other threads
+	size_t bytesRead = 0;
+	bool loaded = ReadDisk(key, tile, bytesRead);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_stats.diskBytesRead += bytesRead;
+	if (!loaded)
+	{
+		m_stats.misses++;
+		return false;
+	}
+	m_stats.diskHits++;
+	Insert(key, tile);
+	return true;
+}
+
+void TerrainTileCache::Store(uint64_t key, const Tile& tile)
+{
+	size_t bytesWritten = 0;
+	WriteDisk(key, tile, bytesWritten);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_stats.stores++;
+	m_stats.diskBytesWritten += bytesWritten;
+	Insert(key, tile);
+}
+
+void TerrainTileCache::ClearMemory()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.clear();
+	m_index.clear();
+	m_stats.memoryBytes = 0;
+	m_stats.memoryTiles = 0;
+}
+
+TerrainTileCache::Stats TerrainTileCache::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+void TerrainTileCache::Insert(uint64_t key, const Tile& tile)
+{
+	auto found = m_index.find(key);
+	if (found != m_index.end())
+	{
+		m_stats.memoryBytes -= found->second->tile.GetBytes();
+		m_stats.memoryTiles--;
+		m_entries.erase(found->second);
+		m_index.erase(found);
+	}
+
+	//a tile bigger than the whole budget would only push everything else out and then go itself
+	size_t bytes = tile.GetBytes();
+	if (bytes > m_memoryBudget)
+	{
+		return;
+	}
+
+	while (!m_entries.empty() && m_stats.memoryBytes + bytes > m_memoryBudget)
+	{
+		Entry& oldest = m_entries.back();
+		m_stats.memoryBytes -= oldest.tile.GetBytes();
+		m_stats.memoryTiles--;
+		m_stats.evictions++;
+		m_index.erase(oldest.key);
+		m_entries.pop_back();
+	}
+
+	m_entries.push_front(Entry());
+	m_entries.front().key = key;
+	m_entries.front().tile = tile;
+	m_index[key] = m_entries.begin();
+	m_stats.memoryBytes += bytes;
+	m_stats.memoryTiles++;
+}
+
+std::string TerrainTileCache::GetPath(uint64_t key) const
+{
+	char name[32];
+	sprintf_s(name, sizeof(name), "%016llx.tile", (unsigned long long)key);
+	return m_directory + "/" + name;
+}
+
+bool TerrainTileCache::ReadDisk(uint64_t key, Tile& tile, size_t& bytesRead) const
+{
+	FILE* file;
+	errno_t err;
+	DiskHeader header;
+
+	bytesRead = 0;
+	if (m_directory.empty())
+	{
+		return false;
+	}
+
+	err = fopen_s(&file, GetPath(key).c_str(), "rb");
+	if (err != 0)
+	{
+		return false;
+	}
+
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+		header.magic == MAGIC && header.version == VERSION && header.key == key &&
+		header.width > 0 && header.height > 0 && header.width <= 65536 && header.height <= 65536;
+
+	size_t samples = valid ? (size_t)header.width * header.height : 0;
+	size_t rawSize = samples * 4 * sizeof(float);
+	valid = valid && header.storedSize <= rawSize;
+
+	std::vector<uint8_t> stored;
+	if (valid)
+	{
+		stored.resize(header.storedSize);
+		valid = fread(stored.data(), 1, stored.size(), file) == stored.size();
+	}
+	fclose(file);
+
+	if (!valid)
+	{
+		return false;
+	}
+	bytesRead = sizeof(header) + stored.size();
+
+	//same layout as the tile files, all the heights and then all the normals
+	std::vector<uint8_t> raw(rawSize);
+	if (header.compression == TerrainTileFile::COMPRESSION_DELTA_RLE)
+	{
+		if (!TerrainTileFile::DecompressTile(stored.data(), stored.size(), raw.data(), raw.size()))
+		{
+			return false;
+		}
+	}
+	else if (header.compression == TerrainTileFile::COMPRESSION_MED_RANS)
+	{
+		if (!TerrainTileFile::DecompressHeightTile(stored.data(), stored.size(), header.width, header.height, raw.data(), raw.size()))
+		{
+			return false;
+		}
+	}
+	else if (header.compression == TerrainTileFile::COMPRESSION_NONE && stored.size() == rawSize)
+	{
+		raw.swap(stored);
+	}
+	else
+	{
+		return false;
+	}
+
+	tile.width = header.width;
+	tile.height = header.height;
+	tile.heights.resize(samples);
+	tile.normals.resize(samples * 3);
+	memcpy(tile.heights.data(), raw.data(), samples * sizeof(float));
+	memcpy(tile.normals.data(), raw.data() + samples * sizeof(float), samples * 3 * sizeof(float));
+	return true;
+}
+
+bool TerrainTileCache::WriteDisk(uint64_t key, const Tile& tile, size_t& bytesWritten)
+{
+	FILE* file;
+	errno_t err;
+	DiskHeader header;
+
+	bytesWritten = 0;
+	if (m_directory.empty())
+	{
+		return false;
+	}
+
+	size_t samples = (size_t)tile.width * tile.height;
+	if (tile.heights.size() != samples || tile.normals.size() != samples * 3)
+	{
+		return false;
+	}
+
+	std::vector<uint8_t> raw(samples * 4 * sizeof(float));
+	memcpy(raw.data(), tile.heights.data(), samples * sizeof(float));
+	memcpy(raw.data() + samples * sizeof(float), tile.normals.data(), samples * 3 * sizeof(float));
+
+	//only keep the compressed copy if it actually saved something
+	std::vector<uint8_t> packed;
+	//the height codec stores 16 bit dimensions, anything wider falls back to the plain delta coding
+	bool heightCodec = tile.width <= 65535 && tile.height <= 65535;
+	if (heightCodec)
+	{
+		TerrainTileFile::CompressHeightTile(raw.data(), raw.size(), tile.width, tile.height, packed);
+	}
+	else
+	{
+		TerrainTileFile::CompressTile(raw.data(), raw.size(), packed);
+	}
+	bool compressed = packed.size() < raw.size();
+	const std::vector<uint8_t>& payload = compressed ? packed : raw;
+
+	header.magic = MAGIC;
+	header.version = VERSION;
+	header.key = key;
+	header.width = tile.width;
+	header.height = tile.height;
+	header.storedSize = (uint32_t)payload.size();
+	header.compression = !compressed ? TerrainTileFile::COMPRESSION_NONE :
+		heightCodec ? TerrainTileFile::COMPRESSION_MED_RANS : TerrainTileFile::COMPRESSION_DELTA_RLE;
+
+	std::string path = GetPath(key);
+	char suffix[32];
+	sprintf_s(suffix, sizeof(suffix), ".%u.tmp", m_tempCounter++);
+	std::string temporary = path + suffix;
+
+	err = fopen_s(&file, temporary.c_str(), "wb");
+	if (err != 0)
+	{
+		return false;
+	}
+
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		fwrite(payload.data(), 1, payload.size(), file) == payload.size();
+	written = (fclose(file) == 0) && written;
+
+	//a reader either sees the old file, no file, or the whole new one
+	if (!written || !MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		remove(temporary.c_str());
+		return false;
+	}
+
+	bytesWritten = sizeof(header) + payload.size();
+	return true;
+}
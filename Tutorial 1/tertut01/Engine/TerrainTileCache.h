@@ -0,0 +1,88 @@
+#pragma once
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <string>
+
+//Cache of generated terrain tiles (heights plus normals), addressed by what produced them rather than by where
+//they sit. A tile's key is a hash of the generator configuration and the tile coordinate, so running the same
+//generator with the same settings again finds the same tiles, whichever terrain asks for them.
+//
+//Tiles live in an in memory LRU limited to a byte budget, and optionally in a directory on disk (one small file
+//per key, named after it) so they survive a restart. Lookups go memory first, then disk, and a disk hit is pulled
+//back into memory. The disk files are written under a temporary name and renamed, so a half written tile is
+//never picked up. Nothing on disk is evicted, delete the directory to clear it.
+//
+//Safe to use from several threads at once, the worker threads and the main thread share one.
+
+class TerrainTileCache
+{
+public:
+	static const uint32_t MAGIC = 0x31435454;	//"TTC1"
+	static const uint32_t VERSION = 1;
+
+	struct Tile
+	{
+		uint32_t width, height;			//samples, tiles along the right / bottom edge can be smaller
+		std::vector<float> heights;
+		std::vector<float> normals;		//x, y, z per sample
+
+		Tile() : width(0), height(0) {}
+		size_t GetBytes() const { return (heights.size() + normals.size()) * sizeof(float); }
+	};
+
+	struct Stats
+	{
+		uint64_t memoryHits, diskHits, misses;
+		uint64_t stores, evictions;
+		uint64_t memoryBytes;			//tile data held in memory right now
+		uint32_t memoryTiles;
+		uint64_t diskBytesRead, diskBytesWritten;
+	};
+
+	//64 bit hash for building keys, pass a previous hash as the seed to chain more data onto it
+	static uint64_t Hash(const void* data, size_t size, uint64_t seed = 0);
+	static uint64_t TileKey(uint64_t configHash, int tileX, int tileZ);
+
+	TerrainTileCache();
+
+	//directory can be null or empty for a memory only cache, it is created if it doesn't exist
+	bool Initialize(const char* directory, size_t memoryBudget);
+	//true and a copy of the tile on a hit
+	bool Find(uint64_t key, Tile& tile);
+	void Store(uint64_t key, const Tile& tile);
+	void ClearMemory();
+	Stats GetStats() const;
+
+private:
+	struct Entry
+	{
+		uint64_t key;
+		Tile tile;
+	};
+
+	struct DiskHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;					//checked on load, guards against renamed or stray files
+		uint32_t width, height;
+		uint32_t storedSize;			//payload bytes after the header
+		uint32_t compression;			//TerrainTileFile::Compression
+	};
+
+	std::string GetPath(uint64_t key) const;
+	bool ReadDisk(uint64_t key, Tile& tile, size_t& bytesRead) const;
+	bool WriteDisk(uint64_t key, const Tile& tile, size_t& bytesWritten);
+	//adds or replaces an entry at the front and evicts from the back until it fits, caller holds the lock
+	void Insert(uint64_t key, const Tile& tile);
+
+	mutable std::mutex m_mutex;
+	std::list<Entry> m_entries;			//most recently used first
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> m_index;
+	std::string m_directory;
+	size_t m_memoryBudget;
+	Stats m_stats;
+	std::atomic<unsigned int> m_tempCounter;	//keeps temporary file names apart when two threads store at once
+};
@@ -0,0 +1,524 @@
+#include "pch.h"
+#include "TerrainTileFile.h"
+#include "HeightCodec.h"
+
+
+TerrainTileFile::PackedNormal TerrainTileFile::PackNormal(float x, float y, float z)
+{
+	PackedNormal n;
+	n.x = (int8_t)std::max(-127.0f, std::min(127.0f, x * 127.0f + (x >= 0.0f ? 0.5f : -0.5f)));
+	n.y = (int8_t)std::max(-127.0f, std::min(127.0f, y * 127.0f + (y >= 0.0f ? 0.5f : -0.5f)));
+	n.z = (int8_t)std::max(-127.0f, std::min(127.0f, z * 127.0f + (z >= 0.0f ? 0.5f : -0.5f)));
+	n.w = 0;
+	return n;
+}
+
+void TerrainTileFile::UnpackNormal(const PackedNormal& n, float& x, float& y, float& z)
+{
+	x = n.x / 127.0f;
+	y = n.y / 127.0f;
+	z = n.z / 127.0f;
+}
+
+//The raw tile is a run of 32 bit words (heights then normals). Each word is xor'd with the one before it
+//so smooth or flat areas turn into mostly zero bytes, then zero bytes are run length encoded as (0, count).
+void TerrainTileFile::CompressTile(const uint8_t* raw, size_t rawSize, std::vector<uint8_t>& out)
+{
+	out.clear();
+	out.reserve(rawSize / 2);
+
+	const uint32_t* words = (const uint32_t*)raw;
+	size_t wordCount = rawSize / sizeof(uint32_t);
+	uint32_t previous = 0;
+	int zeroRun = 0;
+
+	for (size_t i = 0; i < wordCount; i++)
+	{
+		uint32_t delta = words[i] ^ previous;
+		previous = words[i];
+
+		for (int b = 0; b < 4; b++)
+		{
+			uint8_t value = (uint8_t)(delta >> (b * 8));
+			if (value == 0)
+			{
+				zeroRun++;
+				if (zeroRun == 255)
+				{
+					out.push_back(0);
+					out.push_back(255);
+					zeroRun = 0;
+				}
+			}
+			else
+			{
+				if (zeroRun > 0)
+				{
+					out.push_back(0);
+					out.push_back((uint8_t)zeroRun);
+					zeroRun = 0;
+				}
+				out.push_back(value);
+			}
+		}
+	}
+
+	if (zeroRun > 0)
+	{
+		out.push_back(0);
+		out.push_back((uint8_t)zeroRun);
+	}
+}
+
+bool TerrainTileFile::DecompressTile(const uint8_t* stored, size_t storedSize, uint8_t* raw, size_t rawSize)
+{
+	size_t in = 0;
+	size_t outPos = 0;
+
+	//undo the run length encoding first, straight into the output
+	while (in < storedSize)
+	{
+		uint8_t value = stored[in++];
+		if (value == 0)
+		{
+			if (in >= storedSize)
+			{
+				return false;
+			}
+			size_t run = stored[in++];
+			if (outPos + run > rawSize)
+			{
+				return false;
+			}
+			memset(raw + outPos, 0, run);
+			outPos += run;
+		}
+		else
+		{
+			if (outPos >= rawSize)
+			{
+				return false;
+			}
+			raw[outPos++] = value;
+		}
+	}
+
+	if (outPos != rawSize)
+	{
+		return false;
+	}
+
+	//then undo the xor delta
+	uint32_t* words = (uint32_t*)raw;
+	size_t wordCount = rawSize / sizeof(uint32_t);
+	for (size_t i = 1; i < wordCount; i++)
+	{
+		words[i] ^= words[i - 1];
+	}
+
+	return true;
+}
+
+//Stored as: height stream size (32 bits) | HeightCodec stream | CompressTile of the rest.
+//The heights are most of a tile and predict far better in 2D than as a flat run of words.
+void TerrainTileFile::CompressHeightTile(const uint8_t* raw, size_t rawSize, int width, int height, std::vector<uint8_t>& out)
+{
+	size_t heightBytes = (size_t)width * height * sizeof(float);
+	std::vector<uint8_t> heights, rest;
+
+	HeightCodec::Encode((const float*)raw, width, height, width, heights);
+	if (rawSize > heightBytes)
+	{
+		CompressTile(raw + heightBytes, rawSize - heightBytes, rest);
+	}
+
+	uint32_t heightSize = (uint32_t)heights.size();
+	out.resize(sizeof(heightSize) + heights.size() + rest.size());
+	memcpy(out.data(), &heightSize, sizeof(heightSize));
+	memcpy(out.data() + sizeof(heightSize), heights.data(), heights.size());
+	if (!rest.empty())
+	{
+		memcpy(out.data() + sizeof(heightSize) + heights.size(), rest.data(), rest.size());
+	}
+}
+
+bool TerrainTileFile::DecompressHeightTile(const uint8_t* stored, size_t storedSize, int width, int height, uint8_t* raw, size_t rawSize)
+{
+	size_t heightBytes = (size_t)width * height * sizeof(float);
+	uint32_t heightSize;
+
+	if (storedSize < sizeof(heightSize) || rawSize < heightBytes)
+	{
+		return false;
+	}
+	memcpy(&heightSize, stored, sizeof(heightSize));
+	if (heightSize > storedSize - sizeof(heightSize))
+	{
+		return false;
+	}
+
+	if (!HeightCodec::Decode(stored + sizeof(heightSize), heightSize, (float*)raw, width, height, width))
+	{
+		return false;
+	}
+
+	size_t restOffset = sizeof(heightSize) + heightSize;
+	if (rawSize == heightBytes)
+	{
+		return restOffset == storedSize;
+	}
+	return DecompressTile(stored + restOffset, storedSize - restOffset, raw + heightBytes, rawSize - heightBytes);
+}
+
+
+TerrainTileWriter::TerrainTileWriter()
+{
+	m_file = 0;
+	memset(&m_header, 0, sizeof(m_header));
+}
+
+TerrainTileWriter::~TerrainTileWriter()
+{
+	Close();
+}
+
+bool TerrainTileWriter::Open(const char* filename, uint32_t width, uint32_t height, uint32_t tileSize, uint32_t compression)
+{
+	errno_t err;
+
+	Close();
+
+	if (width == 0 || height == 0 || tileSize == 0 || tileSize > TerrainTileFile::MAX_TILE_SIZE)
+	{
+		return false;
+	}
+
+	err = fopen_s(&m_file, filename, "wb");
+	if (err != 0)
+	{
+		m_file = 0;
+		return false;
+	}
+
+	m_header.magic = TerrainTileFile::MAGIC;
+	m_header.version = TerrainTileFile::VERSION;
+	m_header.width = width;
+	m_header.height = height;
+	m_header.tileSize = tileSize;
+	m_header.tilesX = (width + tileSize - 1) / tileSize;
+	m_header.tilesZ = (height + tileSize - 1) / tileSize;
+	m_header.compression = compression;
+	m_header.directoryOffset = 0;
+
+	m_directory.assign((size_t)m_header.tilesX * m_header.tilesZ, TerrainTileFile::TileEntry());
+	memset(m_directory.data(), 0, m_directory.size() * sizeof(TerrainTileFile::TileEntry));
+	m_raw.resize(TerrainTileFile::TileRawSize(tileSize));
+
+	//write a placeholder header now, it gets patched with the directory offset on Close
+	if (fwrite(&m_header, sizeof(m_header), 1, m_file) != 1)
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+bool TerrainTileWriter::WriteTile(uint32_t tileX, uint32_t tileZ, const float* heights, const TerrainTileFile::PackedNormal* normals)
+{
+	if (!m_file || tileX >= m_header.tilesX || tileZ >= m_header.tilesZ)
+	{
+		return false;
+	}
+
+	size_t samples = TerrainTileFile::TileSampleCount(m_header.tileSize);
+	TerrainTileFile::TileEntry& entry = m_directory[(size_t)tileZ * m_header.tilesX + tileX];
+
+	//pack the heights and normals into one contiguous block
+	memcpy(m_raw.data(), heights, samples * sizeof(float));
+	TerrainTileFile::PackedNormal* packedNormals = (TerrainTileFile::PackedNormal*)(m_raw.data() + samples * sizeof(float));
+	if (normals)
+	{
+		memcpy(packedNormals, normals, samples * sizeof(TerrainTileFile::PackedNormal));
+	}
+	else
+	{
+		for (size_t i = 0; i < samples; i++)
+		{
+			packedNormals[i] = TerrainTileFile::PackNormal(0.0f, 1.0f, 0.0f);
+		}
+	}
+
+	entry.minHeight = heights[0];
+	entry.maxHeight = heights[0];
+	for (size_t i = 1; i < samples; i++)
+	{
+		entry.minHeight = std::min(entry.minHeight, heights[i]);
+		entry.maxHeight = std::max(entry.maxHeight, heights[i]);
+	}
+
+	const uint8_t* payload = m_raw.data();
+	size_t payloadSize = m_raw.size();
+	entry.compression = TerrainTileFile::COMPRESSION_NONE;
+
+	if (m_header.compression == TerrainTileFile::COMPRESSION_DELTA_RLE)
+	{
+		TerrainTileFile::CompressTile(m_raw.data(), m_raw.size(), m_packed);
+		//only keep the compressed copy if it actually saved something
+		if (m_packed.size() < m_raw.size())
+		{
+			payload = m_packed.data();
+			payloadSize = m_packed.size();
+			entry.compression = TerrainTileFile::COMPRESSION_DELTA_RLE;
+		}
+	}
+	else if (m_header.compression == TerrainTileFile::COMPRESSION_MED_RANS)
+	{
+		TerrainTileFile::CompressHeightTile(m_raw.data(), m_raw.size(), m_header.tileSize, m_header.tileSize, m_packed);
+		if (m_packed.size() < m_raw.size())
+		{
+			payload = m_packed.data();
+			payloadSize = m_packed.size();
+			entry.compression = TerrainTileFile::COMPRESSION_MED_RANS;
+		}
+	}
+
+	//rewriting a tile just appends a new copy, the directory points at the latest one
+	if (_fseeki64(m_file, 0, SEEK_END) != 0)
+	{
+		return false;
+	}
+	entry.offset = (uint64_t)_ftelli64(m_file);
+	entry.storedSize = (uint32_t)payloadSize;
+
+	if (fwrite(payload, 1, payloadSize, m_file) != payloadSize)
+	{
+		entry.offset = 0;
+		return false;
+	}
+
+	return true;
+}
+
+bool TerrainTileWriter::Close()
+{
+	bool result = true;
+
+	if (!m_file)
+	{
+		return true;
+	}
+
+	_fseeki64(m_file, 0, SEEK_END);
+	m_header.directoryOffset = (uint64_t)_ftelli64(m_file);
+
+	if (fwrite(m_directory.data(), sizeof(TerrainTileFile::TileEntry), m_directory.size(), m_file) != m_directory.size())
+	{
+		result = false;
+	}
+
+	_fseeki64(m_file, 0, SEEK_SET);
+	if (fwrite(&m_header, sizeof(m_header), 1, m_file) != 1)
+	{
+		result = false;
+	}
+
+	fclose(m_file);
+	m_file = 0;
+	m_directory.clear();
+
+	return result;
+}
+
+
+TerrainTileReader::TerrainTileReader()
+{
+	m_fileHandle = INVALID_HANDLE_VALUE;
+	m_mappingHandle = 0;
+	m_view = 0;
+	m_fileSize = 0;
+	m_header = 0;
+	m_directory = 0;
+}
+
+TerrainTileReader::~TerrainTileReader()
+{
+	Close();
+}
+
+bool TerrainTileReader::Open(const char* filename)
+{
+	LARGE_INTEGER size;
+
+	Close();
+
+	//random access hint, we jump around the file a tile at a time
+	m_fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (m_fileHandle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	if (!GetFileSizeEx(m_fileHandle, &size) || size.QuadPart < (LONGLONG)sizeof(TerrainTileFile::Header))
+	{
+		Close();
+		return false;
+	}
+	m_fileSize = (uint64_t)size.QuadPart;
+
+	//map the whole file, on x64 the address space is plenty even for files much larger than RAM
+	m_mappingHandle = CreateFileMappingA(m_fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_mappingHandle)
+	{
+		Close();
+		return false;
+	}
+
+	m_view = (const uint8_t*)MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (!m_view)
+	{
+		Close();
+		return false;
+	}
+
+	m_header = (const TerrainTileFile::Header*)m_view;
+	if (m_header->magic != TerrainTileFile::MAGIC || m_header->version != TerrainTileFile::VERSION || m_header->directoryOffset == 0)
+	{
+		Close();
+		return false;
+	}
+
+	//everything below sizes allocations and offsets, so don't trust any of it until it adds up
+	const TerrainTileFile::Header& header = *m_header;
+	if (header.width == 0 || header.height == 0 || header.tileSize == 0 || header.tileSize > TerrainTileFile::MAX_TILE_SIZE)
+	{
+		Close();
+		return false;
+	}
+	if (header.tilesX != (header.width + (uint64_t)header.tileSize - 1) / header.tileSize ||
+		header.tilesZ != (header.height + (uint64_t)header.tileSize - 1) / header.tileSize)
+	{
+		Close();
+		return false;
+	}
+
+	//the writer puts the directory last, so it has to end exactly where the file does
+	uint64_t directoryBytes = (uint64_t)header.tilesX * header.tilesZ * sizeof(TerrainTileFile::TileEntry);
+	if (header.directoryOffset < sizeof(TerrainTileFile::Header) || header.directoryOffset > m_fileSize ||
+		directoryBytes != m_fileSize - header.directoryOffset)
+	{
+		Close();
+		return false;
+	}
+	m_directory = (const TerrainTileFile::TileEntry*)(m_view + m_header->directoryOffset);
+
+	return true;
+}
+
+void TerrainTileReader::Close()
+{
+	if (m_view)
+	{
+		UnmapViewOfFile(m_view);
+		m_view = 0;
+	}
+
+	if (m_mappingHandle)
+	{
+		CloseHandle(m_mappingHandle);
+		m_mappingHandle = 0;
+	}
+
+	if (m_fileHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_fileHandle);
+		m_fileHandle = INVALID_HANDLE_VALUE;
+	}
+
+	m_header = 0;
+	m_directory = 0;
+	m_fileSize = 0;
+}
+
+const TerrainTileFile::TileEntry* TerrainTileReader::GetTileEntry(uint32_t tileX, uint32_t tileZ) const
+{
+	if (!m_directory || tileX >= m_header->tilesX || tileZ >= m_header->tilesZ)
+	{
+		return nullptr;
+	}
+
+	const TerrainTileFile::TileEntry* entry = &m_directory[(size_t)tileZ * m_header->tilesX + tileX];
+	//payloads sit between the header and the directory
+	if (entry->offset < sizeof(TerrainTileFile::Header) || entry->offset > m_header->directoryOffset ||
+		entry->storedSize > m_header->directoryOffset - entry->offset)
+	{
+		return nullptr;
+	}
+	return entry;
+}
+
+const float* TerrainTileReader::MapTileHeights(uint32_t tileX, uint32_t tileZ) const
+{
+	const TerrainTileFile::TileEntry* entry = GetTileEntry(tileX, tileZ);
+	if (!entry || entry->compression != TerrainTileFile::COMPRESSION_NONE || entry->storedSize != TerrainTileFile::TileRawSize(m_header->tileSize))
+	{
+		return nullptr;
+	}
+	return (const float*)(m_view + entry->offset);
+}
+
+const TerrainTileFile::PackedNormal* TerrainTileReader::MapTileNormals(uint32_t tileX, uint32_t tileZ) const
+{
+	const TerrainTileFile::TileEntry* entry = GetTileEntry(tileX, tileZ);
+	if (!entry || entry->compression != TerrainTileFile::COMPRESSION_NONE || entry->storedSize != TerrainTileFile::TileRawSize(m_header->tileSize))
+	{
+		return nullptr;
+	}
+	return (const TerrainTileFile::PackedNormal*)(m_view + entry->offset + TerrainTileFile::TileSampleCount(m_header->tileSize) * sizeof(float));
+}
+
+bool TerrainTileReader::ReadTile(uint32_t tileX, uint32_t tileZ, float* heights, TerrainTileFile::PackedNormal* normals) const
+{
+	const TerrainTileFile::TileEntry* entry = GetTileEntry(tileX, tileZ);
+	if (!entry)
+	{
+		return false;
+	}
+
+	size_t samples = TerrainTileFile::TileSampleCount(m_header->tileSize);
+	const uint8_t* stored = m_view + entry->offset;
+
+	if (entry->compression == TerrainTileFile::COMPRESSION_NONE)
+	{
+		if (entry->storedSize != TerrainTileFile::TileRawSize(m_header->tileSize))
+		{
+			return false;
+		}
+		memcpy(heights, stored, samples * sizeof(float));
+		if (normals)
+		{
+			memcpy(normals, stored + samples * sizeof(float), samples * sizeof(TerrainTileFile::PackedNormal));
+		}
+		return true;
+	}
+
+	if (entry->compression == TerrainTileFile::COMPRESSION_DELTA_RLE || entry->compression == TerrainTileFile::COMPRESSION_MED_RANS)
+	{
+		std::vector<uint8_t> raw(TerrainTileFile::TileRawSize(m_header->tileSize));
+		bool decoded = entry->compression == TerrainTileFile::COMPRESSION_DELTA_RLE ?
+			TerrainTileFile::DecompressTile(stored, entry->storedSize, raw.data(), raw.size()) :
+			TerrainTileFile::DecompressHeightTile(stored, entry->storedSize, m_header->tileSize, m_header->tileSize, raw.data(), raw.size());
+		if (!decoded)
+		{
+			return false;
+		}
+		memcpy(heights, raw.data(), samples * sizeof(float));
+		if (normals)
+		{
+			memcpy(normals, raw.data() + samples * sizeof(float), samples * sizeof(TerrainTileFile::PackedNormal));
+		}
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+//Binary tile container for terrain data so a heightfield can outlive the app (and be bigger than RAM).
+//File layout:  Header | tile payloads (in whatever order they were written) | tile directory
+//The directory sits at the end so the writer can stream tiles out without knowing their sizes up front.
+//Every tile is a fixed tileSize x tileSize block of float heights followed by packed 8 bit normals,
+//tiles on the right / bottom edge are padded out by repeating the last row / column.
+
+class TerrainTileFile
+{
+public:
+	static const uint32_t MAGIC = 0x31465454;	//"TTF1"
+	static const uint32_t VERSION = 1;
+	static const uint32_t MAX_TILE_SIZE = 4096;	//a raw tile is 8 bytes a sample, so up to 128MB
+
+	enum Compression
+	{
+		COMPRESSION_NONE = 0,
+		COMPRESSION_DELTA_RLE = 1,		//xor delta against the previous sample, then run length of zero bytes
+		COMPRESSION_MED_RANS = 2,		//heights through HeightCodec, the rest of the tile delta / run length coded
+	};
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t width, height;			//samples in the whole terrain
+		uint32_t tileSize;				//samples along one side of a tile
+		uint32_t tilesX, tilesZ;
+		uint32_t compression;			//default for the file, each tile records its own too
+		uint64_t directoryOffset;		//0 until the writer has been closed
+	};
+
+	struct TileEntry
+	{
+		uint64_t offset;				//0 means the tile was never written
+		uint32_t storedSize;			//bytes on disk
+		uint32_t compression;
+		float minHeight, maxHeight;
+	};
+
+	//normals are packed as signed bytes, w is padding so the tile rows stay 4 byte aligned
+	struct PackedNormal
+	{
+		int8_t x, y, z, w;
+	};
+
+	static size_t TileSampleCount(uint32_t tileSize) { return (size_t)tileSize * tileSize; }
+	static size_t TileRawSize(uint32_t tileSize) { return TileSampleCount(tileSize) * (sizeof(float) + sizeof(PackedNormal)); }
+
+	static PackedNormal PackNormal(float x, float y, float z);
+	static void UnpackNormal(const PackedNormal& n, float& x, float& y, float& z);
+
+	//compression helpers, shared by the writer and the reader
+	static void CompressTile(const uint8_t* raw, size_t rawSize, std::vector<uint8_t>& out);
+	static bool DecompressTile(const uint8_t* stored, size_t storedSize, uint8_t* raw, size_t rawSize);
+	//raw starts with width * height float heights, whatever follows (the normals) goes through CompressTile
+	static void CompressHeightTile(const uint8_t* raw, size_t rawSize, int width, int height, std::vector<uint8_t>& out);
+	static bool DecompressHeightTile(const uint8_t* stored, size_t storedSize, int width, int height, uint8_t* raw, size_t rawSize);
+};
+
+
+//Streams tiles to disk one at a time. Only the directory (a few bytes per tile) is kept in memory,
+//so a terrain far bigger than RAM can be written as long as the caller produces it tile by tile.
+class TerrainTileWriter
+{
+public:
+	TerrainTileWriter();
+	~TerrainTileWriter();
+
+	bool Open(const char* filename, uint32_t width, uint32_t height, uint32_t tileSize, uint32_t compression);
+	//heights and normals are tileSize * tileSize samples, row major. normals may be null (written as straight up).
+	bool WriteTile(uint32_t tileX, uint32_t tileZ, const float* heights, const TerrainTileFile::PackedNormal* normals);
+	bool Close();
+
+	uint32_t GetTilesX() const { return m_header.tilesX; }
+	uint32_t GetTilesZ() const { return m_header.tilesZ; }
+	uint32_t GetTileSize() const { return m_header.tileSize; }
+
+private:
+	FILE* m_file;
+	TerrainTileFile::Header m_header;
+	std::vector<TerrainTileFile::TileEntry> m_directory;
+	std::vector<uint8_t> m_raw;
+	std::vector<uint8_t> m_packed;
+};
+
+
+//Opens a tile file with a read only memory mapping. Nothing is read up front: a tile's pages are
+//faulted in by the OS the first time it is touched, and dropped again under memory pressure.
+class TerrainTileReader
+{
+public:
+	TerrainTileReader();
+	~TerrainTileReader();
+
+	bool Open(const char* filename);
+	void Close();
+
+	const TerrainTileFile::Header& GetHeader() const { return *m_header; }
+	const TerrainTileFile::TileEntry* GetTileEntry(uint32_t tileX, uint32_t tileZ) const;
+
+	//direct pointers into the mapping, only valid for uncompressed tiles (returns null otherwise)
+	const float* MapTileHeights(uint32_t tileX, uint32_t tileZ) const;
+	const TerrainTileFile::PackedNormal* MapTileNormals(uint32_t tileX, uint32_t tileZ) const;
+
+	//copies (and decompresses if needed) a tile into caller owned buffers of tileSize * tileSize samples
+	bool ReadTile(uint32_t tileX, uint32_t tileZ, float* heights, TerrainTileFile::PackedNormal* normals) const;
+
+private:
+	HANDLE m_fileHandle;
+	HANDLE m_mappingHandle;
+	const uint8_t* m_view;
+	uint64_t m_fileSize;
+	const TerrainTileFile::Header* m_header;
+	const TerrainTileFile::TileEntry* m_directory;
+};
@@ -0,0 +1,887 @@
+#include "pch.h"
+#include "VolumeLod.h"
+#include "MarchingCubes.h"
+#include "ParallelFor.h"
+#include "Philox.h"
+#include <chrono>
+#include <cstring>
+#include <cfloat>
+
+using DirectX::SimpleMath::Vector3;
+
+namespace
+{
+	//the points a transition cell's vertices can sit on, on the edges of a coarse face cell's 3 x 3 fine samples.
+	//(a, b) is where the edge starts, in fine samples along the face's u and v axes.
+	struct Slot
+	{
+		int a, b;
+		int direction;		//0 along u, 1 along v
+		bool coarse;		//a whole coarse edge rather than half of one
+	};
+
+	const Slot SLOTS[16] =
+	{
+		//fine u edges, b * 2 + a
+		{ 0, 0, 0, false }, { 1, 0, 0, false }, { 0, 1, 0, false }, { 1, 1, 0, false }, { 0, 2, 0, false }, { 1, 2, 0, false },
+		//fine v edges, 6 + b * 3 + a
+		{ 0, 0, 1, false }, { 1, 0, 1, false }, { 2, 0, 1, false }, { 0, 1, 1, false }, { 1, 1, 1, false }, { 2, 1, 1, false },
+		//coarse edges: u at b = 0, u at b = 2, v at a = 0, v at a = 2
+		{ 0, 0, 0, true }, { 0, 2, 0, true }, { 0, 0, 1, true }, { 2, 0, 1, true },
+	};
+
+	int FineU(int a, int b) { return b * 2 + a; }
+	int FineV(int a, int b) { return 6 + b * 3 + a; }
+
+	//the four coarse edges going anticlockwise round the cell, each from corner A through its middle sample M to B.
+	//f1 and f2 are the fine halves A - M and M - B, c the whole edge.
+	struct Border
+	{
+		int a0, b0, a1, b1, a2, b2;
+		int f1, f2, c;
+	};
+
+	const Border BORDERS[4] =
+	{
+		{ 0, 0, 1, 0, 2, 0, 0, 1, 12 },
+		{ 2, 0, 2, 1, 2, 2, 8, 11, 15 },
+		{ 2, 2, 1, 2, 0, 2, 5, 4, 13 },
+		{ 0, 2, 0, 1, 0, 0, 9, 6, 14 },
+	};
+
+	//a chunk's surface meets its faces the right way round when its transition cells face this way on a min face
+	//(in the coarse face's u, v order) and the other way on a max face
+	const bool FLIP_MIN_FACE = false;
+
+	//for each of the 512 cases (bit b * 3 + a set when fine sample (a, b) is below the iso level) the loops around
+	//the part of the face cell between the fine and coarse contours: a vertex count then that many slots, 0 ends
+	struct TransitionTable
+	{
+		int8_t loops[512][24];
+	};
+
+	//marching squares round one square. corners and edges go anticlockwise, edge i from corner i to i + 1.
+	//every run of corners below the iso level is cut off by one segment with it on the left, so on an ambiguous
+	//square the two corners below it are cut off separately, the same split the marching cubes table makes.
+	void AddContour(const bool below[4], const int edges[4], bool reverse, int* from, int* to, int& count)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			if (!below[i] || below[(i + 3) % 4])
+			{
+				continue;
+			}
+
+			int last = i;
+			while (below[(last + 1) % 4] && (last + 1) % 4 != i)
+			{
+				last = (last + 1) % 4;
+			}
+			if ((last + 1) % 4 == i)
+			{
+				//all four below, nothing to cut
+				return;
+			}
+
+			int start = edges[last], end = edges[(i + 3) % 4];
+			from[count] = reverse ? end : start;
+			to[count] = reverse ? start : end;
+			count++;
+		}
+	}
+
+	void BuildCase(int index, int8_t* out)
+	{
+		auto below = [index](int a, int b) { return ((index >> (b * 3 + a)) & 1) != 0; };
+		int from[32], to[32], count = 0;
+
+		//the fine contour
+		for (int b = 0; b < 2; b++)
+		{
+			for (int a = 0; a < 2; a++)
+			{
+				bool corners[4] = { below(a, b), below(a + 1, b), below(a + 1, b + 1), below(a, b + 1) };
+				int edges[4] = { FineU(a, b), FineV(a + 1, b), FineU(a, b + 1), FineV(a, b) };
+				AddContour(corners, edges, false, from, to, count);
+			}
+		}
+
+		//less the coarse one
+		bool corners[4] = { below(0, 0), below(2, 0), below(2, 2), below(0, 2) };
+		int edges[4] = { 12, 15, 13, 14 };
+		AddContour(corners, edges, true, from, to, count);
+
+		//and along each coarse edge, the stretch that is below for the fine samples but not the coarse ones (or the
+		//other way round, backwards). that closes the two contours into loops.
+		for (int i = 0; i < 4; i++)
+		{
+			const Border& border = BORDERS[i];
+			bool start = below(border.a0, border.b0), middle = below(border.a1, border.b1), end = below(border.a2, border.b2);
+			int segmentFrom = -1, segmentTo = -1;
+			if (start == end)
+			{
+				if (middle != start)
+				{
+					segmentFrom = start ? border.f2 : border.f1;
+					segmentTo = start ? border.f1 : border.f2;
+				}
+			}
+			else if (start)
+			{
+				segmentFrom = border.c;
+				segmentTo = middle ? border.f2 : border.f1;
+			}
+			else
+			{
+				segmentFrom = middle ? border.f1 : border.f2;
+				segmentTo = border.c;
+			}
+
+			if (segmentFrom >= 0)
+			{
+				from[count] = segmentFrom;
+				to[count] = segmentTo;
+				count++;
+			}
+		}
+
+		//every slot is entered and left at most once, so the segments chain into loops without any choices
+		int next[16];
+		std::fill(next, next + 16, -1);
+		for (int i = 0; i < count; i++)
+		{
+			next[from[i]] = to[i];
+		}
+
+		int written = 0;
+		for (int slot = 0; slot < 16; slot++)
+		{
+			if (next[slot] < 0)
+			{
+				continue;
+			}
+
+			int size = written++;
+			out[size] = 0;
+			for (int current = slot; next[current] >= 0; )
+			{
+				int following = next[current];
+				next[current] = -1;
+				out[written++] = (int8_t)current;
+				out[size]++;
+				current = following;
+			}
+		}
+		out[written] = 0;
+	}
+
+	const TransitionTable& GetTransitionTable()
+	{
+		static const TransitionTable table = []()
+		{
+			TransitionTable built;
+			for (int i = 0; i < 512; i++)
+			{
+				BuildCase(i, built.loops[i]);
+			}
+			return built;
+		}();
+		return table;
+	}
+
+	//ear clipping in the face plane. loops are tiny and mostly convex, and a loop keeps its winding (anticlockwise
+	//loops are fine samples below over coarse ones above, clockwise ones the reverse).
+	void Triangulate(const int8_t* loop, int size, const float* u, const float* v, int* out, int& count)
+	{
+		int ring[16];
+		float area = 0.0f;
+		for (int i = 0; i < size; i++)
+		{
+			ring[i] = loop[i];
+			int j = loop[(i + 1) % size];
+			area += u[loop[i]] * v[j] - u[j] * v[loop[i]];
+		}
+		float winding = area < 0.0f ? -1.0f : 1.0f;
+
+		auto cross = [&](int a, int b, int c) { return ((u[b] - u[a]) * (v[c] - v[a]) - (v[b] - v[a]) * (u[c] - u[a])) * winding; };
+
+		while (size > 3)
+		{
+			int ear = 0;
+			for (int i = 0; i < size; i++)
+			{
+				int previous = ring[(i + size - 1) % size], current = ring[i], next = ring[(i + 1) % size];
+				if (cross(previous, current, next) < 0.0f)
+				{
+					continue;
+				}
+
+				bool blocked = false;
+				for (int j = 0; j < size && !blocked; j++)
+				{
+					int other = ring[j];
+					blocked = other != previous && other != current && other != next &&
+						cross(previous, current, other) > 0.0f && cross(current, next, other) > 0.0f && cross(next, previous, other) > 0.0f;
+				}
+				if (!blocked)
+				{
+					ear = i;
+					break;
+				}
+			}
+
+			//with no clean ear (everything in a line) any corner will do
+			out[count++] = ring[(ear + size - 1) % size];
+			out[count++] = ring[ear];
+			out[count++] = ring[(ear + 1) % size];
+			for (int i = ear; i + 1 < size; i++)
+			{
+				ring[i] = ring[i + 1];
+			}
+			size--;
+		}
+
+		out[count++] = ring[0];
+		out[count++] = ring[1];
+		out[count++] = ring[2];
+	}
+
+	float Component(const Vector3& vector, int axis)
+	{
+		return axis == 0 ? vector.x : axis == 1 ? vector.y : vector.z;
+	}
+
+	//exact positions for welding
+	struct PositionKey
+	{
+		uint32_t x, y, z;
+		bool operator==(const PositionKey& other) const { return x == other.x && y == other.y && z == other.z; }
+	};
+
+	struct PositionHash
+	{
+		size_t operator()(const PositionKey& key) const
+		{
+			uint64_t hash = key.x * 0x9E3779B97F4A7C15ull;
+			hash ^= (hash >> 29) + key.y * 0xBF58476D1CE4E5B9ull;
+			hash ^= (hash >> 31) + key.z * 0x94D049BB133111EBull;
+			return (size_t)(hash ^ (hash >> 32));
+		}
+	};
+}
+
+VolumeLod::VolumeLod()
+{
+	m_density = nullptr;
+	m_sizeX = m_sizeY = m_sizeZ = 0;
+	m_rootsX = m_rootsY = m_rootsZ = 0;
+}
+
+VolumeLod::~VolumeLod()
+{
+}
+
+bool VolumeLod::Initialize(const float* density, int sizeX, int sizeY, int sizeZ, const Settings& settings)
+{
+	Clear();
+	if (!density || settings.chunkCells < 2 || (settings.chunkCells & 1) || settings.levels < 1 || settings.levels > MAX_LEVELS)
+	{
+		return false;
+	}
+
+	int rootCells = settings.chunkCells << (settings.levels - 1);
+	if (sizeX < 2 || sizeY < 2 || sizeZ < 2 || (sizeX - 1) % rootCells || (sizeY - 1) % rootCells || (sizeZ - 1) % rootCells)
+	{
+		return false;
+	}
+
+	m_density = density;
+	m_sizeX = sizeX;
+	m_sizeY = sizeY;
+	m_sizeZ = sizeZ;
+	m_rootsX = (sizeX - 1) / rootCells;
+	m_rootsY = (sizeY - 1) / rootCells;
+	m_rootsZ = (sizeZ - 1) / rootCells;
+	m_settings = settings;
+	return true;
+}
+
+void VolumeLod::Clear()
+{
+	m_density = nullptr;
+	m_sizeX = m_sizeY = m_sizeZ = 0;
+	m_rootsX = m_rootsY = m_rootsZ = 0;
+	m_split.clear();
+	m_cache.clear();
+	m_chunks.clear();
+}
+
+void VolumeLod::Update(const Vector3& eye, int threadCount, Stats* stats)
+{
+	if (!m_density)
+	{
+		return;
+	}
+
+	//split by distance, then until it's balanced. splitting a chunk can unbalance a coarser one next to it,
+	//so that goes round until nothing changes (at most once per level).
+	int top = m_settings.levels - 1;
+	m_split.clear();
+	for (int z = 0; z < m_rootsZ; z++)
+	{
+		for (int y = 0; y < m_rootsY; y++)
+		{
+			for (int x = 0; x < m_rootsX; x++)
+			{
+				Refine(top, x, y, z, eye);
+			}
+		}
+	}
+
+	std::vector<Chunk> leaves;
+	for (bool changed = true; changed; )
+	{
+		changed = false;
+		leaves.clear();
+		for (int z = 0; z < m_rootsZ; z++)
+		{
+			for (int y = 0; y < m_rootsY; y++)
+			{
+				for (int x = 0; x < m_rootsX; x++)
+				{
+					GatherLeaves(top, x, y, z, leaves);
+				}
+			}
+		}
+
+		for (const Chunk& leaf : leaves)
+		{
+			if (NeedsSplit(leaf.level, leaf.x, leaf.y, leaf.z))
+			{
+				m_split.insert(Key(leaf.level, leaf.x, leaf.y, leaf.z));
+				changed = true;
+			}
+		}
+	}
+
+	//a face is finer when the same sized chunk across it is split (by one level, the balance sees to that)
+	const int offsets[6][3] = { { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+	for (Chunk& leaf : leaves)
+	{
+		leaf.finerFaces = 0;
+		for (int face = 0; face < 6; face++)
+		{
+			if (IsSplit(leaf.level, leaf.x + offsets[face][0], leaf.y + offsets[face][1], leaf.z + offsets[face][2]))
+			{
+				leaf.finerFaces |= (uint8_t)(1 << face);
+			}
+		}
+	}
+
+	//new chunks and chunks whose finer faces changed get (re)meshed, everything that isn't a leaf any more goes
+	for (auto& entry : m_cache)
+	{
+		entry.second.used = false;
+	}
+
+	std::vector<std::pair<Chunk*, Cached*>> work;
+	std::vector<uint8_t> fresh;
+	size_t meshed = 0;
+	for (Chunk& leaf : leaves)
+	{
+		uint64_t key = Key(leaf.level, leaf.x, leaf.y, leaf.z);
+		auto found = m_cache.find(key);
+		bool added = found == m_cache.end();
+		if (added)
+		{
+			found = m_cache.emplace(key, Cached()).first;
+			meshed++;
+		}
+
+		//a chunk that was already there only needs its transition cells redone, and only if its finer faces changed
+		Cached& cached = found->second;
+		cached.used = true;
+		if (added || cached.finerFaces != leaf.finerFaces)
+		{
+			cached.finerFaces = leaf.finerFaces;
+			work.push_back(std::make_pair(&leaf, &cached));
+			fresh.push_back(added ? 1 : 0);
+		}
+		leaf.mesh = &cached.mesh;
+		leaf.transition = &cached.transition;
+	}
+
+	ParallelForRanges(0, (int)work.size(), [&](int first, int last)
+	{
+		std::vector<float> samples;
+		for (int i = first; i < last; i++)
+		{
+			if (fresh[i])
+			{
+				MeshChunk(*work[i].first, samples, work[i].second->mesh);
+			}
+			MeshTransition(*work[i].first, work[i].second->transition);
+		}
+	}, threadCount);
+
+	for (auto entry = m_cache.begin(); entry != m_cache.end(); )
+	{
+		entry = entry->second.used ? std::next(entry) : m_cache.erase(entry);
+	}
+	m_chunks.swap(leaves);
+
+	if (stats)
+	{
+		memset(stats, 0, sizeof(Stats));
+		stats->chunks = m_chunks.size();
+		stats->meshedChunks = meshed;
+		size_t chunkCells = (size_t)m_settings.chunkCells * m_settings.chunkCells * m_settings.chunkCells;
+		for (const Chunk& chunk : m_chunks)
+		{
+			stats->levelChunks[chunk.level]++;
+			stats->cells += chunkCells;
+			stats->fullCells += chunkCells << (3 * chunk.level);
+			stats->triangles += chunk.mesh->GetTriangleCount();
+			stats->transitionTriangles += chunk.transition->GetTriangleCount();
+		}
+		stats->triangles += stats->transitionTriangles;
+	}
+}
+
+void VolumeLod::Merge(MeshData& mesh) const
+{
+	mesh.Clear();
+	for (const Chunk& chunk : m_chunks)
+	{
+		const MeshData* parts[2] = { chunk.mesh, chunk.transition };
+		for (const MeshData* part : parts)
+		{
+			uint32_t base = (uint32_t)mesh.positions.size();
+			mesh.positions.insert(mesh.positions.end(), part->positions.begin(), part->positions.end());
+			mesh.normals.insert(mesh.normals.end(), part->normals.begin(), part->normals.end());
+			for (uint32_t index : part->indices)
+			{
+				mesh.indices.push_back(base + index);
+			}
+		}
+	}
+}
+
+uint64_t VolumeLod::Key(int level, int x, int y, int z)
+{
+	return ((uint64_t)level << 60) | ((uint64_t)(uint32_t)x << 40) | ((uint64_t)(uint32_t)y << 20) | (uint64_t)(uint32_t)z;
+}
+
+bool VolumeLod::ShouldSplit(int level, int x, int y, int z, const Vector3& eye) const
+{
+	//distance from the eye to the chunk's box
+	float width = (float)(m_settings.chunkCells << level) * m_settings.spacing;
+	Vector3 minimum = m_settings.origin + Vector3((float)x, (float)y, (float)z) * width;
+	Vector3 maximum = minimum + Vector3(width, width, width);
+	Vector3 closest(
+		std::max(minimum.x, std::min(eye.x, maximum.x)),
+		std::max(minimum.y, std::min(eye.y, maximum.y)),
+		std::max(minimum.z, std::min(eye.z, maximum.z)));
+	return (eye - closest).Length() < m_settings.lodDistance * width;
+}
+
+void VolumeLod::Refine(int level, int x, int y, int z, const Vector3& eye)
+{
+	if (level == 0 || !ShouldSplit(level, x, y, z, eye))
+	{
+		return;
+	}
+
+	m_split.insert(Key(level, x, y, z));
+	for (int i = 0; i < 8; i++)
+	{
+		Refine(level - 1, x * 2 + (i & 1), y * 2 + ((i >> 1) & 1), z * 2 + (i >> 2), eye);
+	}
+}
+
+bool VolumeLod::NeedsSplit(int level, int x, int y, int z) const
+{
+	//a leaf is too coarse when a neighbour is split and one of that neighbour's children on the shared face is too
+	if (level < 2)
+	{
+		return false;
+	}
+
+	const int offsets[6][3] = { { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+	for (int face = 0; face < 6; face++)
+	{
+		const int* offset = offsets[face];
+		int nx = x + offset[0], ny = y + offset[1], nz = z + offset[2];
+		if (!IsSplit(level, nx, ny, nz))
+		{
+			continue;
+		}
+
+		for (int i = 0; i < 8; i++)
+		{
+			int child[3] = { i & 1, (i >> 1) & 1, i >> 2 };
+			//the children facing back towards this chunk
+			int axis = face / 2;
+			if (child[axis] != (offset[axis] > 0 ? 0 : 1))
+			{
+				continue;
+			}
+			if (IsSplit(level - 1, nx * 2 + child[0], ny * 2 + child[1], nz * 2 + child[2]))
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool VolumeLod::IsSplit(int level, int x, int y, int z) const
+{
+	int shift = m_settings.levels - 1 - level;
+	if (x < 0 || y < 0 || z < 0 || x >= (m_rootsX << shift) || y >= (m_rootsY << shift) || z >= (m_rootsZ << shift))
+	{
+		return false;
+	}
+	return m_split.count(Key(level, x, y, z)) != 0;
+}
+
+void VolumeLod::GatherLeaves(int level, int x, int y, int z, std::vector<Chunk>& leaves) const
+{
+	if (!IsSplit(level, x, y, z))
+	{
+		Chunk chunk;
+		chunk.level = level;
+		chunk.x = x;
+		chunk.y = y;
+		chunk.z = z;
+		chunk.finerFaces = 0;
+		chunk.mesh = nullptr;
+		chunk.transition = nullptr;
+		leaves.push_back(chunk);
+		return;
+	}
+
+	for (int i = 0; i < 8; i++)
+	{
+		GatherLeaves(level - 1, x * 2 + (i & 1), y * 2 + ((i >> 1) & 1), z * 2 + (i >> 2), leaves);
+	}
+}
+
+void VolumeLod::MeshChunk(const Chunk& chunk, std::vector<float>& samples, MeshData& mesh) const
+{
+	int step = 1 << chunk.level;
+	int size = m_settings.chunkCells + 1;
+	int base[3] = { chunk.x * m_settings.chunkCells * step, chunk.y * m_settings.chunkCells * step, chunk.z * m_settings.chunkCells * step };
+
+	samples.resize((size_t)size * size * size);
+	for (int z = 0; z < size; z++)
+	{
+		for (int y = 0; y < size; y++)
+		{
+			float* row = samples.data() + ((size_t)z * size + y) * size;
+			for (int x = 0; x < size; x++)
+			{
+				row[x] = Sample(base[0] + x * step, base[1] + y * step, base[2] + z * step);
+			}
+		}
+	}
+
+	//meshed in the chunk's own sample units, which says which edge each vertex is on
+	MarchingCubes::Settings settings;
+	settings.isoLevel = m_settings.isoLevel;
+	settings.normals = false;
+	MarchingCubes::Polygonise(samples.data(), size, size, size, settings, mesh, 1);
+
+	mesh.normals.resize(mesh.positions.size());
+	for (size_t i = 0; i < mesh.positions.size(); i++)
+	{
+		//the edge is along the one axis that isn't a whole number (none when the crossing is right on a sample)
+		const Vector3& local = mesh.positions[i];
+		int sample[3], axis = -1;
+		float furthest = 0.0f;
+		for (int k = 0; k < 3; k++)
+		{
+			float value = Component(local, k);
+			float nearest = floorf(value + 0.5f);
+			if (fabsf(value - nearest) > furthest)
+			{
+				furthest = fabsf(value - nearest);
+				axis = k;
+			}
+			sample[k] = (int)nearest;
+		}
+		if (axis >= 0)
+		{
+			sample[axis] = (int)floorf(Component(local, axis));
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			sample[k] = base[k] + sample[k] * step;
+		}
+		PlaceEdge(sample, axis, step, mesh.positions[i], mesh.normals[i]);
+	}
+}
+
+void VolumeLod::MeshTransition(const Chunk& chunk, MeshData& mesh) const
+{
+	mesh.Clear();
+	if (!chunk.finerFaces)
+	{
+		return;
+	}
+
+	const TransitionTable& table = GetTransitionTable();
+	int cells = m_settings.chunkCells;
+	int step = 1 << chunk.level, half = step / 2;
+	int base[3] = { chunk.x * cells * step, chunk.y * cells * step, chunk.z * cells * step };
+
+	for (int face = 0; face < 6; face++)
+	{
+		if (!(chunk.finerFaces & (1 << face)))
+		{
+			continue;
+		}
+
+		//u, v, normal is right handed
+		int normal = face / 2, u = (normal + 1) % 3, v = (normal + 2) % 3;
+		bool flip = ((face & 1) == 0) != FLIP_MIN_FACE;
+		int sample[3];
+		sample[normal] = base[normal] + (face & 1) * cells * step;
+
+		for (int j = 0; j < cells; j++)
+		{
+			for (int i = 0; i < cells; i++)
+			{
+				int cornerU = base[u] + i * step, cornerV = base[v] + j * step;
+				int caseIndex = 0;
+				for (int b = 0; b < 3; b++)
+				{
+					for (int a = 0; a < 3; a++)
+					{
+						sample[u] = cornerU + a * half;
+						sample[v] = cornerV + b * half;
+						if (Sample(sample[0], sample[1], sample[2]) < m_settings.isoLevel)
+						{
+							caseIndex |= 1 << (b * 3 + a);
+						}
+					}
+				}
+
+				const int8_t* loops = table.loops[caseIndex];
+				if (!loops[0])
+				{
+					continue;
+				}
+
+				uint32_t indices[16];
+				float faceU[16], faceV[16];
+				std::fill(indices, indices + 16, UINT32_MAX);
+				int triangles[48], count = 0;
+				for (const int8_t* loop = loops; *loop; loop += *loop + 1)
+				{
+					for (int k = 1; k <= *loop; k++)
+					{
+						int slot = loop[k];
+						if (indices[slot] != UINT32_MAX)
+						{
+							continue;
+						}
+
+						const Slot& place = SLOTS[slot];
+						sample[u] = cornerU + place.a * half;
+						sample[v] = cornerV + place.b * half;
+						Vector3 position, direction;
+						PlaceEdge(sample, place.direction ? v : u, place.coarse ? step : half, position, direction);
+
+						indices[slot] = (uint32_t)mesh.positions.size();
+						faceU[slot] = Component(position, u);
+						faceV[slot] = Component(position, v);
+						mesh.positions.push_back(position);
+						mesh.normals.push_back(direction);
+					}
+					Triangulate(loop + 1, *loop, faceU, faceV, triangles, count);
+				}
+
+				for (int k = 0; k < count; k += 3)
+				{
+					mesh.indices.push_back(indices[triangles[k]]);
+					mesh.indices.push_back(indices[triangles[k + (flip ? 2 : 1)]]);
+					mesh.indices.push_back(indices[triangles[k + (flip ? 1 : 2)]]);
+				}
+			}
+		}
+	}
+}
+
+void VolumeLod::PlaceEdge(const int sample[3], int axis, int step, Vector3& position, Vector3& normal) const
+{
+	//axis -1 is the sample itself
+	float t = 0.0f;
+	int end[3] = { sample[0], sample[1], sample[2] };
+	if (axis >= 0)
+	{
+		end[axis] += step;
+		float value0 = Sample(sample[0], sample[1], sample[2]);
+		float value1 = Sample(end[0], end[1], end[2]);
+		t = (m_settings.isoLevel - value0) / (value1 - value0);
+	}
+
+	float offset[3] = { 0.0f, 0.0f, 0.0f };
+	if (axis >= 0)
+	{
+		offset[axis] = t * step;
+	}
+	position = m_settings.origin + Vector3(sample[0] + offset[0], sample[1] + offset[1], sample[2] + offset[2]) * m_settings.spacing;
+
+	//like MarchingCubes, at the spacing of the samples the edge came from
+	Vector3 gradient = Gradient(sample, step) * (1.0f - t) + Gradient(end, step) * t;
+	float length = gradient.Length();
+	normal = length > 0.0f ? gradient * (-1.0f / length) : Vector3(0.0f, 1.0f, 0.0f);
+}
+
+Vector3 VolumeLod::Gradient(const int sample[3], int step) const
+{
+	int x = sample[0], y = sample[1], z = sample[2];
+	int x0 = std::max(x - step, 0), x1 = std::min(x + step, m_sizeX - 1);
+	int y0 = std::max(y - step, 0), y1 = std::min(y + step, m_sizeY - 1);
+	int z0 = std::max(z - step, 0), z1 = std::min(z + step, m_sizeZ - 1);
+	return Vector3(
+		(Sample(x1, y, z) - Sample(x0, y, z)) / (float)std::max(x1 - x0, 1),
+		(Sample(x, y1, z) - Sample(x, y0, z)) / (float)std::max(y1 - y0, 1),
+		(Sample(x, y, z1) - Sample(x, y, z0)) / (float)std::max(z1 - z0, 1));
+}
+
+size_t VolumeLod::CountOpenEdges(const MeshData& mesh)
+{
+	std::unordered_map<PositionKey, uint32_t, PositionHash> lookup;
+	std::vector<uint32_t> remap(mesh.positions.size());
+	lookup.reserve(mesh.positions.size());
+	for (size_t i = 0; i < mesh.positions.size(); i++)
+	{
+		PositionKey key;
+		memcpy(&key.x, &mesh.positions[i].x, 4);
+		memcpy(&key.y, &mesh.positions[i].y, 4);
+		memcpy(&key.z, &mesh.positions[i].z, 4);
+		remap[i] = lookup.emplace(key, (uint32_t)lookup.size()).first->second;
+	}
+
+	//every directed edge once, and its reverse once
+	std::unordered_map<uint64_t, int> edges;
+	edges.reserve(mesh.indices.size());
+	for (size_t t = 0; t + 2 < mesh.indices.size(); t += 3)
+	{
+		uint32_t corners[3] = { remap[mesh.indices[t]], remap[mesh.indices[t + 1]], remap[mesh.indices[t + 2]] };
+		if (corners[0] == corners[1] || corners[1] == corners[2] || corners[0] == corners[2])
+		{
+			continue;
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			edges[((uint64_t)corners[k] << 32) | corners[(k + 1) % 3]]++;
+		}
+	}
+
+	size_t open = 0;
+	for (const auto& edge : edges)
+	{
+		uint64_t reverse = (edge.first << 32) | (edge.first >> 32);
+		auto found = edges.find(reverse);
+		if (edge.second != 1 || found == edges.end() || found->second != 1)
+		{
+			open++;
+		}
+	}
+	return open;
+}
+
+size_t VolumeLod::TestWatertight(int trials, int threadCount)
+{
+	//three levels of 8 cell chunks, two roots across
+	Settings settings;
+	settings.chunkCells = 8;
+	settings.levels = 3;
+	const int size = 8 * 4 * 2 + 1;
+
+	Philox random(47);
+	std::vector<float> density((size_t)size * size * size);
+	size_t open = 0;
+	for (int trial = 0; trial < trials; trial++)
+	{
+		//a few solid balls with noise on every sample (which gives plenty of ambiguous faces), kept off the edges
+		int balls = 2 + (int)(random.GetFloat(0, trial, 0) * 5.0f);
+		float noise = random.GetFloat(1, trial, 0) * 1.5f;
+		Vector3 centres[8];
+		float radii[8];
+		for (int i = 0; i < balls; i++)
+		{
+			centres[i] = Vector3(random.GetFloat(i, trial, 1), random.GetFloat(i, trial, 2), random.GetFloat(i, trial, 3)) * (size - 24.0f) + Vector3(12.0f, 12.0f, 12.0f);
+			radii[i] = 4.0f + random.GetFloat(i, trial, 4) * 10.0f;
+		}
+
+		for (int z = 0; z < size; z++)
+		{
+			for (int y = 0; y < size; y++)
+			{
+				for (int x = 0; x < size; x++)
+				{
+					size_t index = ((size_t)z * size + y) * size + x;
+					if (x == 0 || y == 0 || z == 0 || x == size - 1 || y == size - 1 || z == size - 1)
+					{
+						density[index] = -1.0f;
+						continue;
+					}
+
+					float value = -FLT_MAX;
+					for (int i = 0; i < balls; i++)
+					{
+						value = std::max(value, radii[i] - (Vector3((float)x, (float)y, (float)z) - centres[i]).Length());
+					}
+					density[index] = value + (random.GetFloat(x + y * size, z, 5 + trial) - 0.5f) * noise;
+				}
+			}
+		}
+
+		VolumeLod lod;
+		settings.lodDistance = 0.25f + random.GetFloat(2, trial, 0) * 1.5f;
+		lod.Initialize(density.data(), size, size, size, settings);
+
+		//a few eyes in turn, so cached chunks get reused next to new ones
+		for (int eye = 0; eye < 3; eye++)
+		{
+			Vector3 position = Vector3(random.GetFloat(eye, trial, 6), random.GetFloat(eye, trial, 7), random.GetFloat(eye, trial, 8)) * (size + 32.0f) - Vector3(16.0f, 16.0f, 16.0f);
+			lod.Update(position, threadCount);
+
+			MeshData merged;
+			lod.Merge(merged);
+			open += CountOpenEdges(merged);
+		}
+	}
+	return open;
+}
+
+double VolumeLod::Benchmark(int size, int levels, int iterations, int threadCount, Stats* stats)
+{
+	Settings settings;
+	settings.levels = std::max(1, std::min(levels, (int)MAX_LEVELS));
+	int rootCells = settings.chunkCells << (settings.levels - 1);
+	size = ((std::max(size, 2) - 2) / rootCells + 1) * rootCells + 1;
+
+	std::vector<float> density;
+	MarchingCubes::BuildBenchmarkVolume(size, density, threadCount);
+
+	Vector3 eye(0.0f, size * 0.75f, 0.0f);
+	iterations = std::max(iterations, 1);
+	double seconds = 0.0;
+	for (int i = 0; i < iterations; i++)
+	{
+		VolumeLod lod;
+		lod.Initialize(density.data(), size, size, size, settings);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		lod.Update(eye, threadCount, stats);
+		auto end = std::chrono::high_resolution_clock::now();
+		seconds += std::chrono::duration<double>(end - start).count();
+	}
+	return seconds / iterations;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <stdint.h>
+#include "MeshData.h"
+
+//Level of detail for a marching cubes volume, in the spirit of Lengyel's Transvoxel.
+//
+//The volume is cut into chunks of chunkCells^3 cells. A level l chunk reads every 2^l th sample, so it covers 8^l
+//times the volume of a level 0 one for the same meshing cost: each level further out costs 8x less per unit of
+//volume. The chunks are the leaves of an octree over the volume: a chunk splits into its eight children while the
+//eye is closer than lodDistance of its own widths, and is then split some more until no chunk touches a face of one
+//more than a level finer (2:1 balance). Every chunk is meshed with MarchingCubes, so with the same table as the
+//geometry shader, and kept until it stops being a leaf.
+//
+//Where a chunk meets a finer one, the two surfaces end on the shared face along different contours (the coarse one
+//misses the samples in between) and leave a crack. The coarser chunk closes it with a transition cell on each of
+//its face cells there: the region of the face between the fine contour (its 3 x 3 fine samples) and the coarse one
+//(its 4 corners), triangulated. Both contours are marching squares on the face, split on ambiguous faces the way
+//the marching cubes table does, so they are exactly the edges the two chunks' triangles end on. The 512 cases are
+//worked out once from that and the triangles follow each case's loops. Unlike Transvoxel's, these cells lie in the
+//face instead of taking a slice out of the coarse chunk, so the chunk meshes need no changes.
+//
+//Every vertex (chunk or transition cell) is placed from the volume's own samples with the same expression, so a
+//crossing shared between chunks comes out bit for bit the same in each of them and the pieces weld exactly.
+
+class VolumeLod
+{
+public:
+	static const int MAX_LEVELS = 8;
+
+	struct Settings
+	{
+		float isoLevel;							//like MarchingCubes, below it is outside
+		DirectX::SimpleMath::Vector3 origin;	//where sample (0, 0, 0) sits
+		float spacing;							//distance between samples
+		int chunkCells;							//cells along a chunk side, even
+		int levels;								//0 (full resolution) to levels - 1
+		float lodDistance;						//split while the eye is closer than this many chunk widths
+
+		Settings() : isoLevel(0.0f), origin(0.0f, 0.0f, 0.0f), spacing(1.0f), chunkCells(16), levels(4), lodDistance(2.0f) {}
+	};
+
+	struct Chunk
+	{
+		int level;
+		int x, y, z;							//in chunks of its level
+		uint8_t finerFaces;						//bit per face (-x, +x, -y, +y, -z, +z) with a finer chunk across it
+		const MeshData* mesh;					//its marching cubes surface
+		const MeshData* transition;				//the transition cells on its finer faces
+	};
+
+	struct Stats
+	{
+		size_t chunks;
+		size_t levelChunks[MAX_LEVELS];
+		size_t meshedChunks;					//new this update, the rest came from the cache
+		size_t cells;							//cells behind the current chunks
+		size_t fullCells;						//cells the same volume has at level 0
+		size_t triangles, transitionTriangles;
+	};
+
+	VolumeLod();
+	~VolumeLod();
+
+	//density is sizeX * sizeY * sizeZ samples (x fastest) and has to stay alive. each size must be one more than
+	//a multiple of chunkCells * 2^(levels - 1).
+	bool Initialize(const float* density, int sizeX, int sizeY, int sizeZ, const Settings& settings);
+	void Clear();
+
+	//picks the chunks for an eye position and meshes the ones that are new
+	void Update(const DirectX::SimpleMath::Vector3& eye, int threadCount = 0, Stats* stats = nullptr);
+
+	const std::vector<Chunk>& GetChunks() const { return m_chunks; }
+	//every chunk and transition cell in one mesh
+	void Merge(MeshData& mesh) const;
+
+	//edges not shared by exactly two triangles running opposite ways, after welding equal positions
+	static size_t CountOpenEdges(const MeshData& mesh);
+	//random closed blobs with noise, random eyes. returns the open edges over all trials, 0 when watertight.
+	static size_t TestWatertight(int trials, int threadCount = 0);
+	//a size^3 terrain like volume seen from above one corner, meshed from scratch. returns the average seconds.
+	static double Benchmark(int size, int levels, int iterations, int threadCount = 0, Stats* stats = nullptr);
+
+private:
+	struct Cached
+	{
+		MeshData mesh;
+		MeshData transition;
+		uint8_t finerFaces;
+		bool used;
+	};
+
+	static uint64_t Key(int level, int x, int y, int z);
+	bool ShouldSplit(int level, int x, int y, int z, const DirectX::SimpleMath::Vector3& eye) const;
+	void Refine(int level, int x, int y, int z, const DirectX::SimpleMath::Vector3& eye);
+	bool NeedsSplit(int level, int x, int y, int z) const;
+	bool IsSplit(int level, int x, int y, int z) const;
+	void GatherLeaves(int level, int x, int y, int z, std::vector<Chunk>& leaves) const;
+
+	void MeshChunk(const Chunk& chunk, std::vector<float>& samples, MeshData& mesh) const;
+	void MeshTransition(const Chunk& chunk, MeshData& mesh) const;
+	void PlaceEdge(const int sample[3], int axis, int step, DirectX::SimpleMath::Vector3& position, DirectX::SimpleMath::Vector3& normal) const;
+	DirectX::SimpleMath::Vector3 Gradient(const int sample[3], int step) const;
+	float Sample(int x, int y, int z) const { return m_density[((size_t)z * m_sizeY + y) * m_sizeX + x]; }
+
+private:
+	const float* m_density;
+	int m_sizeX, m_sizeY, m_sizeZ;
+	int m_rootsX, m_rootsY, m_rootsZ;
+	Settings m_settings;
+	std::unordered_set<uint64_t> m_split;					//octree nodes that aren't leaves
+	std::unordered_map<uint64_t, Cached> m_cache;
+	std::vector<Chunk> m_chunks;
+};
@@ -0,0 +1,45 @@
+// Instanced pixel shader
+// Same lighting as light_ps, with see through texels cut out so foliage cards show their leaves only
+
+Texture2D shaderTexture : register(t0);
+SamplerState SampleType : register(s0);
+
+
+cbuffer LightBuffer : register(b0)
+{
+	float4 ambientColor;
+    float4 diffuseColor;
+    float3 lightPosition;
+    float fogDensity;
+};
+
+struct InputType
+{
+    float4 position : SV_POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+	float3 position3D : TEXCOORD2;
+};
+
+float4 main(InputType input) : SV_TARGET
+{
+	float4	textureColor;
+    float3	lightDir;
+    float	lightIntensity;
+    float4	color;
+
+	// Sample the pixel color from the texture using the sampler at this texture coordinate location.
+	textureColor = shaderTexture.Sample(SampleType, input.tex);
+	clip(textureColor.a - 0.5f);
+
+	// Invert the light direction for calculations.
+	lightDir = normalize(input.position3D - lightPosition);
+
+	// Calculate the amount of light on this pixel.
+	lightIntensity = saturate(dot(input.normal, -lightDir));
+
+	color = ambientColor + (diffuseColor * lightIntensity); //adding ambient
+	color = saturate(color);
+
+    return color * textureColor;
+}
@@ -0,0 +1,55 @@
+// Instanced vertex shader
+// Same as light_vs, but each instance is first scaled, turned about y and moved to its own spot (see ObjectScatter.h)
+
+cbuffer MatrixBuffer : register(b0)
+{
+    matrix worldMatrix;
+    matrix viewMatrix;
+    matrix projectionMatrix;
+};
+
+struct InputType
+{
+    float4 position : POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+    float3 instancePosition : INSTANCEPOSITION;
+    float2 instanceParams : INSTANCEPARAMS;    // rotation, scale
+};
+
+struct OutputType
+{
+    float4 position : SV_POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+	float3 position3D : TEXCOORD2;
+};
+
+OutputType main(InputType input)
+{
+    OutputType output;
+    float s, c;
+
+    // the instances are in the terrain's grid space, so after this the terrain's world matrix places them
+    sincos(input.instanceParams.x, s, c);
+    float3 local = input.position.xyz * input.instanceParams.y;
+    float4 position = float4(c * local.x + s * local.z, local.y, c * local.z - s * local.x, 1.0f);
+    position.xyz += input.instancePosition;
+    float3 normal = float3(c * input.normal.x + s * input.normal.z, input.normal.y, c * input.normal.z - s * input.normal.x);
+
+    // Calculate the position of the vertex against the world, view, and projection matrices.
+    output.position = mul(position, worldMatrix);
+    output.position = mul(output.position, viewMatrix);
+    output.position = mul(output.position, projectionMatrix);
+
+    // Store the texture coordinates for the pixel shader.
+    output.tex = input.tex;
+
+	 // Calculate the normal vector against the world matrix only.
+    output.normal = normalize(mul(normal, (float3x3)worldMatrix));
+
+	// world position of vertex (for point light)
+	output.position3D = (float3)mul(position, worldMatrix);
+
+    return output;
+}
@@ -56,6 +56,38 @@ bool ModelClass::InitializeSphere(ID3D11Device *device)
 	return true;
 }
 
+//builds the buffers from a CPU side mesh, used for the simplified LOD models
+bool ModelClass::InitializeMesh(ID3D11Device* device, const MeshData& mesh)
+{
+	//the pre-fab indices are 16 bit
+	if (mesh.positions.empty() || mesh.positions.size() > 65536)
+	{
+		return false;
+	}
+
+	bool normals = mesh.HasNormals();
+	bool uvs = mesh.HasUVs();
+	preFabVertices.resize(mesh.positions.size());
+	for (size_t i = 0; i < mesh.positions.size(); i++)
+	{
+		preFabVertices[i].position = DirectX::XMFLOAT3(mesh.positions[i].x, mesh.positions[i].y, mesh.positions[i].z);
+		preFabVertices[i].normal = normals ? DirectX::XMFLOAT3(mesh.normals[i].x, mesh.normals[i].y, mesh.normals[i].z) : DirectX::XMFLOAT3(0.0f, 1.0f, 0.0f);
+		preFabVertices[i].textureCoordinate = uvs ? DirectX::XMFLOAT2(mesh.uvs[i].x, mesh.uvs[i].y) : DirectX::XMFLOAT2(0.0f, 0.0f);
+	}
+	preFabIndices.assign(mesh.indices.begin(), mesh.indices.end());
+	m_vertexCount = preFabVertices.size();
+	m_indexCount = preFabIndices.size();
+
+	bool result;
+	// Initialize the vertex and index buffers.
+	result = InitializeBuffers(device);
+	if (!result)
+	{
+		return false;
+	}
+	return true;
+}
+
 bool ModelClass::InitializeBox(ID3D11Device * device, float xwidth, float yheight, float zdepth)
 {
 	GeometricPrimitive::CreateBox(preFabVertices, preFabIndices,
@@ -97,12 +129,48 @@ void ModelClass::Render(ID3D11DeviceContext* deviceContext)
 }
 
 
+void ModelClass::RenderInstanced(ID3D11DeviceContext* deviceContext, ID3D11Buffer* instances, unsigned int stride, unsigned int count, unsigned int firstInstance)
+{
+	unsigned int strides[2] = { sizeof(VertexType), stride };
+	unsigned int offsets[2] = { 0, 0 };
+	ID3D11Buffer* buffers[2] = { m_vertexBuffer, instances };
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	deviceContext->IASetVertexBuffers(0, 2, buffers, strides, offsets);
+	deviceContext->IASetIndexBuffer(m_indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	deviceContext->DrawIndexedInstanced(m_indexCount, count, 0, 0, firstInstance);
+}
+
+
 int ModelClass::GetIndexCount()
 {
 	return m_indexCount;
 }
 
 
+void ModelClass::GetMesh(MeshData& mesh)
+{
+	mesh.Clear();
+	mesh.positions.resize(preFabVertices.size());
+	mesh.normals.resize(preFabVertices.size());
+	mesh.uvs.resize(preFabVertices.size());
+
+	for (size_t i = 0; i < preFabVertices.size(); i++)
+	{
+		mesh.positions[i] = DirectX::SimpleMath::Vector3(preFabVertices[i].position.x, preFabVertices[i].position.y, preFabVertices[i].position.z);
+		mesh.normals[i] = DirectX::SimpleMath::Vector3(preFabVertices[i].normal.x, preFabVertices[i].normal.y, preFabVertices[i].normal.z);
+		mesh.uvs[i] = DirectX::SimpleMath::Vector2(preFabVertices[i].textureCoordinate.x, preFabVertices[i].textureCoordinate.y);
+	}
+
+	mesh.indices.assign(preFabIndices.begin(), preFabIndices.end());
+}
+
+
 bool ModelClass::InitializeBuffers(ID3D11Device* device)
 {
 	VertexType* vertices;
@@ -9,6 +9,7 @@
 // INCLUDES //
 //////////////
 #include "pch.h"
+#include "MeshData.h"
 //#include <d3dx10math.h>
 //#include <fstream>
 //using namespace std;
@@ -37,11 +38,15 @@ public:
 	bool InitializeTeapot(ID3D11Device*);
 	bool InitializeSphere(ID3D11Device*);
 	bool InitializeBox(ID3D11Device*, float xwidth, float yheight, float zdepth);
+	bool InitializeMesh(ID3D11Device*, const MeshData& mesh);
 	void Shutdown();
 	void Render(ID3D11DeviceContext*);
+	//draws count copies, the per instance data comes from slot 1 starting at firstInstance
+	void RenderInstanced(ID3D11DeviceContext*, ID3D11Buffer* instances, unsigned int stride, unsigned int count, unsigned int firstInstance = 0);
 	bool InitializeBuffersForBlur(ID3D11Device*, int windowWidth, int windowHeight);
 	
 	int GetIndexCount();
+	void GetMesh(MeshData& mesh);
 
 
 private:
@@ -0,0 +1,71 @@
+// Compact terrain vertex shader
+// Same output as light_vs, but reads the 8 byte quantised grid vertex (see CompactVertex.h)
+// and rebuilds x / z / uv from the vertex index
+
+cbuffer MatrixBuffer : register(b0)
+{
+    matrix worldMatrix;
+    matrix viewMatrix;
+    matrix projectionMatrix;
+};
+
+// b1 is the screen size buffer
+cbuffer CompactTerrainBuffer : register(b2)
+{
+    float heightScale;
+    float heightOffset;
+    uint gridWidth;
+    float uvStep;
+};
+
+struct InputType
+{
+    float height : HEIGHT;
+    float2 octNormal : NORMAL;
+    uint vertexId : SV_VertexID;
+};
+
+struct OutputType
+{
+    float4 position : SV_POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+	float3 position3D : TEXCOORD2;
+};
+
+float3 DecodeOctahedral(float2 e)
+{
+    float3 n = float3(e.x, e.y, 1.0f - abs(e.x) - abs(e.y));
+    if (n.z < 0.0f)
+    {
+        // lower half was folded over the diagonals
+        n.xy = (1.0f - abs(n.yx)) * (n.xy >= 0.0f ? 1.0f : -1.0f);
+    }
+    return normalize(n);
+}
+
+OutputType main(InputType input)
+{
+    OutputType output;
+
+    // the index buffer points straight at the grid so the index is the grid position
+    float x = (float)(input.vertexId % gridWidth);
+    float z = (float)(input.vertexId / gridWidth);
+    float4 position = float4(x, heightOffset + input.height * heightScale, z, 1.0f);
+
+    // Calculate the position of the vertex against the world, view, and projection matrices.
+    output.position = mul(position, worldMatrix);
+    output.position = mul(output.position, viewMatrix);
+    output.position = mul(output.position, projectionMatrix);
+
+    output.tex = float2(x, z) * uvStep;
+
+	 // Calculate the normal vector against the world matrix only.
+    output.normal = mul(DecodeOctahedral(input.octNormal), (float3x3)worldMatrix);
+    output.normal = normalize(output.normal);
+
+	// world position of vertex (for point light)
+	output.position3D = (float3)mul(position, worldMatrix);
+
+    return output;
+}
@@ -0,0 +1,59 @@
+// Lit terrain pixel shader
+// Same lighting as light_ps, but from a directional sun, with the ambient scaled by the baked occlusion and the
+// diffuse by the baked sun shadowing (see HorizonMap.h)
+
+Texture2D shaderTexture : register(t0);
+Texture2D lightingTexture : register(t5);
+SamplerState SampleType : register(s0);
+
+
+cbuffer LightBuffer : register(b0)
+{
+	float4 ambientColor;
+    float4 diffuseColor;
+    float3 lightPosition;
+    float fogDensity;
+};
+
+// the sun is directional, the same direction the lighting texture was baked for (see Shader::SetTerrainLighting)
+cbuffer SunBuffer : register(b1)
+{
+    float3 towardsSun;
+    float sunPadding;
+};
+
+struct InputType
+{
+    float4 position : SV_POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+	float3 position3D : TEXCOORD2;
+};
+
+float4 main(InputType input) : SV_TARGET
+{
+	float4	textureColor;
+    float3	lightDir;
+    float	lightIntensity;
+    float4	color;
+
+	// The light travels away from the sun, in the same direction everywhere.
+	lightDir = -normalize(towardsSun);
+
+	// Calculate the amount of light on this pixel.
+	lightIntensity = saturate(dot(input.normal, -lightDir));
+
+	// one texel per vertex like the splat map, r is the sky left open and g how much of the sun gets through
+	float width, height;
+	lightingTexture.GetDimensions(width, height);
+	float2 lightingUV = (input.tex * 0.2f * float2(width, height) + 0.5f) / float2(width, height);
+	float2 lighting = lightingTexture.Sample(SampleType, lightingUV).rg;
+
+	color = ambientColor * lighting.r + (diffuseColor * lightIntensity * lighting.g);
+	color = saturate(color);
+
+	// Sample the pixel color from the texture using the sampler at this texture coordinate location.
+	textureColor = shaderTexture.Sample(SampleType, input.tex);
+
+    return color * textureColor;
+}
@@ -0,0 +1,66 @@
+// Splat terrain pixel shader
+// Same lighting as terrain_lit_ps, but blends four material textures by the weights in the splat map (see SplatMap.h)
+
+Texture2D materialTexture0 : register(t0);
+Texture2D materialTexture1 : register(t1);
+Texture2D materialTexture2 : register(t2);
+Texture2D materialTexture3 : register(t3);
+Texture2D splatTexture : register(t4);
+Texture2D lightingTexture : register(t5);
+SamplerState SampleType : register(s0);
+
+
+cbuffer LightBuffer : register(b0)
+{
+	float4 ambientColor;
+    float4 diffuseColor;
+    float3 lightPosition;
+    float fogDensity;
+};
+
+// the sun is directional, the same direction the lighting texture was baked for (see Shader::SetTerrainLighting)
+cbuffer SunBuffer : register(b1)
+{
+    float3 towardsSun;
+    float sunPadding;
+};
+
+struct InputType
+{
+    float4 position : SV_POSITION;
+    float2 tex : TEXCOORD0;
+    float3 normal : NORMAL;
+	float3 position3D : TEXCOORD2;
+};
+
+float4 main(InputType input) : SV_TARGET
+{
+	float3	lightDir;
+    float	lightIntensity;
+    float4	color;
+
+	// The light travels away from the sun, in the same direction everywhere.
+	lightDir = -normalize(towardsSun);
+
+	// Calculate the amount of light on this pixel.
+	lightIntensity = saturate(dot(input.normal, -lightDir));
+
+	// the terrain uv of vertex i is i * 5 / width and the splat map has one texel per vertex,
+	// so tex * 0.2 * width is i and the half texel puts it on that texel's centre
+	float width, height;
+	splatTexture.GetDimensions(width, height);
+	float2 splatUV = (input.tex * 0.2f * float2(width, height) + 0.5f) / float2(width, height);
+	float4 weights = splatTexture.Sample(SampleType, splatUV);
+
+	// the baked lighting has the same layout, occlusion in r and sun in g
+	float2 lighting = lightingTexture.Sample(SampleType, splatUV).rg;
+	color = ambientColor * lighting.r + (diffuseColor * lightIntensity * lighting.g);
+	color = saturate(color);
+
+	float4 textureColor = materialTexture0.Sample(SampleType, input.tex) * weights.r;
+	textureColor += materialTexture1.Sample(SampleType, input.tex) * weights.g;
+	textureColor += materialTexture2.Sample(SampleType, input.tex) * weights.b;
+	textureColor += materialTexture3.Sample(SampleType, input.tex) * weights.a;
+
+    return color * textureColor;
+}